@@ -122,7 +122,9 @@
  * The life-time of invalid DNS response in the resolver response cache.
  * An invalid DNS response is a response which RCODE is non-zero and 
  * response without any answer section. These responses can be put in 
- * the cache too to minimize message round-trip.
+ * the cache too to minimize message round-trip. If the response carries
+ * the SOA record of the zone, the negative caching TTL of the zone
+ * (RFC 2308) is used instead when it is shorter.
  *
  * Default: 60 (one minute).
  *
@@ -132,6 +134,33 @@
 #   define PJ_DNS_RESOLVER_INVALID_TTL		    60
 #endif
 
+/**
+ * Maximum number of responses kept in the resolver response cache. When
+ * the cache is full, the least recently used response is removed to make
+ * room for the new one. If the value is zero, the number of cached
+ * responses is not limited.
+ *
+ * Default: 1024
+ */
+#ifndef PJ_DNS_RESOLVER_MAX_CACHED_CNT
+#   define PJ_DNS_RESOLVER_MAX_CACHED_CNT	    1024
+#endif
+
+/**
+ * Refresh cached responses ahead of their expiration. When a cached
+ * response is used and its remaining life-time is less than this
+ * percentage of its TTL, the response is returned from the cache as usual,
+ * and at the same time the resolver sends a new query in the background
+ * to refresh the cache, so the next request to the same resource doesn't
+ * have to wait for the nameserver. If the value is zero, cached responses
+ * are only refreshed after they have expired.
+ *
+ * Default: 10 (percent)
+ */
+#ifndef PJ_DNS_RESOLVER_PREFETCH_PCT
+#   define PJ_DNS_RESOLVER_PREFETCH_PCT		    10
+#endif
+
 /**
  * The interval on which nameservers which are known to be good to be 
  * probed again to determine whether they are still good. Note that
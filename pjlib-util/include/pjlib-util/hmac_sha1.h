@@ -44,8 +44,9 @@ PJ_BEGIN_DECL
  */
 typedef struct pj_hmac_sha1_context
 {
-    pj_sha1_context context;	/**< SHA1 context	    */
-    pj_uint8_t	    k_opad[64];	/**< opad xor-ed with key   */
+    pj_sha1_context context;	/**< SHA1 context		    */
+    pj_sha1_context outer;	/**< SHA1 context of opad xor-ed
+				     with key			    */
 } pj_hmac_sha1_context;
 
 
@@ -65,7 +66,10 @@ PJ_DECL(void) pj_hmac_sha1(const pj_uint8_t *input, unsigned input_len,
 
 
 /**
- * Initiate HMAC-SHA1 context for incremental hashing.
+ * Initiate HMAC-SHA1 context for incremental hashing. The key pads are
+ * hashed here, so a context which has just been initialized may be
+ * copied and kept, and the copy used to start calculating HMAC of
+ * another message with the same key without hashing the pads again.
  *
  * @param hctx		HMAC-SHA1 context.
  * @param key		Pointer to the authentication key.
@@ -196,6 +196,9 @@ typedef struct pj_dns_settings
 				     value is zero, caching is disabled.    */
     unsigned	good_ns_ttl;	/**< See #PJ_DNS_RESOLVER_GOOD_NS_TTL	    */
     unsigned	bad_ns_ttl;	/**< See #PJ_DNS_RESOLVER_BAD_NS_TTL	    */
+    unsigned	cache_max_cnt;	/**< Maximum number of cached responses,
+				     see #PJ_DNS_RESOLVER_MAX_CACHED_CNT    */
+    unsigned	prefetch_pct;	/**< See #PJ_DNS_RESOLVER_PREFETCH_PCT	    */
 } pj_dns_settings;
 
 
@@ -68,6 +68,13 @@ PJ_BEGIN_DECL
  * These targets are returned in the #pj_dns_srv_record structure 
  * argument of the callback. 
  *
+ * The DNS A queries for all targets are sent in parallel. By default the
+ * callback is called once all of them have completed. With the
+ * #PJ_DNS_SRV_RESOLVE_EARLY option, the callback is called as soon as the
+ * first target (in the order above) that has an address is known, which
+ * avoids waiting for slow or unreachable name servers of less preferred
+ * targets.
+ *
  * \section PJ_DNS_SRV_RESOLVER_REFERENCE Reference
  *
  * Reference:
@@ -104,7 +111,18 @@ typedef enum pj_dns_srv_option
      * this option is not specified, the SRV resolver will query
      * the DNS A record for the target instead.
      */
-    PJ_DNS_SRV_RESOLVE_AAAA	= 4
+    PJ_DNS_SRV_RESOLVE_AAAA	= 4,
+
+    /**
+     * Specify if the resolver should report the result as soon as the
+     * most preferred usable target has been resolved, instead of waiting
+     * for the DNS A queries of all targets to complete. The record given
+     * to the callback contains the targets resolved so far, in the order
+     * of preference. Queries for the remaining targets are left to
+     * complete in the background, so their answers are available in the
+     * resolver cache when the application needs to fail-over.
+     */
+    PJ_DNS_SRV_RESOLVE_EARLY	= 8
 
 } pj_dns_srv_option;
 
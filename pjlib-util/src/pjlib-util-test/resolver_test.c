@@ -1370,6 +1370,234 @@ static int srv_resolver_many_test(void)
 ////////////////////////////////////////////////////////////////////////////
 
 
+////////////////////////////////////////////////////////////////////////////
+/* Early result: the less preferred target is slow to resolve */
+#define DOMAIN5	    "d5"
+#define PORT5	    50065
+#define IP_ADDR5    0x05050505
+#define SLOW_DELAY5 1000
+
+static pj_timestamp t_early5;
+static unsigned count_early5;
+
+static void action5_1(const pj_dns_parsed_packet *pkt,
+		      pj_dns_parsed_packet **p_res)
+{
+    pj_dns_parsed_packet *res;
+    unsigned i;
+
+    res = PJ_POOL_ZALLOC_T(pool, pj_dns_parsed_packet);
+    res->q = PJ_POOL_ZALLOC_T(pool, pj_dns_parsed_query);
+
+    res->hdr.qdcount = 1;
+    res->q[0].type = pkt->q[0].type;
+    res->q[0].dnsclass = pkt->q[0].dnsclass;
+    res->q[0].name = pkt->q[0].name;
+
+    if (pkt->q[0].type == PJ_DNS_TYPE_SRV) {
+
+	res->hdr.anscount = 2;
+	res->ans = (pj_dns_parsed_rr*) 
+		   pj_pool_calloc(pool, 2, sizeof(pj_dns_parsed_rr));
+
+	for (i=0; i<2; ++i) {
+	    res->ans[i].type = PJ_DNS_TYPE_SRV;
+	    res->ans[i].dnsclass = 1;
+	    res->ans[i].name = res->q[0].name;
+	    res->ans[i].ttl = 1;
+	    res->ans[i].rdata.srv.prio = (pj_uint16_t)i;
+	    res->ans[i].rdata.srv.weight = 1;
+	    res->ans[i].rdata.srv.port = (pj_uint16_t)(PORT5+i);
+	    res->ans[i].rdata.srv.target = pj_str(i==0 ? "fast." DOMAIN5 :
+							 "slow." DOMAIN5);
+	}
+
+    } else if (pkt->q[0].type == PJ_DNS_TYPE_A) {
+
+	if (pj_strcmp2(&pkt->q[0].name, "slow." DOMAIN5)==0)
+	    pj_thread_sleep(SLOW_DELAY5);
+
+	res->hdr.anscount = 1;
+	res->ans = PJ_POOL_ZALLOC_T(pool, pj_dns_parsed_rr);
+	res->ans[0].type = PJ_DNS_TYPE_A;
+	res->ans[0].dnsclass = 1;
+	res->ans[0].ttl = 1;
+	res->ans[0].name = res->q[0].name;
+	res->ans[0].rdata.a.ip_addr.s_addr = IP_ADDR5;
+    }
+
+    *p_res = res;
+}
+
+static void srv_cb_5(void *user_data,
+		     pj_status_t status,
+		     const pj_dns_srv_record *rec)
+{
+    PJ_UNUSED_ARG(user_data);
+
+    pj_get_timestamp(&t_early5);
+    count_early5 = 0;
+    if (status == PJ_SUCCESS && rec->entry[0].port == PORT5 &&
+	rec->entry[0].server.addr[0].s_addr == IP_ADDR5)
+    {
+	count_early5 = rec->count;
+    }
+
+    pj_sem_post(sem);
+}
+
+static int srv_resolver_early_test(void)
+{
+    pj_status_t status;
+    pj_str_t domain = pj_str(DOMAIN5);
+    pj_str_t res_name = pj_str("_sip._udp.");
+    pj_timestamp t_start;
+    unsigned msec;
+
+    PJ_LOG(3,(THIS_FILE, "  srv_resolve(): early result test"));
+
+    g_server[0].action = ACTION_CB;
+    g_server[0].action_cb = &action5_1;
+    g_server[1].action = ACTION_CB;
+    g_server[1].action_cb = &action5_1;
+
+    pj_get_timestamp(&t_start);
+    status = pj_dns_srv_resolve(&domain, &res_name, 1, pool, resolver,
+				PJ_DNS_SRV_FALLBACK_A | PJ_DNS_SRV_RESOLVE_EARLY,
+				NULL, &srv_cb_5, NULL);
+    if (status != PJ_SUCCESS)
+	return -1100;
+
+    pj_sem_wait(sem);
+
+    /* Let the slow query finish before the next test */
+    pj_thread_sleep(SLOW_DELAY5 + 200);
+
+    msec = pj_elapsed_msec(&t_start, &t_early5);
+    if (count_early5 != 1) {
+	PJ_LOG(3,(THIS_FILE, "   error: expecting 1 entry, got %u",
+		  count_early5));
+	return -1110;
+    }
+    if (msec >= SLOW_DELAY5) {
+	PJ_LOG(3,(THIS_FILE, "   error: early result took %u ms", msec));
+	return -1120;
+    }
+
+    return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+/* Response cache test */
+#define IP_ADDR4    0x05060708
+
+static pj_bool_t cache_cb_called;
+
+static void cache_callback(void *user_data,
+			   pj_status_t status,
+			   pj_dns_parsed_packet *resp)
+{
+    PJ_UNUSED_ARG(user_data);
+    PJ_UNUSED_ARG(status);
+    PJ_UNUSED_ARG(resp);
+
+    cache_cb_called = PJ_TRUE;
+}
+
+static pj_status_t add_cache_entry(const char *name, unsigned ttl)
+{
+    pj_dns_parsed_packet pkt;
+    pj_dns_parsed_rr ans;
+
+    pj_bzero(&pkt, sizeof(pkt));
+    pj_bzero(&ans, sizeof(ans));
+
+    pkt.hdr.flags = PJ_DNS_SET_QR(1);
+    pkt.hdr.anscount = 1;
+    pkt.ans = &ans;
+    ans.name = pj_str((char*)name);
+    ans.type = PJ_DNS_TYPE_A;
+    ans.dnsclass = 1;
+    ans.ttl = ttl;
+    ans.rdata.a.ip_addr.s_addr = IP_ADDR4;
+
+    return pj_dns_resolver_add_entry(resolver, &pkt, PJ_TRUE);
+}
+
+/* Check if the query is answered from the cache, i.e: synchronously */
+static pj_bool_t is_cached(const char *name)
+{
+    pj_str_t qname = pj_str((char*)name);
+    pj_dns_async_query *q = NULL;
+
+    cache_cb_called = PJ_FALSE;
+    pj_dns_resolver_start_query(resolver, &qname, PJ_DNS_TYPE_A, 0,
+				&cache_callback, NULL, &q);
+    if (q)
+	pj_dns_resolver_cancel_query(q, PJ_FALSE);
+
+    return cache_cb_called;
+}
+
+static int cache_test(void)
+{
+    PJ_LOG(3,(THIS_FILE, "  response cache prefetch test"));
+
+    g_server[0].action = ACTION_IGNORE;
+    g_server[1].action = ACTION_IGNORE;
+
+    pj_dns_resolver_get_settings(resolver, &set);
+    set.prefetch_pct = 100;
+    pj_dns_resolver_set_settings(resolver, &set);
+
+    if (add_cache_entry("prefetch", 60) != PJ_SUCCESS)
+	return -1200;
+
+    g_server[0].pkt_count = 0;
+    g_server[1].pkt_count = 0;
+
+    /* Answered from cache, and refreshed in the background */
+    if (!is_cached("prefetch"))
+	return -1210;
+
+    pj_thread_sleep(500);
+    if (g_server[0].pkt_count + g_server[1].pkt_count == 0)
+	return -1220;
+
+    PJ_LOG(3,(THIS_FILE, "  response cache LRU test"));
+
+    set.prefetch_pct = 0;
+    set.cache_max_cnt = 2;
+    pj_dns_resolver_set_settings(resolver, &set);
+
+    add_cache_entry("lru1", 60);
+    add_cache_entry("lru2", 60);
+
+    /* Make lru2 the least recently used entry */
+    if (!is_cached("lru1"))
+	return -1230;
+
+    add_cache_entry("lru3", 60);
+
+    if (pj_dns_resolver_get_cached_count(resolver) != 2)
+	return -1240;
+    if (!is_cached("lru1") || !is_cached("lru3"))
+	return -1250;
+    if (is_cached("lru2"))
+	return -1260;
+
+    pj_dns_resolver_dump(resolver, PJ_TRUE);
+
+    pj_dns_settings_default(&set);
+    set.good_ns_ttl = 20;
+    set.bad_ns_ttl = 20;
+    pj_dns_resolver_set_settings(resolver, &set);
+
+    return 0;
+}
+
+
 int resolver_test(void)
 {
     int rc;
@@ -1394,6 +1622,14 @@ int resolver_test(void)
     srv_resolver_fallback_test();
     srv_resolver_many_test();
 
+    rc = srv_resolver_early_test();
+    if (rc != 0)
+	goto on_error;
+
+    rc = cache_test();
+    if (rc != 0)
+	goto on_error;
+
     destroy();
     return 0;
 
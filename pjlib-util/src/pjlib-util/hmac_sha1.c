@@ -25,6 +25,7 @@ PJ_DEF(void) pj_hmac_sha1_init(pj_hmac_sha1_context *hctx,
 			       const pj_uint8_t *key, unsigned key_len)
 {
     pj_uint8_t k_ipad[64];
+    pj_uint8_t k_opad[64];
     pj_uint8_t tk[20];
     unsigned i;
 
@@ -46,20 +47,26 @@ PJ_DEF(void) pj_hmac_sha1_init(pj_hmac_sha1_context *hctx,
 
     /* start out by storing key in pads */
     pj_bzero( k_ipad, sizeof(k_ipad));
-    pj_bzero( hctx->k_opad, sizeof(hctx->k_opad));
+    pj_bzero( k_opad, sizeof(k_opad));
     pj_memcpy( k_ipad, key, key_len);
-    pj_memcpy( hctx->k_opad, key, key_len);
+    pj_memcpy( k_opad, key, key_len);
 
     /* XOR key with ipad and opad values */
     for (i=0; i<64; i++) {
         k_ipad[i] ^= 0x36;
-        hctx->k_opad[i] ^= 0x5c;
+        k_opad[i] ^= 0x5c;
     }
     /*
      * perform inner SHA1
      */
     pj_sha1_init(&hctx->context);
     pj_sha1_update(&hctx->context, k_ipad, 64);
+
+    /*
+     * start outer SHA1 now too, it only needs the digest to complete
+     */
+    pj_sha1_init(&hctx->outer);
+    pj_sha1_update(&hctx->outer, k_opad, 64);
 }
 
 PJ_DEF(void) pj_hmac_sha1_update(pj_hmac_sha1_context *hctx,
@@ -76,10 +83,8 @@ PJ_DEF(void) pj_hmac_sha1_final(pj_hmac_sha1_context *hctx,
     /*
      * perform outer SHA1
      */
-    pj_sha1_init(&hctx->context);
-    pj_sha1_update(&hctx->context, hctx->k_opad, 64);
-    pj_sha1_update(&hctx->context, digest, 20);
-    pj_sha1_final(&hctx->context, digest);
+    pj_sha1_update(&hctx->outer, digest, 20);
+    pj_sha1_final(&hctx->outer, digest);
 }
 
 PJ_DEF(void) pj_hmac_sha1(const pj_uint8_t *input, unsigned input_len, 
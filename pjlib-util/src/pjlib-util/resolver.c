@@ -156,11 +156,31 @@ struct cached_res
     struct res_key	     key;	    /**< Resource key.		    */
     pj_hash_entry_buf	     hbuf;	    /**< Hash buffer		    */
     pj_time_val		     expiry_time;   /**< Expiration time.	    */
+    unsigned		     ttl;	    /**< TTL applied, zero if the
+						 entry doesn't expire.	    */
     pj_dns_parsed_packet    *pkt;	    /**< The response packet.	    */
     unsigned		     ref_cnt;	    /**< Reference counter.	    */
 };
 
 
+/* Cached response list head, ordered from the least recently used. */
+struct cache_head
+{
+    PJ_DECL_LIST_MEMBER(struct cached_res);
+};
+
+
+/* Response cache statistics */
+struct cache_stat
+{
+    unsigned		     hit;	    /**< Responses found in cache.  */
+    unsigned		     neg_hit;	    /**< ..of which are negative.   */
+    unsigned		     miss;	    /**< Resources not in cache.    */
+    unsigned		     prefetch;	    /**< Refresh before expiration. */
+    unsigned		     evict;	    /**< Removed as cache is full.  */
+};
+
+
 /* Resolver entry */
 struct pj_dns_resolver
 {
@@ -198,6 +218,8 @@ struct pj_dns_resolver
 
     /* Hash table for cached response */
     pj_hash_table_t	*hrescache;	/**< Cached response in hash table  */
+    struct cache_head	 cache_lru;	/**< Cached response in LRU order   */
+    struct cache_stat	 cache_stat;	/**< Cache statistics.		    */
 
     /* Pending asynchronous query, hashed by transaction ID. */
     pj_hash_table_t	*hquerybyid;
@@ -291,6 +313,8 @@ PJ_DEF(void) pj_dns_settings_default(pj_dns_settings *s)
     s->cache_max_ttl = PJ_DNS_RESOLVER_MAX_TTL;
     s->good_ns_ttl = PJ_DNS_RESOLVER_GOOD_NS_TTL;
     s->bad_ns_ttl = PJ_DNS_RESOLVER_BAD_NS_TTL;
+    s->cache_max_cnt = PJ_DNS_RESOLVER_MAX_CACHED_CNT;
+    s->prefetch_pct = PJ_DNS_RESOLVER_PREFETCH_PCT;
 }
 
 
@@ -354,6 +378,7 @@ PJ_DEF(pj_status_t) pj_dns_resolver_create( pj_pool_factory *pf,
 
     /* Response cache hash table */
     resv->hrescache = pj_hash_create(pool, RES_HASH_TABLE_SIZE);
+    pj_list_init(&resv->cache_lru);
 
     /* Query hash table and free list. */
     resv->hquerybyid = pj_hash_create(pool, Q_HASH_TABLE_SIZE);
@@ -731,6 +756,120 @@ static void free_entry(pj_dns_resolver *resolver, struct cached_res *cache)
     pj_pool_release(cache->pool);
 }
 
+/* Remove cached entry from the hash table and LRU list. The entry is
+ * not freed.
+ */
+static void unlink_entry(pj_dns_resolver *resolver, struct cached_res *cache)
+{
+    pj_hash_set(NULL, resolver->hrescache, &cache->key, sizeof(cache->key),
+		0, NULL);
+    pj_list_erase(cache);
+}
+
+/* Remove the least recently used entries until the cache has room for
+ * a new entry.
+ */
+static void evict_entries(pj_dns_resolver *resolver)
+{
+    unsigned max_cnt = resolver->settings.cache_max_cnt;
+
+    if (max_cnt == 0)
+	return;
+
+    while (pj_hash_count(resolver->hrescache) >= max_cnt &&
+	   !pj_list_empty(&resolver->cache_lru))
+    {
+	struct cached_res *cache = resolver->cache_lru.next;
+
+	PJ_LOG(5,(resolver->name.ptr, 
+		  "Cache full, removing DNS %s record for %s",
+		  pj_dns_get_type_name(cache->key.qtype), cache->key.name));
+
+	unlink_entry(resolver, cache);
+	++resolver->cache_stat.evict;
+
+	if (--cache->ref_cnt <= 0)
+	    free_entry(resolver, cache);
+    }
+}
+
+
+/* Create and transmit new query for the resource. */
+static pj_status_t start_new_query(pj_dns_resolver *resolver,
+				   const struct res_key *key,
+				   unsigned options,
+				   pj_dns_callback *cb,
+				   void *user_data,
+				   pj_dns_async_query **p_query)
+{
+    pj_dns_async_query *q;
+    pj_status_t status;
+
+    q = alloc_qnode(resolver, options, user_data, cb);
+
+    /* Save the ID and key */
+    /* TODO: dnsext-forgery-resilient: randomize id for security */
+    q->id = resolver->last_id++;
+    if (resolver->last_id == 0)
+	resolver->last_id = 1;
+    pj_memcpy(&q->key, key, sizeof(struct res_key));
+
+    /* Send the query */
+    status = transmit_query(resolver, q);
+    if (status != PJ_SUCCESS) {
+	pj_list_push_back(&resolver->query_free_nodes, q);
+	return status;
+    }
+
+    /* Add query entry to the hash tables */
+    pj_hash_set_np(resolver->hquerybyid, &q->id, sizeof(q->id), 
+		   0, q->hbufid, q);
+    pj_hash_set_np(resolver->hquerybyres, &q->key, sizeof(q->key),
+		   0, q->hbufkey, q);
+
+    if (p_query)
+	*p_query = q;
+
+    return PJ_SUCCESS;
+}
+
+
+/* Refresh cached entry in the background if it is about to expire */
+static void prefetch_entry(pj_dns_resolver *resolver,
+			   struct cached_res *cache,
+			   const pj_time_val *now)
+{
+    pj_time_val left;
+    pj_status_t status;
+
+    if (resolver->settings.prefetch_pct == 0 || cache->ttl == 0)
+	return;
+
+    left = cache->expiry_time;
+    PJ_TIME_VAL_SUB(left, *now);
+    if ((pj_uint64_t)PJ_TIME_VAL_MSEC(left) * 100 >
+	(pj_uint64_t)cache->ttl * 1000 * resolver->settings.prefetch_pct)
+    {
+	return;
+    }
+
+    /* Query may already be in progress */
+    if (pj_hash_get(resolver->hquerybyres, &cache->key, sizeof(cache->key),
+		    NULL))
+    {
+	return;
+    }
+
+    PJ_LOG(5,(resolver->name.ptr, 
+	      "Refreshing DNS %s record for %s, ttl=%d",
+	      pj_dns_get_type_name(cache->key.qtype), cache->key.name,
+	      (int)left.sec));
+
+    status = start_new_query(resolver, &cache->key, 0, NULL, NULL, NULL);
+    if (status == PJ_SUCCESS)
+	++resolver->cache_stat.prefetch;
+}
+
 
 /*
  * Create and start asynchronous DNS query for a single resource.
@@ -784,6 +923,10 @@ PJ_DEF(pj_status_t) pj_dns_resolver_start_query( pj_dns_resolver *resolver,
 	/* Check for expiration */
 	if (PJ_TIME_VAL_GT(cache->expiry_time, now)) {
 
+	    /* Mark as most recently used */
+	    pj_list_erase(cache);
+	    pj_list_push_back(&resolver->cache_lru, cache);
+
 	    /* Log */
 	    PJ_LOG(5,(resolver->name.ptr, 
 		      "Picked up DNS %s record for %.*s from cache, ttl=%d",
@@ -795,6 +938,13 @@ PJ_DEF(pj_status_t) pj_dns_resolver_start_query( pj_dns_resolver *resolver,
 	    status = PJ_DNS_GET_RCODE(cache->pkt->hdr.flags);
 	    status = PJ_STATUS_FROM_DNS_RCODE(status);
 
+	    ++resolver->cache_stat.hit;
+	    if (status != PJ_SUCCESS || cache->pkt->hdr.anscount == 0)
+		++resolver->cache_stat.neg_hit;
+
+	    /* Refresh the entry before it expires */
+	    prefetch_entry(resolver, cache, &now);
+
 	    /* Workaround for deadlock problem. Need to increment the cache's
 	     * ref counter first before releasing mutex, so the cache won't be
 	     * destroyed by other thread while in callback.
@@ -828,7 +978,7 @@ PJ_DEF(pj_status_t) pj_dns_resolver_start_query( pj_dns_resolver *resolver,
 	/* At this point, we have a cached entry, but this entry has expired.
 	 * Remove this entry from the cached list.
 	 */
-	pj_hash_set(NULL, resolver->hrescache, &key, sizeof(key), 0, NULL);
+	unlink_entry(resolver, cache);
 
 	/* Also free the cache, if it is not being used (by callback). */
 	cache->ref_cnt--;
@@ -838,6 +988,8 @@ PJ_DEF(pj_status_t) pj_dns_resolver_start_query( pj_dns_resolver *resolver,
 	/* Must continue with creating a query now */
     }
 
+    ++resolver->cache_stat.miss;
+
     /* Next, check if we have pending query on the same resource */
     q = (pj_dns_async_query *) pj_hash_get(resolver->hquerybyres, &key, 
     					   sizeof(key), NULL);
@@ -859,30 +1011,8 @@ PJ_DEF(pj_status_t) pj_dns_resolver_start_query( pj_dns_resolver *resolver,
     } 
 
     /* There's no pending query to the same key, initiate a new one. */
-    q = alloc_qnode(resolver, options, user_data, cb);
-
-    /* Save the ID and key */
-    /* TODO: dnsext-forgery-resilient: randomize id for security */
-    q->id = resolver->last_id++;
-    if (resolver->last_id == 0)
-	resolver->last_id = 1;
-    pj_memcpy(&q->key, &key, sizeof(struct res_key));
-
-    /* Send the query */
-    status = transmit_query(resolver, q);
-    if (status != PJ_SUCCESS) {
-	pj_list_push_back(&resolver->query_free_nodes, q);
-	goto on_return;
-    }
-
-    /* Add query entry to the hash tables */
-    pj_hash_set_np(resolver->hquerybyid, &q->id, sizeof(q->id), 
-		   0, q->hbufid, q);
-    pj_hash_set_np(resolver->hquerybyres, &q->key, sizeof(q->key),
-		   0, q->hbufkey, q);
-
-    if (p_query)
-	*p_query = q;
+    status = start_new_query(resolver, &key, options, cb, user_data,
+			     p_query);
 
 on_return:
     pj_mutex_unlock(resolver->mutex);
@@ -1183,6 +1313,36 @@ static void report_nameserver_status(pj_dns_resolver *resolver,
 }
 
 
+/* Get the negative caching TTL (RFC 2308 section 5) from the SOA record
+ * in the authority section of the response, or -1 if there's none.
+ */
+static int get_neg_ttl(const pj_dns_parsed_packet *pkt)
+{
+    unsigned i;
+
+    for (i=0; i<pkt->hdr.nscount; ++i) {
+	const pj_dns_parsed_rr *rr = &pkt->ns[i];
+	const pj_uint8_t *p;
+	pj_uint32_t minimum;
+
+	if (rr->type != PJ_DNS_TYPE_SOA || rr->data == NULL ||
+	    rr->rdlength < 22)
+	{
+	    continue;
+	}
+
+	/* MINIMUM field is the last field of SOA RDATA */
+	p = (const pj_uint8_t*)rr->data + rr->rdlength - 4;
+	minimum = ((pj_uint32_t)p[0] << 24) | ((pj_uint32_t)p[1] << 16) |
+		  ((pj_uint32_t)p[2] << 8) | p[3];
+
+	return (int)(rr->ttl < minimum ? rr->ttl : minimum);
+    }
+
+    return -1;
+}
+
+
 /* Update response cache */
 static void update_res_cache(pj_dns_resolver *resolver,
 			     const struct res_key *key,
@@ -1198,11 +1358,13 @@ static void update_res_cache(pj_dns_resolver *resolver,
 	cache = (struct cached_res *) pj_hash_get(resolver->hrescache, key, 
 						  sizeof(*key), &hval);
 	/* Remove the entry before releasing its pool (see ticket #1710) */
-	pj_hash_set(NULL, resolver->hrescache, key, sizeof(*key), hval, NULL);
-	
-	/* Free the entry */
-	if (cache && --cache->ref_cnt <= 0)
-	    free_entry(resolver, cache);
+	if (cache) {
+	    unlink_entry(resolver, cache);
+
+	    /* Free the entry */
+	    if (--cache->ref_cnt <= 0)
+		free_entry(resolver, cache);
+	}
     }
 
 
@@ -1213,7 +1375,11 @@ static void update_res_cache(pj_dns_resolver *resolver,
 	     * ttl value (note: PJ_DNS_RESOLVER_INVALID_TTL may be zero, 
 	     * which means that invalid names won't be kept in the cache)
 	     */
+	    int neg_ttl = get_neg_ttl(pkt);
+
 	    ttl = PJ_DNS_RESOLVER_INVALID_TTL;
+	    if (neg_ttl >= 0 && (unsigned)neg_ttl < ttl)
+		ttl = neg_ttl;
 
 	} else {
 	    /* Otherwise get the minimum TTL from the answers */
@@ -1237,11 +1403,13 @@ static void update_res_cache(pj_dns_resolver *resolver,
 	cache = (struct cached_res *) pj_hash_get(resolver->hrescache, key, 
 						  sizeof(*key), &hval);
 	/* Remove the entry before releasing its pool (see ticket #1710) */
-	pj_hash_set(NULL, resolver->hrescache, key, sizeof(*key), hval, NULL);
+	if (cache) {
+	    unlink_entry(resolver, cache);
 
-	/* Free the entry */
-	if (cache && --cache->ref_cnt <= 0)
-	    free_entry(resolver, cache);
+	    /* Free the entry */
+	    if (--cache->ref_cnt <= 0)
+		free_entry(resolver, cache);
+	}
 	return;
     }
 
@@ -1249,17 +1417,21 @@ static void update_res_cache(pj_dns_resolver *resolver,
     cache = (struct cached_res *) pj_hash_get(resolver->hrescache, key, 
     					      sizeof(*key), &hval);
     if (cache == NULL) {
+	/* Make room for the new entry */
+	evict_entries(resolver);
 	cache = alloc_entry(resolver);
     } else if (cache->ref_cnt > 1) {
 	/* When cache entry is being used by callback (to app), just decrement
 	 * ref_cnt so it will be freed after the callback returns and allocate
-	 * new entry.
+	 * new entry. The hash table entry lives in the old entry, so remove
+	 * it first.
 	 */
+	unlink_entry(resolver, cache);
 	cache->ref_cnt--;
 	cache = alloc_entry(resolver);
     } else {
 	/* Remove the entry before resetting its pool (see ticket #1710) */
-	pj_hash_set(NULL, resolver->hrescache, key, sizeof(*key), hval, NULL);
+	unlink_entry(resolver, cache);
 
 	/* Reset cache to avoid bloated cache pool */
 	reset_entry(&cache);
@@ -1279,18 +1451,20 @@ static void update_res_cache(pj_dns_resolver *resolver,
     if (set_expiry) {
 	pj_gettimeofday(&cache->expiry_time);
 	cache->expiry_time.sec += ttl;
+	cache->ttl = ttl;
     } else {
 	cache->expiry_time.sec = 0x7FFFFFFFL;
 	cache->expiry_time.msec = 0;
+	cache->ttl = 0;
     }
 
     /* Copy key to the cached response */
     pj_memcpy(&cache->key, key, sizeof(*key));
 
-    /* Update the hash table */
+    /* Update the hash table and make it the most recently used entry */
     pj_hash_set_np(resolver->hrescache, &cache->key, sizeof(*key), hval,
 		   cache->hbuf, cache);
-
+    pj_list_push_back(&resolver->cache_lru, cache);
 }
 
 
@@ -1645,19 +1819,27 @@ PJ_DEF(void) pj_dns_resolver_dump(pj_dns_resolver *resolver,
 		  PJ_TIME_VAL_MSEC(ns->rt_delay)));
     }
 
-    PJ_LOG(3,(resolver->name.ptr, "  Nb. of cached responses: %u",
-	      pj_hash_count(resolver->hrescache)));
+    PJ_LOG(3,(resolver->name.ptr, "  Nb. of cached responses: %u (max %u)",
+	      pj_hash_count(resolver->hrescache),
+	      resolver->settings.cache_max_cnt));
+    PJ_LOG(3,(resolver->name.ptr, 
+	      "  Cache: %u hits (%u negative), %u misses, %u prefetches, "
+	      "%u evictions",
+	      resolver->cache_stat.hit, resolver->cache_stat.neg_hit,
+	      resolver->cache_stat.miss, resolver->cache_stat.prefetch,
+	      resolver->cache_stat.evict));
     if (detail) {
-	pj_hash_iterator_t itbuf, *it;
-	it = pj_hash_first(resolver->hrescache, &itbuf);
-	while (it) {
-	    struct cached_res *cache;
-	    cache = (struct cached_res*)pj_hash_this(resolver->hrescache, it);
+	struct cached_res *cache;
+
+	/* From the least recently used */
+	cache = resolver->cache_lru.next;
+	while (cache != (struct cached_res*)&resolver->cache_lru) {
 	    PJ_LOG(3,(resolver->name.ptr, 
-		      "   Type %s: %s",
+		      "   Type %s: %s (ttl=%d)",
 		      pj_dns_get_type_name(cache->key.qtype), 
-		      cache->key.name));
-	    it = pj_hash_next(resolver->hrescache, it);
+		      cache->key.name,
+		      (int)(cache->expiry_time.sec - now.sec)));
+	    cache = cache->next;
 	}
     }
     PJ_LOG(3,(resolver->name.ptr, "  Nb. of pending queries: %u (%u)",
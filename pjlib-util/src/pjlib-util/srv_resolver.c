@@ -79,6 +79,9 @@ struct pj_dns_srv_async_query
     /* Number of hosts in SRV records that the IP address has been resolved */
     unsigned		     host_resolved;
 
+    /* Still starting the DNS A queries in resolve_hostnames() */
+    pj_bool_t		     starting_a;
+
 };
 
 
@@ -402,6 +405,88 @@ static void build_server_entries(pj_dns_srv_async_query *query_job,
 }
 
 
+/* Build server addresses from the resolved SRV targets */
+static void build_srv_record(pj_dns_srv_async_query *query_job,
+			     pj_dns_srv_record *srv_rec)
+{
+    unsigned i;
+
+    srv_rec->count = 0;
+    for (i=0; i<query_job->srv_cnt; ++i) {
+	unsigned j;
+	struct srv_target *srv = &query_job->srv[i];
+
+	srv_rec->entry[srv_rec->count].priority = srv->priority;
+	srv_rec->entry[srv_rec->count].weight = srv->weight;
+	srv_rec->entry[srv_rec->count].port = (pj_uint16_t)srv->port ;
+
+	srv_rec->entry[srv_rec->count].server.name = srv->target_name;
+	srv_rec->entry[srv_rec->count].server.alias = srv->cname;
+	srv_rec->entry[srv_rec->count].server.addr_count = 0;
+
+	pj_assert(srv->addr_cnt <= PJ_DNS_MAX_IP_IN_A_REC);
+
+	for (j=0; j<srv->addr_cnt; ++j) {
+	    srv_rec->entry[srv_rec->count].server.addr[j].s_addr = 
+		srv->addr[j].s_addr;
+	    ++srv_rec->entry[srv_rec->count].server.addr_count;
+	}
+
+	if (srv->addr_cnt > 0) {
+	    ++srv_rec->count;
+	    if (srv_rec->count == PJ_DNS_SRV_MAX_ADDR)
+		break;
+	}
+    }
+}
+
+
+/* With PJ_DNS_SRV_RESOLVE_EARLY, call the callback once the most preferred
+ * target that has an address is known, even when DNS A queries for the
+ * other targets are still pending. Returns PJ_TRUE if the callback has
+ * been called, in which case query_job may have been destroyed.
+ */
+static pj_bool_t notify_early(pj_dns_srv_async_query *query_job)
+{
+    pj_dns_srv_record srv_rec;
+    unsigned i;
+
+    for (i=0; i<query_job->srv_cnt; ++i) {
+	struct srv_target *srv = &query_job->srv[i];
+
+	if (srv->addr_cnt > 0)
+	    break;
+
+	/* A more preferred target is still being resolved */
+	if (srv->q_a)
+	    return PJ_FALSE;
+    }
+
+    if (i == query_job->srv_cnt)
+	return PJ_FALSE;
+
+    /* Detach the pending queries. They will still complete and update
+     * the resolver cache, but won't call us back.
+     */
+    for (i=0; i<query_job->srv_cnt; ++i) {
+	struct srv_target *srv = &query_job->srv[i];
+	if (srv->q_a) {
+	    pj_dns_resolver_cancel_query(srv->q_a, PJ_FALSE);
+	    srv->q_a = NULL;
+	}
+    }
+
+    build_srv_record(query_job, &srv_rec);
+
+    PJ_LOG(5,(query_job->objname, 
+	      "Server resolution early result, %d of %d server entry(s) "
+	      "resolved", srv_rec.count, query_job->srv_cnt));
+
+    (*query_job->cb)(query_job->token, PJ_SUCCESS, &srv_rec);
+    return PJ_TRUE;
+}
+
+
 /* Start DNS A record queries for all SRV records in the query_job structure */
 static pj_status_t resolve_hostnames(pj_dns_srv_async_query *query_job)
 {
@@ -409,6 +494,7 @@ static pj_status_t resolve_hostnames(pj_dns_srv_async_query *query_job)
     pj_status_t err=PJ_SUCCESS, status;
 
     query_job->dns_state = PJ_DNS_TYPE_A;
+    query_job->starting_a = PJ_TRUE;
     for (i=0; i<query_job->srv_cnt; ++i) {
 	struct srv_target *srv = &query_job->srv[i];
 
@@ -431,7 +517,17 @@ static pj_status_t resolve_hostnames(pj_dns_srv_async_query *query_job)
 	}
     }
     
-    return (query_job->host_resolved == query_job->srv_cnt) ? err : PJ_SUCCESS;
+    if (query_job->host_resolved == query_job->srv_cnt)
+	return err;
+
+    /* Some answers may have come from the cache while we were starting
+     * the queries, and the early result was deferred until now.
+     */
+    query_job->starting_a = PJ_FALSE;
+    if (query_job->option & PJ_DNS_SRV_RESOLVE_EARLY)
+	notify_early(query_job);
+
+    return PJ_SUCCESS;
 }
 
 /* 
@@ -594,6 +690,15 @@ static void dns_callback(void *user_data,
 
 	++query_job->host_resolved;
 
+	/* Report the most preferred target without waiting for the rest */
+	if ((query_job->option & PJ_DNS_SRV_RESOLVE_EARLY) &&
+	    !query_job->starting_a &&
+	    query_job->host_resolved != query_job->srv_cnt &&
+	    notify_early(query_job))
+	{
+	    return;
+	}
+
     } else {
 	pj_assert(!"Unexpected state!");
 	query_job->last_error = status = PJ_EINVALIDOP;
@@ -605,33 +710,7 @@ static void dns_callback(void *user_data,
 	/* Got all answers, build server addresses */
 	pj_dns_srv_record srv_rec;
 
-	srv_rec.count = 0;
-	for (i=0; i<query_job->srv_cnt; ++i) {
-	    unsigned j;
-	    struct srv_target *srv = &query_job->srv[i];
-
-	    srv_rec.entry[srv_rec.count].priority = srv->priority;
-	    srv_rec.entry[srv_rec.count].weight = srv->weight;
-	    srv_rec.entry[srv_rec.count].port = (pj_uint16_t)srv->port ;
-
-	    srv_rec.entry[srv_rec.count].server.name = srv->target_name;
-	    srv_rec.entry[srv_rec.count].server.alias = srv->cname;
-	    srv_rec.entry[srv_rec.count].server.addr_count = 0;
-
-	    pj_assert(srv->addr_cnt <= PJ_DNS_MAX_IP_IN_A_REC);
-
-	    for (j=0; j<srv->addr_cnt; ++j) {
-		srv_rec.entry[srv_rec.count].server.addr[j].s_addr = 
-		    srv->addr[j].s_addr;
-		++srv_rec.entry[srv_rec.count].server.addr_count;
-	    }
-
-	    if (srv->addr_cnt > 0) {
-		++srv_rec.count;
-		if (srv_rec.count == PJ_DNS_SRV_MAX_ADDR)
-		    break;
-	    }
-	}
+	build_srv_record(query_job, &srv_rec);
 
 	PJ_LOG(5,(query_job->objname, 
 		  "Server resolution complete, %d server entry(s) found",
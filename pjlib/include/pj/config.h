@@ -858,6 +858,56 @@
 #endif
 
 
+/**
+ * Enable support for kernel TLS (kTLS) transmit offload in the OpenSSL
+ * secure socket backend, see \a ktls field of #pj_ssl_sock_param. This
+ * requires Linux with kernel TLS support (the "tls" TCP upper layer
+ * protocol) and OpenSSL 1.1.1 or later. When the kernel rejects the
+ * offload, the secure socket transparently keeps encrypting in user space.
+ *
+ * Default: 0
+ */
+#ifndef PJ_SSL_SOCK_HAS_KTLS
+#  define PJ_SSL_SOCK_HAS_KTLS	    0
+#endif
+
+
+/**
+ * Default maximum number of TLS sessions to be kept by a secure socket
+ * for session resumption, see \a sess_cache_size field of
+ * #pj_ssl_sock_param.
+ *
+ * Default: 1024
+ */
+#ifndef PJ_SSL_SOCK_SESS_CACHE_SIZE
+#  define PJ_SSL_SOCK_SESS_CACHE_SIZE	    1024
+#endif
+
+
+/**
+ * Default lifetime of cached TLS sessions, in seconds, see
+ * \a sess_timeout field of #pj_ssl_sock_param.
+ *
+ * Default: 3600
+ */
+#ifndef PJ_SSL_SOCK_SESS_TIMEOUT
+#  define PJ_SSL_SOCK_SESS_TIMEOUT	    3600
+#endif
+
+
+/**
+ * Maximum number of servers whose TLS session is remembered by secure
+ * sockets acting as client, so the session can be resumed when
+ * connecting to the same server again. When the table is full, the
+ * least recently used entry is replaced.
+ *
+ * Default: 32
+ */
+#ifndef PJ_SSL_SOCK_MAX_CLIENT_SESS
+#  define PJ_SSL_SOCK_MAX_CLIENT_SESS	    32
+#endif
+
+
 /**
  * Disable WSAECONNRESET error for UDP sockets on Win32 platforms. See
  * https://trac.pjsip.org/repos/ticket/1197.
@@ -257,6 +257,8 @@ typedef enum pj_ssl_cipher {
     PJ_TLS_RSA_WITH_AES_256_CBC_SHA          	= 0x00000035,
     PJ_TLS_RSA_WITH_AES_128_CBC_SHA256       	= 0x0000003C,
     PJ_TLS_RSA_WITH_AES_256_CBC_SHA256       	= 0x0000003D,
+    PJ_TLS_RSA_WITH_AES_128_GCM_SHA256       	= 0x0000009C,
+    PJ_TLS_RSA_WITH_AES_256_GCM_SHA384       	= 0x0000009D,
     PJ_TLS_DH_DSS_WITH_3DES_EDE_CBC_SHA      	= 0x0000000D,
     PJ_TLS_DH_RSA_WITH_3DES_EDE_CBC_SHA      	= 0x00000010,
     PJ_TLS_DHE_DSS_WITH_3DES_EDE_CBC_SHA     	= 0x00000013,
@@ -547,9 +549,35 @@ typedef struct pj_ssl_sock_info
      */
     unsigned long	last_native_err;
 
+    /**
+     * Describes whether the connection was established by resuming a
+     * previous TLS session, i.e: without full handshake.
+     */
+    pj_bool_t		sess_reused;
+
+    /**
+     * Describes whether encryption of sent data has been offloaded to
+     * the kernel, see \a ktls field of #pj_ssl_sock_param.
+     */
+    pj_bool_t		ktls_tx;
+
 } pj_ssl_sock_info;
 
 
+/**
+ * Secure socket handshake statistics, see
+ * #pj_ssl_sock_get_handshake_stat().
+ */
+typedef struct pj_ssl_sock_handshake_stat
+{
+    unsigned	server_full;	/**< Full handshakes, as server.	    */
+    unsigned	server_resumed;	/**< Resumed sessions, as server.	    */
+    unsigned	client_full;	/**< Full handshakes, as client.	    */
+    unsigned	client_resumed;	/**< Resumed sessions, as client.	    */
+    unsigned	failed;		/**< Failed handshakes.			    */
+} pj_ssl_sock_handshake_stat;
+
+
 /**
  * Definition of secure socket creation parameters.
  */
@@ -710,6 +738,57 @@ typedef struct pj_ssl_sock_param
      */
     pj_str_t server_name;
 
+    /**
+     * Maximum number of TLS sessions kept for session resumption, so
+     * that reconnecting peers can skip the full handshake. When the
+     * secure socket is used as listener, all connections it accepts share
+     * one SSL context, which is created by #pj_ssl_sock_start_accept(),
+     * and the server side session cache of that context is bounded by
+     * this value. When the secure socket is used as client, the session
+     * is looked up in a process wide table (see
+     * PJ_SSL_SOCK_MAX_CLIENT_SESS) keyed by remote address and server
+     * name, and offered to the server. Set to zero to disable session
+     * resumption.
+     *
+     * Default value is PJ_SSL_SOCK_SESS_CACHE_SIZE.
+     */
+    unsigned sess_cache_size;
+
+    /**
+     * Lifetime of cached TLS sessions, in seconds.
+     *
+     * Default value is PJ_SSL_SOCK_SESS_TIMEOUT.
+     */
+    unsigned sess_timeout;
+
+    /**
+     * Specify whether session tickets (RFC 5077) should be used. With
+     * session tickets, the server does not need to keep the session state
+     * of its clients, as the state is stored, encrypted, by the client.
+     * Session tickets are only used when session resumption is enabled,
+     * see \a sess_cache_size.
+     *
+     * Default value is PJ_TRUE.
+     */
+    pj_bool_t sess_ticket;
+
+    /**
+     * Specify whether encryption of sent data should be offloaded to the
+     * kernel (kTLS) once the handshake has completed, so application data
+     * is passed to the socket without being copied into and out of the
+     * SSL write buffer. Currently this is only available for TLS 1.2
+     * stream connections using AES-GCM ciphers, on Linux with
+     * PJ_SSL_SOCK_HAS_KTLS enabled. Received data is still decrypted in
+     * user space. If the offload cannot be set up, the secure socket
+     * falls back to encrypting in user space. Note that SSL
+     * re-negotiation is not possible on offloaded connections. When this
+     * is set, PJ_SSL_SOCK_PROTO_DEFAULT and PJ_SSL_SOCK_PROTO_SSL23
+     * negotiate up to TLS 1.2 only.
+     *
+     * Default value is PJ_FALSE.
+     */
+    pj_bool_t ktls;
+
     /**
      * Specify if SO_REUSEADDR should be used for listening socket. This
      * option will only be used with accept() operation.
@@ -1050,6 +1129,19 @@ PJ_DECL(pj_status_t) pj_ssl_sock_start_connect(pj_ssl_sock_t *ssock,
 PJ_DECL(pj_status_t) pj_ssl_sock_renegotiate(pj_ssl_sock_t *ssock);
 
 
+/**
+ * Get the handshake statistics of all secure sockets in this process,
+ * e.g: to monitor how many connections were established by resuming a
+ * previous TLS session.
+ *
+ * @param stat		The statistics to be filled in.
+ *
+ * @return		PJ_SUCCESS on success, or the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pj_ssl_sock_get_handshake_stat(
+					pj_ssl_sock_handshake_stat *stat);
+
+
 /**
  * @}
  */
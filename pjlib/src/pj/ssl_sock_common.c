@@ -43,6 +43,9 @@ PJ_DEF(void) pj_ssl_sock_param_default(pj_ssl_sock_param *param)
 
     /* Security config */
     param->proto = PJ_SSL_SOCK_PROTO_DEFAULT;
+    param->sess_cache_size = PJ_SSL_SOCK_SESS_CACHE_SIZE;
+    param->sess_timeout = PJ_SSL_SOCK_SESS_TIMEOUT;
+    param->sess_ticket = PJ_TRUE;
 }
 
 
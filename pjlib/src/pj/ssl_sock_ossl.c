@@ -21,6 +21,7 @@
 #include <pj/compat/socket.h>
 #include <pj/assert.h>
 #include <pj/errno.h>
+#include <pj/hash.h>
 #include <pj/list.h>
 #include <pj/lock.h>
 #include <pj/log.h>
@@ -50,6 +51,28 @@
 #include <openssl/err.h>
 #include <openssl/x509v3.h>
 
+/*
+ * Kernel TLS transmit offload, for TLS 1.2 AES-GCM ciphers.
+ */
+#if defined(PJ_SSL_SOCK_HAS_KTLS) && PJ_SSL_SOCK_HAS_KTLS!=0 && \
+    OPENSSL_VERSION_NUMBER >= 0x10101000L
+#  define USE_KTLS		1
+#  include <openssl/hmac.h>
+#  include <netinet/tcp.h>
+#  include <linux/tls.h>
+#  ifndef TCP_ULP
+#    define TCP_ULP		31
+#  endif
+#  ifndef SOL_TLS
+#    define SOL_TLS		282
+#  endif
+#  ifndef TLS_SET_RECORD_TYPE
+#    define TLS_SET_RECORD_TYPE	1
+#  endif
+#else
+#  define USE_KTLS		0
+#endif
+
 
 #ifdef _MSC_VER
 #  pragma comment( lib, "libeay32")
@@ -166,6 +189,9 @@ struct pj_ssl_sock_t
     send_buf_t		  send_buf;
     write_data_t	  send_pending;	/* list of pending write to network */
     pj_lock_t		 *write_mutex;	/* protect write BIO and send_buf   */
+    pj_bool_t		  ktls_tx;	/* encryption done by the kernel    */
+    pj_uint8_t		  ktls_alert[8];/* alerts to send via the kernel    */
+    unsigned		  ktls_alert_len;
 
     SSL_CTX		 *ossl_ctx;
     SSL			 *ossl_ssl;
@@ -189,6 +215,11 @@ struct pj_ssl_cert_t
 static write_data_t* alloc_send_data(pj_ssl_sock_t *ssock, pj_size_t len);
 static void free_send_data(pj_ssl_sock_t *ssock, write_data_t *wdata);
 static pj_status_t flush_delayed_send(pj_ssl_sock_t *ssock);
+#if USE_KTLS
+static void ktls_msg_cb(int write_p, int version, int content_type,
+			const void *buf, size_t len, SSL *ssl, void *arg);
+static void ktls_send_alerts(pj_ssl_sock_t *ssock);
+#endif
 
 /*
  *******************************************************************
@@ -291,6 +322,23 @@ static struct openssl_ciphers_t {
 /* OpenSSL application data index */
 static int sslsock_idx;
 
+/* Handshake statistics, protected by the global critical section */
+static pj_ssl_sock_handshake_stat handshake_stat;
+
+/* Sessions established by client sockets, keyed by remote address and
+ * server name, protected by the global critical section.
+ */
+#define CLIENT_SESS_KEY_LEN	(PJ_INET6_ADDRSTRLEN + 80)
+
+static struct client_sess_t {
+    char		 key[CLIENT_SESS_KEY_LEN];
+    SSL_SESSION		*sess;
+    pj_uint32_t		 last_used;
+} client_sess[PJ_SSL_SOCK_MAX_CLIENT_SESS];
+static pj_uint32_t client_sess_clock;
+
+static void clear_client_sess(void);
+
 
 /* Initialize OpenSSL */
 static pj_status_t init_openssl(void)
@@ -359,6 +407,9 @@ static pj_status_t init_openssl(void)
     /* Create OpenSSL application data index for SSL socket */
     sslsock_idx = SSL_get_ex_new_index(0, "SSL socket", NULL, NULL, NULL);
 
+    /* Release cached client sessions on library shutdown */
+    pj_atexit(&clear_client_sess);
+
     return PJ_SUCCESS;
 }
 
@@ -385,43 +436,25 @@ static int password_cb(char *buf, int num, int rwflag, void *user_data)
 }
 
 
-/* SSL password callback. */
-static int verify_cb(int preverify_ok, X509_STORE_CTX *x509_ctx)
+/* Map OpenSSL certificate verification error to verification status */
+static pj_uint32_t get_verify_status(long err)
 {
-    pj_ssl_sock_t *ssock;
-    SSL *ossl_ssl;
-    int err;
-
-    /* Get SSL instance */
-    ossl_ssl = X509_STORE_CTX_get_ex_data(x509_ctx, 
-				    SSL_get_ex_data_X509_STORE_CTX_idx());
-    pj_assert(ossl_ssl);
-
-    /* Get SSL socket instance */
-    ssock = SSL_get_ex_data(ossl_ssl, sslsock_idx);
-    pj_assert(ssock);
-
-    /* Store verification status */
-    err = X509_STORE_CTX_get_error(x509_ctx);
     switch (err) {
     case X509_V_OK:
-	break;
+	return PJ_SSL_CERT_ESUCCESS;
 
     case X509_V_ERR_UNABLE_TO_GET_ISSUER_CERT:
-	ssock->verify_status |= PJ_SSL_CERT_EISSUER_NOT_FOUND;
-	break;
+	return PJ_SSL_CERT_EISSUER_NOT_FOUND;
 
     case X509_V_ERR_ERROR_IN_CERT_NOT_BEFORE_FIELD:
     case X509_V_ERR_ERROR_IN_CERT_NOT_AFTER_FIELD:
     case X509_V_ERR_UNABLE_TO_DECRYPT_CERT_SIGNATURE:
     case X509_V_ERR_UNABLE_TO_DECODE_ISSUER_PUBLIC_KEY:
-	ssock->verify_status |= PJ_SSL_CERT_EINVALID_FORMAT;
-	break;
+	return PJ_SSL_CERT_EINVALID_FORMAT;
 
     case X509_V_ERR_CERT_NOT_YET_VALID:
     case X509_V_ERR_CERT_HAS_EXPIRED:
-	ssock->verify_status |= PJ_SSL_CERT_EVALIDITY_PERIOD;
-	break;
+	return PJ_SSL_CERT_EVALIDITY_PERIOD;
 
     case X509_V_ERR_UNABLE_TO_GET_CRL:
     case X509_V_ERR_CRL_NOT_YET_VALID:
@@ -430,15 +463,13 @@ static int verify_cb(int preverify_ok, X509_STORE_CTX *x509_ctx)
     case X509_V_ERR_CRL_SIGNATURE_FAILURE:
     case X509_V_ERR_ERROR_IN_CRL_LAST_UPDATE_FIELD:
     case X509_V_ERR_ERROR_IN_CRL_NEXT_UPDATE_FIELD:
-	ssock->verify_status |= PJ_SSL_CERT_ECRL_FAILURE;
-	break;	
+	return PJ_SSL_CERT_ECRL_FAILURE;
 
     case X509_V_ERR_DEPTH_ZERO_SELF_SIGNED_CERT:
     case X509_V_ERR_CERT_UNTRUSTED:
     case X509_V_ERR_SELF_SIGNED_CERT_IN_CHAIN:
     case X509_V_ERR_UNABLE_TO_GET_ISSUER_CERT_LOCALLY:
-	ssock->verify_status |= PJ_SSL_CERT_EUNTRUSTED;
-	break;	
+	return PJ_SSL_CERT_EUNTRUSTED;
 
     case X509_V_ERR_CERT_SIGNATURE_FAILURE:
     case X509_V_ERR_UNABLE_TO_VERIFY_LEAF_SIGNATURE:
@@ -446,30 +477,55 @@ static int verify_cb(int preverify_ok, X509_STORE_CTX *x509_ctx)
     case X509_V_ERR_AKID_SKID_MISMATCH:
     case X509_V_ERR_AKID_ISSUER_SERIAL_MISMATCH:
     case X509_V_ERR_KEYUSAGE_NO_CERTSIGN:
-	ssock->verify_status |= PJ_SSL_CERT_EISSUER_MISMATCH;
-	break;
+	return PJ_SSL_CERT_EISSUER_MISMATCH;
 
     case X509_V_ERR_CERT_REVOKED:
-	ssock->verify_status |= PJ_SSL_CERT_EREVOKED;
-	break;	
+	return PJ_SSL_CERT_EREVOKED;
 
     case X509_V_ERR_INVALID_PURPOSE:
     case X509_V_ERR_CERT_REJECTED:
     case X509_V_ERR_INVALID_CA:
-	ssock->verify_status |= PJ_SSL_CERT_EINVALID_PURPOSE;
-	break;
+	return PJ_SSL_CERT_EINVALID_PURPOSE;
 
     case X509_V_ERR_CERT_CHAIN_TOO_LONG: /* not really used */
     case X509_V_ERR_PATH_LENGTH_EXCEEDED:
-	ssock->verify_status |= PJ_SSL_CERT_ECHAIN_TOO_LONG;
-	break;
+	return PJ_SSL_CERT_ECHAIN_TOO_LONG;
 
     /* Unknown errors */
     case X509_V_ERR_OUT_OF_MEM:
     default:
-	ssock->verify_status |= PJ_SSL_CERT_EUNKNOWN;
-	break;
+	return PJ_SSL_CERT_EUNKNOWN;
     }
+}
+
+
+/* SSL password callback. */
+static int verify_cb(int preverify_ok, X509_STORE_CTX *x509_ctx)
+{
+    pj_ssl_sock_t *ssock;
+    SSL *ossl_ssl;
+    int err;
+
+    /* Get SSL instance */
+    ossl_ssl = X509_STORE_CTX_get_ex_data(x509_ctx, 
+				    SSL_get_ex_data_X509_STORE_CTX_idx());
+    pj_assert(ossl_ssl);
+
+    /* Get SSL socket instance */
+    ssock = SSL_get_ex_data(ossl_ssl, sslsock_idx);
+    pj_assert(ssock);
+
+    /* Store verification status */
+    err = X509_STORE_CTX_get_error(x509_ctx);
+    ssock->verify_status |= get_verify_status(err);
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    /* Don't issue TLSv1.3 tickets for a session whose peer failed the
+     * verification, so it can't be resumed later.
+     */
+    if (err != X509_V_OK && ssock->is_server)
+	SSL_set_num_tickets(ossl_ssl, 0);
+#endif
 
     /* When verification is not requested just return ok here, however
      * application can still get the verification status.
@@ -484,16 +540,137 @@ static int verify_cb(int preverify_ok, X509_STORE_CTX *x509_ctx)
 static pj_status_t set_cipher_list(pj_ssl_sock_t *ssock);
 
 
-/* Create and initialize new SSL context and instance */
-static pj_status_t create_ssl(pj_ssl_sock_t *ssock)
+/* Get the key of the client session table for the SSL socket. Besides
+ * the server, the key covers the CA and certificate settings, so a session
+ * is never offered by a socket configured with different credentials.
+ */
+static void get_client_sess_key(pj_ssl_sock_t *ssock, char *key)
+{
+    pj_uint32_t cert_hash = 0;
+    pj_size_t len;
+
+    if (ssock->cert) {
+	const pj_ssl_cert_t *cert = ssock->cert;
+
+	cert_hash = pj_hash_calc(cert_hash, cert->CA_file.ptr,
+				 (unsigned)cert->CA_file.slen);
+	cert_hash = pj_hash_calc(cert_hash, "/", 1);
+	cert_hash = pj_hash_calc(cert_hash, cert->cert_file.ptr,
+				 (unsigned)cert->cert_file.slen);
+	cert_hash = pj_hash_calc(cert_hash, "/", 1);
+	cert_hash = pj_hash_calc(cert_hash, cert->privkey_file.ptr,
+				 (unsigned)cert->privkey_file.slen);
+    }
+
+    pj_sockaddr_print(&ssock->rem_addr, key, CLIENT_SESS_KEY_LEN, 3);
+    len = pj_ansi_strlen(key);
+    pj_ansi_snprintf(key + len, CLIENT_SESS_KEY_LEN - len, "/%08x/%.*s",
+		     cert_hash, (int)ssock->param.server_name.slen,
+		     ssock->param.server_name.ptr);
+}
+
+
+/* Find client session entry. When not found and add is set, return the
+ * least recently used entry instead.
+ */
+static struct client_sess_t* find_client_sess(const char *key,
+					      pj_bool_t add)
+{
+    struct client_sess_t *lru = &client_sess[0];
+    unsigned i;
+
+    for (i = 0; i < PJ_ARRAY_SIZE(client_sess); ++i) {
+	struct client_sess_t *e = &client_sess[i];
+
+	if (e->sess && pj_ansi_strcmp(e->key, key) == 0)
+	    return e;
+	if (!e->sess || (lru->sess && e->last_used < lru->last_used))
+	    lru = e;
+    }
+
+    return add? lru : NULL;
+}
+
+
+/* Release all cached client sessions */
+static void clear_client_sess(void)
+{
+    unsigned i;
+
+    pj_enter_critical_section();
+    for (i = 0; i < PJ_ARRAY_SIZE(client_sess); ++i) {
+	if (client_sess[i].sess) {
+	    SSL_SESSION_free(client_sess[i].sess);
+	    client_sess[i].sess = NULL;
+	}
+    }
+    pj_leave_critical_section();
+}
+
+
+/* OpenSSL callback when a client socket has established a new session,
+ * keep it so it can be resumed on the next connection to the server.
+ */
+static int on_new_client_sess(SSL *ossl_ssl, SSL_SESSION *sess)
+{
+    pj_ssl_sock_t *ssock;
+    struct client_sess_t *e;
+    char key[CLIENT_SESS_KEY_LEN];
+
+    ssock = (pj_ssl_sock_t*) SSL_get_ex_data(ossl_ssl, sslsock_idx);
+    if (!ssock)
+	return 0;
+
+    /* Only keep sessions with a verified server, as resuming a session
+     * skips the verification.
+     */
+    if (ssock->verify_status != PJ_SSL_CERT_ESUCCESS)
+	return 0;
+
+    get_client_sess_key(ssock, key);
+
+    pj_enter_critical_section();
+    e = find_client_sess(key, PJ_TRUE);
+    if (e->sess)
+	SSL_SESSION_free(e->sess);
+    pj_ansi_strcpy(e->key, key);
+    e->sess = sess;
+    e->last_used = ++client_sess_clock;
+    pj_leave_critical_section();
+
+    /* We keep the session reference */
+    return 1;
+}
+
+
+/* Offer the session previously established with the same server */
+static void set_client_sess(pj_ssl_sock_t *ssock)
+{
+    struct client_sess_t *e;
+    char key[CLIENT_SESS_KEY_LEN];
+
+    get_client_sess_key(ssock, key);
+
+    pj_enter_critical_section();
+    e = find_client_sess(key, PJ_FALSE);
+    if (e) {
+	SSL_set_session(ssock->ossl_ssl, e->sess);
+	e->last_used = ++client_sess_clock;
+    }
+    pj_leave_critical_section();
+}
+
+
+/* Create and initialize new SSL context */
+static pj_status_t create_ssl_ctx(pj_ssl_sock_t *ssock, SSL_CTX **p_ctx)
 {
     SSL_METHOD *ssl_method;
     SSL_CTX *ctx;
     pj_ssl_cert_t *cert;
-    int mode, rc;
+    int rc;
     pj_status_t status;
         
-    pj_assert(ssock);
+    pj_assert(ssock && p_ctx);
 
     cert = ssock->cert;
 
@@ -503,6 +680,14 @@ static pj_status_t create_ssl(pj_ssl_sock_t *ssock)
     /* Determine SSL method to use */
     switch (ssock->param.proto) {
     case PJ_SSL_SOCK_PROTO_DEFAULT:
+#if USE_KTLS
+	/* Kernel offload requires TLS 1.2, let the version be negotiated */
+	if (ssock->param.ktls) {
+	    ssl_method = (SSL_METHOD*)SSLv23_method();
+	    break;
+	}
+#endif
+	/* Fallthrough */
     case PJ_SSL_SOCK_PROTO_TLS1:
 	ssl_method = (SSL_METHOD*)TLSv1_method();
 	break;
@@ -530,6 +715,14 @@ static pj_status_t create_ssl(pj_ssl_sock_t *ssock)
 	return GET_SSL_STATUS(ssock);
     }
 
+#if USE_KTLS
+    /* Kernel offload is only available for TLS 1.2, don't negotiate any
+     * later version.
+     */
+    if (ssock->param.ktls && ssl_method == SSLv23_method())
+	SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+#endif
+
     /* Apply credentials */
     if (cert) {
 	/* Load CA list if one is specified. */
@@ -585,9 +778,58 @@ static pj_status_t create_ssl(pj_ssl_sock_t *ssock)
 	}
     }
 
+    /* Setup session resumption */
+    if (ssock->param.sess_cache_size == 0) {
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    } else if (ssock->is_server) {
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_sess_set_cache_size(ctx, ssock->param.sess_cache_size);
+	SSL_CTX_set_timeout(ctx, ssock->param.sess_timeout);
+
+	/* Required to resume sessions when peer is verified */
+	SSL_CTX_set_session_id_context(ctx, (const unsigned char*)"pjlib",
+				       5);
+    } else {
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT |
+					    SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx, &on_new_client_sess);
+	SSL_CTX_set_timeout(ctx, ssock->param.sess_timeout);
+    }
+
+#ifdef SSL_OP_NO_TICKET
+    if (ssock->param.sess_cache_size == 0 || !ssock->param.sess_ticket)
+	SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+#endif
+
+    *p_ctx = ctx;
+
+    return PJ_SUCCESS;
+}
+
+
+/* Create and initialize new SSL instance */
+static pj_status_t create_ssl(pj_ssl_sock_t *ssock)
+{
+    SSL_CTX *ctx;
+    int mode;
+    pj_status_t status;
+
+    pj_assert(ssock);
+
+    /* Accepted connections share the SSL context of the listener if it
+     * has one, so they share the session cache and ticket keys too.
+     */
+    if (ssock->parent && ssock->parent->ossl_ctx) {
+	ctx = ssock->parent->ossl_ctx;
+    } else {
+	status = create_ssl_ctx(ssock, &ctx);
+	if (status != PJ_SUCCESS)
+	    return status;
+	ssock->ossl_ctx = ctx;
+    }
+
     /* Create SSL instance */
-    ssock->ossl_ctx = ctx;
-    ssock->ossl_ssl = SSL_new(ssock->ossl_ctx);
+    ssock->ossl_ssl = SSL_new(ctx);
     if (ssock->ossl_ssl == NULL) {
 	return GET_SSL_STATUS(ssock);
     }
@@ -602,6 +844,14 @@ static pj_status_t create_ssl(pj_ssl_sock_t *ssock)
 
     SSL_set_verify(ssock->ossl_ssl, mode, &verify_cb);
 
+#if USE_KTLS
+    /* Catch alerts generated by OpenSSL once the kernel encrypts */
+    if (ssock->param.ktls) {
+	SSL_set_msg_callback(ssock->ossl_ssl, &ktls_msg_cb);
+	SSL_set_msg_callback_arg(ssock->ossl_ssl, ssock);
+    }
+#endif
+
     /* Set cipher list */
     status = set_cipher_list(ssock);
     if (status != PJ_SUCCESS)
@@ -614,6 +864,10 @@ static pj_status_t create_ssl(pj_ssl_sock_t *ssock)
     (void)BIO_set_close(ssock->ossl_wbio, BIO_CLOSE);
     SSL_set_bio(ssock->ossl_ssl, ssock->ossl_rbio, ssock->ossl_wbio);
 
+    /* Try to resume previous session with the server */
+    if (!ssock->is_server && ssock->param.sess_cache_size)
+	set_client_sess(ssock);
+
     return PJ_SUCCESS;
 }
 
@@ -644,7 +898,20 @@ static void destroy_ssl(pj_ssl_sock_t *ssock)
 /* Reset SSL socket state */
 static void reset_ssl_sock_state(pj_ssl_sock_t *ssock)
 {
+#if USE_KTLS
+    /* Send close_notify through the kernel, as it owns the write key */
+    if (ssock->ktls_tx && ssock->ossl_ssl) {
+	pj_lock_acquire(ssock->write_mutex);
+	SSL_shutdown(ssock->ossl_ssl);
+	(void)BIO_reset(ssock->ossl_wbio);
+	ktls_send_alerts(ssock);
+	pj_lock_release(ssock->write_mutex);
+    }
+#endif
+
     ssock->ssl_state = SSL_STATE_NULL;
+    ssock->ktls_tx = PJ_FALSE;
+    ssock->ktls_alert_len = 0;
 
     destroy_ssl(ssock);
 
@@ -955,6 +1222,222 @@ static void update_certs_info(pj_ssl_sock_t *ssock)
 }
 
 
+#if USE_KTLS
+/* TLS 1.2 pseudorandom function (RFC 5246 section 5) */
+static void tls12_prf(const EVP_MD *md,
+		      const unsigned char *secret, unsigned secret_len,
+		      const unsigned char *seed, unsigned seed_len,
+		      unsigned char *out, unsigned out_len)
+{
+    unsigned char a[EVP_MAX_MD_SIZE];
+    unsigned char buf[EVP_MAX_MD_SIZE + 128];
+    unsigned char p[EVP_MAX_MD_SIZE];
+    unsigned a_len, p_len, md_len;
+
+    md_len = EVP_MD_size(md);
+    pj_assert(seed_len <= 128);
+
+    /* A(1) = HMAC(secret, seed) */
+    HMAC(md, secret, secret_len, seed, seed_len, a, &a_len);
+
+    while (out_len) {
+	/* P_hash = HMAC(secret, A(i) + seed) */
+	pj_memcpy(buf, a, md_len);
+	pj_memcpy(buf + md_len, seed, seed_len);
+	HMAC(md, secret, secret_len, buf, md_len + seed_len, p, &p_len);
+
+	p_len = PJ_MIN(p_len, out_len);
+	pj_memcpy(out, p, p_len);
+	out += p_len;
+	out_len -= p_len;
+
+	/* A(i+1) = HMAC(secret, A(i)) */
+	HMAC(md, secret, secret_len, a, md_len, a, &a_len);
+    }
+
+    OPENSSL_cleanse(a, sizeof(a));
+    OPENSSL_cleanse(p, sizeof(p));
+}
+
+
+/* Hand the negotiated write key over to the kernel, so data sent on the
+ * socket afterwards is encrypted by the kernel.
+ */
+static pj_status_t ktls_start_tx(pj_ssl_sock_t *ssock)
+{
+    static const char label[] = "key expansion";
+    SSL *ssl = ssock->ossl_ssl;
+    const SSL_CIPHER *cipher;
+    const EVP_MD *md;
+    unsigned char master[SSL_MAX_MASTER_KEY_LENGTH];
+    unsigned char seed[sizeof(label) - 1 + 2 * SSL3_RANDOM_SIZE];
+    unsigned char key_block[2 * 32 + 2 * 4];
+    const unsigned char *key, *salt;
+    unsigned master_len, key_len;
+    union {
+	struct tls12_crypto_info_aes_gcm_128 gcm128;
+	struct tls12_crypto_info_aes_gcm_256 gcm256;
+    } ci;
+    /* Finished message was the first record sent with the new keys */
+    const unsigned char rec_seq[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    socklen_t ci_len;
+    pj_status_t status = PJ_SUCCESS;
+
+    if (ssock->param.sock_type != pj_SOCK_STREAM() ||
+	SSL_version(ssl) != TLS1_2_VERSION)
+    {
+	return PJ_ENOTSUP;
+    }
+
+    cipher = SSL_get_current_cipher(ssl);
+    switch (SSL_CIPHER_get_cipher_nid(cipher)) {
+    case NID_aes_128_gcm:
+	key_len = 16;
+	break;
+    case NID_aes_256_gcm:
+	key_len = 32;
+	break;
+    default:
+	return PJ_ENOTSUP;
+    }
+    md = SSL_CIPHER_get_handshake_digest(cipher);
+    if (!md)
+	return PJ_ENOTSUP;
+
+    /* Any data in flight must go out before the kernel takes over */
+    pj_lock_acquire(ssock->write_mutex);
+    if (!pj_list_empty(&ssock->send_pending) ||
+	BIO_pending(ssock->ossl_wbio))
+    {
+	pj_lock_release(ssock->write_mutex);
+	return PJ_EBUSY;
+    }
+
+    /* Derive the key block, AEAD ciphers have no MAC keys:
+     * client key, server key, client salt, server salt.
+     */
+    master_len = (unsigned)SSL_SESSION_get_master_key(SSL_get_session(ssl),
+						      master, sizeof(master));
+    pj_memcpy(seed, label, sizeof(label) - 1);
+    SSL_get_server_random(ssl, seed + sizeof(label) - 1, SSL3_RANDOM_SIZE);
+    SSL_get_client_random(ssl, seed + sizeof(label) - 1 + SSL3_RANDOM_SIZE,
+			  SSL3_RANDOM_SIZE);
+    tls12_prf(md, master, master_len, seed, sizeof(seed),
+	      key_block, 2 * key_len + 2 * 4);
+
+    key = key_block + (ssock->is_server? key_len : 0);
+    salt = key_block + 2 * key_len + (ssock->is_server? 4 : 0);
+
+    pj_bzero(&ci, sizeof(ci));
+    if (key_len == 16) {
+	ci.gcm128.info.version = TLS_1_2_VERSION;
+	ci.gcm128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+	pj_memcpy(ci.gcm128.key, key, key_len);
+	pj_memcpy(ci.gcm128.salt, salt, 4);
+	pj_memcpy(ci.gcm128.iv, rec_seq, sizeof(rec_seq));
+	pj_memcpy(ci.gcm128.rec_seq, rec_seq, sizeof(rec_seq));
+	ci_len = sizeof(ci.gcm128);
+    } else {
+	ci.gcm256.info.version = TLS_1_2_VERSION;
+	ci.gcm256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+	pj_memcpy(ci.gcm256.key, key, key_len);
+	pj_memcpy(ci.gcm256.salt, salt, 4);
+	pj_memcpy(ci.gcm256.iv, rec_seq, sizeof(rec_seq));
+	pj_memcpy(ci.gcm256.rec_seq, rec_seq, sizeof(rec_seq));
+	ci_len = sizeof(ci.gcm256);
+    }
+
+    if (setsockopt(ssock->sock, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) ||
+	setsockopt(ssock->sock, SOL_TLS, TLS_TX, &ci, ci_len))
+    {
+	status = pj_get_netos_error();
+    } else {
+	ssock->ktls_tx = PJ_TRUE;
+
+	/* The write key now lives in the kernel only */
+#ifdef SSL_OP_NO_RENEGOTIATION
+	SSL_set_options(ssl, SSL_OP_NO_RENEGOTIATION);
+#endif
+    }
+    pj_lock_release(ssock->write_mutex);
+
+    OPENSSL_cleanse(master, sizeof(master));
+    OPENSSL_cleanse(key_block, sizeof(key_block));
+    OPENSSL_cleanse(&ci, sizeof(ci));
+
+    return status;
+}
+
+
+/* OpenSSL protocol message callback, used to keep the alerts sent by
+ * OpenSSL after the kernel has taken over the encryption. Records
+ * encrypted by OpenSSL are useless by then, the alerts are resent as
+ * kernel TLS records by ktls_send_alerts().
+ */
+static void ktls_msg_cb(int write_p, int version, int content_type,
+			const void *buf, size_t len, SSL *ssl, void *arg)
+{
+    pj_ssl_sock_t *ssock = (pj_ssl_sock_t*)arg;
+
+    PJ_UNUSED_ARG(version);
+    PJ_UNUSED_ARG(ssl);
+
+    if (!write_p || content_type != SSL3_RT_ALERT || len != 2 ||
+	!ssock->ktls_tx)
+    {
+	return;
+    }
+
+    if (ssock->ktls_alert_len + 2 <= sizeof(ssock->ktls_alert)) {
+	pj_memcpy(ssock->ktls_alert + ssock->ktls_alert_len, buf, 2);
+	ssock->ktls_alert_len += 2;
+    }
+}
+
+
+/* Send the alerts kept by ktls_msg_cb() as kernel TLS alert records.
+ * This must be called with the write mutex held.
+ */
+static void ktls_send_alerts(pj_ssl_sock_t *ssock)
+{
+    unsigned i;
+
+    for (i = 0; i + 2 <= ssock->ktls_alert_len; i += 2) {
+	union {
+	    struct cmsghdr hdr;
+	    char buf[CMSG_SPACE(sizeof(unsigned char))];
+	} ctrl;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+
+	iov.iov_base = ssock->ktls_alert + i;
+	iov.iov_len = 2;
+
+	pj_bzero(&msg, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl.buf;
+	msg.msg_controllen = sizeof(ctrl.buf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_TLS;
+	cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+	*CMSG_DATA(cmsg) = SSL3_RT_ALERT;
+
+	if (sendmsg(ssock->sock, &msg, MSG_DONTWAIT) != 2) {
+	    PJ_PERROR(4,(ssock->pool->obj_name, pj_get_netos_error(),
+			 "Error sending TLS alert"));
+	    break;
+	}
+    }
+
+    ssock->ktls_alert_len = 0;
+}
+#endif	/* USE_KTLS */
+
+
 /* When handshake completed:
  * - notify application
  * - if handshake failed, reset SSL state
@@ -969,9 +1452,57 @@ static pj_bool_t on_handshake_complete(pj_ssl_sock_t *ssock,
 	ssock->timer.id = TIMER_NONE;
     }
 
-    /* Update certificates info on successful handshake */
-    if (status == PJ_SUCCESS)
+    /* Update handshake statistics */
+    pj_enter_critical_section();
+    if (status != PJ_SUCCESS) {
+	++handshake_stat.failed;
+    } else if (SSL_session_reused(ssock->ossl_ssl)) {
+	if (ssock->is_server)
+	    ++handshake_stat.server_resumed;
+	else
+	    ++handshake_stat.client_resumed;
+    } else {
+	if (ssock->is_server)
+	    ++handshake_stat.server_full;
+	else
+	    ++handshake_stat.client_full;
+    }
+    pj_leave_critical_section();
+
+    if (status == PJ_SUCCESS) {
+	SSL *ssl = ssock->ossl_ssl;
+
+	if (SSL_session_reused(ssl)) {
+	    /* Certificates are not verified again on a resumed session,
+	     * get the verification result of the original handshake.
+	     */
+	    ssock->verify_status |= get_verify_status(
+					    SSL_get_verify_result(ssl));
+	} else if (ssock->verify_status != PJ_SSL_CERT_ESUCCESS) {
+	    /* Don't let the session of a peer which failed verification
+	     * be resumed from the server session cache.
+	     */
+	    SSL_CTX_remove_session(SSL_get_SSL_CTX(ssl),
+				   SSL_get_session(ssl));
+	}
+
+	/* Update certificates info on successful handshake */
 	update_certs_info(ssock);
+    }
+
+#if USE_KTLS
+    /* Offload encryption to the kernel */
+    if (status == PJ_SUCCESS && ssock->param.ktls) {
+	pj_status_t ktls_status = ktls_start_tx(ssock);
+	if (ktls_status != PJ_SUCCESS) {
+	    char errmsg[PJ_ERR_MSG_SIZE];
+
+	    pj_strerror(ktls_status, errmsg, sizeof(errmsg));
+	    PJ_LOG(5,(ssock->pool->obj_name, "kTLS is not used: %s",
+		      errmsg));
+	}
+    }
+#endif
 
     /* Accepting */
     if (ssock->is_server) {
@@ -1244,6 +1775,21 @@ static pj_status_t flush_write_bio(pj_ssl_sock_t *ssock,
 	return PJ_SUCCESS;
     }
 
+#if USE_KTLS
+    /* Records encrypted by OpenSSL, e.g: alerts, cannot be sent once the
+     * kernel does the encryption, send the alerts via the kernel instead.
+     * Keep them after any data being sent, they'll be sent when the send
+     * completes.
+     */
+    if (ssock->ktls_tx) {
+	(void)BIO_reset(ssock->ossl_wbio);
+	if (ssock->send_buf.len == 0)
+	    ktls_send_alerts(ssock);
+	pj_lock_release(ssock->write_mutex);
+	return PJ_SUCCESS;
+    }
+#endif
+
     /* Get data and its length */
     len = BIO_get_mem_data(ssock->ossl_wbio, &data);
     if (len == 0) {
@@ -1561,6 +2107,11 @@ static pj_bool_t asock_on_data_sent (pj_activesock_t *asock,
 	/* Update write buffer state */
 	pj_lock_acquire(ssock->write_mutex);
 	free_send_data(ssock, wdata);
+#if USE_KTLS
+	/* Send alerts held back by the data */
+	if (ssock->ktls_alert_len && ssock->send_buf.len == 0)
+	    ktls_send_alerts(ssock);
+#endif
 	pj_lock_release(ssock->write_mutex);
 
     } else {
@@ -2051,6 +2602,12 @@ PJ_DEF(pj_status_t) pj_ssl_sock_get_info (pj_ssl_sock_t *ssock,
 
 	/* Verification status */
 	info->verify_status = ssock->verify_status;
+
+	/* Session resumption */
+	info->sess_reused = (SSL_session_reused(ssock->ossl_ssl) != 0);
+
+	/* Kernel TLS offload */
+	info->ktls_tx = ssock->ktls_tx;
     }
 
     /* Last known OpenSSL error code */
@@ -2165,6 +2722,52 @@ PJ_DEF(pj_status_t) pj_ssl_sock_start_recvfrom2 (pj_ssl_sock_t *ssock,
     return PJ_ENOTSUP;
 }
 
+#if USE_KTLS
+/* Send plain data directly to the socket, the kernel encrypts it. */
+static pj_status_t ktls_write(pj_ssl_sock_t *ssock, 
+			      pj_ioqueue_op_key_t *send_key,
+			      const void *data,
+			      pj_ssize_t size,
+			      unsigned flags)
+{
+    write_data_t *wdata;
+    pj_ssize_t len = size;
+    pj_size_t needed_len;
+    pj_status_t status;
+
+    /* Only the send data header goes to the send buffer */
+    needed_len = ((sizeof(write_data_t) + 7) >> 3) << 3;
+
+    pj_lock_acquire(ssock->write_mutex);
+    wdata = alloc_send_data(ssock, needed_len);
+    if (wdata == NULL) {
+	pj_lock_release(ssock->write_mutex);
+	return PJ_ENOMEM;
+    }
+
+    pj_ioqueue_op_key_init(&wdata->key, sizeof(pj_ioqueue_op_key_t));
+    wdata->key.user_data = wdata;
+    wdata->app_key = send_key;
+    wdata->record_len = needed_len;
+    wdata->data_len = size;
+    wdata->plain_data_len = size;
+    wdata->flags = flags;
+    wdata->data.ptr = (const char*)data;
+    pj_lock_release(ssock->write_mutex);
+
+    status = pj_activesock_send(ssock->asock, &wdata->key, data, &len,
+				flags);
+    if (status != PJ_EPENDING) {
+	pj_lock_acquire(ssock->write_mutex);
+	free_send_data(ssock, wdata);
+	pj_lock_release(ssock->write_mutex);
+    }
+
+    return status;
+}
+#endif	/* USE_KTLS */
+
+
 /* Write plain data to SSL and flush write BIO. */
 static pj_status_t ssl_write(pj_ssl_sock_t *ssock, 
 			     pj_ioqueue_op_key_t *send_key,
@@ -2175,6 +2778,11 @@ static pj_status_t ssl_write(pj_ssl_sock_t *ssock,
     pj_status_t status;
     int nwritten;
 
+#if USE_KTLS
+    if (ssock->ktls_tx)
+	return ktls_write(ssock, send_key, data, size, flags);
+#endif
+
     /* Write the plain data to SSL, after SSL encrypts it, write BIO will
      * contain the secured data to be sent via socket. Note that re-
      * negotitation may be on progress, so sending data should be delayed
@@ -2407,6 +3015,17 @@ PJ_DEF(pj_status_t) pj_ssl_sock_start_accept (pj_ssl_sock_t *ssock,
     if (status != PJ_SUCCESS)
 	goto on_error;
 
+    ssock->is_server = PJ_TRUE;
+
+    /* Create the SSL context to be shared by accepted connections, so
+     * their sessions can be resumed.
+     */
+    if (ssock->param.sess_cache_size) {
+	status = create_ssl_ctx(ssock, &ssock->ossl_ctx);
+	if (status != PJ_SUCCESS)
+	    goto on_error;
+    }
+
     /* Create active socket */
     pj_activesock_cfg_default(&asock_cfg);
     asock_cfg.async_cnt = ssock->param.async_cnt;
@@ -2440,8 +3059,6 @@ PJ_DEF(pj_status_t) pj_ssl_sock_start_accept (pj_ssl_sock_t *ssock,
     if (status != PJ_SUCCESS)
 	pj_sockaddr_cp(&ssock->local_addr, localaddr);
 
-    ssock->is_server = PJ_TRUE;
-
     return PJ_SUCCESS;
 
 on_error:
@@ -2561,6 +3178,10 @@ PJ_DEF(pj_status_t) pj_ssl_sock_renegotiate(pj_ssl_sock_t *ssock)
 
     PJ_ASSERT_RETURN(ssock->ssl_state == SSL_STATE_ESTABLISHED, PJ_EINVALIDOP);
 
+    /* The kernel owns the write key of offloaded connections */
+    if (ssock->ktls_tx)
+	return PJ_EINVALIDOP;
+
     if (SSL_renegotiate_pending(ssock->ossl_ssl))
 	return PJ_EPENDING;
 
@@ -2574,5 +3195,21 @@ PJ_DEF(pj_status_t) pj_ssl_sock_renegotiate(pj_ssl_sock_t *ssock)
     return status;
 }
 
+
+/*
+ * Get handshake statistics.
+ */
+PJ_DEF(pj_status_t) pj_ssl_sock_get_handshake_stat(
+					pj_ssl_sock_handshake_stat *stat)
+{
+    PJ_ASSERT_RETURN(stat, PJ_EINVAL);
+
+    pj_enter_critical_section();
+    pj_memcpy(stat, &handshake_stat, sizeof(*stat));
+    pj_leave_critical_section();
+
+    return PJ_SUCCESS;
+}
+
 #endif  /* PJ_HAS_SSL_SOCK */
 
@@ -1424,3 +1424,12 @@ PJ_DEF(pj_status_t) pj_ssl_sock_renegotiate(pj_ssl_sock_t *ssock)
     PJ_UNUSED_ARG(ssock);
     return PJ_ENOTSUP;
 }
+
+
+PJ_DEF(pj_status_t) pj_ssl_sock_get_handshake_stat(
+					pj_ssl_sock_handshake_stat *stat)
+{
+    PJ_ASSERT_RETURN(stat, PJ_EINVAL);
+    pj_bzero(stat, sizeof(*stat));
+    return PJ_ENOTSUP;
+}
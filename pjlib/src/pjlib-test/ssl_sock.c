@@ -82,6 +82,8 @@ struct test_state
     pj_bool_t	    check_echo;	    /* flag to compare sent & echoed data   */
     const char	   *check_echo_ptr; /* pointer/cursor for comparing data    */
     struct send_key send_key;	    /* send op key			    */
+    pj_uint32_t	    verify_status;  /* peer cert verification status	    */
+    pj_bool_t	    ktls_tx;	    /* sent data encrypted by the kernel    */
 };
 
 static void dump_ssl_info(const pj_ssl_sock_info *si)
@@ -94,6 +96,9 @@ static void dump_ssl_info(const pj_ssl_sock_info *si)
 	tmp_st = "[Unknown]";
     PJ_LOG(3, ("", ".....Cipher: %s", tmp_st));
 
+    if (si->ktls_tx)
+	PJ_LOG(3, ("", ".....Sent data encrypted by kernel (kTLS)"));
+
     /* Print remote certificate info and verification result */
     if (si->remote_cert_info && si->remote_cert_info->subject.info.slen) 
     {
@@ -145,6 +150,9 @@ static pj_bool_t ssl_on_connect_complete(pj_ssl_sock_t *ssock,
     pj_sockaddr_print((pj_sockaddr_t*)&info.remote_addr, buf2, sizeof(buf2), 1);
     PJ_LOG(3, ("", "...Connected %s -> %s!", buf1, buf2));
 
+    st->verify_status = info.verify_status;
+    st->ktls_tx = info.ktls_tx;
+
     if (st->is_verbose)
 	dump_ssl_info(&info);
 
@@ -216,6 +224,11 @@ static pj_bool_t ssl_on_accept_complete(pj_ssl_sock_t *ssock,
     pj_sockaddr_print(src_addr, buf, sizeof(buf), 1);
     PJ_LOG(3, ("", "...Accepted connection from %s", buf));
 
+    st->verify_status = info.verify_status;
+    st->ktls_tx = info.ktls_tx;
+    parent_st->verify_status |= info.verify_status;
+    parent_st->ktls_tx |= info.ktls_tx;
+
     if (st->is_verbose)
 	dump_ssl_info(&info);
 
@@ -416,12 +429,12 @@ static int https_client_test(unsigned ms_timeout)
 
     pool = pj_pool_create(mem, "https_get", 256, 256, NULL);
 
-    status = pj_ioqueue_create(pool, 4, &ioqueue);
+    status = pj_ioqueue_create(pool, PJ_IOQUEUE_MAX_HANDLES, &ioqueue);
     if (status != PJ_SUCCESS) {
 	goto on_return;
     }
 
-    status = pj_timer_heap_create(pool, 4, &timer);
+    status = pj_timer_heap_create(pool, PJ_IOQUEUE_MAX_HANDLES, &timer);
     if (status != PJ_SUCCESS) {
 	goto on_return;
     }
@@ -493,9 +506,47 @@ on_return:
 }
 
 
+#if PJ_SSL_SOCK_HAS_KTLS
+/* Check if the kernel supports TLS, by attaching the "tls" TCP upper
+ * layer protocol (TCP_ULP) to a connected socket.
+ */
+static pj_bool_t ktls_available(void)
+{
+    pj_sock_t lsock = PJ_INVALID_SOCKET;
+    pj_sock_t csock = PJ_INVALID_SOCKET;
+    pj_sockaddr_in addr;
+    int addr_len = sizeof(addr);
+    pj_str_t tmp_st;
+    pj_bool_t avail = PJ_FALSE;
+
+    pj_sockaddr_in_init(&addr, pj_strset2(&tmp_st, "127.0.0.1"), 0);
+    if (pj_sock_socket(pj_AF_INET(), pj_SOCK_STREAM(), 0,
+		       &lsock) == PJ_SUCCESS &&
+	pj_sock_bind(lsock, &addr, addr_len) == PJ_SUCCESS &&
+	pj_sock_listen(lsock, 1) == PJ_SUCCESS &&
+	pj_sock_getsockname(lsock, &addr, &addr_len) == PJ_SUCCESS &&
+	pj_sock_socket(pj_AF_INET(), pj_SOCK_STREAM(), 0,
+		       &csock) == PJ_SUCCESS &&
+	pj_sock_connect(csock, &addr, addr_len) == PJ_SUCCESS)
+    {
+	avail = (pj_sock_setsockopt(csock, pj_SOL_TCP(), 31 /* TCP_ULP */,
+				    "tls", 4) == PJ_SUCCESS);
+    }
+
+    if (csock != PJ_INVALID_SOCKET)
+	pj_sock_close(csock);
+    if (lsock != PJ_INVALID_SOCKET)
+	pj_sock_close(lsock);
+
+    return avail;
+}
+#endif
+
+
 static int echo_test(pj_ssl_sock_proto srv_proto, pj_ssl_sock_proto cli_proto,
 		     pj_ssl_cipher srv_cipher, pj_ssl_cipher cli_cipher,
-		     pj_bool_t req_client_cert, pj_bool_t client_provide_cert)
+		     pj_bool_t req_client_cert, pj_bool_t client_provide_cert,
+		     pj_bool_t ktls)
 {
     pj_pool_t *pool = NULL;
     pj_ioqueue_t *ioqueue = NULL;
@@ -511,7 +562,7 @@ static int echo_test(pj_ssl_sock_proto srv_proto, pj_ssl_sock_proto cli_proto,
 
     pool = pj_pool_create(mem, "ssl_echo", 256, 256, NULL);
 
-    status = pj_ioqueue_create(pool, 4, &ioqueue);
+    status = pj_ioqueue_create(pool, PJ_IOQUEUE_MAX_HANDLES, &ioqueue);
     if (status != PJ_SUCCESS) {
 	goto on_return;
     }
@@ -523,6 +574,7 @@ static int echo_test(pj_ssl_sock_proto srv_proto, pj_ssl_sock_proto cli_proto,
     param.cb.on_data_sent = &ssl_on_data_sent;
     param.ioqueue = ioqueue;
     param.ciphers = ciphers;
+    param.ktls = ktls;
 
     /* Init default bind address */
     {
@@ -669,6 +721,18 @@ static int echo_test(pj_ssl_sock_proto srv_proto, pj_ssl_sock_proto cli_proto,
     PJ_LOG(3, ("", "...Done!"));
     PJ_LOG(3, ("", ".....Sent/recv: %d/%d bytes", state_cli.sent, state_cli.recv));
 
+#if PJ_SSL_SOCK_HAS_KTLS
+    /* Both sides must have offloaded the encryption */
+    if (ktls && !(state_cli.ktls_tx && state_serv.ktls_tx)) {
+	if (ktls_available()) {
+	    PJ_LOG(3, ("", "...ERROR: kTLS is not used"));
+	    status = PJ_EBUG;
+	} else {
+	    PJ_LOG(3, ("", "...kTLS is not supported by the kernel"));
+	}
+    }
+#endif
+
 on_return:
     if (ssock_serv)
 	pj_ssl_sock_close(ssock_serv);
@@ -812,12 +876,12 @@ static int client_non_ssl(unsigned ms_timeout)
 
     pool = pj_pool_create(mem, "ssl_accept_raw_tcp", 256, 256, NULL);
 
-    status = pj_ioqueue_create(pool, 4, &ioqueue);
+    status = pj_ioqueue_create(pool, PJ_IOQUEUE_MAX_HANDLES, &ioqueue);
     if (status != PJ_SUCCESS) {
 	goto on_return;
     }
 
-    status = pj_timer_heap_create(pool, 4, &timer);
+    status = pj_timer_heap_create(pool, PJ_IOQUEUE_MAX_HANDLES, &timer);
     if (status != PJ_SUCCESS) {
 	goto on_return;
     }
@@ -968,12 +1032,12 @@ static int server_non_ssl(unsigned ms_timeout)
 
     pool = pj_pool_create(mem, "ssl_connect_raw_tcp", 256, 256, NULL);
 
-    status = pj_ioqueue_create(pool, 4, &ioqueue);
+    status = pj_ioqueue_create(pool, PJ_IOQUEUE_MAX_HANDLES, &ioqueue);
     if (status != PJ_SUCCESS) {
 	goto on_return;
     }
 
-    status = pj_timer_heap_create(pool, 4, &timer);
+    status = pj_timer_heap_create(pool, PJ_IOQUEUE_MAX_HANDLES, &timer);
     if (status != PJ_SUCCESS) {
 	goto on_return;
     }
@@ -1330,6 +1394,219 @@ on_return:
     return status;
 }
 
+/* Connect to the same listener several times, all but the first
+ * connection should resume the session established earlier. When the
+ * client (cli_untrusted) or the server (srv_untrusted) can't verify its
+ * peer certificate, the session must not be resumed and every connection
+ * must report the verification failure.
+ */
+static int sess_resumption_test(unsigned connects,
+				pj_bool_t cli_untrusted,
+				pj_bool_t srv_untrusted)
+{
+    pj_pool_t *pool = NULL;
+    pj_ioqueue_t *ioqueue = NULL;
+    pj_timer_heap_t *timer = NULL;
+    pj_ssl_sock_t *ssock_serv = NULL;
+    pj_ssl_sock_param param;
+    struct test_state state_serv = { 0 };
+    pj_sockaddr addr, listen_addr;
+    pj_ssl_cert_t *cert = NULL;
+    pj_ssl_cert_t *cert_noca = NULL;
+    pj_ssl_sock_handshake_stat stat0, stat1;
+    unsigned expected_resumed;
+    pj_status_t status;
+    unsigned i;
+
+    pool = pj_pool_create(mem, "ssl_sess", 256, 256, NULL);
+
+    status = pj_ioqueue_create(pool, PJ_IOQUEUE_MAX_HANDLES, &ioqueue);
+    if (status != PJ_SUCCESS) {
+	goto on_return;
+    }
+
+    status = pj_timer_heap_create(pool, PJ_IOQUEUE_MAX_HANDLES, &timer);
+    if (status != PJ_SUCCESS) {
+	goto on_return;
+    }
+
+    /* Set cert */
+    {
+	pj_str_t tmp1, tmp2, tmp3, tmp4;
+
+	status = pj_ssl_cert_load_from_files(pool, 
+					     pj_strset2(&tmp1, (char*)CERT_CA_FILE), 
+					     pj_strset2(&tmp2, (char*)CERT_FILE), 
+					     pj_strset2(&tmp3, (char*)CERT_PRIVKEY_FILE), 
+					     pj_strset2(&tmp4, (char*)CERT_PRIVKEY_PASS), 
+					     &cert);
+	if (status != PJ_SUCCESS) {
+	    goto on_return;
+	}
+
+	/* Same certificate without any trusted CA */
+	status = pj_ssl_cert_load_from_files(pool, 
+					     pj_strset2(&tmp1, (char*)""), 
+					     &tmp2, &tmp3, &tmp4,
+					     &cert_noca);
+	if (status != PJ_SUCCESS) {
+	    goto on_return;
+	}
+    }
+
+    pj_ssl_sock_param_default(&param);
+    param.cb.on_accept_complete = &ssl_on_accept_complete;
+    param.cb.on_connect_complete = &ssl_on_connect_complete;
+    param.cb.on_data_read = &ssl_on_data_read;
+    param.cb.on_data_sent = &ssl_on_data_sent;
+    param.ioqueue = ioqueue;
+    param.timer_heap = timer;
+    /* Old protocol versions can't sign with the test certificate */
+    param.proto = PJ_SSL_SOCK_PROTO_SSL23;
+
+    /* Init default bind address */
+    {
+	pj_str_t tmp_st;
+	pj_sockaddr_init(PJ_AF_INET, &addr, pj_strset2(&tmp_st, "127.0.0.1"), 0);
+    }
+
+    /* SERVER */
+    param.user_data = &state_serv;
+
+    state_serv.pool = pool;
+    state_serv.echo = PJ_TRUE;
+    state_serv.is_server = PJ_TRUE;
+
+    status = pj_ssl_sock_create(pool, &param, &ssock_serv);
+    if (status != PJ_SUCCESS) {
+	goto on_return;
+    }
+
+    status = pj_ssl_sock_set_certificate(ssock_serv, pool,
+					 srv_untrusted? cert_noca : cert);
+    if (status != PJ_SUCCESS) {
+	goto on_return;
+    }
+
+    status = pj_ssl_sock_start_accept(ssock_serv, pool, &addr, pj_sockaddr_get_len(&addr));
+    if (status != PJ_SUCCESS) {
+	goto on_return;
+    }
+
+    /* Get listening address for clients to connect to */
+    {
+	pj_ssl_sock_info info;
+
+	pj_ssl_sock_get_info(ssock_serv, &info);
+	pj_sockaddr_cp(&listen_addr, &info.local_addr);
+    }
+
+    pj_ssl_sock_get_handshake_stat(&stat0);
+
+    /* CLIENTS, one at a time */
+    for (i = 0; i < connects; ++i) {
+	pj_ssl_sock_t *ssock_cli = NULL;
+	struct test_state state_cli = { 0 };
+	char send_str[] = "Hello again!";
+
+	param.user_data = &state_cli;
+	state_cli.pool = pool;
+	state_cli.check_echo = PJ_TRUE;
+	state_cli.send_str = send_str;
+	state_cli.send_str_len = sizeof(send_str);
+	state_serv.verify_status = 0;
+
+	clients_num = 1;
+
+	status = pj_ssl_sock_create(pool, &param, &ssock_cli);
+	if (status != PJ_SUCCESS) {
+	    goto on_return;
+	}
+
+	status = pj_ssl_sock_set_certificate(ssock_cli, pool,
+					     cli_untrusted? cert_noca : cert);
+	if (status != PJ_SUCCESS) {
+	    pj_ssl_sock_close(ssock_cli);
+	    goto on_return;
+	}
+
+	status = pj_ssl_sock_start_connect(ssock_cli, pool, &addr, &listen_addr, pj_sockaddr_get_len(&addr));
+	if (status == PJ_SUCCESS) {
+	    ssl_on_connect_complete(ssock_cli, PJ_SUCCESS);
+	} else if (status == PJ_EPENDING) {
+	    status = PJ_SUCCESS;
+	} else {
+	    pj_ssl_sock_close(ssock_cli);
+	    goto on_return;
+	}
+
+	/* Wait until echo has been received or error */
+	while (clients_num) {
+#ifdef PJ_SYMBIAN
+	    pj_symbianos_poll(-1, 1000);
+#else
+	    pj_time_val delay = {0, 100};
+	    pj_ioqueue_poll(ioqueue, &delay);
+	    pj_timer_heap_poll(timer, &delay);
+#endif
+	}
+
+	if (state_cli.err != PJ_SUCCESS) {
+	    status = state_cli.err;
+	    goto on_return;
+	}
+	if (state_serv.err != PJ_SUCCESS) {
+	    status = state_serv.err;
+	    goto on_return;
+	}
+
+	/* Verification failure must be reported on every connection,
+	 * including the resumed ones.
+	 */
+	if ((state_cli.verify_status != PJ_SSL_CERT_ESUCCESS) !=
+	    cli_untrusted ||
+	    (state_serv.verify_status != PJ_SSL_CERT_ESUCCESS) !=
+	    srv_untrusted)
+	{
+	    PJ_LOG(3, ("", "...ERROR: unexpected verification status, "
+			   "client 0x%x, server 0x%x",
+			   state_cli.verify_status,
+			   state_serv.verify_status));
+	    status = PJ_EBUG;
+	    goto on_return;
+	}
+    }
+
+    pj_ssl_sock_get_handshake_stat(&stat1);
+
+    PJ_LOG(3, ("", "...Handshakes: client %u full/%u resumed, "
+		   "server %u full/%u resumed",
+		   stat1.client_full - stat0.client_full,
+		   stat1.client_resumed - stat0.client_resumed,
+		   stat1.server_full - stat0.server_full,
+		   stat1.server_resumed - stat0.server_resumed));
+
+    expected_resumed = (cli_untrusted || srv_untrusted)? 0 : connects - 1;
+    if (stat1.client_resumed - stat0.client_resumed != expected_resumed ||
+	stat1.server_resumed - stat0.server_resumed != expected_resumed)
+    {
+	PJ_LOG(3, ("", "...ERROR: expecting %u resumed sessions",
+		   expected_resumed));
+	status = PJ_EBUG;
+    }
+
+on_return:
+    if (ssock_serv) 
+	pj_ssl_sock_close(ssock_serv);
+    if (ioqueue)
+	pj_ioqueue_destroy(ioqueue);
+    if (pool)
+	pj_pool_release(pool);
+
+    return status;
+}
+
+
 #if 0 && (!defined(PJ_SYMBIAN) || PJ_SYMBIAN==0)
 pj_status_t pj_ssl_sock_ossl_test_send_buf(pj_pool_t *pool);
 static int ossl_test_send_buf()
@@ -1379,42 +1656,49 @@ int ssl_sock_test(void)
     PJ_LOG(3,("", "..echo test w/ TLSv1 and PJ_TLS_RSA_WITH_DES_CBC_SHA cipher"));
     ret = echo_test(PJ_SSL_SOCK_PROTO_TLS1, PJ_SSL_SOCK_PROTO_TLS1, 
 		    PJ_TLS_RSA_WITH_DES_CBC_SHA, PJ_TLS_RSA_WITH_DES_CBC_SHA, 
-		    PJ_FALSE, PJ_FALSE);
+		    PJ_FALSE, PJ_FALSE, PJ_FALSE);
     if (ret != 0)
 	return ret;
 
     PJ_LOG(3,("", "..echo test w/ SSLv23 and PJ_TLS_RSA_WITH_AES_256_CBC_SHA cipher"));
     ret = echo_test(PJ_SSL_SOCK_PROTO_SSL23, PJ_SSL_SOCK_PROTO_SSL23, 
 		    PJ_TLS_RSA_WITH_AES_256_CBC_SHA, PJ_TLS_RSA_WITH_AES_256_CBC_SHA,
-		    PJ_FALSE, PJ_FALSE);
+		    PJ_FALSE, PJ_FALSE, PJ_FALSE);
+    if (ret != 0)
+	return ret;
+
+    PJ_LOG(3,("", "..echo test w/ default proto, PJ_TLS_RSA_WITH_AES_128_GCM_SHA256 cipher and kTLS"));
+    ret = echo_test(PJ_SSL_SOCK_PROTO_DEFAULT, PJ_SSL_SOCK_PROTO_DEFAULT, 
+		    PJ_TLS_RSA_WITH_AES_128_GCM_SHA256, PJ_TLS_RSA_WITH_AES_128_GCM_SHA256,
+		    PJ_FALSE, PJ_FALSE, PJ_TRUE);
     if (ret != 0)
 	return ret;
 
     PJ_LOG(3,("", "..echo test w/ incompatible proto"));
     ret = echo_test(PJ_SSL_SOCK_PROTO_TLS1, PJ_SSL_SOCK_PROTO_SSL3, 
 		    PJ_TLS_RSA_WITH_DES_CBC_SHA, PJ_TLS_RSA_WITH_DES_CBC_SHA,
-		    PJ_FALSE, PJ_FALSE);
+		    PJ_FALSE, PJ_FALSE, PJ_FALSE);
     if (ret == 0)
 	return PJ_EBUG;
 
     PJ_LOG(3,("", "..echo test w/ incompatible ciphers"));
     ret = echo_test(PJ_SSL_SOCK_PROTO_DEFAULT, PJ_SSL_SOCK_PROTO_DEFAULT, 
 		    PJ_TLS_RSA_WITH_DES_CBC_SHA, PJ_TLS_RSA_WITH_AES_256_CBC_SHA,
-		    PJ_FALSE, PJ_FALSE);
+		    PJ_FALSE, PJ_FALSE, PJ_FALSE);
     if (ret == 0)
 	return PJ_EBUG;
 
     PJ_LOG(3,("", "..echo test w/ client cert required but not provided"));
     ret = echo_test(PJ_SSL_SOCK_PROTO_DEFAULT, PJ_SSL_SOCK_PROTO_DEFAULT, 
 		    PJ_TLS_RSA_WITH_AES_256_CBC_SHA, PJ_TLS_RSA_WITH_AES_256_CBC_SHA,
-		    PJ_TRUE, PJ_FALSE);
+		    PJ_TRUE, PJ_FALSE, PJ_FALSE);
     if (ret == 0)
 	return PJ_EBUG;
 
     PJ_LOG(3,("", "..echo test w/ client cert required and provided"));
     ret = echo_test(PJ_SSL_SOCK_PROTO_DEFAULT, PJ_SSL_SOCK_PROTO_DEFAULT, 
 		    PJ_TLS_RSA_WITH_AES_256_CBC_SHA, PJ_TLS_RSA_WITH_AES_256_CBC_SHA,
-		    PJ_TRUE, PJ_TRUE);
+		    PJ_TRUE, PJ_TRUE, PJ_FALSE);
     if (ret != 0)
 	return ret;
 
@@ -1423,6 +1707,21 @@ int ssl_sock_test(void)
     if (ret != 0)
 	return ret;
 
+    PJ_LOG(3,("", "..session resumption test"));
+    ret = sess_resumption_test(3, PJ_FALSE, PJ_FALSE);
+    if (ret != 0)
+	return ret;
+
+    PJ_LOG(3,("", "..session resumption test, untrusted server"));
+    ret = sess_resumption_test(3, PJ_TRUE, PJ_FALSE);
+    if (ret != 0)
+	return ret;
+
+    PJ_LOG(3,("", "..session resumption test, untrusted client"));
+    ret = sess_resumption_test(3, PJ_FALSE, PJ_TRUE);
+    if (ret != 0)
+	return ret;
+
     PJ_LOG(3,("", "..client non-SSL (handshake timeout 5 secs)"));
     ret = client_non_ssl(5000);
     /* PJ_TIMEDOUT won't be returned as accepted socket is deleted silently */
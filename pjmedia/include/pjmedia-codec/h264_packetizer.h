@@ -88,6 +88,64 @@ typedef struct pjmedia_h264_packetizer_cfg
 pjmedia_h264_packetizer_cfg;
 
 
+/**
+ * Maximum number of NAL units aggregated into a single STAP-A payload.
+ */
+#define PJMEDIA_H264_MAX_NALS_IN_AGGR	32
+
+
+/**
+ * H.264 RTP payload descriptor, generated by #pjmedia_h264_packetize2().
+ * Instead of holding the payload itself, the descriptor holds the payload
+ * header octets and references to the NAL unit data in the (unmodified)
+ * picture bitstream, so the payload can be assembled with a single copy
+ * directly into its final destination, e.g: the RTP packet buffer, using
+ * #pjmedia_h264_write_payload().
+ *
+ * The payload is laid out as the header octets followed by the NAL unit
+ * data. For STAP-A payload, each NAL unit data is prefixed with its two
+ * octets size in network byte order.
+ */
+typedef struct pjmedia_h264_payload_desc
+{
+    /**
+     * Payload header octets, i.e: FU indicator and FU header for FU-A,
+     * or the STAP-A NAL unit header.
+     */
+    pj_uint8_t	hdr[2];
+
+    /**
+     * Number of valid octets in the header, zero for single NAL unit
+     * packet.
+     */
+    unsigned	hdr_len;
+
+    /**
+     * Specify whether the payload is an aggregation (STAP-A) packet.
+     */
+    pj_bool_t	aggr;
+
+    /**
+     * Number of NAL unit data references.
+     */
+    unsigned	nal_cnt;
+
+    /**
+     * NAL unit data references, pointing to the picture bitstream.
+     */
+    struct {
+	const pj_uint8_t *data;	/**< NAL unit data.			*/
+	pj_size_t	  len;	/**< NAL unit data length.		*/
+    } nal[PJMEDIA_H264_MAX_NALS_IN_AGGR];
+
+    /**
+     * Total payload length.
+     */
+    pj_size_t	payload_len;
+
+} pjmedia_h264_payload_desc;
+
+
 /**
  * Create H.264 packetizer.
  *
@@ -126,6 +184,54 @@ PJ_DECL(pj_status_t) pjmedia_h264_packetize(pjmedia_h264_packetizer *pktz,
                                             pj_size_t *payload_len);
 
 
+/**
+ * Generate an RTP payload descriptor from a H.264 picture bitstream. Unlike
+ * #pjmedia_h264_packetize(), the bitstream is not modified and no payload
+ * data is copied, the descriptor only refers to the bitstream, so the
+ * bitstream must remain valid until the payload is written. Note that
+ * the bitstream must be packetized sequentially, as the packetizer keeps
+ * the state of the NAL unit being fragmented.
+ *
+ * @param pktz		The packetizer.
+ * @param bits		The picture bitstream to be packetized.
+ * @param bits_len	The length of the bitstream.
+ * @param bits_pos	The bitstream offset to be packetized, upon return,
+ *			this will be updated to the offset of the next
+ *			payload.
+ * @param desc		The output payload descriptor.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjmedia_h264_packetize2(pjmedia_h264_packetizer *pktz,
+					     const pj_uint8_t *bits,
+					     pj_size_t bits_len,
+					     unsigned *bits_pos,
+					     pjmedia_h264_payload_desc *desc);
+
+
+/**
+ * Assemble the RTP payload described by a payload descriptor into the
+ * specified buffer, e.g: right after the RTP header in the outgoing RTP
+ * packet buffer. The buffer may overlap the bitstream as long as it does
+ * not start after the first NAL unit data, e.g: the payload may be
+ * assembled in place, as done by #pjmedia_h264_packetize().
+ *
+ * @param desc		The payload descriptor, as generated by
+ *			#pjmedia_h264_packetize2().
+ * @param buf		The destination buffer.
+ * @param buf_size	The destination buffer size.
+ * @param payload_len	Optional pointer to receive the payload length.
+ *
+ * @return		PJ_SUCCESS on success, or PJ_ETOOSMALL if the
+ *			buffer is too small for the payload.
+ */
+PJ_DECL(pj_status_t) pjmedia_h264_write_payload(
+				    const pjmedia_h264_payload_desc *desc,
+				    pj_uint8_t *buf,
+				    pj_size_t buf_size,
+				    pj_size_t *payload_len);
+
+
 /**
  * Append an RTP payload to an H.264 picture bitstream. Note that in case of
  * noticing packet lost, application should keep calling this function with
@@ -30,6 +30,8 @@ extern const pj_uint8_t pjmedia_linear2ulaw_tab[16384];
 extern const pj_uint8_t pjmedia_linear2alaw_tab[16384];
 extern const pj_int16_t pjmedia_ulaw2linear_tab[256];
 extern const pj_int16_t pjmedia_alaw2linear_tab[256];
+extern const pj_uint8_t pjmedia_alaw2ulaw_tab[256];
+extern const pj_uint8_t pjmedia_ulaw2alaw_tab[256];
 
 
 /**
@@ -75,7 +77,7 @@ extern const pj_int16_t pjmedia_alaw2linear_tab[256];
  * @return	    8-bit U-Law value.
  */
 #define pjmedia_alaw2ulaw(aval)		\
-	    pjmedia_linear2ulaw(pjmedia_alaw2linear(aval))
+	    pjmedia_alaw2ulaw_tab[aval]
 
 /**
  * Convert 8-bit U-Law value to 8-bit A-Law value.
@@ -84,7 +86,7 @@ extern const pj_int16_t pjmedia_alaw2linear_tab[256];
  * @return	    8-bit A-Law value.
  */
 #define pjmedia_ulaw2alaw(uval)		\
-	    pjmedia_linear2alaw(pjmedia_ulaw2linear(uval))
+	    pjmedia_ulaw2alaw_tab[uval]
 
 
 #else
@@ -140,72 +142,77 @@ PJ_DECL(unsigned char) pjmedia_ulaw2alaw(unsigned char uval);
 #endif
 
 /**
- * Encode 16-bit linear PCM data to 8-bit U-Law data.
+ * Encode 16-bit linear PCM data to 8-bit U-Law data. The block is
+ * processed with SIMD instructions when available (see
+ * PJMEDIA_HAS_ALAW_ULAW_SSE2).
  *
  * @param dst	    Destination buffer for 8-bit U-Law data.
  * @param src	    Source, 16-bit linear PCM data.
  * @param count	    Number of samples.
  */
-PJ_INLINE(void) pjmedia_ulaw_encode(pj_uint8_t *dst, const pj_int16_t *src, 
-				    pj_size_t count)
-{
-    const pj_int16_t *end = src + count;
-    
-    while (src < end) {
-	*dst++ = pjmedia_linear2ulaw(*src++);
-    }
-}
+PJ_DECL(void) pjmedia_ulaw_encode(pj_uint8_t *dst, const pj_int16_t *src, 
+				  pj_size_t count);
 
 /**
- * Encode 16-bit linear PCM data to 8-bit A-Law data.
+ * Encode 16-bit linear PCM data to 8-bit A-Law data. The block is
+ * processed with SIMD instructions when available (see
+ * PJMEDIA_HAS_ALAW_ULAW_SSE2).
  *
  * @param dst	    Destination buffer for 8-bit A-Law data.
  * @param src	    Source, 16-bit linear PCM data.
  * @param count	    Number of samples.
  */
-PJ_INLINE(void) pjmedia_alaw_encode(pj_uint8_t *dst, const pj_int16_t *src, 
-				    pj_size_t count)
-{
-    const pj_int16_t *end = src + count;
-    
-    while (src < end) {
-	*dst++ = pjmedia_linear2alaw(*src++);
-    }
-}
+PJ_DECL(void) pjmedia_alaw_encode(pj_uint8_t *dst, const pj_int16_t *src, 
+				  pj_size_t count);
 
 /**
- * Decode 8-bit U-Law data to 16-bit linear PCM data.
+ * Decode 8-bit U-Law data to 16-bit linear PCM data. The block is
+ * processed with SIMD instructions when available (see
+ * PJMEDIA_HAS_ALAW_ULAW_SSE2).
  *
  * @param dst	    Destination buffer for 16-bit PCM data.
  * @param src	    Source, 8-bit U-Law data.
  * @param len	    Encoded frame/source length in bytes.
  */
-PJ_INLINE(void) pjmedia_ulaw_decode(pj_int16_t *dst, const pj_uint8_t *src, 
-				    pj_size_t len)
-{
-    const pj_uint8_t *end = src + len;
-    
-    while (src < end) {
-	*dst++ = pjmedia_ulaw2linear(*src++);
-    }
-}
+PJ_DECL(void) pjmedia_ulaw_decode(pj_int16_t *dst, const pj_uint8_t *src, 
+				  pj_size_t len);
 
 /**
- * Decode 8-bit A-Law data to 16-bit linear PCM data.
+ * Decode 8-bit A-Law data to 16-bit linear PCM data. The block is
+ * processed with SIMD instructions when available (see
+ * PJMEDIA_HAS_ALAW_ULAW_SSE2).
  *
  * @param dst	    Destination buffer for 16-bit PCM data.
  * @param src	    Source, 8-bit A-Law data.
  * @param len	    Encoded frame/source length in bytes.
  */
-PJ_INLINE(void) pjmedia_alaw_decode(pj_int16_t *dst, const pj_uint8_t *src, 
-				    pj_size_t len)
-{
-    const pj_uint8_t *end = src + len;
-    
-    while (src < end) {
-	*dst++ = pjmedia_alaw2linear(*src++);
-    }
-}
+PJ_DECL(void) pjmedia_alaw_decode(pj_int16_t *dst, const pj_uint8_t *src, 
+				  pj_size_t len);
+
+/**
+ * Transcode 8-bit A-Law data to 8-bit U-Law data directly, without
+ * going through linear PCM. This is useful to relay G.711 audio between
+ * two legs which use different G.711 laws. The source and destination
+ * may be the same buffer.
+ *
+ * @param dst	    Destination buffer for 8-bit U-Law data.
+ * @param src	    Source, 8-bit A-Law data.
+ * @param len	    Number of bytes (samples).
+ */
+PJ_DECL(void) pjmedia_alaw_to_ulaw(pj_uint8_t *dst, const pj_uint8_t *src,
+				   pj_size_t len);
+
+/**
+ * Transcode 8-bit U-Law data to 8-bit A-Law data directly, without
+ * going through linear PCM. The source and destination may be the same
+ * buffer.
+ *
+ * @param dst	    Destination buffer for 8-bit A-Law data.
+ * @param src	    Source, 8-bit U-Law data.
+ * @param len	    Number of bytes (samples).
+ */
+PJ_DECL(void) pjmedia_ulaw_to_alaw(pj_uint8_t *dst, const pj_uint8_t *src,
+				   pj_size_t len);
 
 PJ_END_DECL
 
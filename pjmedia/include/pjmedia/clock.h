@@ -177,10 +177,74 @@ enum pjmedia_clock_options
     /**
      * Prevent the clock from setting it's thread to highest priority.
      */
-    PJMEDIA_CLOCK_NO_HIGHEST_PRIO = 2
+    PJMEDIA_CLOCK_NO_HIGHEST_PRIO = 2,
+
+    /**
+     * Sleep until the exact deadline of the next tick using an absolute
+     * high resolution timer (clock_nanosleep() with TIMER_ABSTIME), instead
+     * of sleeping in whole milliseconds. This option is ignored when
+     * #PJMEDIA_CLOCK_HAS_POSIX_RT is disabled.
+     */
+    PJMEDIA_CLOCK_HIGH_RES = 4,
+
+    /**
+     * Run the clock thread with the SCHED_FIFO real-time scheduling policy
+     * at its maximum priority. This usually requires elevated privileges;
+     * the clock continues with the default policy if it cannot be set.
+     * This option is ignored when #PJMEDIA_CLOCK_HAS_POSIX_RT is disabled.
+     */
+    PJMEDIA_CLOCK_REALTIME_PRIO = 8,
+
+    /**
+     * Don't create a thread for the clock, but let it be served by the
+     * shared clock threads (see #PJMEDIA_CLOCK_SHARED_THREAD_CNT) along
+     * with other shared clocks. The callbacks of all clocks which are
+     * served by the same thread are called one after another, so the
+     * callback must not block. This option cannot be combined with
+     * #PJMEDIA_CLOCK_NO_ASYNC, and the thread options
+     * (#PJMEDIA_CLOCK_HIGH_RES, #PJMEDIA_CLOCK_REALTIME_PRIO and
+     * #pjmedia_clock_set_cpu()) don't apply to shared clocks. A shared
+     * clock thread runs at the highest priority unless all of its clocks
+     * are created with #PJMEDIA_CLOCK_NO_HIGHEST_PRIO.
+     */
+    PJMEDIA_CLOCK_SHARED = 16
 };
 
 
+/**
+ * Number of buckets in the tick lateness histogram of #pjmedia_clock_stat.
+ * Bucket 0 counts ticks which are less than 100 usec late, bucket n (n > 0)
+ * counts ticks which are between (50 << n) and (100 << n) usec late, and
+ * the last bucket also counts all later ticks.
+ */
+#define PJMEDIA_CLOCK_LATE_HIST_CNT	10
+
+
+/**
+ * Media clock statistics, see #pjmedia_clock_get_stat(). The lateness of
+ * a tick is the time between its deadline and the time its callback is
+ * called.
+ */
+typedef struct pjmedia_clock_stat
+{
+    unsigned	    tick_cnt;	    /**< Number of ticks.		    */
+    unsigned	    missed_cnt;	    /**< Ticks which are at least one
+					 interval late, i.e. were run in
+					 a catch up burst.		    */
+    unsigned	    resync_cnt;	    /**< Number of times the clock has
+					 given up catching up and dropped
+					 ticks to resynchronize.	    */
+    unsigned	    max_burst;	    /**< Longest run of ticks called back
+					 to back without sleeping.	    */
+    unsigned	    max_late_usec;  /**< Maximum lateness, in usec.	    */
+    pj_uint64_t	    total_late_usec;/**< Total lateness, in usec.	    */
+
+    /** Histogram of tick lateness, see #PJMEDIA_CLOCK_LATE_HIST_CNT. */
+    unsigned	    late_hist[PJMEDIA_CLOCK_LATE_HIST_CNT];
+
+} pjmedia_clock_stat;
+
+
 typedef struct pjmedia_clock_param
 {
     /**
@@ -267,7 +331,7 @@ PJ_DECL(pj_status_t) pjmedia_clock_create2(pj_pool_t *pool,
  *
  * @param clock		    The media clock.
  *
- * @return		    PJ_SUCCES on success.
+ * @return		    PJ_SUCCESS on success.
  */
 PJ_DECL(pj_status_t) pjmedia_clock_start(pjmedia_clock *clock);
 
@@ -277,7 +341,7 @@ PJ_DECL(pj_status_t) pjmedia_clock_start(pjmedia_clock *clock);
  *
  * @param clock		    The media clock.
  *
- * @return		    PJ_SUCCES on success.
+ * @return		    PJ_SUCCESS on success.
  */
 PJ_DECL(pj_status_t) pjmedia_clock_stop(pjmedia_clock *clock);
 
@@ -287,7 +351,7 @@ PJ_DECL(pj_status_t) pjmedia_clock_stop(pjmedia_clock *clock);
  *
  * @param clock		    The media clock.
  * @param param	            The clock's new parameter.
- * @return		    PJ_SUCCES on success.
+ * @return		    PJ_SUCCESS on success.
  */
 PJ_DECL(pj_status_t) pjmedia_clock_modify(pjmedia_clock *clock,
                                           const pjmedia_clock_param *param);
@@ -313,12 +377,51 @@ PJ_DECL(pj_bool_t) pjmedia_clock_wait(pjmedia_clock *clock,
 				      pj_timestamp *ts);
 
 
+/**
+ * Pin the clock thread to the specified CPU. The setting is applied when
+ * the clock thread is started, so this should be called before
+ * #pjmedia_clock_start().
+ *
+ * @param clock		    The media clock.
+ * @param cpu		    The CPU index, or -1 to not pin the thread.
+ *
+ * @return		    PJ_SUCCESS on success, PJ_EINVALIDOP for shared
+ *			    clock, or PJ_ENOTSUP if
+ *			    #PJMEDIA_CLOCK_HAS_POSIX_RT is disabled.
+ */
+PJ_DECL(pj_status_t) pjmedia_clock_set_cpu(pjmedia_clock *clock, int cpu);
+
+
+/**
+ * Get the clock statistics. The statistics are updated by the clock
+ * without locking, so they may be slightly inconsistent when read while
+ * the clock is running.
+ *
+ * @param clock		    The media clock.
+ * @param stat		    Pointer to receive the statistics.
+ *
+ * @return		    PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjmedia_clock_get_stat(const pjmedia_clock *clock,
+					    pjmedia_clock_stat *stat);
+
+
+/**
+ * Reset the clock statistics.
+ *
+ * @param clock		    The media clock.
+ *
+ * @return		    PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjmedia_clock_reset_stat(pjmedia_clock *clock);
+
+
 /**
  * Destroy the clock.
  *
  * @param clock		    The media clock.
  *
- * @return		    PJ_SUCCES on success.
+ * @return		    PJ_SUCCESS on success.
  */
 PJ_DECL(pj_status_t) pjmedia_clock_destroy(pjmedia_clock *clock);
 
@@ -231,6 +231,45 @@
 #endif
 
 
+/**
+ * Specify the step of the coarse pass of WSOLA similarity search, in
+ * samples, when PJMEDIA_WSOLA_COARSE_SEARCH option is used.
+ *
+ * Default: 4
+ */
+#ifndef PJMEDIA_WSOLA_COARSE_STEP
+#   define PJMEDIA_WSOLA_COARSE_STEP	    4
+#endif
+
+
+/**
+ * Set this to non-zero to make the PLC use coarse-to-fine similarity
+ * search (see PJMEDIA_WSOLA_COARSE_SEARCH), to reduce the CPU spike when
+ * many streams are concealing lost packets at the same time.
+ *
+ * Default: 0
+ */
+#ifndef PJMEDIA_WSOLA_PLC_COARSE_SEARCH
+#   define PJMEDIA_WSOLA_PLC_COARSE_SEARCH  0
+#endif
+
+
+/**
+ * Use SSE2 instructions for the WSOLA similarity search. This only takes
+ * effect in the floating point WSOLA implementation.
+ *
+ * Default: enabled when the compiler targets SSE2 (e.g. all x86-64 builds)
+ */
+#ifndef PJMEDIA_WSOLA_SSE2
+#   if defined(__SSE2__) || defined(_M_X64) || \
+       (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define PJMEDIA_WSOLA_SSE2	    1
+#   else
+#	define PJMEDIA_WSOLA_SSE2	    0
+#   endif
+#endif
+
+
 /**
  * Limit the number of calls by stream to the PLC to generate synthetic
  * frames to this duration. If packets are still lost after this maximum
@@ -276,6 +315,24 @@
 #endif
 
 
+/**
+ * Use SSE2 instructions to encode and decode blocks of G.711 A-law and
+ * U-law samples (see #pjmedia_alaw_encode() and friends). The results
+ * are identical to the conversion tables, so this only takes effect when
+ * PJMEDIA_HAS_ALAW_ULAW_TABLE is enabled.
+ *
+ * Default: enabled when the compiler targets SSE2 (e.g. all x86-64 builds)
+ */
+#ifndef PJMEDIA_HAS_ALAW_ULAW_SSE2
+#   if defined(__SSE2__) || defined(_M_X64) || \
+       (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define PJMEDIA_HAS_ALAW_ULAW_SSE2   1
+#   else
+#	define PJMEDIA_HAS_ALAW_ULAW_SSE2   0
+#   endif
+#endif
+
+
 /**
  * Unless specified otherwise, G711 codec is included by default.
  */
@@ -341,6 +398,9 @@
 						     using libsamplerate 
 						     (a.k.a Secret Rabbit Code)
 						 */
+#define PJMEDIA_RESAMPLE_POLYPHASE	    5	/**< Sample rate conversion 
+						     using built-in polyphase
+						     filter bank.	    */
 
 /**
  * Select which resample implementation to use. Currently pjmedia supports:
@@ -350,6 +410,10 @@
  *    (a.k.a. Secret Rabbit Code).
  *  - #PJMEDIA_RESAMPLE_SPEEX, to use experimental sample rate conversion in
  *    Speex library.
+ *  - #PJMEDIA_RESAMPLE_POLYPHASE, to use the built-in rational polyphase
+ *    resampler with precomputed filter banks (and SIMD filter loop, see
+ *    #PJMEDIA_RESAMPLE_POLYPHASE_SSE2). It needs no third party library,
+ *    and supports conversion ratios up to 1024/N (all common rates).
  *  - #PJMEDIA_RESAMPLE_NONE, to disable sample rate conversion. Any calls to
  *    resample function will return error.
  *
@@ -360,6 +424,22 @@
 #endif
 
 
+/**
+ * Use SSE2 instructions for the filter loop of the polyphase resampler
+ * (#PJMEDIA_RESAMPLE_POLYPHASE).
+ *
+ * Default: enabled when the compiler targets SSE2 (e.g. all x86-64 builds)
+ */
+#ifndef PJMEDIA_RESAMPLE_POLYPHASE_SSE2
+#   if defined(__SSE2__) || defined(_M_X64) || \
+       (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define PJMEDIA_RESAMPLE_POLYPHASE_SSE2	1
+#   else
+#	define PJMEDIA_RESAMPLE_POLYPHASE_SSE2	0
+#   endif
+#endif
+
+
 /**
  * Specify whether libsamplerate, when used, should be linked statically
  * into the application. This option is only useful for Visual Studio
@@ -375,6 +455,65 @@
 #endif
 
 
+/**
+ * Specify whether the media clock may use the POSIX real-time facilities
+ * (clock_nanosleep(), SCHED_FIFO and thread CPU affinity) for
+ * #PJMEDIA_CLOCK_HIGH_RES, #PJMEDIA_CLOCK_REALTIME_PRIO and
+ * #pjmedia_clock_set_cpu().
+ *
+ * Default: 1 on Linux, 0 otherwise.
+ */
+#ifndef PJMEDIA_CLOCK_HAS_POSIX_RT
+#   if defined(PJ_LINUX) && PJ_LINUX!=0
+#	define PJMEDIA_CLOCK_HAS_POSIX_RT	1
+#   else
+#	define PJMEDIA_CLOCK_HAS_POSIX_RT	0
+#   endif
+#endif
+
+
+/**
+ * Number of threads which serve the media clocks created with
+ * #PJMEDIA_CLOCK_SHARED option. The threads are started on demand, and
+ * each new shared clock is assigned to the thread with the least clocks.
+ *
+ * Default: 4
+ */
+#ifndef PJMEDIA_CLOCK_SHARED_THREAD_CNT
+#   define PJMEDIA_CLOCK_SHARED_THREAD_CNT	4
+#endif
+
+
+/**
+ * Specify whether master ports should use shared media clock (see
+ * #PJMEDIA_CLOCK_SHARED) instead of creating a clock thread for every
+ * master port. Master ports which are created with #PJMEDIA_CLOCK_NO_ASYNC,
+ * #PJMEDIA_CLOCK_HIGH_RES or #PJMEDIA_CLOCK_REALTIME_PRIO option always use
+ * their own clock thread. The shared clock threads always use the high
+ * resolution timer when it is available.
+ *
+ * Default: 1 (yes)
+ */
+#ifndef PJMEDIA_MASTER_PORT_SHARED_CLOCK
+#   define PJMEDIA_MASTER_PORT_SHARED_CLOCK	1
+#endif
+
+
+/**
+ * Specify whether media ports should record the time spent in every
+ * #pjmedia_port_get_frame() and #pjmedia_port_put_frame() call, so that
+ * the cost of each stage of the media flow can be inspected with
+ * #pjmedia_port_get_prof() and #pjmedia_port_dump_prof() (pjsua prints
+ * these in pjsua_dump()). Enabling this adds two timestamp readings to
+ * every frame operation.
+ *
+ * Default: 0 (no).
+ */
+#ifndef PJMEDIA_PORT_HAS_PROFILING
+#   define PJMEDIA_PORT_HAS_PROFILING		0
+#endif
+
+
 /**
  * Maximum frame duration (in msec) to be supported.
  * This (among other thing) will affect the size of buffers to be allocated
@@ -635,6 +774,34 @@
 #endif
 
 
+/**
+ * Number of frames to be processed at once by the echo canceller backend
+ * when the echo canceller runs on a worker thread (see
+ * PJMEDIA_ECHO_USE_WORKER). Larger batch uses larger FFT blocks, which
+ * reduces the processing cost per frame, at the expense of latency.
+ * It can be set per echo canceller with PJMEDIA_ECHO_WORKER_BATCH_OPTION().
+ *
+ * Default: 1
+ */
+#ifndef PJMEDIA_ECHO_WORKER_BATCH
+#   define PJMEDIA_ECHO_WORKER_BATCH		1
+#endif
+
+
+/**
+ * Latency budget of the echo canceller worker thread (see
+ * PJMEDIA_ECHO_USE_WORKER), in frames. The captured signal is delayed by
+ * this many frames, and frames which have not been processed by then are
+ * returned unprocessed. The value must be at least
+ * PJMEDIA_ECHO_WORKER_BATCH.
+ *
+ * Default: 2
+ */
+#ifndef PJMEDIA_ECHO_WORKER_DELAY
+#   define PJMEDIA_ECHO_WORKER_DELAY		2
+#endif
+
+
 /**
  * Maximum number of parameters in SDP fmtp attribute.
  *
@@ -1218,6 +1385,31 @@
 #endif
 
 
+/**
+ * Default value of the async_enc setting of video stream info. When it is
+ * enabled, the video stream encodes and sends the pictures in a dedicated
+ * thread instead of in the thread calling the stream port put_frame()
+ * (normally the video port clock or capture thread). If the encoder falls
+ * behind, the oldest pending picture is dropped.
+ *
+ * Default: 0
+ */
+#ifndef PJMEDIA_VID_STREAM_ASYNC_ENCODE
+#   define PJMEDIA_VID_STREAM_ASYNC_ENCODE			0
+#endif
+
+
+/**
+ * Number of pictures that can be queued for encoding when the video stream
+ * encodes asynchronously (see PJMEDIA_VID_STREAM_ASYNC_ENCODE).
+ *
+ * Default: 2
+ */
+#ifndef PJMEDIA_VID_STREAM_ENC_QUEUE_LEN
+#   define PJMEDIA_VID_STREAM_ENC_QUEUE_LEN			2
+#endif
+
+
 /**
  * Maximum video payload size. Note that this must not be greater than
  * PJMEDIA_MAX_MTU.
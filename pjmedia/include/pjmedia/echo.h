@@ -101,11 +101,94 @@ typedef enum pjmedia_echo_flag
      * If PJMEDIA_ECHO_USE_SW_ECHO flag is specified, software echo canceller
      * will be used instead of device EC.
      */
-    PJMEDIA_ECHO_USE_SW_ECHO = 64
+    PJMEDIA_ECHO_USE_SW_ECHO = 64,
+
+    /**
+     * If PJMEDIA_ECHO_USE_WORKER flag is specified, the echo cancellation
+     * will be performed by a dedicated worker thread instead of inside
+     * #pjmedia_echo_capture(), so that the sound device callback only
+     * needs to queue the frames. The processed signal is returned with
+     * a fixed delay of PJMEDIA_ECHO_WORKER_DELAY frames, and frames which
+     * are not processed within that budget are returned unprocessed.
+     * The backend processes PJMEDIA_ECHO_WORKER_BATCH frames at once,
+     * unless set otherwise with #PJMEDIA_ECHO_WORKER_BATCH_OPTION().
+     */
+    PJMEDIA_ECHO_USE_WORKER = 128,
+
+    /**
+     * Mask of the worker batch size field, see
+     * #PJMEDIA_ECHO_WORKER_BATCH_OPTION().
+     */
+    PJMEDIA_ECHO_WORKER_BATCH_MASK = 0xFF00
 
 } pjmedia_echo_flag;
 
 
+/**
+ * Bit position of the worker batch size field in the echo canceller
+ * options.
+ */
+#define PJMEDIA_ECHO_WORKER_BATCH_SHIFT	8
+
+/**
+ * Build the echo canceller option to set the number of frames processed
+ * at once by the backend when PJMEDIA_ECHO_USE_WORKER is specified, e.g:
+ * (PJMEDIA_ECHO_USE_WORKER | PJMEDIA_ECHO_WORKER_BATCH_OPTION(4)). The
+ * value must be between 1 and 255, zero (the default) uses
+ * PJMEDIA_ECHO_WORKER_BATCH. The output delay is increased to the batch
+ * size if it is larger than PJMEDIA_ECHO_WORKER_DELAY.
+ */
+#define PJMEDIA_ECHO_WORKER_BATCH_OPTION(batch) \
+	    (((unsigned)(batch) << PJMEDIA_ECHO_WORKER_BATCH_SHIFT) & \
+	     PJMEDIA_ECHO_WORKER_BATCH_MASK)
+
+
+/**
+ * Echo canceller processing statistic, see #pjmedia_echo_get_stat().
+ */
+typedef struct pjmedia_echo_stat
+{
+    /**
+     * Number of frames passed to #pjmedia_echo_capture().
+     */
+    unsigned	frame_cnt;
+
+    /**
+     * Number of frames processed by the echo canceller backend.
+     */
+    unsigned	proc_cnt;
+
+    /**
+     * Number of frames returned without echo cancellation because the
+     * worker could not process them within the latency budget (only
+     * with PJMEDIA_ECHO_USE_WORKER).
+     */
+    unsigned	miss_cnt;
+
+    /**
+     * Number of frames processed by the backend in one call.
+     */
+    unsigned	batch;
+
+    /**
+     * Additional delay of the processed signal, in frames (only with
+     * PJMEDIA_ECHO_USE_WORKER, otherwise zero).
+     */
+    unsigned	delay;
+
+    /**
+     * Average processing time per frame, in microseconds.
+     */
+    unsigned	avg_proc_usec;
+
+    /**
+     * Maximum processing time per frame, in microseconds.
+     */
+    unsigned	max_proc_usec;
+
+} pjmedia_echo_stat;
+
+
 
 
 /**
@@ -184,6 +267,18 @@ PJ_DECL(pj_status_t) pjmedia_echo_destroy(pjmedia_echo_state *echo );
 PJ_DECL(pj_status_t) pjmedia_echo_reset(pjmedia_echo_state *echo );
 
 
+/**
+ * Get the processing statistic of the echo canceller.
+ *
+ * @param echo		The Echo Canceller.
+ * @param stat		Pointer to receive the statistic.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjmedia_echo_get_stat(pjmedia_echo_state *echo,
+					   pjmedia_echo_stat *stat);
+
+
 /**
  * Let the Echo Canceller know that a frame has been played to the speaker.
  * The Echo Canceller will keep the frame in its internal buffer, to be used
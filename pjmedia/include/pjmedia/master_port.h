@@ -73,7 +73,10 @@ typedef struct pjmedia_master_port pjmedia_master_port;
  * @param u_port	Upstream port.
  * @param d_port	Downstream port.
  * @param options	Options flags, from bitmask combinations from
- *			pjmedia_clock_options.
+ *			pjmedia_clock_options. Unless
+ *			#PJMEDIA_MASTER_PORT_SHARED_CLOCK is disabled,
+ *			#PJMEDIA_CLOCK_SHARED is added to the options when
+ *			the port doesn't need a clock thread of its own.
  * @param p_m		Pointer to receive the master port instance.
  *
  * @return		PJ_SUCCESS on success.
@@ -173,6 +176,17 @@ PJ_DECL(pj_status_t) pjmedia_master_port_set_dport(pjmedia_master_port *m,
 PJ_DECL(pjmedia_port*) pjmedia_master_port_get_dport(pjmedia_master_port*m);
 
 
+/**
+ * Get the media clock which drives the master port, for example to
+ * retrieve its statistics with #pjmedia_clock_get_stat().
+ *
+ * @param m		The master port.
+ *
+ * @return		The media clock.
+ */
+PJ_DECL(pjmedia_clock*) pjmedia_master_port_get_clock(pjmedia_master_port*m);
+
+
 /**
  * Destroy the master port, and optionally destroy the upstream and 
  * downstream ports.
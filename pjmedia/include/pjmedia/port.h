@@ -358,6 +358,41 @@ PJ_INLINE(unsigned) PJMEDIA_PIA_MAX_FSZ(const pjmedia_port_info *pia)
     return PJMEDIA_AFD_MAX_FSZ(&pia->fmt.det.aud);
 }
 
+/**
+ * Number of buckets in the frame processing time histogram of
+ * #pjmedia_port_op_prof. Bucket 0 counts calls shorter than 32 usec,
+ * bucket n (n > 0) counts calls between (16 << n) and (32 << n) usec,
+ * and the last bucket also counts all longer calls.
+ */
+#define PJMEDIA_PORT_PROF_HIST_CNT	12
+
+/**
+ * Frame processing time statistics of one direction of a media port.
+ * The time of a call includes the time spent in the downstream ports
+ * which are called by the port to get or put their frames.
+ */
+typedef struct pjmedia_port_op_prof
+{
+    unsigned	    count;	    /**< Number of calls.		    */
+    pj_uint64_t	    total_usec;	    /**< Total time spent, in usec.	    */
+    unsigned	    max_usec;	    /**< Longest call, in usec.		    */
+
+    /** Histogram of the call duration, see #PJMEDIA_PORT_PROF_HIST_CNT. */
+    unsigned	    hist[PJMEDIA_PORT_PROF_HIST_CNT];
+
+} pjmedia_port_op_prof;
+
+/**
+ * Frame processing time statistics of a media port, available when
+ * #PJMEDIA_PORT_HAS_PROFILING is enabled.
+ */
+typedef struct pjmedia_port_prof
+{
+    pjmedia_port_op_prof    get;    /**< get_frame() statistics.	    */
+    pjmedia_port_op_prof    put;    /**< put_frame() statistics.	    */
+
+} pjmedia_port_prof;
+
 /**
  * Port interface.
  */
@@ -399,6 +434,14 @@ typedef struct pjmedia_port
      */
     pj_status_t (*on_destroy)(struct pjmedia_port *this_port);
 
+#if defined(PJMEDIA_PORT_HAS_PROFILING) && PJMEDIA_PORT_HAS_PROFILING!=0
+    /**
+     * Frame processing time statistics, updated by #pjmedia_port_get_frame()
+     * and #pjmedia_port_put_frame().
+     */
+    pjmedia_port_prof	 prof;
+#endif
+
 } pjmedia_port;
 
 
@@ -478,6 +521,41 @@ PJ_DECL(pj_status_t) pjmedia_port_get_frame( pjmedia_port *port,
 PJ_DECL(pj_status_t) pjmedia_port_put_frame( pjmedia_port *port,
 					     pjmedia_frame *frame );
 
+/**
+ * Get the frame processing time statistics of the port. The statistics
+ * are updated without locking, so they may be slightly inconsistent when
+ * read while the media flow is running.
+ *
+ * @param port	    The media port.
+ * @param prof	    Pointer to receive the statistics.
+ *
+ * @return	    PJ_SUCCESS on success, or PJ_ENOTSUP if
+ *		    #PJMEDIA_PORT_HAS_PROFILING is disabled.
+ */
+PJ_DECL(pj_status_t) pjmedia_port_get_prof( const pjmedia_port *port,
+					    pjmedia_port_prof *prof );
+
+/**
+ * Reset the frame processing time statistics of the port.
+ *
+ * @param port	    The media port.
+ *
+ * @return	    PJ_SUCCESS on success, or PJ_ENOTSUP if
+ *		    #PJMEDIA_PORT_HAS_PROFILING is disabled.
+ */
+PJ_DECL(pj_status_t) pjmedia_port_reset_prof( pjmedia_port *port );
+
+/**
+ * Dump the frame processing time statistics of the port to log, using
+ * verbosity level 3. Nothing is printed when #PJMEDIA_PORT_HAS_PROFILING
+ * is disabled, or when the port has not processed any frame.
+ *
+ * @param port	    The media port.
+ * @param indent    Prefix to print before every line.
+ */
+PJ_DECL(void) pjmedia_port_dump_prof( const pjmedia_port *port,
+				      const char *indent );
+
 /**
  * Destroy port (and subsequent downstream ports)
  *
@@ -26,6 +26,7 @@
  */
 #include <pjmedia-audiodev/audiodev.h>
 #include <pjmedia/clock.h>
+#include <pjmedia/echo.h>
 #include <pjmedia/port.h>
 
 PJ_BEGIN_DECL
@@ -284,6 +285,20 @@ PJ_DECL(pj_status_t) pjmedia_snd_port_get_ec_tail(pjmedia_snd_port *snd_port,
 						  unsigned *p_length);
 
 
+/**
+ * Get the processing statistic of the software echo canceller, see
+ * #pjmedia_echo_get_stat().
+ *
+ * @param snd_port	    The sound device port.
+ * @param stat		    Pointer to receive the statistic.
+ *
+ * @return		    PJ_SUCCESS on success, or PJ_ENOTFOUND if
+ *			    software echo canceller is not enabled.
+ */
+PJ_DECL(pj_status_t) pjmedia_snd_port_get_ec_stat(pjmedia_snd_port *snd_port,
+						  pjmedia_echo_stat *stat);
+
+
 /**
  * Get a clock source from the sound port.
  *
@@ -335,6 +335,33 @@ PJ_DECL(pj_status_t) pjmedia_stream_pause( pjmedia_stream *stream,
 PJ_DECL(pj_status_t) pjmedia_stream_resume(pjmedia_stream *stream,
 					   pjmedia_dir dir);
 
+/**
+ * Enable or disable forwarding of encoded frames between this stream and
+ * a peer stream. While forwarding is enabled, the stream port exchanges
+ * PJMEDIA_FRAME_TYPE_EXTENDED frames containing the RTP payloads instead
+ * of PCM: the port's get_frame() returns the payloads from the jitter
+ * buffer without decoding them, and the extended frames given to the
+ * port's put_frame() are transmitted without encoding, with only the RTP
+ * header rewritten. G.711 payloads are converted directly when one
+ * stream uses A-law and the other uses U-law.
+ *
+ * This is useful to relay media between two legs of a B2BUA which use
+ * the same codec: enable forwarding on each stream with the other stream
+ * as the peer, then connect both stream ports with a master port.
+ *
+ * @param stream	The media stream.
+ * @param peer		The stream which frames will be put to this stream,
+ *			or NULL to disable forwarding and return to
+ *			decoding and encoding.
+ *
+ * @return		PJ_SUCCESS on success, or PJMEDIA_EBADFMT when the
+ *			codecs of both streams do not match (e.g. different
+ *			codec, ptime, or fmtp), in which case the stream
+ *			keeps transcoding.
+ */
+PJ_DECL(pj_status_t) pjmedia_stream_set_forward(pjmedia_stream *stream,
+					        const pjmedia_stream *peer);
+
 /**
  * Transmit DTMF to this stream. The DTMF will be transmitted uisng
  * RTP telephone-events as described in RFC 2833. This operation is
@@ -135,6 +135,26 @@ typedef struct pjmedia_vid_codec_info
 } pjmedia_vid_codec_info;
 
 
+/**
+ * Multithreading methods of video codec, used in the thread_type field of
+ * #pjmedia_vid_codec_param.
+ */
+typedef enum pjmedia_vid_codec_thread_type
+{
+    /**
+     * Process several frames in parallel. This adds a delay of one frame
+     * per additional thread.
+     */
+    PJMEDIA_VID_CODEC_THREAD_FRAME = 1,
+
+    /**
+     * Process several slices of a single frame in parallel.
+     */
+    PJMEDIA_VID_CODEC_THREAD_SLICE = 2
+
+} pjmedia_vid_codec_thread_type;
+
+
 /** 
  * Detailed codec attributes used in configuring a codec and in querying
  * the capability of codec factories. Default attributes of any codecs could
@@ -162,6 +182,15 @@ typedef struct pjmedia_vid_codec_param
 					     format settings specified in
 					     enc_fmt and dec_fmt only.	    */
 
+    unsigned		thread_cnt;	/**< Number of threads used by the
+					     encoder and the decoder, or zero
+					     to use the codec default.	    */
+    unsigned		thread_type;	/**< Allowed multithreading methods,
+					     bitmask of
+					     pjmedia_vid_codec_thread_type,
+					     or zero to use the codec
+					     default.			    */
+
 } pjmedia_vid_codec_param;
 
 
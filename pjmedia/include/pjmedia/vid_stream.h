@@ -165,6 +165,13 @@ typedef struct pjmedia_vid_stream_info
 
     pjmedia_vid_stream_rc_config rc_cfg;
                                     /**< Stream send rate control settings. */
+
+    pj_bool_t		async_enc;  /**< Encode and send the pictures in a
+					 dedicated thread, so that capturing
+					 the next picture overlaps with
+					 encoding and sending the previous
+					 one. Default is
+					 PJMEDIA_VID_STREAM_ASYNC_ENCODE.   */
 } pjmedia_vid_stream_info;
 
 
@@ -79,7 +79,16 @@ enum pjmedia_wsola_option
      * the volume on every more samples it generates, and when it reaches
      * the limit it will only generate silence.
      */
-    PJMEDIA_WSOLA_NO_FADING = 8
+    PJMEDIA_WSOLA_NO_FADING = 8,
+
+    /**
+     * Use coarse-to-fine waveform similarity search: the search range is
+     * scanned at every PJMEDIA_WSOLA_COARSE_STEP-th position first, then
+     * only the neighborhood of the best candidate is scanned at every
+     * position. This reduces the search cost by roughly the step factor,
+     * at the risk of missing a narrow similarity peak.
+     */
+    PJMEDIA_WSOLA_COARSE_SEARCH = 16
 };
 
 
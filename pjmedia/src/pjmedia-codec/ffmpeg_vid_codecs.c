@@ -210,6 +210,14 @@ typedef struct ffmpeg_private
 		      pj_size_t bits_len, unsigned *bits_pos, \
 		      const pj_uint8_t **payload, pj_size_t *payload_len)
 
+/* Packetize directly into the output buffer, payload_len is the buffer
+ * size on input and the payload length on output.
+ */
+#define FUNC_PACKETIZE_TO(name) \
+    pj_status_t(name)(ffmpeg_private *ff, const pj_uint8_t *bits, \
+		      pj_size_t bits_len, unsigned *bits_pos, \
+		      pj_uint8_t *payload, pj_size_t *payload_len)
+
 #define FUNC_UNPACKETIZE(name) \
     pj_status_t(name)(ffmpeg_private *ff, const pj_uint8_t *payload, \
 		      pj_size_t payload_len, pj_uint8_t *bits, \
@@ -224,6 +232,7 @@ typedef struct ffmpeg_private
 
 /* Type definition of codec specific functions */
 typedef FUNC_PACKETIZE(*func_packetize);
+typedef FUNC_PACKETIZE_TO(*func_packetize_to);
 typedef FUNC_UNPACKETIZE(*func_unpacketize);
 typedef pj_status_t (*func_preopen)	(ffmpeg_private *ff);
 typedef pj_status_t (*func_postopen)	(ffmpeg_private *ff);
@@ -251,6 +260,9 @@ struct ffmpeg_codec_desc
     func_preopen		 postopen;
     func_sdp_fmt_match		 sdp_fmt_match;
     pjmedia_codec_fmtp		 dec_fmtp;
+    func_packetize_to		 packetize_to;	/**< Optional, packetize
+						     without modifying the
+						     encoder output	    */
 
     /* Init time defined info */
     pj_bool_t			 enabled;
@@ -272,6 +284,7 @@ struct ffmpeg_codec_desc
 static pj_status_t h264_preopen(ffmpeg_private *ff);
 static pj_status_t h264_postopen(ffmpeg_private *ff);
 static FUNC_PACKETIZE(h264_packetize);
+static FUNC_PACKETIZE_TO(h264_packetize_to);
 static FUNC_UNPACKETIZE(h264_unpacketize);
 #endif
 
@@ -294,6 +307,7 @@ static ffmpeg_codec_desc codec_desc[] =
 	/* Leading space for better compatibility (strange indeed!) */
 	{2, { {{"profile-level-id",16},    {"42e01e",6}}, 
 	      {{" packetization-mode",19},  {"1",1}}, } },
+	&h264_packetize_to,
     },
 #endif
 
@@ -476,6 +490,25 @@ static FUNC_PACKETIZE(h264_packetize)
 				  payload, payload_len);
 }
 
+static FUNC_PACKETIZE_TO(h264_packetize_to)
+{
+    h264_data *data = (h264_data*)ff->data;
+    pjmedia_h264_payload_desc desc;
+    pj_status_t status;
+
+    status = pjmedia_h264_packetize2(data->pktz, bits, bits_len, bits_pos,
+				     &desc);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    status = pjmedia_h264_write_payload(&desc, payload, *payload_len,
+					payload_len);
+    if (status == PJ_ETOOSMALL)
+	return PJMEDIA_CODEC_EFRMTOOSHORT;
+
+    return status;
+}
+
 static FUNC_UNPACKETIZE(h264_unpacketize)
 {
     h264_data *data = (h264_data*)ff->data;
@@ -1091,6 +1124,24 @@ static void print_ffmpeg_err(int err)
 
 }
 
+/* Apply the codec param threading settings to the ffmpeg context */
+static void init_ffmpeg_threads(AVCodecContext *ctx,
+				const pjmedia_vid_codec_param *param)
+{
+    if (param->thread_cnt)
+	ctx->thread_count = param->thread_cnt;
+
+#if defined(FF_THREAD_FRAME) && defined(FF_THREAD_SLICE)
+    if (param->thread_type) {
+	ctx->thread_type = 0;
+	if (param->thread_type & PJMEDIA_VID_CODEC_THREAD_FRAME)
+	    ctx->thread_type |= FF_THREAD_FRAME;
+	if (param->thread_type & PJMEDIA_VID_CODEC_THREAD_SLICE)
+	    ctx->thread_type |= FF_THREAD_SLICE;
+    }
+#endif
+}
+
 static pj_status_t open_ffmpeg_codec(ffmpeg_private *ff,
                                      pj_mutex_t *ff_mutex)
 {
@@ -1168,6 +1219,12 @@ static pj_status_t open_ffmpeg_codec(ffmpeg_private *ff,
         ctx->opaque = ff;
     }
 
+    /* Init threading params */
+    if (ff->enc_ctx)
+	init_ffmpeg_threads(ff->enc_ctx, &ff->param);
+    if (ff->dec_ctx)
+	init_ffmpeg_threads(ff->dec_ctx, &ff->param);
+
     /* Override generic params or apply specific params before opening
      * the codec.
      */
@@ -1478,6 +1535,56 @@ static pj_status_t ffmpeg_codec_encode_whole(pjmedia_vid_codec *codec,
     return PJ_SUCCESS;
 }
 
+/*
+ * Packetize the next payload of the encoded picture into the output frame.
+ */
+static pj_status_t ffmpeg_packetize_next(pjmedia_vid_codec *codec,
+					 unsigned out_size,
+					 pjmedia_frame *output,
+					 pj_bool_t *has_more)
+{
+    ffmpeg_private *ff = (ffmpeg_private*)codec->codec_data;
+    pj_size_t payload_len;
+    pj_status_t status;
+
+    if (ff->desc->packetize_to) {
+	/* Assemble the payload straight from the encoder output into the
+	 * output buffer, which is normally the RTP packet buffer.
+	 */
+	payload_len = out_size;
+	status = (*ff->desc->packetize_to)(ff, (pj_uint8_t*)ff->enc_buf,
+					   ff->enc_frame_len,
+					   &ff->enc_processed,
+					   (pj_uint8_t*)output->buf,
+					   &payload_len);
+	if (status != PJ_SUCCESS)
+	    return status;
+    } else {
+	const pj_uint8_t *payload;
+
+	status = ffmpeg_packetize(codec, (pj_uint8_t*)ff->enc_buf,
+				  ff->enc_frame_len, &ff->enc_processed,
+				  &payload, &payload_len);
+	if (status != PJ_SUCCESS)
+	    return status;
+
+	if (out_size < payload_len)
+	    return PJMEDIA_CODEC_EFRMTOOSHORT;
+
+	pj_memcpy(output->buf, payload, payload_len);
+    }
+
+    output->type = PJMEDIA_FRAME_TYPE_VIDEO;
+    output->size = payload_len;
+
+    if (ff->enc_buf_is_keyframe)
+	output->bit_info |= PJMEDIA_VID_FRM_KEYFRAME;
+
+    *has_more = (ff->enc_processed < ff->enc_frame_len);
+
+    return PJ_SUCCESS;
+}
+
 static pj_status_t ffmpeg_codec_encode_begin(pjmedia_vid_codec *codec,
 					     const pjmedia_vid_encode_opt *opt,
 					     const pjmedia_frame *input,
@@ -1495,8 +1602,6 @@ static pj_status_t ffmpeg_codec_encode_begin(pjmedia_vid_codec *codec,
 					   output);
     } else {
 	pjmedia_frame whole_frm;
-        const pj_uint8_t *payload;
-        pj_size_t payload_len;
 
 	pj_bzero(&whole_frm, sizeof(whole_frm));
 	whole_frm.buf = ff->enc_buf;
@@ -1511,23 +1616,7 @@ static pj_status_t ffmpeg_codec_encode_begin(pjmedia_vid_codec *codec,
 				   PJMEDIA_VID_FRM_KEYFRAME);
 	ff->enc_frame_len = (unsigned)whole_frm.size;
 	ff->enc_processed = 0;
-        status = ffmpeg_packetize(codec, (pj_uint8_t*)whole_frm.buf,
-                                  whole_frm.size, &ff->enc_processed,
-				  &payload, &payload_len);
-        if (status != PJ_SUCCESS)
-            return status;
-
-        if (out_size < payload_len)
-            return PJMEDIA_CODEC_EFRMTOOSHORT;
-
-        output->type = PJMEDIA_FRAME_TYPE_VIDEO;
-        pj_memcpy(output->buf, payload, payload_len);
-        output->size = payload_len;
-
-	if (ff->enc_buf_is_keyframe)
-	    output->bit_info |= PJMEDIA_VID_FRM_KEYFRAME;
-
-        *has_more = (ff->enc_processed < ff->enc_frame_len);
+	status = ffmpeg_packetize_next(codec, out_size, output, has_more);
     }
 
     return status;
@@ -1539,9 +1628,6 @@ static pj_status_t ffmpeg_codec_encode_more(pjmedia_vid_codec *codec,
 					    pj_bool_t *has_more)
 {
     ffmpeg_private *ff = (ffmpeg_private*)codec->codec_data;
-    const pj_uint8_t *payload;
-    pj_size_t payload_len;
-    pj_status_t status;
 
     *has_more = PJ_FALSE;
 
@@ -1550,25 +1636,7 @@ static pj_status_t ffmpeg_codec_encode_more(pjmedia_vid_codec *codec,
 	return PJ_EEOF;
     }
 
-    status = ffmpeg_packetize(codec, (pj_uint8_t*)ff->enc_buf,
-                              ff->enc_frame_len, &ff->enc_processed,
-                              &payload, &payload_len);
-    if (status != PJ_SUCCESS)
-        return status;
-
-    if (out_size < payload_len)
-        return PJMEDIA_CODEC_EFRMTOOSHORT;
-
-    output->type = PJMEDIA_FRAME_TYPE_VIDEO;
-    pj_memcpy(output->buf, payload, payload_len);
-    output->size = payload_len;
-
-    if (ff->enc_buf_is_keyframe)
-	output->bit_info |= PJMEDIA_VID_FRM_KEYFRAME;
-
-    *has_more = (ff->enc_processed < ff->enc_frame_len);
-
-    return PJ_SUCCESS;
+    return ffmpeg_packetize_next(codec, out_size, output, has_more);
 }
 
 
@@ -43,6 +43,9 @@ struct pjmedia_h264_packetizer
     /* Unpacketizer state */
     unsigned	    unpack_last_sync_pos;
     pj_bool_t	    unpack_prev_lost;
+
+    /* Packetizer state, NAL unit octet of the NAL unit being fragmented */
+    pj_uint8_t	    pack_nal_octet;
 };
 
 
@@ -59,14 +62,24 @@ enum
 /*
  * Find next NAL unit from the specified H.264 bitstream data.
  */
-static pj_uint8_t* find_next_nal_unit(pj_uint8_t *start,
-                                      pj_uint8_t *end)
+static const pj_uint8_t* find_next_nal_unit(const pj_uint8_t *start,
+                                            const pj_uint8_t *end)
 {
-    pj_uint8_t *p = start;
-
-    /* Simply lookup "0x000001" pattern */
-    while (p <= end-3 && (p[0] || p[1] || p[2]!=1))
-        ++p;
+    const pj_uint8_t *p = start;
+
+    /* Lookup "0x000001" pattern, skipping positions that can't be the
+     * start of the pattern based on the third octet.
+     */
+    while (p <= end-3) {
+	if (p[2] > 1)
+	    p += 3;
+	else if (p[1])
+	    p += 2;
+	else if (p[0] || p[2] != 1)
+	    ++p;
+	else
+	    break;
+    }
 
     if (p > end-3)
 	/* No more NAL unit in this bitstream */
@@ -115,22 +128,23 @@ PJ_DEF(pj_status_t) pjmedia_h264_packetizer_create(
 
 
 /*
- * Generate an RTP payload from H.264 frame bitstream, in-place processing.
+ * Generate an RTP payload descriptor from H.264 frame bitstream, the
+ * bitstream is left untouched.
  */
-PJ_DEF(pj_status_t) pjmedia_h264_packetize(pjmedia_h264_packetizer *pktz,
-					   pj_uint8_t *buf,
-                                           pj_size_t buf_len,
-                                           unsigned *pos,
-                                           const pj_uint8_t **payload,
-                                           pj_size_t *payload_len)
+PJ_DEF(pj_status_t) pjmedia_h264_packetize2(pjmedia_h264_packetizer *pktz,
+					    const pj_uint8_t *buf,
+					    pj_size_t buf_len,
+					    unsigned *pos,
+					    pjmedia_h264_payload_desc *desc)
 {
-    pj_uint8_t *nal_start = NULL, *nal_end = NULL, *nal_octet = NULL;
-    pj_uint8_t *p, *end;
+    const pj_uint8_t *nal_start = NULL, *nal_end = NULL, *nal_octet = NULL;
+    const pj_uint8_t *p, *end;
     enum { 
 	HEADER_SIZE_FU_A	     = 2,
 	HEADER_SIZE_STAP_A	     = 3,
     };
-    enum { MAX_NALS_IN_AGGR = 32 };
+
+    PJ_ASSERT_RETURN(pktz && buf && pos && desc, PJ_EINVAL);
 
 #if DBG_PACKETIZE
     if (*pos == 0 && buf_len) {
@@ -141,9 +155,14 @@ PJ_DEF(pj_status_t) pjmedia_h264_packetize(pjmedia_h264_packetizer *pktz,
     p = buf + *pos;
     end = buf + buf_len;
 
-    /* Find NAL unit startcode */
+    /* Find NAL unit startcode, it must be right at the current position,
+     * otherwise the last octet of a fragmented NAL unit may be mistaken
+     * as the leading zero of the next startcode.
+     */
     if (end-p >= 4)
 	nal_start = find_next_nal_unit(p, p+4);
+    if (nal_start && nal_start != p)
+	nal_start = NULL;
     if (nal_start) {
 	/* Get NAL unit octet pointer */
 	while (*nal_start++ == 0);
@@ -153,8 +172,10 @@ PJ_DEF(pj_status_t) pjmedia_h264_packetize(pjmedia_h264_packetizer *pktz,
 	nal_start = p;
     }
 
-    /* Get end of NAL unit */
-    p = nal_start+pktz->cfg.mtu+1;
+    /* Get end of NAL unit, the search range must cover a whole (4 octets)
+     * startcode that follows a NAL unit fitting into the MTU.
+     */
+    p = nal_start+pktz->cfg.mtu+4;
     if (p > end || pktz->cfg.mode==PJMEDIA_H264_PACKETIZER_MODE_SINGLE_NAL) 
 	p = end;
     nal_end = find_next_nal_unit(nal_start, p); 
@@ -172,6 +193,8 @@ PJ_DEF(pj_status_t) pjmedia_h264_packetize(pjmedia_h264_packetizer *pktz,
 	return PJ_ETOOSMALL;
     }
 
+    desc->aggr = PJ_FALSE;
+
     /* Evaluate the proper payload format structure */
 
     /* Fragmentation (FU-A) packet */
@@ -179,48 +202,47 @@ PJ_DEF(pj_status_t) pjmedia_h264_packetize(pjmedia_h264_packetizer *pktz,
 	(!nal_octet || nal_end-nal_start > pktz->cfg.mtu))
     {
 	pj_uint8_t NRI, TYPE;
+	pj_size_t len;
 
 	if (nal_octet) {
-	    /* We have NAL unit octet, so this is the first fragment */
-	    NRI = (*nal_octet & 0x60) >> 5;
-	    TYPE = *nal_octet & 0x1F;
+	    /* We have NAL unit octet, so this is the first fragment,
+	     * keep the octet for the following fragments.
+	     */
+	    pktz->pack_nal_octet = *nal_octet;
 
-	    /* Skip nal_octet in nal_start to be overriden by FU header */
+	    /* Skip nal_octet, it is carried in the FU header */
 	    ++nal_start;
-	} else {
-	    /* Not the first fragment, get NRI and NAL unit type
-	     * from the previous fragment.
-	     */
-	    p = nal_start - pktz->cfg.mtu;
-	    NRI = (*p & 0x60) >> 5;
-	    TYPE = *(p+1) & 0x1F;
 	}
+	NRI = (pktz->pack_nal_octet & 0x60) >> 5;
+	TYPE = pktz->pack_nal_octet & 0x1F;
 
 	/* Init FU indicator (one octet: F+NRI+TYPE) */
-	p = nal_start - HEADER_SIZE_FU_A;
-	*p = (NRI << 5) | NAL_TYPE_FU_A;
-	++p;
+	desc->hdr[0] = (pj_uint8_t)((NRI << 5) | NAL_TYPE_FU_A);
 
 	/* Init FU header (one octed: S+E+R+TYPE) */
-	*p = TYPE;
+	desc->hdr[1] = TYPE;
 	if (nal_octet)
-	    *p |= (1 << 7); /* S bit flag = start of fragmentation */
+	    desc->hdr[1] |= (1 << 7); /* S bit flag = start of fragmentation */
 	if (nal_end-nal_start+HEADER_SIZE_FU_A <= pktz->cfg.mtu)
-	    *p |= (1 << 6); /* E bit flag = end of fragmentation */
+	    desc->hdr[1] |= (1 << 6); /* E bit flag = end of fragmentation */
+	desc->hdr_len = HEADER_SIZE_FU_A;
 
-	/* Set payload, payload length */
-	*payload = nal_start - HEADER_SIZE_FU_A;
+	/* Set fragment data, payload length, and pos */
 	if (nal_end-nal_start+HEADER_SIZE_FU_A > pktz->cfg.mtu)
-	    *payload_len = pktz->cfg.mtu;
+	    len = pktz->cfg.mtu - HEADER_SIZE_FU_A;
 	else
-	    *payload_len = nal_end - nal_start + HEADER_SIZE_FU_A;
-	*pos = (unsigned)(*payload + *payload_len - buf);
+	    len = nal_end - nal_start;
+	desc->nal_cnt = 1;
+	desc->nal[0].data = nal_start;
+	desc->nal[0].len = len;
+	desc->payload_len = len + HEADER_SIZE_FU_A;
+	*pos = (unsigned)(nal_start + len - buf);
 
 #if DBG_PACKETIZE
 	PJ_LOG(3, ("h264pack", "Packetized fragmented H264 NAL unit "
 		   "(pos=%d, type=%d, NRI=%d, S=%d, E=%d, len=%d/%d)",
-		   *payload-buf, TYPE, NRI, *p>>7, (*p>>6)&1, *payload_len,
-		   buf_len));
+		   nal_start-buf, TYPE, NRI, desc->hdr[1]>>7,
+		   (desc->hdr[1]>>6)&1, desc->payload_len, buf_len));
 #endif
 
 	return PJ_SUCCESS;
@@ -233,26 +255,25 @@ PJ_DEF(pj_status_t) pjmedia_h264_packetize(pjmedia_h264_packetizer *pktz,
     {
 	int total_size;
 	unsigned nal_cnt = 1;
-	pj_uint8_t *nal[MAX_NALS_IN_AGGR];
-	pj_size_t nal_size[MAX_NALS_IN_AGGR];
 	pj_uint8_t NRI;
 
 	pj_assert(nal_octet);
 
 	/* Init the first NAL unit in the packet */
-	nal[0] = nal_start;
-	nal_size[0] = nal_end - nal_start;
-	total_size = (int)nal_size[0] + HEADER_SIZE_STAP_A;
+	desc->nal[0].data = nal_start;
+	desc->nal[0].len = nal_end - nal_start;
+	total_size = (int)desc->nal[0].len + HEADER_SIZE_STAP_A;
 	NRI = (*nal_octet & 0x60) >> 5;
 
 	/* Populate next NAL units */
-	while (nal_cnt < MAX_NALS_IN_AGGR) {
-	    pj_uint8_t *tmp_end;
+	while (nal_cnt < PJMEDIA_H264_MAX_NALS_IN_AGGR) {
+	    const pj_uint8_t *tmp_end;
+	    pj_uint8_t tmp_nri;
 
 	    /* Find start address of the next NAL unit */
-	    p = nal[nal_cnt-1] + nal_size[nal_cnt-1];
+	    p = desc->nal[nal_cnt-1].data + desc->nal[nal_cnt-1].len;
 	    while (*p++ == 0);
-	    nal[nal_cnt] = p;
+	    desc->nal[nal_cnt].data = p;
 
 	    /* Find end address of the next NAL unit */
 	    tmp_end = p + (pktz->cfg.mtu - total_size);
@@ -260,58 +281,44 @@ PJ_DEF(pj_status_t) pjmedia_h264_packetize(pjmedia_h264_packetizer *pktz,
 		tmp_end = end;
 	    p = find_next_nal_unit(p+1, tmp_end);
 	    if (p) {
-		nal_size[nal_cnt] = p - nal[nal_cnt];
+		desc->nal[nal_cnt].len = p - desc->nal[nal_cnt].data;
 	    } else {
 		break;
 	    }
 
 	    /* Update total payload size (2 octet NAL size + NAL) */
-	    total_size += (2 + (int)nal_size[nal_cnt]);
-	    if (total_size <= pktz->cfg.mtu) {
-		pj_uint8_t tmp_nri;
-
-		/* Get maximum NRI of the aggregated NAL units */
-		tmp_nri = (*(nal[nal_cnt]-1) & 0x60) >> 5;
-		if (tmp_nri > NRI)
-		    NRI = tmp_nri;
-	    } else {
+	    if (total_size + 2 + (int)desc->nal[nal_cnt].len > pktz->cfg.mtu)
 		break;
-	    }
+	    total_size += (2 + (int)desc->nal[nal_cnt].len);
+
+	    /* Get maximum NRI of the aggregated NAL units */
+	    tmp_nri = (*desc->nal[nal_cnt].data & 0x60) >> 5;
+	    if (tmp_nri > NRI)
+		NRI = tmp_nri;
 
 	    ++nal_cnt;
 	}
 
 	/* Only use STAP-A when we found more than one NAL units */
 	if (nal_cnt > 1) {
-	    unsigned i;
+	    const pj_uint8_t *last_end;
 
 	    /* Init STAP-A NAL header (F+NRI+TYPE) */
-	    p = nal[0] - HEADER_SIZE_STAP_A;
-	    *p++ = (NRI << 5) | NAL_TYPE_STAP_A;
-
-	    /* Append all populated NAL units into payload (SIZE+NAL) */
-	    for (i = 0; i < nal_cnt; ++i) {
-		/* Put size (2 octets in network order) */
-		pj_assert(nal_size[i] <= 0xFFFF);
-		*p++ = (pj_uint8_t)(nal_size[i] >> 8);
-		*p++ = (pj_uint8_t)(nal_size[i] & 0xFF);
-		
-		/* Append NAL unit, watchout memmove()-ing bitstream! */
-		if (p != nal[i])
-		    pj_memmove(p, nal[i], nal_size[i]);
-		p += nal_size[i];
-	    }
+	    desc->hdr[0] = (pj_uint8_t)((NRI << 5) | NAL_TYPE_STAP_A);
+	    desc->hdr_len = 1;
+	    desc->aggr = PJ_TRUE;
+	    desc->nal_cnt = nal_cnt;
+	    desc->payload_len = total_size;
 
-	    /* Set payload, payload length, and pos */
-	    *payload = nal[0] - HEADER_SIZE_STAP_A;
-	    pj_assert(*payload >= buf+*pos);
-	    *payload_len = p - *payload;
-	    *pos = (unsigned)(nal[nal_cnt-1] + nal_size[nal_cnt-1] - buf);
+	    /* Set pos */
+	    last_end = desc->nal[nal_cnt-1].data + desc->nal[nal_cnt-1].len;
+	    *pos = (unsigned)(last_end - buf);
 
 #if DBG_PACKETIZE
 	    PJ_LOG(3, ("h264pack", "Packetized aggregation of "
 		       "%d H264 NAL units (pos=%d, NRI=%d len=%d/%d)",
-		       nal_cnt, *payload-buf, NRI, *payload_len, buf_len));
+		       nal_cnt, desc->nal[0].data-buf, NRI,
+		       desc->payload_len, buf_len));
 #endif
 
 	    return PJ_SUCCESS;
@@ -319,21 +326,105 @@ PJ_DEF(pj_status_t) pjmedia_h264_packetize(pjmedia_h264_packetizer *pktz,
     }
 
     /* Single NAL unit packet */
-    *payload = nal_start;
-    *payload_len = nal_end - nal_start;
+    desc->hdr_len = 0;
+    desc->nal_cnt = 1;
+    desc->nal[0].data = nal_start;
+    desc->nal[0].len = nal_end - nal_start;
+    desc->payload_len = desc->nal[0].len;
     *pos = (unsigned)(nal_end - buf);
 
 #if DBG_PACKETIZE
     PJ_LOG(3, ("h264pack", "Packetized single H264 NAL unit "
 	       "(pos=%d, type=%d, NRI=%d, len=%d/%d)",
 	       nal_start-buf, *nal_octet&0x1F, (*nal_octet&0x60)>>5,
-	       *payload_len, buf_len));
+	       desc->payload_len, buf_len));
 #endif
 
     return PJ_SUCCESS;
 }
 
 
+/*
+ * Write the payload described by the descriptor into the buffer.
+ */
+PJ_DEF(pj_status_t) pjmedia_h264_write_payload(
+				const pjmedia_h264_payload_desc *desc,
+				pj_uint8_t *buf,
+				pj_size_t buf_size,
+				pj_size_t *payload_len)
+{
+    pj_uint8_t *p = buf;
+    unsigned i;
+
+    PJ_ASSERT_RETURN(desc && buf, PJ_EINVAL);
+
+    if (buf_size < desc->payload_len)
+	return PJ_ETOOSMALL;
+
+    if (desc->hdr_len) {
+	pj_memcpy(p, desc->hdr, desc->hdr_len);
+	p += desc->hdr_len;
+    }
+
+    for (i = 0; i < desc->nal_cnt; ++i) {
+	pj_size_t len = desc->nal[i].len;
+
+	if (desc->aggr) {
+	    /* Put size (2 octets in network order) */
+	    pj_assert(len <= 0xFFFF);
+	    *p++ = (pj_uint8_t)(len >> 8);
+	    *p++ = (pj_uint8_t)(len & 0xFF);
+	}
+	/* The payload may be assembled in place, watchout memmove()-ing
+	 * bitstream!
+	 */
+	if (p != desc->nal[i].data)
+	    pj_memmove(p, desc->nal[i].data, len);
+	p += len;
+    }
+    if (payload_len)
+	*payload_len = desc->payload_len;
+
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Generate an RTP payload from H.264 frame bitstream, in-place processing.
+ */
+PJ_DEF(pj_status_t) pjmedia_h264_packetize(pjmedia_h264_packetizer *pktz,
+					   pj_uint8_t *buf,
+                                           pj_size_t buf_len,
+                                           unsigned *pos,
+                                           const pj_uint8_t **payload,
+                                           pj_size_t *payload_len)
+{
+    pjmedia_h264_payload_desc desc;
+    pj_uint8_t *p;
+    pj_size_t hdr_len;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(payload && payload_len, PJ_EINVAL);
+
+    status = pjmedia_h264_packetize2(pktz, buf, buf_len, pos, &desc);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    /* Assemble the payload over the bitstream, ending the payload header
+     * right at the first NAL unit (data). This overwrites the startcode,
+     * or the tail of the previous fragment for FU-A, and the aggregated
+     * NAL units are only moved backward.
+     */
+    hdr_len = desc.hdr_len + (desc.aggr ? 2 : 0);
+    p = buf + (desc.nal[0].data - buf) - hdr_len;
+    pj_assert(p >= buf);
+
+    *payload = p;
+    return pjmedia_h264_write_payload(&desc, p, desc.payload_len,
+				      payload_len);
+}
+
+
 /*
  * Append RTP payload to a H.264 picture bitstream. Note that the only
  * payload format that cares about packet lost is the NAL unit
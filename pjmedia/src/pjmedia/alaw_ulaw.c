@@ -298,3 +298,263 @@ PJ_DEF(unsigned char) pjmedia_ulaw2alaw(
 
 #endif	/* PJMEDIA_HAS_ALAW_ULAW_TABLE */
 
+
+
+/*
+ * Block conversion functions.
+ *
+ * When the conversion tables are used and SSE2 is available, the bulk of
+ * the block is converted eight samples at a time by evaluating the G.711
+ * segment/quantization rules with SIMD arithmetic. The results are bit
+ * exact with the tables, which are still used for the remaining samples.
+ */
+#if defined(PJMEDIA_HAS_ALAW_ULAW_TABLE) && PJMEDIA_HAS_ALAW_ULAW_TABLE!=0 && \
+    defined(PJMEDIA_HAS_ALAW_ULAW_SSE2) && PJMEDIA_HAS_ALAW_ULAW_SSE2!=0
+#   define G711_SSE2	1
+#   include <emmintrin.h>
+#else
+#   define G711_SSE2	0
+#endif
+
+
+#if G711_SSE2
+
+/* The G.711 segment number is the position of the leading one of the
+ * biased magnitude and the quantization value is the four bits that
+ * follow it, which is exactly the exponent and the top of the mantissa
+ * of the value converted to single precision float. Each lane of mag
+ * must be a positive 16-bit value, the result is (float_bits >> 19) - bias.
+ */
+static __m128i sse2_float_code(__m128i mag, int bias)
+{
+    const __m128i z = _mm_setzero_si128();
+    __m128i lo, hi;
+
+    lo = _mm_castps_si128(_mm_cvtepi32_ps(_mm_unpacklo_epi16(mag, z)));
+    hi = _mm_castps_si128(_mm_cvtepi32_ps(_mm_unpackhi_epi16(mag, z)));
+    lo = _mm_srli_epi32(lo, 19);
+    hi = _mm_srli_epi32(hi, 19);
+    return _mm_sub_epi16(_mm_packs_epi32(lo, hi), _mm_set1_epi16(bias));
+}
+
+/* The reverse of above: build (2*quant + 33) << (seg + 2) for the 7-bit
+ * segment and quantization code in each lane by composing the float
+ * directly and converting it back to integer.
+ */
+static __m128i sse2_float_value(__m128i code)
+{
+    const __m128i z = _mm_setzero_si128();
+    const __m128i k = _mm_set1_epi32((134 << 23) + (1 << 18));
+    __m128i lo, hi;
+
+    lo = _mm_add_epi32(_mm_slli_epi32(_mm_unpacklo_epi16(code, z), 19), k);
+    hi = _mm_add_epi32(_mm_slli_epi32(_mm_unpackhi_epi16(code, z), 19), k);
+    lo = _mm_cvttps_epi32(_mm_castsi128_ps(lo));
+    hi = _mm_cvttps_epi32(_mm_castsi128_ps(hi));
+    return _mm_packs_epi32(lo, hi);
+}
+
+/* Linear to U-Law for eight samples, result in the low byte of each lane */
+static __m128i sse2_linear2ulaw(__m128i x)
+{
+    __m128i neg, mag;
+
+    /* Sign and magnitude, biased and clipped to 0x1FFF */
+    x = _mm_srai_epi16(x, 2);
+    neg = _mm_srai_epi16(x, 15);
+    mag = _mm_sub_epi16(_mm_xor_si128(x, neg), neg);
+    mag = _mm_add_epi16(_mm_min_epi16(mag, _mm_set1_epi16(8158)),
+			_mm_set1_epi16(33));
+
+    /* Magnitude is at least 33, i.e. segment 0 starts at exponent 5 */
+    mag = sse2_float_code(mag, (127 + 5) << 4);
+    return _mm_xor_si128(mag, _mm_xor_si128(_mm_set1_epi16(0xFF),
+					    _mm_and_si128(neg, 
+							  _mm_set1_epi16(0x80))));
+}
+
+/* Linear to A-Law for eight samples, result in the low byte of each lane */
+static __m128i sse2_linear2alaw(__m128i x)
+{
+    __m128i neg, mag, small;
+
+    x = _mm_srai_epi16(x, 2);
+    neg = _mm_srai_epi16(x, 15);
+    mag = _mm_sub_epi16(_mm_xor_si128(x, neg), neg);
+    mag = _mm_min_epi16(_mm_srli_epi16(mag, 1), _mm_set1_epi16(0xFFF));
+
+    /* Segment 0 (magnitude below 0x20) is linear and encodes as mag>>1,
+     * which is what segment 1 yields for (mag + 0x20) minus 0x10.
+     */
+    small = _mm_cmpgt_epi16(_mm_set1_epi16(0x20), mag);
+    mag = _mm_add_epi16(mag, _mm_and_si128(small, _mm_set1_epi16(0x20)));
+    mag = sse2_float_code(mag, (127 + 4) << 4);
+    mag = _mm_sub_epi16(mag, _mm_and_si128(small, _mm_set1_epi16(0x10)));
+    return _mm_xor_si128(mag, _mm_xor_si128(_mm_set1_epi16(0xD5),
+					    _mm_and_si128(neg,
+							  _mm_set1_epi16(0x80))));
+}
+
+/* U-Law to linear for eight samples (one code per 16-bit lane) */
+static __m128i sse2_ulaw2linear(__m128i u)
+{
+    __m128i t, s;
+
+    u = _mm_xor_si128(u, _mm_set1_epi16(0xFF));
+    t = sse2_float_value(_mm_and_si128(u, _mm_set1_epi16(0x7F)));
+    t = _mm_sub_epi16(t, _mm_set1_epi16(0x84));
+
+    /* Negate when the sign bit is set */
+    s = _mm_cmpgt_epi16(_mm_and_si128(u, _mm_set1_epi16(0x80)),
+			_mm_setzero_si128());
+    return _mm_sub_epi16(_mm_xor_si128(t, s), s);
+}
+
+/* A-Law to linear for eight samples (one code per 16-bit lane) */
+static __m128i sse2_alaw2linear(__m128i a)
+{
+    __m128i t, lin, seg0, s;
+
+    a = _mm_xor_si128(a, _mm_set1_epi16(0x55));
+    t = sse2_float_value(_mm_and_si128(a, _mm_set1_epi16(0x7F)));
+
+    /* Segment 0 is linear: (quant << 4) + 8 */
+    lin = _mm_add_epi16(_mm_slli_epi16(_mm_and_si128(a, 
+						     _mm_set1_epi16(0xF)), 4),
+			_mm_set1_epi16(8));
+    seg0 = _mm_cmpeq_epi16(_mm_and_si128(a, _mm_set1_epi16(0x70)),
+			   _mm_setzero_si128());
+    t = _mm_or_si128(_mm_andnot_si128(seg0, t), _mm_and_si128(seg0, lin));
+
+    /* Negate when the sign bit is clear */
+    s = _mm_cmpeq_epi16(_mm_and_si128(a, _mm_set1_epi16(0x80)),
+			_mm_setzero_si128());
+    return _mm_sub_epi16(_mm_xor_si128(t, s), s);
+}
+
+#endif	/* G711_SSE2 */
+
+
+/*
+ * Encode 16-bit linear PCM data to 8-bit U-Law data.
+ */
+PJ_DEF(void) pjmedia_ulaw_encode(pj_uint8_t *dst, const pj_int16_t *src, 
+				 pj_size_t count)
+{
+    const pj_int16_t *end = src + count;
+
+#if G711_SSE2
+    for (; end - src >= 16; src += 16, dst += 16) {
+	__m128i lo = sse2_linear2ulaw(_mm_loadu_si128((const __m128i*)src));
+	__m128i hi = sse2_linear2ulaw(_mm_loadu_si128((const __m128i*)
+						      (src+8)));
+	_mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    while (src < end) {
+	*dst++ = pjmedia_linear2ulaw(*src);
+	++src;
+    }
+}
+
+/*
+ * Encode 16-bit linear PCM data to 8-bit A-Law data.
+ */
+PJ_DEF(void) pjmedia_alaw_encode(pj_uint8_t *dst, const pj_int16_t *src, 
+				 pj_size_t count)
+{
+    const pj_int16_t *end = src + count;
+
+#if G711_SSE2
+    for (; end - src >= 16; src += 16, dst += 16) {
+	__m128i lo = sse2_linear2alaw(_mm_loadu_si128((const __m128i*)src));
+	__m128i hi = sse2_linear2alaw(_mm_loadu_si128((const __m128i*)
+						      (src+8)));
+	_mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    while (src < end) {
+	*dst++ = pjmedia_linear2alaw(*src);
+	++src;
+    }
+}
+
+/*
+ * Decode 8-bit U-Law data to 16-bit linear PCM data.
+ */
+PJ_DEF(void) pjmedia_ulaw_decode(pj_int16_t *dst, const pj_uint8_t *src, 
+				 pj_size_t len)
+{
+    const pj_uint8_t *end = src + len;
+
+#if G711_SSE2
+    for (; end - src >= 16; src += 16, dst += 16) {
+	__m128i v = _mm_loadu_si128((const __m128i*)src);
+	__m128i z = _mm_setzero_si128();
+	_mm_storeu_si128((__m128i*)dst,
+			 sse2_ulaw2linear(_mm_unpacklo_epi8(v, z)));
+	_mm_storeu_si128((__m128i*)(dst+8),
+			 sse2_ulaw2linear(_mm_unpackhi_epi8(v, z)));
+    }
+#endif
+
+    while (src < end) {
+	*dst++ = (pj_int16_t) pjmedia_ulaw2linear(*src);
+	++src;
+    }
+}
+
+/*
+ * Decode 8-bit A-Law data to 16-bit linear PCM data.
+ */
+PJ_DEF(void) pjmedia_alaw_decode(pj_int16_t *dst, const pj_uint8_t *src, 
+				 pj_size_t len)
+{
+    const pj_uint8_t *end = src + len;
+
+#if G711_SSE2
+    for (; end - src >= 16; src += 16, dst += 16) {
+	__m128i v = _mm_loadu_si128((const __m128i*)src);
+	__m128i z = _mm_setzero_si128();
+	_mm_storeu_si128((__m128i*)dst,
+			 sse2_alaw2linear(_mm_unpacklo_epi8(v, z)));
+	_mm_storeu_si128((__m128i*)(dst+8),
+			 sse2_alaw2linear(_mm_unpackhi_epi8(v, z)));
+    }
+#endif
+
+    while (src < end) {
+	*dst++ = (pj_int16_t) pjmedia_alaw2linear(*src);
+	++src;
+    }
+}
+
+/*
+ * Transcode A-Law to U-Law.
+ */
+PJ_DEF(void) pjmedia_alaw_to_ulaw(pj_uint8_t *dst, const pj_uint8_t *src,
+				  pj_size_t len)
+{
+    const pj_uint8_t *end = src + len;
+
+    while (src < end) {
+	*dst++ = (pj_uint8_t) pjmedia_alaw2ulaw(*src);
+	++src;
+    }
+}
+
+/*
+ * Transcode U-Law to A-Law.
+ */
+PJ_DEF(void) pjmedia_ulaw_to_alaw(pj_uint8_t *dst, const pj_uint8_t *src,
+				  pj_size_t len)
+{
+    const pj_uint8_t *end = src + len;
+
+    while (src < end) {
+	*dst++ = (pj_uint8_t) pjmedia_ulaw2alaw(*src);
+	++src;
+    }
+}
@@ -17,15 +17,29 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA 
  */
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
 #include <pjmedia/clock.h>
 #include <pjmedia/errno.h>
 #include <pj/assert.h>
+#include <pj/errno.h>
 #include <pj/lock.h>
+#include <pj/log.h>
 #include <pj/os.h>
 #include <pj/pool.h>
 #include <pj/string.h>
 #include <pj/compat/high_precision.h>
 
+#if defined(PJMEDIA_CLOCK_HAS_POSIX_RT) && PJMEDIA_CLOCK_HAS_POSIX_RT!=0
+#   include <errno.h>
+#   include <pthread.h>
+#   include <sched.h>
+#   include <time.h>
+#endif
+
+#define THIS_FILE   "clock_thread.c"
+
 /* API: Init clock source */
 PJ_DEF(pj_status_t) pjmedia_clock_src_init( pjmedia_clock_src *clocksrc,
                                             pjmedia_type media_type,
@@ -107,8 +121,11 @@ pjmedia_clock_src_get_time_msec( const pjmedia_clock_src *clocksrc )
  * Implementation of media clock with OS thread.
  */
 
+struct clock_worker;
+
 struct pjmedia_clock
 {
+    PJ_DECL_LIST_MEMBER(struct pjmedia_clock);
     pj_pool_t		    *pool;
     pj_timestamp	     freq;
     pj_timestamp	     interval;
@@ -123,14 +140,72 @@ struct pjmedia_clock
     pj_bool_t		     running;
     pj_bool_t		     quitting;
     pj_lock_t		    *lock;
+    int			     cpu;
+    unsigned		     burst;
+    pjmedia_clock_stat	     stat;
+    struct clock_worker	    *worker;	/* Shared clock worker, if any	    */
+    unsigned		     sleep_seq;	/* Worker sleep_seq at last tick    */
 };
 
 
+/*
+ * Shared clocks (PJMEDIA_CLOCK_SHARED) don't have their own thread, but
+ * are served by a fixed pool of worker threads. Each worker runs all of
+ * its clocks which are due in a single pass, then sleeps until the
+ * earliest deadline among them, or until a clock is added. The worker
+ * mutex is released while a callback is called, and removing a clock
+ * waits for its running callback to return, so that a stopped clock is
+ * never called again.
+ */
+struct clock_list
+{
+    PJ_DECL_LIST_MEMBER(struct pjmedia_clock);
+};
+
+typedef struct clock_worker
+{
+    pj_thread_t		    *thread;
+    pj_mutex_t		    *mutex;
+    pj_sem_t		    *sem;	/* Wakes up idle worker		    */
+    struct clock_list	     clocks;	/* Clocks served by this worker	    */
+    unsigned		     clock_cnt;
+    unsigned		     hi_prio_cnt; /* Clocks wanting highest prio    */
+    unsigned		     sleep_seq;	/* Incremented on every sleep	    */
+    pj_bool_t		     changed;	/* Clock list has been modified	    */
+    pj_bool_t		     quitting;
+    pjmedia_clock	    *cb_clock;	/* Clock whose callback is running  */
+    pj_sem_t		    *cb_sem;	/* Wakes up threads waiting for the
+					   callback to return		    */
+    unsigned		     cb_waiters;
+    pj_bool_t		     wakeup;	/* Interrupt the sleep		    */
+#if defined(PJMEDIA_CLOCK_HAS_POSIX_RT) && PJMEDIA_CLOCK_HAS_POSIX_RT!=0
+    pj_bool_t		     has_cond;
+    pthread_mutex_t	     wake_mutex;
+    pthread_cond_t	     wake_cond;
+#endif
+} clock_worker;
+
+static struct clock_sched
+{
+    pj_caching_pool	     cp;
+    pj_pool_t		    *pool;
+    pj_timestamp	     freq;
+    clock_worker	     worker[PJMEDIA_CLOCK_SHARED_THREAD_CNT];
+} *clock_sched;
+
+
 static int clock_thread(void *arg);
+static pj_status_t shared_clock_add(pjmedia_clock *clock);
+static void shared_clock_remove(pjmedia_clock *clock);
 
 #define MAX_JUMP_MSEC	500
 #define USEC_IN_SEC	(pj_uint64_t)1000000
 
+/* Without POSIX_RT, the shared clock worker sleeps in slices of this
+ * length to notice new clocks.
+ */
+#define WAKEUP_CHECK_MSEC   10
+
 /*
  * Create media clock.
  */
@@ -164,6 +239,8 @@ PJ_DEF(pj_status_t) pjmedia_clock_create2(pj_pool_t *pool,
 
     PJ_ASSERT_RETURN(pool && param->usec_interval && param->clock_rate &&
                      p_clock, PJ_EINVAL);
+    PJ_ASSERT_RETURN((options & PJMEDIA_CLOCK_SHARED) == 0 ||
+		     (options & PJMEDIA_CLOCK_NO_ASYNC) == 0, PJ_EINVAL);
 
     clock = PJ_POOL_ALLOC_T(pool, pjmedia_clock);
     clock->pool = pj_pool_create(pool->factory, "clock%p", 512, 512, NULL);
@@ -186,6 +263,12 @@ PJ_DEF(pj_status_t) pjmedia_clock_create2(pj_pool_t *pool,
     clock->thread = NULL;
     clock->running = PJ_FALSE;
     clock->quitting = PJ_FALSE;
+    clock->cpu = -1;
+    clock->burst = 0;
+    pj_bzero(&clock->stat, sizeof(clock->stat));
+    clock->worker = NULL;
+    clock->sleep_seq = 0;
+    pj_list_init(clock);
     
     /* I don't think we need a mutex, so we'll use null. */
     status = pj_lock_create_null_mutex(pool, "clock", &clock->lock);
@@ -219,6 +302,13 @@ PJ_DEF(pj_status_t) pjmedia_clock_start(pjmedia_clock *clock)
     clock->running = PJ_TRUE;
     clock->quitting = PJ_FALSE;
 
+    if (clock->options & PJMEDIA_CLOCK_SHARED) {
+	status = shared_clock_add(clock);
+	if (status != PJ_SUCCESS)
+	    clock->running = PJ_FALSE;
+	return status;
+    }
+
     if ((clock->options & PJMEDIA_CLOCK_NO_ASYNC) == 0 && !clock->thread) {
 	status = pj_thread_create(clock->pool, "clock", &clock_thread, clock,
 				  0, 0, &clock->thread);
@@ -242,6 +332,9 @@ PJ_DEF(pj_status_t) pjmedia_clock_stop(pjmedia_clock *clock)
     clock->running = PJ_FALSE;
     clock->quitting = PJ_TRUE;
 
+    if (clock->worker)
+	shared_clock_remove(clock);
+
     if (clock->thread) {
 	if (pj_thread_join(clock->thread) == PJ_SUCCESS) {
 	    pj_thread_destroy(clock->thread);
@@ -272,6 +365,50 @@ PJ_DEF(pj_status_t) pjmedia_clock_modify(pjmedia_clock *clock,
 }
 
 
+/*
+ * Pin the clock thread to a CPU.
+ */
+PJ_DEF(pj_status_t) pjmedia_clock_set_cpu(pjmedia_clock *clock, int cpu)
+{
+    PJ_ASSERT_RETURN(clock != NULL, PJ_EINVAL);
+
+#if defined(PJMEDIA_CLOCK_HAS_POSIX_RT) && PJMEDIA_CLOCK_HAS_POSIX_RT!=0
+    if (clock->options & PJMEDIA_CLOCK_SHARED)
+	return PJ_EINVALIDOP;
+    clock->cpu = cpu;
+    return PJ_SUCCESS;
+#else
+    PJ_UNUSED_ARG(cpu);
+    return PJ_ENOTSUP;
+#endif
+}
+
+
+/*
+ * Get clock statistics.
+ */
+PJ_DEF(pj_status_t) pjmedia_clock_get_stat(const pjmedia_clock *clock,
+					   pjmedia_clock_stat *stat)
+{
+    PJ_ASSERT_RETURN(clock && stat, PJ_EINVAL);
+
+    pj_memcpy(stat, &clock->stat, sizeof(*stat));
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Reset clock statistics.
+ */
+PJ_DEF(pj_status_t) pjmedia_clock_reset_stat(pjmedia_clock *clock)
+{
+    PJ_ASSERT_RETURN(clock != NULL, PJ_EINVAL);
+
+    pj_bzero(&clock->stat, sizeof(clock->stat));
+    return PJ_SUCCESS;
+}
+
+
 /* Calculate next tick */
 PJ_INLINE(void) clock_calc_next_tick(pjmedia_clock *clock,
 				     pj_timestamp *now)
@@ -279,11 +416,93 @@ PJ_INLINE(void) clock_calc_next_tick(pjmedia_clock *clock,
     if (clock->next_tick.u64+clock->max_jump < now->u64) {
 	/* Timestamp has made large jump, adjust next_tick */
 	clock->next_tick.u64 = now->u64;
+	++clock->stat.resync_cnt;
     }
     clock->next_tick.u64 += clock->interval.u64;
 
 }
 
+/* Sleep until the deadline, and update the current time */
+#if defined(PJMEDIA_CLOCK_HAS_POSIX_RT) && PJMEDIA_CLOCK_HAS_POSIX_RT!=0
+/* Convert the deadline to CLOCK_MONOTONIC, since the timestamp may come
+ * from a different time source.
+ */
+static void get_monotonic_deadline(const pj_timestamp *freq,
+				   const pj_timestamp *now,
+				   const pj_timestamp *deadline,
+				   struct timespec *ts)
+{
+    pj_uint64_t nsec;
+
+    nsec = (deadline->u64 - now->u64) * 1000000000 / freq->u64;
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += (time_t)(nsec / 1000000000);
+    ts->tv_nsec += (long)(nsec % 1000000000);
+    if (ts->tv_nsec >= 1000000000) {
+	ts->tv_nsec -= 1000000000;
+	++ts->tv_sec;
+    }
+}
+#endif
+
+static void sleep_until(const pj_timestamp *freq, pj_timestamp *now,
+			const pj_timestamp *deadline, pj_bool_t high_res)
+{
+#if defined(PJMEDIA_CLOCK_HAS_POSIX_RT) && PJMEDIA_CLOCK_HAS_POSIX_RT!=0
+    if (high_res) {
+	struct timespec ts;
+
+	get_monotonic_deadline(freq, now, deadline, &ts);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+			       NULL) == EINTR)
+	    ;
+
+	pj_get_timestamp(now);
+	return;
+    }
+#else
+    PJ_UNUSED_ARG(freq);
+    PJ_UNUSED_ARG(high_res);
+#endif
+
+    pj_thread_sleep(pj_elapsed_msec(now, deadline));
+    pj_get_timestamp(now);
+}
+
+/* Sleep until the next tick, and update the current time */
+static void clock_sleep(pjmedia_clock *clock, pj_timestamp *now)
+{
+    sleep_until(&clock->freq, now, &clock->next_tick,
+		(clock->options & PJMEDIA_CLOCK_HIGH_RES) != 0);
+}
+
+/* Update statistics for the tick about to be called at "now" */
+static void clock_update_stat(pjmedia_clock *clock, const pj_timestamp *now,
+			      pj_bool_t slept)
+{
+    pjmedia_clock_stat *stat = &clock->stat;
+    pj_uint32_t late = 0;
+    unsigned i;
+
+    if (now->u64 > clock->next_tick.u64)
+	late = pj_elapsed_usec(&clock->next_tick, now);
+
+    ++stat->tick_cnt;
+    stat->total_late_usec += late;
+    if (late > stat->max_late_usec)
+	stat->max_late_usec = late;
+    if (now->u64 >= clock->next_tick.u64 + clock->interval.u64)
+	++stat->missed_cnt;
+
+    for (i = 0; i < PJMEDIA_CLOCK_LATE_HIST_CNT-1 && late >= (100U << i); ++i)
+	;
+    ++stat->late_hist[i];
+
+    clock->burst = slept ? 1 : clock->burst + 1;
+    if (clock->burst > stat->max_burst)
+	stat->max_burst = clock->burst;
+}
+
 /*
  * Poll the clock. 
  */
@@ -292,6 +511,7 @@ PJ_DEF(pj_bool_t) pjmedia_clock_wait( pjmedia_clock *clock,
 				      pj_timestamp *ts)
 {
     pj_timestamp now;
+    pj_bool_t slept;
     pj_status_t status;
 
     PJ_ASSERT_RETURN(clock != NULL, PJ_FALSE);
@@ -304,16 +524,16 @@ PJ_DEF(pj_bool_t) pjmedia_clock_wait( pjmedia_clock *clock,
 	return PJ_FALSE;
 
     /* Wait for the next tick to happen */
-    if (now.u64 < clock->next_tick.u64) {
-	unsigned msec;
-
+    slept = (now.u64 < clock->next_tick.u64);
+    if (slept) {
 	if (!wait)
 	    return PJ_FALSE;
 
-	msec = pj_elapsed_msec(&now, &clock->next_tick);
-	pj_thread_sleep(msec);
+	clock_sleep(clock, &now);
     }
 
+    clock_update_stat(clock, &now, slept);
+
     /* Call callback, if any */
     if (clock->cb)
 	(*clock->cb)(&clock->timestamp, clock->user_data);
@@ -339,10 +559,45 @@ PJ_DEF(pj_bool_t) pjmedia_clock_wait( pjmedia_clock *clock,
 static int clock_thread(void *arg)
 {
     pj_timestamp now;
+    pj_bool_t slept;
     pjmedia_clock *clock = (pjmedia_clock*) arg;
+    pj_bool_t rt_prio = PJ_FALSE;
+
+#if defined(PJMEDIA_CLOCK_HAS_POSIX_RT) && PJMEDIA_CLOCK_HAS_POSIX_RT!=0
+    /* Use real-time scheduling if wanted */
+    if (clock->options & PJMEDIA_CLOCK_REALTIME_PRIO) {
+	struct sched_param param;
+	int rc;
+
+	pj_bzero(&param, sizeof(param));
+	param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+	rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (rc == 0) {
+	    rt_prio = PJ_TRUE;
+	} else {
+	    PJ_PERROR(4,(THIS_FILE, PJ_RETURN_OS_ERROR(rc),
+			 "Unable to set SCHED_FIFO for clock thread"));
+	}
+    }
+
+    /* Pin the thread to the CPU, if set. On Linux, sched_setaffinity()
+     * with zero pid applies to the calling thread, and unlike
+     * pthread_setaffinity_np() it is also available on Android.
+     */
+    if (clock->cpu >= 0) {
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(clock->cpu, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+	    PJ_PERROR(4,(THIS_FILE, PJ_RETURN_OS_ERROR(errno),
+			 "Unable to pin clock thread to CPU %d", clock->cpu));
+	}
+    }
+#endif
 
     /* Set thread priority to maximum unless not wanted. */
-    if ((clock->options & PJMEDIA_CLOCK_NO_HIGHEST_PRIO) == 0) {
+    if (!rt_prio && (clock->options & PJMEDIA_CLOCK_NO_HIGHEST_PRIO) == 0) {
 	int max = pj_thread_get_prio_max(pj_thread_this());
 	if (max > 0)
 	    pj_thread_set_prio(pj_thread_this(), max);
@@ -358,11 +613,9 @@ static int clock_thread(void *arg)
 	pj_get_timestamp(&now);
 
 	/* Wait for the next tick to happen */
-	if (now.u64 < clock->next_tick.u64) {
-	    unsigned msec;
-	    msec = pj_elapsed_msec(&now, &clock->next_tick);
-	    pj_thread_sleep(msec);
-	}
+	slept = (now.u64 < clock->next_tick.u64);
+	if (slept)
+	    clock_sleep(clock, &now);
 
 	/* Skip if not running */
 	if (!clock->running) {
@@ -371,6 +624,8 @@ static int clock_thread(void *arg)
 	    continue;
 	}
 
+	clock_update_stat(clock, &now, slept);
+
 	pj_lock_acquire(clock->lock);
 
 	/* Call callback, if any */
@@ -394,6 +649,358 @@ static int clock_thread(void *arg)
 }
 
 
+/* Sleep until the deadline, or until the worker is woken up */
+static void shared_clock_sleep(clock_worker *w, pj_timestamp *now,
+			       const pj_timestamp *deadline)
+{
+    const pj_timestamp *freq = &clock_sched->freq;
+
+#if defined(PJMEDIA_CLOCK_HAS_POSIX_RT) && PJMEDIA_CLOCK_HAS_POSIX_RT!=0
+    struct timespec ts;
+
+    get_monotonic_deadline(freq, now, deadline, &ts);
+
+    pthread_mutex_lock(&w->wake_mutex);
+    while (!w->wakeup) {
+	if (pthread_cond_timedwait(&w->wake_cond, &w->wake_mutex,
+				   &ts) == ETIMEDOUT)
+	{
+	    break;
+	}
+    }
+    w->wakeup = PJ_FALSE;
+    pthread_mutex_unlock(&w->wake_mutex);
+
+    pj_get_timestamp(now);
+#else
+    while (!w->wakeup && now->u64 < deadline->u64) {
+	pj_timestamp slice;
+
+	slice.u64 = now->u64 + freq->u64 * WAKEUP_CHECK_MSEC / 1000;
+	if (slice.u64 > deadline->u64)
+	    slice.u64 = deadline->u64;
+	sleep_until(freq, now, &slice, PJ_FALSE);
+    }
+    w->wakeup = PJ_FALSE;
+#endif
+}
+
+/* Interrupt the sleep of the worker */
+static void shared_clock_wakeup(clock_worker *w)
+{
+#if defined(PJMEDIA_CLOCK_HAS_POSIX_RT) && PJMEDIA_CLOCK_HAS_POSIX_RT!=0
+    pthread_mutex_lock(&w->wake_mutex);
+    w->wakeup = PJ_TRUE;
+    pthread_cond_signal(&w->wake_cond);
+    pthread_mutex_unlock(&w->wake_mutex);
+#else
+    w->wakeup = PJ_TRUE;
+#endif
+}
+
+/*
+ * Shared clock worker thread
+ */
+static int shared_clock_thread(void *arg)
+{
+    clock_worker *w = (clock_worker*) arg;
+    int normal_prio, max_prio;
+    pj_bool_t hi_prio = PJ_FALSE;
+
+    normal_prio = pj_thread_get_prio(pj_thread_this());
+    max_prio = pj_thread_get_prio_max(pj_thread_this());
+
+    while (!w->quitting) {
+	pj_timestamp now, next;
+	pjmedia_clock *clock;
+
+	/* Wait until there is something to do */
+	if (w->clock_cnt == 0) {
+	    pj_sem_wait(w->sem);
+	    continue;
+	}
+
+	/* Run at the highest priority, unless all clocks are created
+	 * with PJMEDIA_CLOCK_NO_HIGHEST_PRIO.
+	 */
+	if ((w->hi_prio_cnt != 0) != hi_prio && max_prio > 0) {
+	    hi_prio = !hi_prio;
+	    pj_thread_set_prio(pj_thread_this(),
+			       hi_prio ? max_prio : normal_prio);
+	}
+
+	pj_mutex_lock(w->mutex);
+
+	pj_get_timestamp(&now);
+	next.u64 = now.u64 + clock_sched->freq.u64;
+	w->changed = PJ_FALSE;
+
+	/* Run all clocks which are due */
+	clock = w->clocks.next;
+	while (clock != (pjmedia_clock*)&w->clocks) {
+	    if (clock->next_tick.u64 <= now.u64) {
+		pj_timestamp ts = clock->timestamp;
+
+		/* The tick is part of a burst if the worker hasn't slept
+		 * since the previous tick of the clock.
+		 */
+		clock_update_stat(clock, &now,
+				  clock->sleep_seq != w->sleep_seq);
+		clock->sleep_seq = w->sleep_seq;
+
+		/* Advance the clock first, as it may be stopped or
+		 * destroyed in the callback.
+		 */
+		clock->timestamp.u64 += clock->timestamp_inc;
+		clock_calc_next_tick(clock, &now);
+
+		/* Call the callback without holding the mutex, so other
+		 * threads are not blocked by it. The clock must not be
+		 * touched afterwards, unless the list is unchanged.
+		 */
+		if (clock->cb) {
+		    w->cb_clock = clock;
+		    pj_mutex_unlock(w->mutex);
+
+		    (*clock->cb)(&ts, clock->user_data);
+
+		    pj_mutex_lock(w->mutex);
+		    w->cb_clock = NULL;
+		    while (w->cb_waiters) {
+			--w->cb_waiters;
+			pj_sem_post(w->cb_sem);
+		    }
+		}
+
+		/* Restart the pass if the list was modified */
+		if (w->changed)
+		    break;
+	    }
+
+	    if (clock->next_tick.u64 < next.u64)
+		next.u64 = clock->next_tick.u64;
+
+	    clock = clock->next;
+	}
+
+	pj_mutex_unlock(w->mutex);
+
+	if (w->changed)
+	    continue;
+
+	/* Sleep until the earliest deadline */
+	pj_get_timestamp(&now);
+	if (now.u64 < next.u64) {
+	    shared_clock_sleep(w, &now, &next);
+	    ++w->sleep_seq;
+	}
+    }
+
+    return 0;
+}
+
+/* Stop the shared clock workers, on library shutdown */
+static void shared_clock_shutdown(void)
+{
+    struct clock_sched *sched = clock_sched;
+    unsigned i;
+
+    if (!sched)
+	return;
+
+    for (i = 0; i < PJ_ARRAY_SIZE(sched->worker); ++i) {
+	clock_worker *w = &sched->worker[i];
+
+	if (w->thread) {
+	    w->quitting = PJ_TRUE;
+	    pj_sem_post(w->sem);
+	    shared_clock_wakeup(w);
+	    pj_thread_join(w->thread);
+	    pj_thread_destroy(w->thread);
+	}
+	if (w->cb_sem)
+	    pj_sem_destroy(w->cb_sem);
+	if (w->sem)
+	    pj_sem_destroy(w->sem);
+	if (w->mutex)
+	    pj_mutex_destroy(w->mutex);
+#if defined(PJMEDIA_CLOCK_HAS_POSIX_RT) && PJMEDIA_CLOCK_HAS_POSIX_RT!=0
+	if (w->has_cond) {
+	    pthread_cond_destroy(&w->wake_cond);
+	    pthread_mutex_destroy(&w->wake_mutex);
+	}
+#endif
+    }
+
+    clock_sched = NULL;
+    pj_pool_release(sched->pool);
+    pj_caching_pool_destroy(&sched->cp);
+}
+
+#if defined(PJMEDIA_CLOCK_HAS_POSIX_RT) && PJMEDIA_CLOCK_HAS_POSIX_RT!=0
+/* Create the condition variable to wake up the worker, which waits on
+ * CLOCK_MONOTONIC like sleep_until().
+ */
+static pj_status_t shared_clock_init_cond(clock_worker *w)
+{
+    pthread_condattr_t attr;
+    int rc;
+
+    rc = pthread_condattr_init(&attr);
+    if (rc == 0)
+	rc = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    if (rc == 0)
+	rc = pthread_cond_init(&w->wake_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (rc != 0)
+	return PJ_RETURN_OS_ERROR(rc);
+
+    rc = pthread_mutex_init(&w->wake_mutex, NULL);
+    if (rc != 0) {
+	pthread_cond_destroy(&w->wake_cond);
+	return PJ_RETURN_OS_ERROR(rc);
+    }
+
+    w->has_cond = PJ_TRUE;
+    return PJ_SUCCESS;
+}
+#endif
+
+/* Create the shared clock workers */
+static pj_status_t shared_clock_init(void)
+{
+    static struct clock_sched sched;
+    unsigned i;
+    pj_status_t status;
+
+    pj_bzero(&sched, sizeof(sched));
+
+    /* The workers outlive any application pool, so use own pool factory */
+    pj_caching_pool_init(&sched.cp, NULL, 0);
+    sched.pool = pj_pool_create(&sched.cp.factory, "clocksched", 512, 512,
+				NULL);
+    if (!sched.pool) {
+	pj_caching_pool_destroy(&sched.cp);
+	return PJ_ENOMEM;
+    }
+
+    pj_get_timestamp_freq(&sched.freq);
+
+    for (i = 0; i < PJ_ARRAY_SIZE(sched.worker); ++i) {
+	clock_worker *w = &sched.worker[i];
+
+	pj_list_init(&w->clocks);
+	status = pj_mutex_create_recursive(sched.pool, "clocksched",
+					   &w->mutex);
+	if (status == PJ_SUCCESS)
+	    status = pj_sem_create(sched.pool, "clocksched", 0, 1, &w->sem);
+	if (status == PJ_SUCCESS) {
+	    status = pj_sem_create(sched.pool, "clocksched", 0,
+				   PJ_MAXINT32, &w->cb_sem);
+	}
+#if defined(PJMEDIA_CLOCK_HAS_POSIX_RT) && PJMEDIA_CLOCK_HAS_POSIX_RT!=0
+	if (status == PJ_SUCCESS)
+	    status = shared_clock_init_cond(w);
+#endif
+	if (status != PJ_SUCCESS) {
+	    clock_sched = &sched;
+	    shared_clock_shutdown();
+	    return status;
+	}
+    }
+
+    clock_sched = &sched;
+    pj_atexit(&shared_clock_shutdown);
+
+    return PJ_SUCCESS;
+}
+
+/* Assign clock to the least loaded worker */
+static pj_status_t shared_clock_add(pjmedia_clock *clock)
+{
+    clock_worker *w;
+    unsigned i;
+    pj_status_t status = PJ_SUCCESS;
+
+    if (clock->worker)
+	return PJ_SUCCESS;
+
+    pj_enter_critical_section();
+
+    if (!clock_sched)
+	status = shared_clock_init();
+
+    if (status != PJ_SUCCESS) {
+	pj_leave_critical_section();
+	return status;
+    }
+
+    w = &clock_sched->worker[0];
+    for (i = 1; i < PJ_ARRAY_SIZE(clock_sched->worker); ++i) {
+	if (clock_sched->worker[i].clock_cnt < w->clock_cnt)
+	    w = &clock_sched->worker[i];
+    }
+
+    /* Workers are started on demand */
+    if (!w->thread) {
+	status = pj_thread_create(clock_sched->pool, "clocksched",
+				  &shared_clock_thread, w, 0, 0, &w->thread);
+	if (status != PJ_SUCCESS) {
+	    pj_leave_critical_section();
+	    return status;
+	}
+    }
+
+    pj_mutex_lock(w->mutex);
+    clock->worker = w;
+    clock->sleep_seq = w->sleep_seq - 1;
+    pj_list_push_back(&w->clocks, clock);
+    w->changed = PJ_TRUE;
+    if ((clock->options & PJMEDIA_CLOCK_NO_HIGHEST_PRIO) == 0)
+	++w->hi_prio_cnt;
+    if (w->clock_cnt++ == 0)
+	pj_sem_post(w->sem);
+    pj_mutex_unlock(w->mutex);
+
+    /* The worker may be sleeping past the first tick of this clock */
+    shared_clock_wakeup(w);
+
+    pj_leave_critical_section();
+
+    return PJ_SUCCESS;
+}
+
+/* Remove clock from its worker, and wait until its callback returns */
+static void shared_clock_remove(pjmedia_clock *clock)
+{
+    clock_worker *w = clock->worker;
+
+    pj_mutex_lock(w->mutex);
+    pj_list_erase(clock);
+    --w->clock_cnt;
+    if ((clock->options & PJMEDIA_CLOCK_NO_HIGHEST_PRIO) == 0)
+	--w->hi_prio_cnt;
+    w->changed = PJ_TRUE;
+    clock->worker = NULL;
+
+    if (w->cb_clock == clock) {
+	if (pj_thread_this() == w->thread) {
+	    /* Stopped or destroyed by its own callback */
+	    w->cb_clock = NULL;
+	} else {
+	    while (w->cb_clock == clock) {
+		++w->cb_waiters;
+		pj_mutex_unlock(w->mutex);
+		pj_sem_wait(w->cb_sem);
+		pj_mutex_lock(w->mutex);
+	    }
+	}
+    }
+
+    pj_mutex_unlock(w->mutex);
+}
+
+
 /*
  * Destroy the clock. 
  */
@@ -404,6 +1011,9 @@ PJ_DEF(pj_status_t) pjmedia_clock_destroy(pjmedia_clock *clock)
     clock->running = PJ_FALSE;
     clock->quitting = PJ_TRUE;
 
+    if (clock->worker)
+	shared_clock_remove(clock);
+
     if (clock->thread) {
 	pj_thread_join(clock->thread);
 	pj_thread_destroy(clock->thread);
@@ -26,6 +26,7 @@
 #include <pj/list.h>
 #include <pj/log.h>
 #include <pj/math.h>
+#include <pj/os.h>
 #include <pj/pool.h>
 #include "echo_internal.h"
 
@@ -39,6 +40,35 @@ struct frame
     short   buf[1];
 };
 
+/* Echo canceller worker thread. Captured and reference frames are queued
+ * in a ring of job slots by pjmedia_echo_capture() and processed by the
+ * worker in batches of "batch" consecutive slots.
+ */
+struct ec_worker
+{
+    pj_thread_t	    *thread;
+    pj_sem_t	    *sem;
+    pj_mutex_t	    *mutex;	    /* Protects the job ring and stat.	    */
+    pj_mutex_t	    *proc_mutex;    /* Held while the backend is running.   */
+    pj_bool_t	     quitting;
+
+    unsigned	     batch;	    /* Frames per backend call.		    */
+    unsigned	     delay;	    /* Output delay, in frames.		    */
+    unsigned	     slot_cnt;	    /* Number of job slots.		    */
+    pj_int16_t	    *in_buf;	    /* Captured frames.			    */
+    pj_int16_t	    *ref_buf;	    /* Reference (playback) frames.	    */
+    pj_int16_t	    *out_buf;	    /* Processed frames.		    */
+    pj_bool_t	    *done;	    /* Per slot, processed flag.	    */
+    unsigned	    *opt;	    /* Per slot, pjmedia_echo_capture()
+				       options.				    */
+
+    unsigned	     wr;	    /* Next slot to be filled by capture.   */
+    unsigned	     rd;	    /* Next slot to be processed.	    */
+    unsigned	     queued;	    /* Slots filled but not processed yet.  */
+    unsigned	     fill;	    /* Output delay built so far.	    */
+    unsigned	     gen;	    /* Incremented on reset.		    */
+};
+
 struct pjmedia_echo_state
 {
     pj_pool_t	    *pool;
@@ -53,6 +83,10 @@ struct pjmedia_echo_state
 
     pjmedia_delay_buf	*delay_buf;
     pj_int16_t	    *frm_buf;
+
+    struct ec_worker *worker;	    /* Worker, if PJMEDIA_ECHO_USE_WORKER.  */
+    pjmedia_echo_stat stat;	    /* Processing statistic.		    */
+    pj_uint64_t	     total_usec;    /* Total processing time.		    */
 };
 
 
@@ -124,6 +158,218 @@ static struct ec_operations ipp_aec_op =
 };
 #endif
 
+/* Update processing time statistic after the backend has processed
+ * frame_cnt frames in usec.
+ */
+static void update_stat(pjmedia_echo_state *ec, unsigned frame_cnt,
+			pj_uint32_t usec)
+{
+    unsigned per_frame = usec / frame_cnt;
+
+    ec->stat.proc_cnt += frame_cnt;
+    ec->total_usec += usec;
+    if (per_frame > ec->stat.max_proc_usec)
+	ec->stat.max_proc_usec = per_frame;
+}
+
+
+/* Worker thread: process the queued frames one batch at a time. */
+static int worker_thread(void *arg)
+{
+    pjmedia_echo_state *ec = (pjmedia_echo_state*) arg;
+    struct ec_worker *w = ec->worker;
+    unsigned spf = ec->samples_per_frame;
+
+    for (;;) {
+	unsigned i, slot, gen;
+	pj_timestamp t0, t1;
+
+	pj_sem_wait(w->sem);
+
+	pj_mutex_lock(w->mutex);
+	for (;;) {
+	    if (w->quitting || w->queued < w->batch)
+		break;
+
+	    /* Skip the batch if its last frame has been returned already */
+	    if (w->queued - w->batch >= w->delay) {
+		w->rd = (w->rd + w->batch) % w->slot_cnt;
+		w->queued -= w->batch;
+		continue;
+	    }
+
+	    slot = w->rd;
+	    gen = w->gen;
+	    pj_mutex_unlock(w->mutex);
+
+	    /* The slots of a batch are contiguous, since the number of
+	     * slots is a multiple of the batch.
+	     */
+	    pj_mutex_lock(w->proc_mutex);
+	    pj_get_timestamp(&t0);
+	    pjmedia_copy_samples(w->out_buf + slot * spf,
+				 w->in_buf + slot * spf, w->batch * spf);
+	    if (gen == w->gen) {
+		pjmedia_echo_cancel(ec, w->out_buf + slot * spf,
+				    w->ref_buf + slot * spf, w->opt[slot],
+				    NULL);
+	    }
+	    pj_get_timestamp(&t1);
+	    pj_mutex_unlock(w->proc_mutex);
+
+	    pj_mutex_lock(w->mutex);
+	    if (gen != w->gen)
+		continue;
+	    for (i = 0; i < w->batch; ++i)
+		w->done[slot + i] = PJ_TRUE;
+	    w->rd = (w->rd + w->batch) % w->slot_cnt;
+	    w->queued -= w->batch;
+	    update_stat(ec, w->batch, pj_elapsed_usec(&t0, &t1));
+	}
+	pj_mutex_unlock(w->mutex);
+
+	if (w->quitting)
+	    break;
+    }
+
+    return 0;
+}
+
+
+/* Create the worker thread and its job ring */
+static pj_status_t worker_create(pjmedia_echo_state *ec)
+{
+    struct ec_worker *w;
+    unsigned spf = ec->samples_per_frame;
+    pj_status_t status;
+
+    w = PJ_POOL_ZALLOC_T(ec->pool, struct ec_worker);
+    w->batch = ec->stat.batch;
+    w->delay = ec->stat.delay;
+
+    /* Room for the delayed frames plus the batch being filled and the
+     * batch being processed.
+     */
+    w->slot_cnt = (w->delay / w->batch + 3) * w->batch;
+    w->in_buf = (pj_int16_t*)
+		pj_pool_calloc(ec->pool, w->slot_cnt * spf, sizeof(pj_int16_t));
+    w->ref_buf = (pj_int16_t*)
+		 pj_pool_calloc(ec->pool, w->slot_cnt * spf, sizeof(pj_int16_t));
+    w->out_buf = (pj_int16_t*)
+		 pj_pool_calloc(ec->pool, w->slot_cnt * spf, sizeof(pj_int16_t));
+    w->done = (pj_bool_t*)
+	      pj_pool_calloc(ec->pool, w->slot_cnt, sizeof(pj_bool_t));
+    w->opt = (unsigned*)
+	     pj_pool_calloc(ec->pool, w->slot_cnt, sizeof(unsigned));
+
+    status = pj_mutex_create_simple(ec->pool, ec->obj_name, &w->mutex);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    status = pj_mutex_create_simple(ec->pool, ec->obj_name, &w->proc_mutex);
+    if (status != PJ_SUCCESS) {
+	pj_mutex_destroy(w->mutex);
+	return status;
+    }
+
+    status = pj_sem_create(ec->pool, ec->obj_name, 0, w->slot_cnt, &w->sem);
+    if (status != PJ_SUCCESS) {
+	pj_mutex_destroy(w->proc_mutex);
+	pj_mutex_destroy(w->mutex);
+	return status;
+    }
+
+    ec->worker = w;
+    status = pj_thread_create(ec->pool, ec->obj_name, &worker_thread, ec,
+			      0, 0, &w->thread);
+    if (status != PJ_SUCCESS) {
+	ec->worker = NULL;
+	pj_sem_destroy(w->sem);
+	pj_mutex_destroy(w->proc_mutex);
+	pj_mutex_destroy(w->mutex);
+	return status;
+    }
+
+    return PJ_SUCCESS;
+}
+
+
+/* Stop the worker thread */
+static void worker_destroy(struct ec_worker *w)
+{
+    pj_mutex_lock(w->mutex);
+    w->quitting = PJ_TRUE;
+    pj_mutex_unlock(w->mutex);
+
+    pj_sem_post(w->sem);
+    pj_thread_join(w->thread);
+    pj_thread_destroy(w->thread);
+
+    pj_sem_destroy(w->sem);
+    pj_mutex_destroy(w->proc_mutex);
+    pj_mutex_destroy(w->mutex);
+}
+
+
+/* Queue the captured frame and its reference frame to the worker, and
+ * return the frame captured "delay" frames earlier in rec_frm.
+ */
+static pj_status_t worker_submit(pjmedia_echo_state *ec,
+				 pj_int16_t *rec_frm,
+				 const pj_int16_t *play_frm,
+				 unsigned options)
+{
+    struct ec_worker *w = ec->worker;
+    unsigned spf = ec->samples_per_frame;
+    unsigned slot;
+    pj_bool_t batch_full;
+
+    pj_mutex_lock(w->mutex);
+
+    if (w->queued >= w->slot_cnt) {
+	/* The worker is stalled and this frame cannot be queued. Return
+	 * silence rather than the current frame, which would break the
+	 * constant delay of the output.
+	 */
+	pjmedia_zero_samples(rec_frm, spf);
+	++ec->stat.miss_cnt;
+	pj_mutex_unlock(w->mutex);
+	return PJ_SUCCESS;
+    }
+
+    slot = w->wr;
+    pjmedia_copy_samples(w->in_buf + slot * spf, rec_frm, spf);
+    pjmedia_copy_samples(w->ref_buf + slot * spf, play_frm, spf);
+    w->done[slot] = PJ_FALSE;
+    w->opt[slot] = options;
+    w->wr = (w->wr + 1) % w->slot_cnt;
+    ++w->queued;
+    batch_full = (w->wr % w->batch == 0);
+
+    if (w->fill < w->delay) {
+	/* Still building the output delay */
+	++w->fill;
+	pjmedia_zero_samples(rec_frm, spf);
+    } else {
+	slot = (slot + w->slot_cnt - w->delay) % w->slot_cnt;
+	if (w->done[slot]) {
+	    pjmedia_copy_samples(rec_frm, w->out_buf + slot * spf, spf);
+	} else {
+	    /* Missed the latency budget, return the unprocessed frame */
+	    pjmedia_copy_samples(rec_frm, w->in_buf + slot * spf, spf);
+	    ++ec->stat.miss_cnt;
+	}
+    }
+
+    pj_mutex_unlock(w->mutex);
+
+    if (batch_full)
+	pj_sem_post(w->sem);
+
+    return PJ_SUCCESS;
+}
+
+
 /*
  * Create the echo canceller. 
  */
@@ -196,19 +442,32 @@ PJ_DEF(pj_status_t) pjmedia_echo_create2(pj_pool_t *pool,
 
     PJ_LOG(5,(ec->obj_name, "Creating %s", ec->op->name));
 
+    /* With worker thread, the backend processes a batch of frames at once */
+    ec->stat.batch = 1;
+    if (options & PJMEDIA_ECHO_USE_WORKER) {
+	ec->stat.batch = (options & PJMEDIA_ECHO_WORKER_BATCH_MASK) >>
+			 PJMEDIA_ECHO_WORKER_BATCH_SHIFT;
+	if (ec->stat.batch == 0)
+	    ec->stat.batch = PJMEDIA_ECHO_WORKER_BATCH;
+	ec->stat.delay = PJ_MAX(PJMEDIA_ECHO_WORKER_DELAY, ec->stat.batch);
+    }
+
     /* Instantiate EC object */
     status = (*ec->op->ec_create)(pool, clock_rate, channel_count, 
-				  samples_per_frame, tail_ms, 
+				  samples_per_frame * ec->stat.batch, tail_ms, 
 				  options, &ec->state);
     if (status != PJ_SUCCESS) {
 	pj_pool_release(pool);
 	return status;
     }
 
-    /* If EC algo does not have playback and capture callbakcs,
-     * create latency buffer and delay buffer to handle drift.
+    /* If EC algo does not have playback and capture callbakcs, or if the
+     * worker needs the reference frames, create latency buffer and delay
+     * buffer to handle drift.
      */
-    if (ec->op->ec_playback && ec->op->ec_capture) {
+    if (ec->op->ec_playback && ec->op->ec_capture &&
+	(options & PJMEDIA_ECHO_USE_WORKER) == 0)
+    {
 	latency_ms = 0;
     } else {
 	/* Create latency buffers */
@@ -230,25 +489,40 @@ PJ_DEF(pj_status_t) pjmedia_echo_create2(pj_pool_t *pool,
 	    pj_list_push_back(&ec->lat_free, frm);
 	}
 
-	/* Create delay buffer to compensate drifts */
-	if (options & PJMEDIA_ECHO_USE_SIMPLE_FIFO)
+	/* Create delay buffer to compensate drifts. When the worker is used
+	 * with backend which has its own playback buffering, use simple FIFO
+	 * as the backend would, to keep the reference frames intact.
+	 */
+	if ((options & PJMEDIA_ECHO_USE_SIMPLE_FIFO) ||
+	    (ec->op->ec_playback && (options & PJMEDIA_ECHO_USE_WORKER)))
+	{
 	    delay_buf_opt |= PJMEDIA_DELAY_BUF_SIMPLE_FIFO;
+	}
 	status = pjmedia_delay_buf_create(ec->pool, ec->obj_name, clock_rate, 
 					  samples_per_frame, channel_count,
 					  (PJMEDIA_SOUND_BUFFER_COUNT+1) * ptime,
 					  delay_buf_opt, &ec->delay_buf);
 	if (status != PJ_SUCCESS) {
+	    (*ec->op->ec_destroy)(ec->state);
 	    pj_pool_release(pool);
 	    return status;
 	}
     }
 
+    if (options & PJMEDIA_ECHO_USE_WORKER) {
+	status = worker_create(ec);
+	if (status != PJ_SUCCESS) {
+	    pjmedia_echo_destroy(ec);
+	    return status;
+	}
+    }
+
     PJ_LOG(4,(ec->obj_name, 
 	      "%s created, clock_rate=%d, channel=%d, "
 	      "samples per frame=%d, tail length=%d ms, "
-	      "latency=%d ms", 
+	      "latency=%d ms%s", 
 	      ec->op->name, clock_rate, channel_count, samples_per_frame,
-	      tail_ms, latency_ms));
+	      tail_ms, latency_ms, (ec->worker ? ", on worker thread" : "")));
 
     /* Done */
     *p_echo = ec;
@@ -262,6 +536,9 @@ PJ_DEF(pj_status_t) pjmedia_echo_create2(pj_pool_t *pool,
  */
 PJ_DEF(pj_status_t) pjmedia_echo_destroy(pjmedia_echo_state *echo )
 {
+    if (echo->worker)
+	worker_destroy(echo->worker);
+
     (*echo->op->ec_destroy)(echo->state);
 
     if (echo->delay_buf) {
@@ -288,7 +565,46 @@ PJ_DEF(pj_status_t) pjmedia_echo_reset(pjmedia_echo_state *echo )
     echo->lat_ready = PJ_FALSE;
     if (echo->delay_buf)
 	pjmedia_delay_buf_reset(echo->delay_buf);
-    echo->op->ec_reset(echo->state);
+
+    if (echo->worker) {
+	struct ec_worker *w = echo->worker;
+
+	/* Discard the queued jobs and wait until the backend is idle */
+	pj_mutex_lock(w->proc_mutex);
+	pj_mutex_lock(w->mutex);
+	w->rd = w->wr = 0;
+	w->queued = 0;
+	w->fill = 0;
+	++w->gen;
+	echo->op->ec_reset(echo->state);
+	pj_mutex_unlock(w->mutex);
+	pj_mutex_unlock(w->proc_mutex);
+    } else {
+	echo->op->ec_reset(echo->state);
+    }
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Get the processing statistic.
+ */
+PJ_DEF(pj_status_t) pjmedia_echo_get_stat(pjmedia_echo_state *echo,
+					  pjmedia_echo_stat *stat)
+{
+    PJ_ASSERT_RETURN(echo && stat, PJ_EINVAL);
+
+    if (echo->worker)
+	pj_mutex_lock(echo->worker->mutex);
+
+    pj_memcpy(stat, &echo->stat, sizeof(*stat));
+    if (echo->stat.proc_cnt)
+	stat->avg_proc_usec = (unsigned)(echo->total_usec /
+					 echo->stat.proc_cnt);
+
+    if (echo->worker)
+	pj_mutex_unlock(echo->worker->mutex);
+
     return PJ_SUCCESS;
 }
 
@@ -300,7 +616,7 @@ PJ_DEF(pj_status_t) pjmedia_echo_playback( pjmedia_echo_state *echo,
 					   pj_int16_t *play_frm )
 {
     /* If EC algo has playback handler, just pass the frame. */
-    if (echo->op->ec_playback) {
+    if (echo->op->ec_playback && !echo->worker) {
 	return (*echo->op->ec_playback)(echo->state, play_frm);
     }
 
@@ -355,11 +671,18 @@ PJ_DEF(pj_status_t) pjmedia_echo_capture( pjmedia_echo_state *echo,
 					  unsigned options )
 {
     struct frame *oldest_frm;
+    pj_timestamp t0, t1;
     pj_status_t status, rc;
 
     /* If EC algo has capture handler, just pass the frame. */
-    if (echo->op->ec_capture) {
-	return (*echo->op->ec_capture)(echo->state, rec_frm, options);
+    if (echo->op->ec_capture && !echo->worker) {
+	pj_get_timestamp(&t0);
+	status = (*echo->op->ec_capture)(echo->state, rec_frm, options);
+	pj_get_timestamp(&t1);
+
+	++echo->stat.frame_cnt;
+	update_stat(echo, 1, pj_elapsed_usec(&t0, &t1));
+	return status;
     }
 
     if (!echo->lat_ready) {
@@ -373,8 +696,16 @@ PJ_DEF(pj_status_t) pjmedia_echo_capture( pjmedia_echo_state *echo,
     pj_list_erase(oldest_frm);
 
     /* Cancel echo using this reference frame */
-    status = pjmedia_echo_cancel(echo, rec_frm, oldest_frm->buf, 
-				 options, NULL);
+    ++echo->stat.frame_cnt;
+    if (echo->worker) {
+	status = worker_submit(echo, rec_frm, oldest_frm->buf, options);
+    } else {
+	pj_get_timestamp(&t0);
+	status = pjmedia_echo_cancel(echo, rec_frm, oldest_frm->buf, 
+				     options, NULL);
+	pj_get_timestamp(&t1);
+	update_stat(echo, 1, pj_elapsed_usec(&t0, &t1));
+    }
 
     /* Move one frame from delay buffer to the latency buffer. */
     rc = pjmedia_delay_buf_get(echo->delay_buf, oldest_frm->buf);
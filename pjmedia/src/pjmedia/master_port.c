@@ -26,12 +26,16 @@
 #include <pj/string.h>
 
 
+/* Space reserved for the frame structure in front of the buffer */
+#define FRAME_HDR_SIZE	((sizeof(pjmedia_frame_ext) + 7) & ~7)
+
 struct pjmedia_master_port
 {
     unsigned	     options;
     pjmedia_clock   *clock;
     pjmedia_port    *u_port;
     pjmedia_port    *d_port;
+    pjmedia_frame   *frame;
     unsigned	     buff_size;
     void	    *buff;
     pj_lock_t	    *lock;
@@ -100,18 +104,33 @@ PJ_DEF(pj_status_t) pjmedia_master_port_create( pj_pool_t *pool,
     m->d_port = d_port;
 
     
-    /* Create buffer */
+    /* Create buffer. The frame structure is placed at the start of the
+     * buffer, so that ports may return pjmedia_frame_ext (e.g. streams
+     * forwarding encoded frames), which subframes follow the structure.
+     */
     m->buff_size = bytes_per_frame;
-    m->buff = pj_pool_alloc(pool, m->buff_size);
-    if (!m->buff)
+    m->frame = (pjmedia_frame*)
+	       pj_pool_alloc(pool, FRAME_HDR_SIZE + m->buff_size);
+    if (!m->frame)
 	return PJ_ENOMEM;
+    m->buff = (pj_uint8_t*)m->frame + FRAME_HDR_SIZE;
 
     /* Create lock object */
     status = pj_lock_create_simple_mutex(pool, "mport", &m->lock);
     if (status != PJ_SUCCESS)
 	return status;
 
-    /* Create media clock */
+    /* Create media clock, served by the shared clock threads unless the
+     * port needs a clock thread of its own.
+     */
+#if defined(PJMEDIA_MASTER_PORT_SHARED_CLOCK) && \
+    PJMEDIA_MASTER_PORT_SHARED_CLOCK!=0
+    if ((options & (PJMEDIA_CLOCK_NO_ASYNC | PJMEDIA_CLOCK_HIGH_RES |
+		    PJMEDIA_CLOCK_REALTIME_PRIO)) == 0)
+    {
+	options |= PJMEDIA_CLOCK_SHARED;
+    }
+#endif
     status = pjmedia_clock_create(pool, clock_rate, channel_count, 
 				  samples_per_frame, options, &clock_callback,
 				  m, &m->clock);
@@ -166,7 +185,7 @@ PJ_DEF(pj_bool_t) pjmedia_master_port_wait( pjmedia_master_port *m,
 static void clock_callback(const pj_timestamp *ts, void *user_data)
 {
     pjmedia_master_port *m = (pjmedia_master_port*) user_data;
-    pjmedia_frame frame;
+    pjmedia_frame *frame = m->frame;
     pj_status_t status;
 
     
@@ -174,28 +193,28 @@ static void clock_callback(const pj_timestamp *ts, void *user_data)
     pj_lock_acquire(m->lock);
 
     /* Get frame from upstream port and pass it to downstream port */
-    pj_bzero(&frame, sizeof(frame));
-    frame.buf = m->buff;
-    frame.size = m->buff_size;
-    frame.timestamp.u64 = ts->u64;
+    pj_bzero(frame, sizeof(*frame));
+    frame->buf = m->buff;
+    frame->size = m->buff_size;
+    frame->timestamp.u64 = ts->u64;
 
-    status = pjmedia_port_get_frame(m->u_port, &frame);
+    status = pjmedia_port_get_frame(m->u_port, frame);
     if (status != PJ_SUCCESS)
-	frame.type = PJMEDIA_FRAME_TYPE_NONE;
+	frame->type = PJMEDIA_FRAME_TYPE_NONE;
 
-    status = pjmedia_port_put_frame(m->d_port, &frame);
+    status = pjmedia_port_put_frame(m->d_port, frame);
 
     /* Get frame from downstream port and pass it to upstream port */
-    pj_bzero(&frame, sizeof(frame));
-    frame.buf = m->buff;
-    frame.size = m->buff_size;
-    frame.timestamp.u64 = ts->u64;
+    pj_bzero(frame, sizeof(*frame));
+    frame->buf = m->buff;
+    frame->size = m->buff_size;
+    frame->timestamp.u64 = ts->u64;
 
-    status = pjmedia_port_get_frame(m->d_port, &frame);
+    status = pjmedia_port_get_frame(m->d_port, frame);
     if (status != PJ_SUCCESS)
-	frame.type = PJMEDIA_FRAME_TYPE_NONE;
+	frame->type = PJMEDIA_FRAME_TYPE_NONE;
 
-    status = pjmedia_port_put_frame(m->u_port, &frame);
+    status = pjmedia_port_put_frame(m->u_port, frame);
 
     /* Release lock */
     pj_lock_release(m->lock);
@@ -286,6 +305,16 @@ PJ_DEF(pjmedia_port*) pjmedia_master_port_get_dport(pjmedia_master_port*m)
 }
 
 
+/*
+ * Get the media clock.
+ */
+PJ_DEF(pjmedia_clock*) pjmedia_master_port_get_clock(pjmedia_master_port*m)
+{
+    PJ_ASSERT_RETURN(m, NULL);
+    return m->clock;
+}
+
+
 /*
  * Destroy the master port, and optionally destroy the u_port and 
  * d_port ports.
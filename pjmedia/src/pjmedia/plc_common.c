@@ -136,6 +136,8 @@ static void* plc_wsola_create(pj_pool_t *pool, unsigned clock_rate,
     flag = PJMEDIA_WSOLA_NO_DISCARD;
     if (PJMEDIA_WSOLA_PLC_NO_FADING)
 	flag |= PJMEDIA_WSOLA_NO_FADING;
+    if (PJMEDIA_WSOLA_PLC_COARSE_SEARCH)
+	flag |= PJMEDIA_WSOLA_COARSE_SEARCH;
 
     status = pjmedia_wsola_create(pool, clock_rate, samples_per_frame, 1,
 				  flag, &o->wsola);
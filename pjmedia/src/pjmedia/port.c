@@ -22,10 +22,61 @@
 #include <pj/assert.h>
 #include <pj/log.h>
 #include <pj/pool.h>
+#include <pj/string.h>
 
 #define THIS_FILE	"port.c"
 
 
+#if defined(PJMEDIA_PORT_HAS_PROFILING) && PJMEDIA_PORT_HAS_PROFILING!=0
+/* Account one get_frame()/put_frame() call which started at t0 */
+static void prof_update(pjmedia_port_op_prof *op, const pj_timestamp *t0)
+{
+    pj_timestamp t1;
+    pj_uint32_t usec;
+    unsigned i;
+
+    pj_get_timestamp(&t1);
+    usec = pj_elapsed_usec(t0, &t1);
+
+    ++op->count;
+    op->total_usec += usec;
+    if (usec > op->max_usec)
+	op->max_usec = usec;
+
+    for (i = 0; i < PJMEDIA_PORT_PROF_HIST_CNT-1 && usec >= (32U << i); ++i)
+	;
+    ++op->hist[i];
+}
+
+static void prof_dump(const pjmedia_port *port, const char *indent,
+		      const char *dir, const pjmedia_port_op_prof *op)
+{
+    char buf[160];
+    int len;
+    unsigned i;
+
+    if (op->count == 0)
+	return;
+
+    len = pj_ansi_snprintf(buf, sizeof(buf),
+			   "%s%.*s %s: %u calls, avg %u usec, max %u usec, "
+			   "hist(32us,x2):",
+			   indent, (int)port->info.name.slen,
+			   port->info.name.ptr, dir, op->count,
+			   (unsigned)(op->total_usec / op->count),
+			   op->max_usec);
+    for (i = 0; i < PJMEDIA_PORT_PROF_HIST_CNT && len > 0 &&
+		len < (int)sizeof(buf); ++i)
+    {
+	len += pj_ansi_snprintf(buf+len, sizeof(buf)-len, " %u",
+				op->hist[i]);
+    }
+
+    PJ_LOG(3,(THIS_FILE, "%s", buf));
+}
+#endif
+
+
 /**
  * This is an auxiliary function to initialize port info for
  * ports which deal with PCM audio.
@@ -94,9 +145,19 @@ PJ_DEF(pj_status_t) pjmedia_port_get_frame( pjmedia_port *port,
 {
     PJ_ASSERT_RETURN(port && frame, PJ_EINVAL);
 
-    if (port->get_frame)
+    if (port->get_frame) {
+#if defined(PJMEDIA_PORT_HAS_PROFILING) && PJMEDIA_PORT_HAS_PROFILING!=0
+	pj_timestamp t0;
+	pj_status_t status;
+
+	pj_get_timestamp(&t0);
+	status = port->get_frame(port, frame);
+	prof_update(&port->prof.get, &t0);
+	return status;
+#else
 	return port->get_frame(port, frame);
-    else {
+#endif
+    } else {
 	frame->type = PJMEDIA_FRAME_TYPE_NONE;
 	return PJ_EINVALIDOP;
     }
@@ -111,12 +172,75 @@ PJ_DEF(pj_status_t) pjmedia_port_put_frame( pjmedia_port *port,
 {
     PJ_ASSERT_RETURN(port && frame, PJ_EINVAL);
 
-    if (port->put_frame)
+    if (port->put_frame) {
+#if defined(PJMEDIA_PORT_HAS_PROFILING) && PJMEDIA_PORT_HAS_PROFILING!=0
+	pj_timestamp t0;
+	pj_status_t status;
+
+	pj_get_timestamp(&t0);
+	status = port->put_frame(port, frame);
+	prof_update(&port->prof.put, &t0);
+	return status;
+#else
 	return port->put_frame(port, frame);
-    else
+#endif
+    } else
 	return PJ_EINVALIDOP;
 }
 
+
+/**
+ * Get frame processing time statistics.
+ */
+PJ_DEF(pj_status_t) pjmedia_port_get_prof( const pjmedia_port *port,
+					   pjmedia_port_prof *prof )
+{
+    PJ_ASSERT_RETURN(port && prof, PJ_EINVAL);
+
+#if defined(PJMEDIA_PORT_HAS_PROFILING) && PJMEDIA_PORT_HAS_PROFILING!=0
+    pj_memcpy(prof, &port->prof, sizeof(*prof));
+    return PJ_SUCCESS;
+#else
+    pj_bzero(prof, sizeof(*prof));
+    return PJ_ENOTSUP;
+#endif
+}
+
+
+/**
+ * Reset frame processing time statistics.
+ */
+PJ_DEF(pj_status_t) pjmedia_port_reset_prof( pjmedia_port *port )
+{
+    PJ_ASSERT_RETURN(port, PJ_EINVAL);
+
+#if defined(PJMEDIA_PORT_HAS_PROFILING) && PJMEDIA_PORT_HAS_PROFILING!=0
+    pj_bzero(&port->prof, sizeof(port->prof));
+    return PJ_SUCCESS;
+#else
+    return PJ_ENOTSUP;
+#endif
+}
+
+
+/**
+ * Dump frame processing time statistics.
+ */
+PJ_DEF(void) pjmedia_port_dump_prof( const pjmedia_port *port,
+				     const char *indent )
+{
+    PJ_ASSERT_ON_FAIL(port, return);
+
+#if defined(PJMEDIA_PORT_HAS_PROFILING) && PJMEDIA_PORT_HAS_PROFILING!=0
+    if (!indent)
+	indent = "";
+    prof_dump(port, indent, "get", &port->prof.get);
+    prof_dump(port, indent, "put", &port->prof.put);
+#else
+    PJ_UNUSED_ARG(indent);
+#endif
+}
+
 /**
  * Destroy port (and subsequent downstream ports)
  */
@@ -0,0 +1,327 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include <pjmedia/resample.h>
+#include <pjmedia/errno.h>
+#include <pj/assert.h>
+#include <pj/log.h>
+#include <pj/pool.h>
+
+
+#if PJMEDIA_RESAMPLE_IMP==PJMEDIA_RESAMPLE_POLYPHASE
+
+#include <math.h>
+
+#if defined(PJMEDIA_RESAMPLE_POLYPHASE_SSE2) && \
+    PJMEDIA_RESAMPLE_POLYPHASE_SSE2!=0
+#   include <emmintrin.h>
+#endif
+
+#define THIS_FILE   "resample_polyphase.c"
+
+/*
+ * Rational polyphase resampler.
+ *
+ * The conversion ratio is reduced to up/down = rate_out/rate_in. The
+ * prototype low-pass filter (Kaiser windowed sinc, designed for the input
+ * upsampled by "up") is split into "up" sub-filters of "taps" coefficients
+ * each, stored in reverse order and in Q15, so that every output sample is
+ * a single dot product between one sub-filter and the most recent "taps"
+ * input samples. The sub-filter length is a multiple of eight so that the
+ * dot product maps directly to SSE2 multiply-add.
+ */
+
+/* Maximum number of phases (the reduced output rate factor) */
+#define MAX_PHASES  1024
+
+
+struct pjmedia_resample
+{
+    unsigned	 up;		/* Upsampling factor (number of phases)	    */
+    unsigned	 down;		/* Downsampling factor			    */
+    unsigned	 taps;		/* Coefficients per phase		    */
+    pj_int16_t	*coef;		/* Filter bank, up * taps coefficients	    */
+
+    unsigned	 channel_cnt;	/* Channel count.			    */
+    unsigned	 frame_size;	/* Input samples per frame per channel	    */
+    unsigned	 out_size;	/* Output samples per frame per channel	    */
+
+    pj_int16_t **buf;		/* Per channel history + input frame	    */
+    unsigned	 phase;		/* Phase of the next output sample	    */
+    unsigned	 pos;		/* Window start of the next output sample   */
+};
+
+
+static unsigned gcd(unsigned a, unsigned b)
+{
+    while (b) {
+	unsigned t = a % b;
+	a = b;
+	b = t;
+    }
+    return a;
+}
+
+/* Zeroth order modified Bessel function, for the Kaiser window */
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    unsigned k;
+
+    for (k = 1; k < 32; ++k) {
+	term *= (x / (2.0 * k)) * (x / (2.0 * k));
+	sum += term;
+	if (term < sum * 1e-12)
+	    break;
+    }
+    return sum;
+}
+
+/* Design the filter bank */
+static void design_filter(pjmedia_resample *rs, double cutoff, double beta)
+{
+    const double PI = 3.14159265358979323846;
+    unsigned total = rs->up * rs->taps;
+    double center = (total - 1) / 2.0;
+    double fc, i0_beta;
+    unsigned p, j;
+
+    /* Cut-off frequency, relative to the upsampled rate */
+    fc = cutoff * 0.5 / rs->up;
+    if (rs->down > rs->up)
+	fc = fc * rs->up / rs->down;
+
+    i0_beta = bessel_i0(beta);
+
+    for (p = 0; p < rs->up; ++p) {
+	for (j = 0; j < rs->taps; ++j) {
+	    /* Coefficient k of the prototype filter is applied to the
+	     * input sample which is (taps-1-j) samples older than the
+	     * newest sample of the window.
+	     */
+	    unsigned k = (rs->taps - 1 - j) * rs->up + p;
+	    double t = k - center;
+	    double r = t / center;
+	    double h, w;
+
+	    h = (t == 0.0) ? 2 * fc : sin(2 * PI * fc * t) / (PI * t);
+	    w = (r*r < 1.0) ? bessel_i0(beta * sqrt(1.0 - r*r)) / i0_beta : 0;
+
+	    /* Gain of "up" compensates the zero stuffing */
+	    h = h * w * rs->up * 32768.0;
+	    if (h > 32767.0) h = 32767.0;
+	    if (h < -32767.0) h = -32767.0;
+	    rs->coef[p * rs->taps + j] = (pj_int16_t)(h < 0 ? h-0.5 : h+0.5);
+	}
+    }
+}
+
+
+PJ_DEF(pj_status_t) pjmedia_resample_create( pj_pool_t *pool,
+					     pj_bool_t high_quality,
+					     pj_bool_t large_filter,
+					     unsigned channel_count,
+					     unsigned rate_in,
+					     unsigned rate_out,
+					     unsigned samples_per_frame,
+					     pjmedia_resample **p_resample)
+{
+    pjmedia_resample *resample;
+    double cutoff, beta;
+    unsigned g, i;
+
+    PJ_ASSERT_RETURN(pool && p_resample && rate_in && rate_out &&
+		     channel_count && samples_per_frame, PJ_EINVAL);
+
+    resample = PJ_POOL_ZALLOC_T(pool, pjmedia_resample);
+    PJ_ASSERT_RETURN(resample, PJ_ENOMEM);
+
+    g = gcd(rate_in, rate_out);
+    resample->up = rate_out / g;
+    resample->down = rate_in / g;
+    if (resample->up > MAX_PHASES) {
+	PJ_LOG(4,(THIS_FILE, "Unsupported conversion ratio %d/%d",
+		  rate_in, rate_out));
+	return PJ_ENOTSUP;
+    }
+
+    if (high_quality && large_filter) {
+	resample->taps = 48;
+	cutoff = 0.95;
+	beta = 8.0;
+    } else if (high_quality) {
+	resample->taps = 24;
+	cutoff = 0.91;
+	beta = 7.0;
+    } else {
+	resample->taps = 8;
+	cutoff = 0.80;
+	beta = 5.0;
+    }
+
+    /* Downsampling needs proportionally longer filters for the same
+     * transition band, relative to the input rate.
+     */
+    if (resample->down > resample->up) {
+	resample->taps = resample->taps * resample->down / resample->up;
+	resample->taps = (resample->taps + 7) & ~7;
+    }
+
+    resample->channel_cnt = channel_count;
+    resample->frame_size = samples_per_frame / channel_count;
+    resample->out_size = resample->frame_size * resample->up /
+			 resample->down;
+
+    /* Every frame must produce a whole number of output samples */
+    if (resample->out_size * resample->down !=
+	resample->frame_size * resample->up)
+    {
+	PJ_LOG(4,(THIS_FILE, "Frame size %d is not supported for in/out "
+		  "rate=%d/%d", samples_per_frame, rate_in, rate_out));
+	return PJ_EINVAL;
+    }
+
+    resample->coef = (pj_int16_t*)
+		     pj_pool_alloc(pool, resample->up * resample->taps *
+					 sizeof(pj_int16_t));
+    PJ_ASSERT_RETURN(resample->coef, PJ_ENOMEM);
+    design_filter(resample, cutoff, beta);
+
+    /* The buffer holds taps-1 history samples followed by the frame */
+    resample->buf = (pj_int16_t**)
+		    pj_pool_calloc(pool, channel_count, sizeof(pj_int16_t*));
+    for (i = 0; i < channel_count; ++i) {
+	resample->buf[i] = (pj_int16_t*)
+			   pj_pool_calloc(pool, resample->taps - 1 +
+						resample->frame_size,
+					  sizeof(pj_int16_t));
+	PJ_ASSERT_RETURN(resample->buf[i], PJ_ENOMEM);
+    }
+
+    *p_resample = resample;
+
+    PJ_LOG(5,(THIS_FILE, "resample created: %d phases, %d taps/phase, "
+			 "ch=%d, in/out rate=%d/%d",
+			 resample->up, resample->taps, channel_count,
+			 rate_in, rate_out));
+    return PJ_SUCCESS;
+}
+
+
+/* Dot product of one sub-filter with the input window */
+static pj_int16_t filter(const pj_int16_t *coef, const pj_int16_t *x,
+			 unsigned taps)
+{
+    pj_int32_t acc;
+    unsigned j;
+
+#if defined(PJMEDIA_RESAMPLE_POLYPHASE_SSE2) && \
+    PJMEDIA_RESAMPLE_POLYPHASE_SSE2!=0
+    __m128i sum = _mm_setzero_si128();
+
+    for (j = 0; j < taps; j += 8) {
+	__m128i c = _mm_loadu_si128((const __m128i*)(coef + j));
+	__m128i v = _mm_loadu_si128((const __m128i*)(x + j));
+	sum = _mm_add_epi32(sum, _mm_madd_epi16(c, v));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    acc = _mm_cvtsi128_si32(sum);
+#else
+    acc = 0;
+    for (j = 0; j < taps; ++j)
+	acc += coef[j] * x[j];
+#endif
+
+    acc = (acc + (1 << 14)) >> 15;
+    if (acc > 32767) acc = 32767;
+    else if (acc < -32768) acc = -32768;
+    return (pj_int16_t)acc;
+}
+
+
+PJ_DEF(void) pjmedia_resample_run( pjmedia_resample *resample,
+				   const pj_int16_t *input,
+				   pj_int16_t *output )
+{
+    unsigned hist, ch;
+    unsigned phase = 0, pos = 0;
+
+    PJ_ASSERT_ON_FAIL(resample, return);
+
+    hist = resample->taps - 1;
+
+    for (ch = 0; ch < resample->channel_cnt; ++ch) {
+	pj_int16_t *buf = resample->buf[ch];
+	const pj_int16_t *src;
+	pj_int16_t *dst;
+	unsigned i;
+
+	/* Append (and deinterleave) the input after the history */
+	src = input + ch;
+	for (i = 0; i < resample->frame_size; ++i) {
+	    buf[hist + i] = *src;
+	    src += resample->channel_cnt;
+	}
+
+	/* Output sample n is at input position n*down/up. Its window ends
+	 * at that input sample, i.e. starts at the same index in buf.
+	 */
+	phase = resample->phase;
+	pos = resample->pos;
+	dst = output + ch;
+	for (i = 0; i < resample->out_size; ++i) {
+	    *dst = filter(resample->coef + phase * resample->taps,
+			  buf + pos, resample->taps);
+	    dst += resample->channel_cnt;
+
+	    phase += resample->down;
+	    while (phase >= resample->up) {
+		phase -= resample->up;
+		++pos;
+	    }
+	}
+
+	/* Keep the newest samples as history for the next frame */
+	pjmedia_move_samples(buf, buf + resample->frame_size, hist);
+    }
+
+    resample->phase = phase;
+    resample->pos = pos - resample->frame_size;
+}
+
+
+PJ_DEF(unsigned) pjmedia_resample_get_input_size(pjmedia_resample *resample)
+{
+    PJ_ASSERT_RETURN(resample != NULL, 0);
+    return resample->frame_size * resample->channel_cnt;
+}
+
+
+PJ_DEF(void) pjmedia_resample_destroy(pjmedia_resample *resample)
+{
+    PJ_UNUSED_ARG(resample);
+}
+
+
+#else /* PJMEDIA_RESAMPLE_IMP==PJMEDIA_RESAMPLE_POLYPHASE */
+
+int pjmedia_resample_polyphase_excluded;
+
+#endif	/* PJMEDIA_RESAMPLE_IMP==PJMEDIA_RESAMPLE_POLYPHASE */
@@ -672,6 +672,21 @@ PJ_DEF(pj_status_t) pjmedia_snd_port_get_ec_tail( pjmedia_snd_port *snd_port,
 }
 
 
+/*
+ * Get software EC statistic.
+ */
+PJ_DEF(pj_status_t) pjmedia_snd_port_get_ec_stat( pjmedia_snd_port *snd_port,
+						  pjmedia_echo_stat *stat)
+{
+    PJ_ASSERT_RETURN(snd_port && stat, PJ_EINVAL);
+
+    if (!snd_port->ec_state)
+	return PJ_ENOTFOUND;
+
+    return pjmedia_echo_get_stat(snd_port->ec_state, stat);
+}
+
+
 /*
  * Get clock source.
  */
@@ -18,6 +18,7 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA 
  */
 #include <pjmedia/stream.h>
+#include <pjmedia/alaw_ulaw.h>
 #include <pjmedia/errno.h>
 #include <pjmedia/rtp.h>
 #include <pjmedia/rtcp.h>
@@ -226,6 +227,13 @@ struct pjmedia_stream
 #endif
 
     pj_uint32_t		     rtp_rx_last_ts;        /**< Last received RTP timestamp*/
+
+    /* Encoded frame forwarding, see pjmedia_stream_set_forward() */
+    pj_bool_t		     fwd_enabled;   /**< Forwarding encoded frames? */
+    void		   (*fwd_xcode)(pj_uint8_t*, const pj_uint8_t*,
+					pj_size_t);
+					    /**< Converts payload from the
+						 peer's G.711 law, or NULL. */
 };
 
 
@@ -737,6 +745,8 @@ static pj_status_t get_frame_ext( pjmedia_port *port, pjmedia_frame *frame)
     pjmedia_channel *channel = stream->dec;
     pjmedia_frame_ext *f = (pjmedia_frame_ext*)frame;
     unsigned samples_per_frame, samples_required;
+    pj_size_t buf_left = frame->size;
+    pj_bool_t fwd = PJ_FALSE;
     pj_status_t status;
 
     /* Return no frame if channel is paused */
@@ -766,6 +776,12 @@ static pj_status_t get_frame_ext( pjmedia_port *port, pjmedia_frame *frame)
 	/* Lock jitter buffer mutex first */
 	pj_mutex_lock( stream->jb_mutex );
 
+	/* Forwarding state is switched under this mutex, sample it once
+	 * per frame.
+	 */
+	if (f->samples_cnt == 0)
+	    fwd = stream->fwd_enabled;
+
 	/* Get frame from jitter buffer. */
 	pjmedia_jbuf_get_frame2(stream->jb, channel->out_pkt, &frame_size,
 			        &frame_type, &bit_info);
@@ -777,7 +793,24 @@ static pj_status_t get_frame_ext( pjmedia_port *port, pjmedia_frame *frame)
 	/* Unlock jitter buffer mutex. */
 	pj_mutex_unlock( stream->jb_mutex );
 
-	if (frame_type == PJMEDIA_JB_NORMAL_FRAME) {
+	if (fwd) {
+	    /* Forwarding: pass the payload as is without decoding, or
+	     * an empty subframe so that the loss is forwarded too.
+	     */
+	    if (frame_type != PJMEDIA_JB_NORMAL_FRAME)
+		frame_size = 0;
+	    if (buf_left < sizeof(pj_uint16_t) + frame_size) {
+		PJ_LOG(4,(port->info.name.ptr, "Frame buffer too small to "
+			  "forward %d bytes", (int)frame_size));
+		break;
+	    }
+	    buf_left -= sizeof(pj_uint16_t) + frame_size;
+
+	    pjmedia_frame_ext_append_subframe(f, channel->out_pkt,
+					      (unsigned)(frame_size << 3),
+					      samples_per_frame);
+
+	} else if (frame_type == PJMEDIA_JB_NORMAL_FRAME) {
 	    /* Got "NORMAL" frame from jitter buffer */
 	    pjmedia_frame frame_in;
 
@@ -1150,6 +1183,50 @@ static void rebuffer(pjmedia_stream *stream,
 }
 
 
+/*
+ * Build the RTP payload from the encoded subframes forwarded by the peer
+ * stream. Nothing is sent if any subframe is missing; the remote endpoint
+ * will conceal the loss.
+ */
+static void fwd_payload(pjmedia_stream *stream,
+			const pjmedia_frame_ext *f,
+			pjmedia_frame *frame_out)
+{
+    pj_uint8_t *dst = (pj_uint8_t*) frame_out->buf;
+    void (*xcode)(pj_uint8_t*, const pj_uint8_t*, pj_size_t);
+    const pj_uint8_t *p;
+    unsigned i, len = 0, max_len;
+
+    /* The conversion may be switched by pjmedia_stream_set_forward() */
+    xcode = stream->fwd_xcode;
+
+    max_len = stream->enc->out_pkt_size - sizeof(pjmedia_rtp_hdr);
+    p = (const pj_uint8_t*)f + sizeof(pjmedia_frame_ext);
+
+    for (i = 0; i < f->subframe_cnt; ++i) {
+	const pjmedia_frame_ext_subframe *sf;
+	unsigned n;
+
+	sf = (const pjmedia_frame_ext_subframe*) p;
+	n = (sf->bitlen + 7) >> 3;
+	if (n == 0 || len + n > max_len) {
+	    len = 0;
+	    break;
+	}
+
+	if (xcode)
+	    (*xcode)(dst + len, sf->data, n);
+	else
+	    pj_memcpy(dst + len, sf->data, n);
+
+	len += n;
+	p += sizeof(sf->bitlen) + n;
+    }
+
+    frame_out->size = len;
+}
+
+
 /**
  * put_frame_imp()
  */
@@ -1302,6 +1379,19 @@ static pj_status_t put_frame_imp( pjmedia_port *port,
 					 &rtphdrlen);
 
 
+    /* Relay encoded frame forwarded from the peer stream */
+    } else if (frame->type == PJMEDIA_FRAME_TYPE_EXTENDED &&
+	       stream->fwd_enabled)
+    {
+	fwd_payload(stream, (const pjmedia_frame_ext*)frame, &frame_out);
+
+	/* Encapsulate. Empty payload only updates RTP session's timestamp */
+	status = pjmedia_rtp_encode_rtp( &channel->rtp, 
+					 channel->pt, 0, 
+					 (int)frame_out.size, rtp_ts_len, 
+					 (const void**)&rtphdr, 
+					 &rtphdrlen);
+
     /* Encode audio frame */
     } else if ((frame->type == PJMEDIA_FRAME_TYPE_AUDIO &&
 	        frame->buf != NULL) ||
@@ -2706,6 +2796,123 @@ PJ_DEF(pj_status_t) pjmedia_stream_resume( pjmedia_stream *stream,
     return PJ_SUCCESS;
 }
 
+/* Compare fmtp parameters */
+static pj_bool_t fmtp_equal(const pjmedia_codec_fmtp *a,
+			    const pjmedia_codec_fmtp *b)
+{
+    unsigned i;
+
+    if (a->cnt != b->cnt)
+	return PJ_FALSE;
+
+    for (i = 0; i < a->cnt; ++i) {
+	if (pj_stricmp(&a->param[i].name, &b->param[i].name) != 0 ||
+	    pj_strcmp(&a->param[i].val, &b->param[i].val) != 0)
+	{
+	    return PJ_FALSE;
+	}
+    }
+
+    return PJ_TRUE;
+}
+
+/*
+ * Check if payload received by src can be sent by dst without
+ * transcoding, or only with G.711 law conversion.
+ */
+static pj_status_t check_fwd(const pjmedia_stream *src,
+			     const pjmedia_stream *dst,
+			     void (**xcode)(pj_uint8_t*, const pj_uint8_t*,
+					    pj_size_t))
+{
+    const pjmedia_codec_param *sp = &src->codec_param;
+    const pjmedia_codec_param *dp = &dst->codec_param;
+    const pj_str_t *sname = &src->si.fmt.encoding_name;
+    const pj_str_t *dname = &dst->si.fmt.encoding_name;
+
+    *xcode = NULL;
+
+    if (sp->info.clock_rate != dp->info.clock_rate ||
+	sp->info.channel_cnt != dp->info.channel_cnt ||
+	sp->info.frm_ptime != dp->info.frm_ptime ||
+	sp->setting.frm_per_pkt != dp->setting.frm_per_pkt ||
+	PJMEDIA_PIA_SPF(&src->port.info) != PJMEDIA_PIA_SPF(&dst->port.info) ||
+	dst->enc_buf != NULL)
+    {
+	return PJMEDIA_EBADFMT;
+    }
+
+    if (pj_stricmp(sname, dname) == 0) {
+	if (!fmtp_equal(&sp->setting.dec_fmtp, &dp->setting.enc_fmtp))
+	    return PJMEDIA_EBADFMT;
+	return PJ_SUCCESS;
+    }
+
+    if (pj_stricmp2(sname, "PCMA") == 0 && pj_stricmp2(dname, "PCMU") == 0)
+	*xcode = &pjmedia_alaw_to_ulaw;
+    else if (pj_stricmp2(sname, "PCMU")==0 && pj_stricmp2(dname, "PCMA")==0)
+	*xcode = &pjmedia_ulaw_to_alaw;
+    else
+	return PJMEDIA_EBADFMT;
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * Enable or disable encoded frame forwarding.
+ */
+PJ_DEF(pj_status_t) pjmedia_stream_set_forward(pjmedia_stream *stream,
+					       const pjmedia_stream *peer)
+{
+    void (*xcode)(pj_uint8_t*, const pj_uint8_t*, pj_size_t);
+    void (*unused)(pj_uint8_t*, const pj_uint8_t*, pj_size_t);
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(stream && stream != peer, PJ_EINVAL);
+
+    if (peer == NULL) {
+	/* Switch under the jitter buffer mutex, so get_frame_ext() never
+	 * mixes forwarded and decoded subframes in one frame.
+	 */
+	pj_mutex_lock(stream->jb_mutex);
+	if (stream->fwd_enabled) {
+	    stream->fwd_enabled = PJ_FALSE;
+	    stream->fwd_xcode = NULL;
+	    if (stream->codec_param.info.fmt_id == PJMEDIA_FORMAT_L16)
+		stream->port.get_frame = &get_frame;
+	    PJ_LOG(4,(stream->port.info.name.ptr, "Frame forwarding "
+		      "disabled"));
+	}
+	pj_mutex_unlock(stream->jb_mutex);
+	return PJ_SUCCESS;
+    }
+
+    /* Payload must be usable by both streams in both directions */
+    status = check_fwd(peer, stream, &xcode);
+    if (status == PJ_SUCCESS)
+	status = check_fwd(stream, peer, &unused);
+    if (status != PJ_SUCCESS) {
+	PJ_LOG(4,(stream->port.info.name.ptr, "Unable to forward frames "
+		  "with %s: incompatible codec %.*s",
+		  peer->port.info.name.ptr,
+		  (int)peer->si.fmt.encoding_name.slen,
+		  peer->si.fmt.encoding_name.ptr));
+	return status;
+    }
+
+    pj_mutex_lock(stream->jb_mutex);
+    stream->fwd_xcode = xcode;
+    stream->fwd_enabled = PJ_TRUE;
+    stream->port.get_frame = &get_frame_ext;
+    pj_mutex_unlock(stream->jb_mutex);
+
+    PJ_LOG(4,(stream->port.info.name.ptr, "Forwarding frames with %s%s",
+	      peer->port.info.name.ptr,
+	      (xcode ? " (G.711 law conversion)" : "")));
+
+    return PJ_SUCCESS;
+}
+
 /*
  * Dial DTMF
  */
@@ -175,6 +175,19 @@ struct pjmedia_vid_stream
 
     pj_timestamp	     ts_freq;	    /**< Timestamp frequency.	    */
 
+    pj_thread_t		    *enc_thread;    /**< Async encoding thread.	    */
+    pj_sem_t		    *enc_sem;	    /**< Queued pictures semaphore. */
+    pj_mutex_t		    *enc_mutex;	    /**< Protects the enc. queue.   */
+    pj_bool_t		     enc_quit;	    /**< Quit flag of enc. thread.  */
+    unsigned		     enc_slot_cnt;  /**< # of picture slots.	    */
+    unsigned		     enc_max_size;  /**< Size of picture slot.	    */
+    pjmedia_frame	    *enc_slots;	    /**< Raw picture slots.	    */
+    pj_bool_t		    *enc_slot_used; /**< Slot is queued or encoding.*/
+    unsigned		    *enc_queue;	    /**< Queued slot indices (FIFO).*/
+    unsigned		     enc_queue_head;/**< Oldest queued entry.	    */
+    unsigned		     enc_queue_cnt; /**< # of queued pictures.	    */
+    unsigned		     enc_drop_cnt;  /**< # of dropped pictures.	    */
+
 #if TRACE_RC
     unsigned		     rc_total_sleep;
     unsigned		     rc_total_pkt;
@@ -785,10 +798,10 @@ static void on_rx_rtcp( void *data,
     pjmedia_rtcp_rx_rtcp(&stream->rtcp, pkt, bytes_read);
 }
 
-static pj_status_t put_frame(pjmedia_port *port,
-                             pjmedia_frame *frame)
+/* Encode one picture and send the RTP packets */
+static pj_status_t encode_and_send(pjmedia_vid_stream *stream,
+				   pjmedia_frame *frame)
 {
-    pjmedia_vid_stream *stream = (pjmedia_vid_stream*) port->port_data.pdata;
     pjmedia_vid_channel *channel = stream->enc;
     pj_status_t status = 0;
     pjmedia_frame frame_out;
@@ -993,6 +1006,110 @@ static pj_status_t put_frame(pjmedia_port *port,
     return PJ_SUCCESS;
 }
 
+/* Async encoding thread: encode and send the queued pictures */
+static int enc_thread_proc(void *arg)
+{
+    pjmedia_vid_stream *stream = (pjmedia_vid_stream*) arg;
+
+    for (;;) {
+	unsigned slot;
+
+	pj_sem_wait(stream->enc_sem);
+
+	pj_mutex_lock(stream->enc_mutex);
+	if (stream->enc_quit) {
+	    pj_mutex_unlock(stream->enc_mutex);
+	    break;
+	}
+	if (stream->enc_queue_cnt == 0) {
+	    /* The picture has been dropped */
+	    pj_mutex_unlock(stream->enc_mutex);
+	    continue;
+	}
+	slot = stream->enc_queue[stream->enc_queue_head];
+	stream->enc_queue_head = (stream->enc_queue_head + 1) %
+				 stream->enc_slot_cnt;
+	--stream->enc_queue_cnt;
+	pj_mutex_unlock(stream->enc_mutex);
+
+	encode_and_send(stream, &stream->enc_slots[slot]);
+
+	pj_mutex_lock(stream->enc_mutex);
+	stream->enc_slot_used[slot] = PJ_FALSE;
+	pj_mutex_unlock(stream->enc_mutex);
+    }
+
+    return 0;
+}
+
+/* Queue a copy of the picture to the async encoding thread. If the queue
+ * is full, the oldest queued picture is dropped.
+ */
+static pj_status_t queue_frame(pjmedia_vid_stream *stream,
+			       const pjmedia_frame *frame)
+{
+    pjmedia_frame *dst;
+    unsigned i, slot;
+
+    if (frame->size > stream->enc_max_size) {
+	PJ_LOG(4,(stream->name.ptr, "Picture too large for encoding queue"));
+	return PJ_ETOOBIG;
+    }
+
+    pj_mutex_lock(stream->enc_mutex);
+
+    for (slot = 0; slot < stream->enc_slot_cnt; ++slot) {
+	if (!stream->enc_slot_used[slot])
+	    break;
+    }
+
+    if (slot == stream->enc_slot_cnt) {
+	/* All slots are in use, reuse the slot of the oldest queued picture.
+	 * There is always one, since only one slot is being encoded.
+	 */
+	slot = stream->enc_queue[stream->enc_queue_head];
+	stream->enc_queue_head = (stream->enc_queue_head + 1) %
+				 stream->enc_slot_cnt;
+	--stream->enc_queue_cnt;
+	++stream->enc_drop_cnt;
+	TRC_((stream->name.ptr, "Encoder is late, %d picture(s) dropped",
+	      stream->enc_drop_cnt));
+    }
+
+    dst = &stream->enc_slots[slot];
+    dst->type = frame->type;
+    dst->timestamp = frame->timestamp;
+    dst->bit_info = frame->bit_info;
+    dst->size = frame->size;
+    pj_memcpy(dst->buf, frame->buf, frame->size);
+    stream->enc_slot_used[slot] = PJ_TRUE;
+
+    i = (stream->enc_queue_head + stream->enc_queue_cnt) %
+	stream->enc_slot_cnt;
+    stream->enc_queue[i] = slot;
+    ++stream->enc_queue_cnt;
+
+    pj_mutex_unlock(stream->enc_mutex);
+
+    pj_sem_post(stream->enc_sem);
+
+    return PJ_SUCCESS;
+}
+
+static pj_status_t put_frame(pjmedia_port *port,
+                             pjmedia_frame *frame)
+{
+    pjmedia_vid_stream *stream = (pjmedia_vid_stream*) port->port_data.pdata;
+
+    /* Only the encoding thread may encode, so the pictures are queued even
+     * when the stream is paused, encode_and_send() will then drop them.
+     */
+    if (stream->enc_thread)
+	return queue_frame(stream, frame);
+
+    return encode_and_send(stream, frame);
+}
+
 /* Decode one image from jitter buffer */
 static pj_status_t decode_frame(pjmedia_vid_stream *stream,
                                 pjmedia_frame *frame)
@@ -1347,6 +1464,60 @@ static pj_status_t create_channel( pj_pool_t *pool,
 }
 
 
+/* queue_frame() relies on at least one queued picture to drop */
+#if PJMEDIA_VID_STREAM_ENC_QUEUE_LEN < 1
+#   error PJMEDIA_VID_STREAM_ENC_QUEUE_LEN must be at least 1
+#endif
+
+/*
+ * Create the async encoding thread.
+ */
+static pj_status_t create_enc_thread(pj_pool_t *pool,
+				     pjmedia_vid_stream *stream,
+				     const pjmedia_video_format_detail *vfd)
+{
+    unsigned i;
+    pj_status_t status;
+
+    /* One slot more than the queue length, for the picture being
+     * encoded.
+     */
+    stream->enc_slot_cnt = PJMEDIA_VID_STREAM_ENC_QUEUE_LEN + 1;
+    stream->enc_max_size = vfd->size.w * vfd->size.h * 4;
+    stream->enc_slots = (pjmedia_frame*)
+			pj_pool_calloc(pool, stream->enc_slot_cnt,
+				       sizeof(pjmedia_frame));
+    stream->enc_slot_used = (pj_bool_t*)
+			    pj_pool_calloc(pool, stream->enc_slot_cnt,
+					   sizeof(pj_bool_t));
+    stream->enc_queue = (unsigned*)
+			pj_pool_calloc(pool, stream->enc_slot_cnt,
+				       sizeof(unsigned));
+    for (i = 0; i < stream->enc_slot_cnt; ++i) {
+	stream->enc_slots[i].buf = pj_pool_alloc(pool, stream->enc_max_size);
+	PJ_ASSERT_RETURN(stream->enc_slots[i].buf, PJ_ENOMEM);
+    }
+
+    status = pj_mutex_create_simple(pool, NULL, &stream->enc_mutex);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    status = pj_sem_create(pool, NULL, 0, stream->enc_slot_cnt,
+			   &stream->enc_sem);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    status = pj_thread_create(pool, "vstenc%p", &enc_thread_proc, stream,
+			      0, 0, &stream->enc_thread);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    PJ_LOG(5,(THIS_FILE, "Video stream %s encodes asynchronously",
+	      stream->name.ptr));
+    return PJ_SUCCESS;
+}
+
+
 /*
  * Create stream.
  */
@@ -1531,6 +1702,13 @@ PJ_DEF(pj_status_t) pjmedia_vid_stream_create(
     stream->dec_max_size = vfd_dec->size.w * vfd_dec->size.h * 4;
     stream->dec_frame.buf = pj_pool_alloc(pool, stream->dec_max_size);
 
+    /* Create async encoding thread and its picture queue */
+    if (info->async_enc && (info->dir & PJMEDIA_DIR_ENCODING)) {
+	status = create_enc_thread(pool, stream, vfd_enc);
+	if (status != PJ_SUCCESS)
+	    return status;
+    }
+
     /* Init jitter buffer parameters: */
     frm_ptime	    = 1000 * vfd_enc->fps.denum / vfd_enc->fps.num;
     chunks_per_frm  = stream->frame_size / PJMEDIA_MAX_MRU;
@@ -1692,6 +1870,25 @@ PJ_DEF(pj_status_t) pjmedia_vid_stream_destroy( pjmedia_vid_stream *stream )
     }
 #endif
 
+    /* Stop the async encoding thread */
+    if (stream->enc_thread) {
+	pj_mutex_lock(stream->enc_mutex);
+	stream->enc_quit = PJ_TRUE;
+	pj_mutex_unlock(stream->enc_mutex);
+	pj_sem_post(stream->enc_sem);
+	pj_thread_join(stream->enc_thread);
+	pj_thread_destroy(stream->enc_thread);
+	stream->enc_thread = NULL;
+    }
+    if (stream->enc_sem) {
+	pj_sem_destroy(stream->enc_sem);
+	stream->enc_sem = NULL;
+    }
+    if (stream->enc_mutex) {
+	pj_mutex_destroy(stream->enc_mutex);
+	stream->enc_mutex = NULL;
+    }
+
     /* Send RTCP BYE (also SDES) */
     if (!stream->rtcp_sdes_bye_disabled) {
 	send_rtcp(stream, PJ_TRUE, PJ_TRUE);
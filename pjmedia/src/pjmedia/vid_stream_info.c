@@ -380,6 +380,9 @@ PJ_DEF(pj_status_t) pjmedia_vid_stream_info_from_sdp(
     /* Set default jitter buffer parameter. */
     si->jb_init = si->jb_max = si->jb_min_pre = si->jb_max_pre = -1;
 
+    /* Encoding mode */
+    si->async_enc = PJMEDIA_VID_STREAM_ASYNC_ENCODE;
+
     return status;
 }
 
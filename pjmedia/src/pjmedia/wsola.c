@@ -43,6 +43,11 @@
 #endif
 
 
+#if defined(PJMEDIA_WSOLA_SSE2) && PJMEDIA_WSOLA_SSE2!=0
+#   include <emmintrin.h>
+#endif
+
+
 #if 0
 #   define TRACE_(x)	PJ_LOG(4,x)
 #else
@@ -144,6 +149,7 @@ struct pjmedia_wsola
     pj_uint16_t		 expand_sr_max_dist;/* Maximum distance from template 
 					       for find_pitch() on expansion
 					       (const)			    */
+    pj_uint16_t		 search_step;	    /* find_pitch() coarse step     */
 
 #if defined(PJ_HAS_FLOATING_POINT) && PJ_HAS_FLOATING_POINT!=0
     float		*hanning;	    /* Hanning window.		    */
@@ -166,13 +172,15 @@ struct pjmedia_wsola
  * diff level = (template[1]+..+template[n]) - (target[1]+..+target[n])
  */
 static pj_int16_t *find_pitch(pj_int16_t *frm, pj_int16_t *beg, pj_int16_t *end, 
-			 unsigned template_cnt, int first)
+			 unsigned template_cnt, int first, unsigned step)
 {
     pj_int16_t *sr, *best=beg;
     int best_corr = 0x7FFFFFFF;
     int frm_sum = 0;
     unsigned i;
 
+    PJ_UNUSED_ARG(step);
+
     for (i = 0; i<template_cnt; ++i)
 	frm_sum += frm[i];
 
@@ -224,48 +232,70 @@ static pj_int16_t *find_pitch(pj_int16_t *frm, pj_int16_t *beg, pj_int16_t *end,
 
 #if (PJMEDIA_WSOLA_IMP==PJMEDIA_WSOLA_IMP_WSOLA)
 
-static pj_int16_t *find_pitch(pj_int16_t *frm, pj_int16_t *beg, pj_int16_t *end, 
-			 unsigned template_cnt, int first)
-{
-    pj_int16_t *sr, *best=beg;
-    double best_corr = 0;
+typedef double corr_t;
 
-    for (sr=beg; sr!=end; ++sr) {
-	double corr = 0;
-	unsigned i;
+/* Correlation of the template with the search position */
+static corr_t correlate(const pj_int16_t *frm, const pj_int16_t *sr,
+			unsigned template_cnt)
+{
+    unsigned i;
 
-	/* Do calculation on 8 samples at once */
-	for (i=0; i<template_cnt-8; i += 8) {
-	    corr += ((float)frm[i+0]) * ((float)sr[i+0]) + 
-		    ((float)frm[i+1]) * ((float)sr[i+1]) + 
-		    ((float)frm[i+2]) * ((float)sr[i+2]) + 
-		    ((float)frm[i+3]) * ((float)sr[i+3]) + 
-		    ((float)frm[i+4]) * ((float)sr[i+4]) + 
-		    ((float)frm[i+5]) * ((float)sr[i+5]) + 
-		    ((float)frm[i+6]) * ((float)sr[i+6]) + 
-		    ((float)frm[i+7]) * ((float)sr[i+7]);
-	}
+#if defined(PJMEDIA_WSOLA_SSE2) && PJMEDIA_WSOLA_SSE2!=0
+    /* Multiply-add eight samples at once. The 32bit pair sums are
+     * accumulated as doubles, so the result is exact. The only pair sum
+     * which does not fit, 2 * (-32768 * -32768), wraps to INT_MIN, which
+     * no other pair can produce, so such pairs are counted and corrected
+     * afterwards.
+     */
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    __m128i wrap_cnt = _mm_setzero_si128();
+    const __m128i int_min = _mm_set1_epi32((int)0x80000000);
+    double sum[2];
+    int wraps[4];
+    corr_t corr;
+
+    for (i=0; i+8 <= template_cnt; i += 8) {
+	__m128i f = _mm_loadu_si128((const __m128i*)(frm + i));
+	__m128i v = _mm_loadu_si128((const __m128i*)(sr + i));
+	__m128i p = _mm_madd_epi16(f, v);
+
+	wrap_cnt = _mm_sub_epi32(wrap_cnt, _mm_cmpeq_epi32(p, int_min));
+	acc0 = _mm_add_pd(acc0, _mm_cvtepi32_pd(p));
+	acc1 = _mm_add_pd(acc1, _mm_cvtepi32_pd(_mm_shuffle_epi32(p, 0x4E)));
+    }
+    _mm_storeu_pd(sum, _mm_add_pd(acc0, acc1));
+    _mm_storeu_si128((__m128i*)wraps, wrap_cnt);
+    corr = sum[0] + sum[1] +
+	   4294967296.0 * (wraps[0] + wraps[1] + wraps[2] + wraps[3]);
+
+    /* Process remaining samples. */
+    for (; i<template_cnt; ++i) {
+	corr += ((float)frm[i]) * ((float)sr[i]);
+    }
 
-	/* Process remaining samples. */
-	for (; i<template_cnt; ++i) {
-	    corr += ((float)frm[i]) * ((float)sr[i]);
-	}
+    return corr;
+#else
+    corr_t corr = 0;
+
+    /* Do calculation on 8 samples at once */
+    for (i=0; i<template_cnt-8; i += 8) {
+	corr += ((float)frm[i+0]) * ((float)sr[i+0]) + 
+		((float)frm[i+1]) * ((float)sr[i+1]) + 
+		((float)frm[i+2]) * ((float)sr[i+2]) + 
+		((float)frm[i+3]) * ((float)sr[i+3]) + 
+		((float)frm[i+4]) * ((float)sr[i+4]) + 
+		((float)frm[i+5]) * ((float)sr[i+5]) + 
+		((float)frm[i+6]) * ((float)sr[i+6]) + 
+		((float)frm[i+7]) * ((float)sr[i+7]);
+    }
 
-	if (first) {
-	    if (corr > best_corr) {
-		best_corr = corr;
-		best = sr;
-	    }
-	} else {
-	    if (corr >= best_corr) {
-		best_corr = corr;
-		best = sr;
-	    }
-	}
+    /* Process remaining samples. */
+    for (; i<template_cnt; ++i) {
+	corr += ((float)frm[i]) * ((float)sr[i]);
     }
 
-    /*TRACE_((THIS_FILE, "found pitch at %u", best-beg));*/
-    return best;
+    return corr;
+#endif
 }
 
 #endif
@@ -314,49 +344,33 @@ enum { WINDOW_MAX_VAL = (1 << WINDOW_BITS)-1 };
 
 #if (PJMEDIA_WSOLA_IMP==PJMEDIA_WSOLA_IMP_WSOLA)
 
-static pj_int16_t *find_pitch(pj_int16_t *frm, pj_int16_t *beg, pj_int16_t *end, 
-			 unsigned template_cnt, int first)
-{
-    pj_int16_t *sr, *best=beg;
-    pj_int64_t best_corr = 0;
-
-    
-    for (sr=beg; sr!=end; ++sr) {
-	pj_int64_t corr = 0;
-	unsigned i;
+typedef pj_int64_t corr_t;
 
-	/* Do calculation on 8 samples at once */
-	for (i=0; i<template_cnt-8; i+=8) {
-	    corr += ((int)frm[i+0]) * ((int)sr[i+0]) + 
-		    ((int)frm[i+1]) * ((int)sr[i+1]) + 
-		    ((int)frm[i+2]) * ((int)sr[i+2]) +
-		    ((int)frm[i+3]) * ((int)sr[i+3]) +
-		    ((int)frm[i+4]) * ((int)sr[i+4]) +
-		    ((int)frm[i+5]) * ((int)sr[i+5]) +
-		    ((int)frm[i+6]) * ((int)sr[i+6]) +
-		    ((int)frm[i+7]) * ((int)sr[i+7]);
-	}
+/* Correlation of the template with the search position */
+static corr_t correlate(const pj_int16_t *frm, const pj_int16_t *sr,
+			unsigned template_cnt)
+{
+    corr_t corr = 0;
+    unsigned i;
 
-	/* Process remaining samples. */
-	for (; i<template_cnt; ++i) {
-	    corr += ((int)frm[i]) * ((int)sr[i]);
-	}
+    /* Do calculation on 8 samples at once */
+    for (i=0; i<template_cnt-8; i+=8) {
+	corr += ((int)frm[i+0]) * ((int)sr[i+0]) + 
+		((int)frm[i+1]) * ((int)sr[i+1]) + 
+		((int)frm[i+2]) * ((int)sr[i+2]) +
+		((int)frm[i+3]) * ((int)sr[i+3]) +
+		((int)frm[i+4]) * ((int)sr[i+4]) +
+		((int)frm[i+5]) * ((int)sr[i+5]) +
+		((int)frm[i+6]) * ((int)sr[i+6]) +
+		((int)frm[i+7]) * ((int)sr[i+7]);
+    }
 
-	if (first) {
-	    if (corr > best_corr) {
-		best_corr = corr;
-		best = sr;
-	    }
-	} else {
-	    if (corr >= best_corr) {
-		best_corr = corr;
-		best = sr;
-	    }
-	}
+    /* Process remaining samples. */
+    for (; i<template_cnt; ++i) {
+	corr += ((int)frm[i]) * ((int)sr[i]);
     }
 
-    /*TRACE_((THIS_FILE, "found pitch at %u", best-beg));*/
-    return best;
+    return corr;
 }
 
 #endif
@@ -439,6 +453,58 @@ static void create_win(pj_pool_t *pool, pj_uint16_t **pw, unsigned count)
 
 #endif	/* PJ_HAS_FLOATING_POINT */
 
+
+#if (PJMEDIA_WSOLA_IMP==PJMEDIA_WSOLA_IMP_WSOLA)
+
+/* Scan every step-th position in [beg, end) for the best correlation */
+static pj_int16_t *search_pitch(pj_int16_t *frm, pj_int16_t *beg,
+				pj_int16_t *end, unsigned template_cnt,
+				int first, unsigned step)
+{
+    pj_int16_t *sr, *best=beg;
+    corr_t best_corr = 0;
+
+    for (sr=beg; sr<end; sr+=step) {
+	corr_t corr = correlate(frm, sr, template_cnt);
+
+	if (first) {
+	    if (corr > best_corr) {
+		best_corr = corr;
+		best = sr;
+	    }
+	} else {
+	    if (corr >= best_corr) {
+		best_corr = corr;
+		best = sr;
+	    }
+	}
+    }
+
+    return best;
+}
+
+/* Find the position in [beg, end) which is most similar to the template.
+ * With coarse search (step > 1), the range is scanned at every step-th
+ * position first, and then the neighborhood of the best candidate is
+ * scanned at every position.
+ */
+static pj_int16_t *find_pitch(pj_int16_t *frm, pj_int16_t *beg, pj_int16_t *end, 
+			 unsigned template_cnt, int first, unsigned step)
+{
+    pj_int16_t *best;
+
+    if (step <= 1 || end - beg <= (int)(step * 2))
+	return search_pitch(frm, beg, end, template_cnt, first, 1);
+
+    best = search_pitch(frm, beg, end, template_cnt, first, step);
+    beg = PJ_MAX(beg, best - (step - 1));
+    end = PJ_MIN(end, best + step);
+
+    return search_pitch(frm, beg, end, template_cnt, first, 1);
+}
+
+#endif
+
 /* Apply fade-in to the buffer.
  *  - fade_cnt is the number of samples on which the volume
  *       will go from zero to 100%
@@ -548,6 +614,11 @@ PJ_DEF(pj_status_t) pjmedia_wsola_create( pj_pool_t *pool,
 
     pj_assert(wsola->templ_size <= wsola->hanning_size);
 
+    /* Search step of coarse-to-fine similarity search */
+    wsola->search_step = 1;
+    if (options & PJMEDIA_WSOLA_COARSE_SEARCH)
+	wsola->search_step = PJMEDIA_WSOLA_COARSE_STEP;
+
     /* Create merge buffer */
     wsola->merge_buf = (pj_int16_t*) pj_pool_calloc(pool, 
 						    wsola->hanning_size,
@@ -637,7 +708,7 @@ static void expand(pjmedia_wsola *wsola, unsigned needed)
 			   templ - wsola->expand_sr_max_dist, 
 			   templ - wsola->expand_sr_min_dist,
 			   wsola->templ_size, 
-			   1);
+			   1, wsola->search_step);
 
 	/* Should we make sure that "start" is really aligned to
 	 * channel #0, in case of stereo? Probably not necessary, as
@@ -718,7 +789,8 @@ static unsigned compress(pjmedia_wsola *wsola, pj_int16_t *buf, unsigned count,
 
 	CHECK_(start < end);
 
-	start = find_pitch(buf, start, end, wsola->templ_size, 0);
+	start = find_pitch(buf, start, end, wsola->templ_size, 0,
+			   wsola->search_step);
 	dist = (unsigned)(start - buf);
 
 	if (wsola->options & PJMEDIA_WSOLA_NO_HANNING) {
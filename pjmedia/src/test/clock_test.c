@@ -0,0 +1,275 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+#define THIS_FILE   "clock_test.c"
+
+/*
+ * Media clock tests: shared clock (PJMEDIA_CLOCK_SHARED), high resolution
+ * clock (PJMEDIA_CLOCK_HIGH_RES) and the clock statistics.
+ */
+
+#define CLOCK_RATE	8000
+#define SLOW_MSEC	1000
+#define FAST_MSEC	10
+#define RUN_MSEC	300
+
+struct clock_data
+{
+    pjmedia_clock	*clock;
+    pj_timestamp	 first_tick;
+    volatile int	 tick_cnt;
+    volatile int	 in_cb;
+    unsigned		 cb_msec;	/* Time spent in the callback	*/
+    int			 stop_at;	/* Stop itself at this tick	*/
+};
+
+static void clock_cb(const pj_timestamp *ts, void *user_data)
+{
+    struct clock_data *cd = (struct clock_data*) user_data;
+
+    PJ_UNUSED_ARG(ts);
+
+    cd->in_cb = 1;
+    if (cd->tick_cnt == 0)
+	pj_get_timestamp(&cd->first_tick);
+    if (cd->cb_msec)
+	pj_thread_sleep(cd->cb_msec);
+    ++cd->tick_cnt;
+    if (cd->stop_at && cd->tick_cnt == cd->stop_at)
+	pjmedia_clock_stop(cd->clock);
+    cd->in_cb = 0;
+}
+
+static pj_status_t create_clock(pj_pool_t *pool, unsigned msec,
+				struct clock_data *cd)
+{
+    pjmedia_clock_param param;
+
+    pj_bzero(cd, sizeof(*cd));
+    param.usec_interval = msec * 1000;
+    param.clock_rate = CLOCK_RATE;
+    return pjmedia_clock_create2(pool, &param, PJMEDIA_CLOCK_SHARED,
+				 &clock_cb, cd, &cd->clock);
+}
+
+/* Adding a clock must wake up its worker, which may be sleeping until
+ * the next tick of a slow clock.
+ */
+static int wakeup_test(pj_pool_t *pool)
+{
+    struct clock_data slow[PJMEDIA_CLOCK_SHARED_THREAD_CNT], fast;
+    pj_timestamp start;
+    unsigned i, msec;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  wake up on add"));
+
+    /* Give every worker a slow clock, so they all sleep long */
+    for (i = 0; i < PJ_ARRAY_SIZE(slow); ++i) {
+	if (create_clock(pool, SLOW_MSEC, &slow[i]) != PJ_SUCCESS ||
+	    pjmedia_clock_start(slow[i].clock) != PJ_SUCCESS)
+	{
+	    return -10;
+	}
+    }
+    pj_thread_sleep(50);
+
+    if (create_clock(pool, FAST_MSEC, &fast) != PJ_SUCCESS)
+	return -20;
+
+    pj_get_timestamp(&start);
+    if (pjmedia_clock_start(fast.clock) != PJ_SUCCESS)
+	return -30;
+
+    for (i = 0; i < 100 && fast.tick_cnt == 0; ++i)
+	pj_thread_sleep(10);
+
+    if (fast.tick_cnt == 0) {
+	rc = -40;
+    } else {
+	msec = pj_elapsed_msec(&start, &fast.first_tick);
+	PJ_LOG(3,(THIS_FILE, "    first tick after %d msec", msec));
+	if (msec > SLOW_MSEC / 4)
+	    rc = -50;
+    }
+
+    pjmedia_clock_destroy(fast.clock);
+    for (i = 0; i < PJ_ARRAY_SIZE(slow); ++i)
+	pjmedia_clock_destroy(slow[i].clock);
+
+    return rc;
+}
+
+/* Stopping a clock must wait for its running callback, and the clock
+ * must not be called afterwards.
+ */
+static int stop_test(pj_pool_t *pool)
+{
+    struct clock_data cd;
+    unsigned i;
+    int cnt;
+
+    PJ_LOG(3,(THIS_FILE, "  stop while in callback"));
+
+    if (create_clock(pool, FAST_MSEC, &cd) != PJ_SUCCESS)
+	return -100;
+    cd.cb_msec = 50;
+
+    if (pjmedia_clock_start(cd.clock) != PJ_SUCCESS)
+	return -110;
+
+    for (i = 0; i < 100 && !cd.in_cb; ++i)
+	pj_thread_sleep(5);
+    if (!cd.in_cb) {
+	pjmedia_clock_destroy(cd.clock);
+	return -120;
+    }
+
+    pjmedia_clock_stop(cd.clock);
+    if (cd.in_cb) {
+	pjmedia_clock_destroy(cd.clock);
+	return -130;
+    }
+
+    cnt = cd.tick_cnt;
+    pj_thread_sleep(100);
+    pjmedia_clock_destroy(cd.clock);
+
+    if (cd.tick_cnt != cnt)
+	return -140;
+
+    return 0;
+}
+
+/* A clock may stop itself from its callback */
+static int self_stop_test(pj_pool_t *pool)
+{
+    struct clock_data cd;
+
+    PJ_LOG(3,(THIS_FILE, "  stop from own callback"));
+
+    if (create_clock(pool, FAST_MSEC, &cd) != PJ_SUCCESS)
+	return -200;
+    cd.stop_at = 3;
+
+    if (pjmedia_clock_start(cd.clock) != PJ_SUCCESS)
+	return -210;
+
+    pj_thread_sleep(FAST_MSEC * 10);
+    pjmedia_clock_destroy(cd.clock);
+
+    if (cd.tick_cnt != cd.stop_at)
+	return -220;
+
+    return 0;
+}
+
+/* The high resolution clock must tick at its rate, and its statistics
+ * must count every tick.
+ */
+static int high_res_test(pj_pool_t *pool)
+{
+    struct clock_data cd;
+    pjmedia_clock_param param;
+    pjmedia_clock_stat stat, zero_stat;
+    unsigned i, hist_cnt = 0;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  high resolution clock statistics"));
+
+    pj_bzero(&cd, sizeof(cd));
+    param.usec_interval = FAST_MSEC * 1000;
+    param.clock_rate = CLOCK_RATE;
+    if (pjmedia_clock_create2(pool, &param, PJMEDIA_CLOCK_HIGH_RES,
+			      &clock_cb, &cd, &cd.clock) != PJ_SUCCESS)
+    {
+	return -300;
+    }
+
+    /* Also pin it to the first CPU, when supported */
+    pjmedia_clock_set_cpu(cd.clock, 0);
+
+    if (pjmedia_clock_start(cd.clock) != PJ_SUCCESS) {
+	pjmedia_clock_destroy(cd.clock);
+	return -310;
+    }
+    pj_thread_sleep(RUN_MSEC);
+    pjmedia_clock_stop(cd.clock);
+
+    if (pjmedia_clock_get_stat(cd.clock, &stat) != PJ_SUCCESS) {
+	rc = -320;
+	goto on_return;
+    }
+
+    PJ_LOG(3,(THIS_FILE, "    %d ticks, %d missed, late avg %d usec, "
+	      "max %d usec", stat.tick_cnt, stat.missed_cnt,
+	      (stat.tick_cnt ?
+		  (unsigned)(stat.total_late_usec / stat.tick_cnt) : 0),
+	      stat.max_late_usec));
+
+    /* Allow for a slow start, but the clock must not run too fast */
+    if (stat.tick_cnt != (unsigned)cd.tick_cnt ||
+	stat.tick_cnt < RUN_MSEC / FAST_MSEC / 2 ||
+	stat.tick_cnt > RUN_MSEC / FAST_MSEC + 2)
+    {
+	rc = -330;
+	goto on_return;
+    }
+
+    for (i = 0; i < PJMEDIA_CLOCK_LATE_HIST_CNT; ++i)
+	hist_cnt += stat.late_hist[i];
+    if (hist_cnt != stat.tick_cnt || stat.max_late_usec > stat.total_late_usec
+	|| stat.max_burst < 1)
+    {
+	rc = -340;
+	goto on_return;
+    }
+
+    /* Reset clears the statistics */
+    pjmedia_clock_reset_stat(cd.clock);
+    pjmedia_clock_get_stat(cd.clock, &stat);
+    pj_bzero(&zero_stat, sizeof(zero_stat));
+    if (pj_memcmp(&stat, &zero_stat, sizeof(stat)) != 0)
+	rc = -350;
+
+on_return:
+    pjmedia_clock_destroy(cd.clock);
+    return rc;
+}
+
+int clock_test(void)
+{
+    pj_pool_t *pool;
+    int rc;
+
+    pool = pj_pool_create(mem, "clocktest", 4000, 4000, NULL);
+
+    rc = wakeup_test(pool);
+    if (rc == 0)
+	rc = stop_test(pool);
+    if (rc == 0)
+	rc = self_stop_test(pool);
+    if (rc == 0)
+	rc = high_res_test(pool);
+
+    pj_pool_release(pool);
+    return rc;
+}
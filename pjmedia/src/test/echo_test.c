@@ -0,0 +1,137 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+#define THIS_FILE   "echo_test.c"
+
+/*
+ * Echo canceller worker mode (PJMEDIA_ECHO_USE_WORKER) test. The echo
+ * suppressor is used as the backend, which leaves the captured signal
+ * intact while it is still learning, so every output frame can be
+ * traced back to the captured frame it came from.
+ */
+
+#define CLOCK_RATE	8000
+#define SPF		160
+#define TAIL_MS		100
+#define FRAME_CNT	50
+
+static int worker_test(pj_pool_t *pool, unsigned batch)
+{
+    pjmedia_echo_state *ec;
+    pjmedia_echo_stat stat;
+    pj_int16_t play[SPF], rec[SPF];
+    unsigned options, exp_batch, i, j, checked = 0;
+    int delay = -1;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  batch option %d", batch));
+
+    options = PJMEDIA_ECHO_SIMPLE | PJMEDIA_ECHO_USE_WORKER |
+	      PJMEDIA_ECHO_WORKER_BATCH_OPTION(batch);
+    if (pjmedia_echo_create(pool, CLOCK_RATE, SPF, TAIL_MS, 0, options,
+			    &ec) != PJ_SUCCESS)
+    {
+	return -10;
+    }
+
+    exp_batch = batch ? batch : PJMEDIA_ECHO_WORKER_BATCH;
+    pjmedia_echo_get_stat(ec, &stat);
+    if (stat.batch != exp_batch ||
+	stat.delay != PJ_MAX(PJMEDIA_ECHO_WORKER_DELAY, exp_batch))
+    {
+	PJ_LOG(3,(THIS_FILE, "    bad batch %d or delay %d", stat.batch,
+		  stat.delay));
+	rc = -20;
+	goto on_return;
+    }
+
+    pjmedia_zero_samples(play, SPF);
+
+    for (i = 0; i < FRAME_CNT; ++i) {
+	int src;
+
+	/* Frame i carries the value i+1 */
+	for (j = 0; j < SPF; ++j)
+	    rec[j] = (pj_int16_t)((i + 1) * 100);
+
+	pjmedia_echo_playback(ec, play);
+	pjmedia_echo_capture(ec, rec, 0);
+
+	/* Give the worker time to process the batch, as the sound
+	 * device would.
+	 */
+	pj_thread_sleep(2);
+
+	if (rec[0] == 0) {
+	    /* Output delay being built, or frame dropped */
+	    if (delay >= 0) {
+		rc = -30;
+		goto on_return;
+	    }
+	    continue;
+	}
+
+	for (j = 1; j < SPF; ++j) {
+	    if (rec[j] != rec[0]) {
+		rc = -40;
+		goto on_return;
+	    }
+	}
+
+	/* The output must keep a constant delay after the warm up */
+	src = rec[0] / 100 - 1;
+	if (delay < 0 && (int)i - src == (int)stat.delay) {
+	    delay = (int)i - src;
+	} else if (delay >= 0 && (int)i - src != delay) {
+	    PJ_LOG(3,(THIS_FILE, "    frame %d returned at %d", src, i));
+	    rc = -50;
+	    goto on_return;
+	}
+	if (delay >= 0)
+	    ++checked;
+    }
+
+    pjmedia_echo_get_stat(ec, &stat);
+    PJ_LOG(3,(THIS_FILE, "    %d frames checked, %d processed, %d missed",
+	      checked, stat.proc_cnt, stat.miss_cnt));
+
+    if (checked < FRAME_CNT - 10 || stat.proc_cnt == 0)
+	rc = -60;
+
+on_return:
+    pjmedia_echo_destroy(ec);
+    return rc;
+}
+
+int echo_test(void)
+{
+    pj_pool_t *pool;
+    int rc;
+
+    pool = pj_pool_create(mem, "echotest", 4000, 4000, NULL);
+
+    rc = worker_test(pool, 0);
+    if (rc == 0)
+	rc = worker_test(pool, 3);
+
+    pj_pool_release(pool);
+    return rc;
+}
@@ -0,0 +1,221 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+#include <pjmedia/alaw_ulaw.h>
+
+#define THIS_FILE	"g711_test.c"
+
+/* Number of 20ms frames converted per throughput measurement */
+#define FRAME_COUNT	50000
+#define FRAME_LEN	160
+
+/* Compare the block encoders against the per-sample conversion for
+ * every possible 16-bit input. The block is started at varying offsets
+ * so that both the vectorized part and the remainder are exercised.
+ */
+static int encode_test(pj_int16_t *pcm, pj_uint8_t *enc)
+{
+    unsigned i, off;
+
+    for (i=0; i<65536; ++i)
+	pcm[i] = (pj_int16_t)(i - 32768);
+
+    for (off=0; off<17; off+=5) {
+	pjmedia_ulaw_encode(enc, pcm+off, 65536-off);
+	for (i=off; i<65536; ++i) {
+	    if (enc[i-off] != pjmedia_linear2ulaw(pcm[i])) {
+		PJ_LOG(3,(THIS_FILE, "  error: U-Law encode mismatch for %d",
+			  pcm[i]));
+		return -10;
+	    }
+	}
+
+	pjmedia_alaw_encode(enc, pcm+off, 65536-off);
+	for (i=off; i<65536; ++i) {
+	    if (enc[i-off] != pjmedia_linear2alaw(pcm[i])) {
+		PJ_LOG(3,(THIS_FILE, "  error: A-Law encode mismatch for %d",
+			  pcm[i]));
+		return -20;
+	    }
+	}
+    }
+
+    return 0;
+}
+
+/* Same for the decoders, for every code and every offset within a
+ * vector.
+ */
+static int decode_test(void)
+{
+    pj_uint8_t code[256+16];
+    pj_int16_t pcm[256+16];
+    unsigned i, off;
+
+    for (i=0; i<PJ_ARRAY_SIZE(code); ++i)
+	code[i] = (pj_uint8_t)i;
+
+    for (off=0; off<16; ++off) {
+	pjmedia_ulaw_decode(pcm, code+off, 256);
+	for (i=0; i<256; ++i) {
+	    if (pcm[i] != pjmedia_ulaw2linear(code[i+off])) {
+		PJ_LOG(3,(THIS_FILE, "  error: U-Law decode mismatch for "
+			  "0x%02x", code[i+off]));
+		return -30;
+	    }
+	}
+
+	pjmedia_alaw_decode(pcm, code+off, 256);
+	for (i=0; i<256; ++i) {
+	    if (pcm[i] != pjmedia_alaw2linear(code[i+off])) {
+		PJ_LOG(3,(THIS_FILE, "  error: A-Law decode mismatch for "
+			  "0x%02x", code[i+off]));
+		return -40;
+	    }
+	}
+    }
+
+    return 0;
+}
+
+/* Direct A-Law <-> U-Law transcoding, including in-place operation */
+static int transcode_test(void)
+{
+    pj_uint8_t src[256], dst[256];
+    unsigned i;
+
+    for (i=0; i<256; ++i)
+	src[i] = (pj_uint8_t)i;
+
+    pjmedia_alaw_to_ulaw(dst, src, 256);
+    for (i=0; i<256; ++i) {
+	if (dst[i] != pjmedia_alaw2ulaw(src[i]))
+	    return -50;
+#if defined(PJMEDIA_HAS_ALAW_ULAW_TABLE) && PJMEDIA_HAS_ALAW_ULAW_TABLE!=0
+	if (dst[i] != pjmedia_linear2ulaw(pjmedia_alaw2linear(src[i])))
+	    return -51;
+#endif
+    }
+
+    pjmedia_ulaw_to_alaw(dst, src, 256);
+    for (i=0; i<256; ++i) {
+	if (dst[i] != pjmedia_ulaw2alaw(src[i]))
+	    return -60;
+#if defined(PJMEDIA_HAS_ALAW_ULAW_TABLE) && PJMEDIA_HAS_ALAW_ULAW_TABLE!=0
+	if (dst[i] != pjmedia_linear2alaw(pjmedia_ulaw2linear(src[i])))
+	    return -61;
+#endif
+    }
+
+    pj_memcpy(dst, src, sizeof(src));
+    pjmedia_alaw_to_ulaw(dst, dst, 256);
+    pjmedia_ulaw_to_alaw(dst, dst, 256);
+    for (i=0; i<256; ++i) {
+	if (dst[i] != pjmedia_ulaw2alaw(pjmedia_alaw2ulaw(src[i])))
+	    return -70;
+    }
+
+    return 0;
+}
+
+/* Return conversion speed in Msamples/second */
+static unsigned msps(const pj_timestamp *t0, const pj_timestamp *t1)
+{
+    pj_uint32_t usec = pj_elapsed_usec(t0, t1);
+    if (usec == 0)
+	usec = 1;
+    return (unsigned)((pj_uint64_t)FRAME_COUNT * FRAME_LEN / usec);
+}
+
+static void perf_test(pj_int16_t *pcm, pj_uint8_t *enc)
+{
+    pj_timestamp t0, t1;
+    unsigned i, j, scalar, block;
+
+    for (i=0; i<FRAME_LEN; ++i)
+	pcm[i] = (pj_int16_t)((i * 7919) & 0xFFFF);
+
+    pj_get_timestamp(&t0);
+    for (i=0; i<FRAME_COUNT; ++i) {
+	for (j=0; j<FRAME_LEN; ++j)
+	    enc[j] = pjmedia_linear2ulaw(pcm[j]);
+	pcm[i % FRAME_LEN] ^= enc[i % FRAME_LEN];
+    }
+    pj_get_timestamp(&t1);
+    scalar = msps(&t0, &t1);
+
+    pj_get_timestamp(&t0);
+    for (i=0; i<FRAME_COUNT; ++i) {
+	pjmedia_ulaw_encode(enc, pcm, FRAME_LEN);
+	pcm[i % FRAME_LEN] ^= enc[i % FRAME_LEN];
+    }
+    pj_get_timestamp(&t1);
+    block = msps(&t0, &t1);
+
+    PJ_LOG(3,(THIS_FILE, "  U-Law encode: per-sample %4u Msps, "
+			 "block %4u Msps", scalar, block));
+
+    pj_get_timestamp(&t0);
+    for (i=0; i<FRAME_COUNT; ++i) {
+	for (j=0; j<FRAME_LEN; ++j)
+	    pcm[j] = (pj_int16_t) pjmedia_ulaw2linear(enc[j]);
+	enc[i % FRAME_LEN] ^= (pj_uint8_t)pcm[i % FRAME_LEN];
+    }
+    pj_get_timestamp(&t1);
+    scalar = msps(&t0, &t1);
+
+    pj_get_timestamp(&t0);
+    for (i=0; i<FRAME_COUNT; ++i) {
+	pjmedia_ulaw_decode(pcm, enc, FRAME_LEN);
+	enc[i % FRAME_LEN] ^= (pj_uint8_t)pcm[i % FRAME_LEN];
+    }
+    pj_get_timestamp(&t1);
+    block = msps(&t0, &t1);
+
+    PJ_LOG(3,(THIS_FILE, "  U-Law decode: per-sample %4u Msps, "
+			 "block %4u Msps", scalar, block));
+}
+
+int g711_test(void)
+{
+    pj_pool_t *pool;
+    pj_int16_t *pcm;
+    pj_uint8_t *enc;
+    int rc;
+
+    PJ_LOG(3,(THIS_FILE, "  G.711 block conversion (SIMD %s):",
+	      (PJMEDIA_HAS_ALAW_ULAW_TABLE && PJMEDIA_HAS_ALAW_ULAW_SSE2 ?
+	       "enabled" : "disabled")));
+
+    pool = pj_pool_create(mem, "g711", 4000, 4000, NULL);
+    pcm = (pj_int16_t*) pj_pool_alloc(pool, 65536 * sizeof(pj_int16_t));
+    enc = (pj_uint8_t*) pj_pool_alloc(pool, 65536);
+
+    rc = encode_test(pcm, enc);
+    if (rc == 0)
+	rc = decode_test();
+    if (rc == 0)
+	rc = transcode_test();
+    if (rc == 0)
+	perf_test(pcm, enc);
+
+    pj_pool_release(pool);
+    return rc;
+}
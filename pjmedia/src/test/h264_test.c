@@ -0,0 +1,227 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+#include <pjmedia-codec/h264_packetizer.h>
+
+#define THIS_FILE   "h264_test.c"
+
+#if defined(PJMEDIA_HAS_VIDEO) && (PJMEDIA_HAS_VIDEO != 0)
+
+/*
+ * H.264 packetizer round-trip test. The picture bitstream is packetized
+ * with pjmedia_h264_packetize2() and pjmedia_h264_write_payload(), and
+ * with the in-place pjmedia_h264_packetize(), then unpacketized back with
+ * pjmedia_h264_unpacketize(), which must give the same NAL units, each
+ * prefixed with a 3 octets startcode.
+ */
+
+#define MTU		100
+#define MAX_NALS	8
+#define BITS_SIZE	2000
+
+typedef struct nal_unit
+{
+    pj_uint8_t	octet;		/* NAL unit octet (NRI + type)	*/
+    unsigned	len;		/* Length, incl. NAL unit octet	*/
+} nal_unit;
+
+static pj_uint8_t bits[BITS_SIZE];
+static pj_uint8_t norm[BITS_SIZE];
+static pj_uint8_t dec[BITS_SIZE];
+
+/* Generate the picture bitstream with the specified startcode length, and
+ * the expected unpacketized bitstream. NAL unit data has no zero octets,
+ * so it needs no emulation prevention.
+ */
+static void gen_bits(const nal_unit *nals, unsigned nal_cnt, unsigned sc_len,
+		     pj_size_t *bits_len, pj_size_t *norm_len)
+{
+    unsigned i, j, n = 0, m = 0;
+
+    for (i = 0; i < nal_cnt; ++i) {
+	for (j = 0; j < sc_len - 1; ++j)
+	    bits[n++] = 0;
+	bits[n++] = 1;
+	norm[m++] = 0; norm[m++] = 0; norm[m++] = 1;
+
+	bits[n++] = norm[m++] = nals[i].octet;
+	for (j = 1; j < nals[i].len; ++j)
+	    bits[n++] = norm[m++] = (pj_uint8_t)(1 + (i * 31 + j) % 255);
+    }
+
+    *bits_len = n;
+    *norm_len = m;
+}
+
+/* Packetize and unpacketize the bitstream, counting the STAP-A payloads */
+static int round_trip(pj_pool_t *pool, pj_bool_t in_place,
+		      pj_size_t bits_len, pj_size_t norm_len,
+		      unsigned *stap_cnt)
+{
+    pjmedia_h264_packetizer_cfg cfg;
+    pjmedia_h264_packetizer *pktz, *unpktz;
+    pj_uint8_t buf[MTU];
+    unsigned pos = 0, dec_pos = 0;
+
+    cfg.mtu = MTU;
+    cfg.mode = PJMEDIA_H264_PACKETIZER_MODE_NON_INTERLEAVED;
+    if (pjmedia_h264_packetizer_create(pool, &cfg, &pktz) != PJ_SUCCESS ||
+	pjmedia_h264_packetizer_create(pool, &cfg, &unpktz) != PJ_SUCCESS)
+    {
+	return -10;
+    }
+
+    while (pos < bits_len) {
+	const pj_uint8_t *payload;
+	pj_size_t payload_len;
+
+	if (in_place) {
+	    if (pjmedia_h264_packetize(pktz, bits, bits_len, &pos,
+				       &payload, &payload_len) != PJ_SUCCESS)
+	    {
+		return -20;
+	    }
+	} else {
+	    pjmedia_h264_payload_desc desc;
+
+	    if (pjmedia_h264_packetize2(pktz, bits, bits_len, &pos,
+					&desc) != PJ_SUCCESS)
+	    {
+		return -20;
+	    }
+	    if (pjmedia_h264_write_payload(&desc, buf, sizeof(buf),
+					   &payload_len) != PJ_SUCCESS ||
+		payload_len != desc.payload_len)
+	    {
+		return -30;
+	    }
+	    payload = buf;
+	}
+	if (payload_len > MTU)
+	    return -35;
+
+	if ((payload[0] & 0x1F) == 24) {
+	    const pj_uint8_t *q = payload + 1;
+	    pj_uint8_t nri = 0;
+
+	    /* STAP-A NRI is the maximum NRI of the aggregated NAL units */
+	    while (q < payload + payload_len) {
+		if ((q[2] & 0x60) > nri)
+		    nri = q[2] & 0x60;
+		q += 2 + ((q[0] << 8) | q[1]);
+	    }
+	    if ((payload[0] & 0x60) != nri)
+		return -40;
+	    ++*stap_cnt;
+	}
+
+	if (pjmedia_h264_unpacketize(unpktz, payload, payload_len, dec,
+				     sizeof(dec), &dec_pos) != PJ_SUCCESS)
+	{
+	    return -50;
+	}
+    }
+
+    if (dec_pos != norm_len || pj_memcmp(dec, norm, norm_len) != 0)
+	return -60;
+
+    return 0;
+}
+
+/* Run the round-trip test with both packetizer entry points */
+static int test_nals(pj_pool_t *pool, const nal_unit *nals,
+		     unsigned nal_cnt, unsigned sc_len, unsigned *stap_cnt)
+{
+    pj_size_t bits_len, norm_len;
+    unsigned in_place;
+    int rc;
+
+    for (in_place = 0; in_place <= 1; ++in_place) {
+	/* The in-place packetizer modifies the bitstream */
+	gen_bits(nals, nal_cnt, sc_len, &bits_len, &norm_len);
+	stap_cnt[in_place] = 0;
+	rc = round_trip(pool, in_place, bits_len, norm_len,
+			&stap_cnt[in_place]);
+	if (rc != 0) {
+	    PJ_LOG(3,(THIS_FILE, "    failed with %s packetizer",
+		      (in_place ? "in-place" : "descriptor")));
+	    return rc;
+	}
+    }
+
+    return 0;
+}
+
+int h264_test(void)
+{
+    pj_pool_t *pool;
+    nal_unit nals[MAX_NALS];
+    unsigned sc_len, len, stap_cnt[2];
+    int rc = 0;
+
+    pool = pj_pool_create(mem, "h264test", 4000, 4000, NULL);
+
+    /* Sweep the length of a fragmented NAL unit, so its fragments end
+     * at every offset around the next startcode and the startcode sits
+     * at every offset around the MTU search range.
+     */
+    PJ_LOG(3,(THIS_FILE, "  fragmentation boundaries"));
+    for (sc_len = 3; sc_len <= 4 && rc == 0; ++sc_len) {
+	for (len = 2; len <= 3 * MTU + 8; ++len) {
+	    nals[0].octet = (2 << 5) | 5;
+	    nals[0].len = len;
+	    nals[1].octet = (1 << 5) | 1;
+	    nals[1].len = MTU / 2;
+	    nals[2].octet = (1 << 5) | 1;
+	    nals[2].len = 2;
+
+	    rc = test_nals(pool, nals, 3, sc_len, stap_cnt);
+	    if (rc != 0) {
+		PJ_LOG(3,(THIS_FILE, "    failed with NAL unit length %d, "
+			  "%d octets startcode", len, sc_len));
+		break;
+	    }
+	}
+    }
+
+    /* SEI, SPS and PPS are aggregated in front of the IDR slice */
+    if (rc == 0) {
+	PJ_LOG(3,(THIS_FILE, "  aggregation"));
+	for (sc_len = 3; sc_len <= 4 && rc == 0; ++sc_len) {
+	    nals[0].octet = 6;
+	    nals[0].len = 2;
+	    nals[1].octet = (3 << 5) | 7;
+	    nals[1].len = 12;
+	    nals[2].octet = (3 << 5) | 8;
+	    nals[2].len = 4;
+	    nals[3].octet = (2 << 5) | 5;
+	    nals[3].len = 3 * MTU;
+
+	    rc = test_nals(pool, nals, 4, sc_len, stap_cnt);
+	    if (rc == 0 && (stap_cnt[0] != 1 || stap_cnt[1] != 1))
+		rc = -100;
+	}
+    }
+
+    pj_pool_release(pool);
+    return rc;
+}
+
+#endif /* PJMEDIA_HAS_VIDEO */
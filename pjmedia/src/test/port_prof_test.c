@@ -0,0 +1,130 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+#define THIS_FILE   "port_prof_test.c"
+
+#if defined(PJMEDIA_PORT_HAS_PROFILING) && PJMEDIA_PORT_HAS_PROFILING!=0
+
+/*
+ * Media port profiling (PJMEDIA_PORT_HAS_PROFILING) test. Frames are
+ * read from and written to a null port, and the statistics must count
+ * every call, both in the call counter and in the histogram.
+ */
+
+#define CLOCK_RATE	8000
+#define SPF		160
+#define GET_CNT		20
+#define PUT_CNT		10
+
+/* Check the counters of one direction */
+static int check_op_prof(const pjmedia_port_op_prof *op, unsigned count)
+{
+    unsigned i, hist_cnt = 0;
+
+    if (op->count != count)
+	return -1;
+
+    for (i = 0; i < PJMEDIA_PORT_PROF_HIST_CNT; ++i)
+	hist_cnt += op->hist[i];
+    if (hist_cnt != count)
+	return -2;
+
+    if (count == 0 && (op->total_usec != 0 || op->max_usec != 0))
+	return -3;
+    if (op->max_usec > op->total_usec)
+	return -4;
+
+    return 0;
+}
+
+int port_prof_test(void)
+{
+    pj_pool_t *pool;
+    pjmedia_port *port;
+    pjmedia_port_prof prof;
+    pj_int16_t buf[SPF];
+    pjmedia_frame frame;
+    unsigned i;
+    pj_status_t status;
+    int rc = 0;
+
+    pool = pj_pool_create(mem, "portprof", 1000, 1000, NULL);
+
+    status = pjmedia_null_port_create(pool, CLOCK_RATE, 1, SPF, 16, &port);
+    if (status != PJ_SUCCESS) {
+	app_perror(status, "error creating null port");
+	pj_pool_release(pool);
+	return -10;
+    }
+
+    /* A new port has no statistics */
+    if (pjmedia_port_get_prof(port, &prof) != PJ_SUCCESS) {
+	rc = -20;
+	goto on_return;
+    }
+    if (check_op_prof(&prof.get, 0) || check_op_prof(&prof.put, 0)) {
+	rc = -30;
+	goto on_return;
+    }
+
+    pj_bzero(&frame, sizeof(frame));
+    frame.buf = buf;
+    for (i = 0; i < GET_CNT; ++i) {
+	if (pjmedia_port_get_frame(port, &frame) != PJ_SUCCESS) {
+	    rc = -40;
+	    goto on_return;
+	}
+    }
+    for (i = 0; i < PUT_CNT; ++i) {
+	if (pjmedia_port_put_frame(port, &frame) != PJ_SUCCESS) {
+	    rc = -50;
+	    goto on_return;
+	}
+    }
+
+    pjmedia_port_get_prof(port, &prof);
+    if (check_op_prof(&prof.get, GET_CNT) ||
+	check_op_prof(&prof.put, PUT_CNT))
+    {
+	rc = -60;
+	goto on_return;
+    }
+
+    pjmedia_port_dump_prof(port, "  ");
+
+    /* Reset clears both directions */
+    if (pjmedia_port_reset_prof(port) != PJ_SUCCESS) {
+	rc = -70;
+	goto on_return;
+    }
+    pjmedia_port_get_prof(port, &prof);
+    if (check_op_prof(&prof.get, 0) || check_op_prof(&prof.put, 0)) {
+	rc = -80;
+	goto on_return;
+    }
+
+on_return:
+    pjmedia_port_destroy(port);
+    pj_pool_release(pool);
+    return rc;
+}
+
+#endif /* PJMEDIA_PORT_HAS_PROFILING */
@@ -0,0 +1,197 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+#if PJMEDIA_RESAMPLE_IMP != PJMEDIA_RESAMPLE_NONE
+
+#include <math.h>
+
+#define THIS_FILE	"resample_test.c"
+
+#define PTIME		20	/* Frame length, in msec		*/
+#define SKIP_FRAMES	5	/* Frames skipped for filter settling	*/
+#define FIT_FRAMES	45	/* Frames used in quality measurement	*/
+#define PERF_FRAMES	2000	/* Frames used in throughput measurement*/
+#define AMPLITUDE	10000.0
+#define MIN_SNR		40.0	/* Minimum SNR of in-band tone, in dB	*/
+#define MIN_ALIAS_REJ	30.0	/* Minimum alias rejection, in dB	*/
+
+static const double PI = 3.14159265358979323846;
+
+/* Feed a tone through the resampler, and return the power of the output
+ * (after filter settling) that is not explained by a sine wave of the
+ * same frequency, and the power of that sine wave.
+ */
+static int run_tone(pjmedia_resample *rs, unsigned rate_in, unsigned rate_out,
+		    double freq, double *sig_pwr, double *err_pwr)
+{
+    unsigned spf_in = rate_in * PTIME / 1000;
+    unsigned spf_out = rate_out * PTIME / 1000;
+    pj_int16_t in[48000 * PTIME / 1000], out[48000 * PTIME / 1000];
+    double c = 0, s = 0, tot = 0;
+    unsigned n, i, cnt = 0;
+
+    if (spf_in > PJ_ARRAY_SIZE(in) || spf_out > PJ_ARRAY_SIZE(out))
+	return -10;
+
+    for (n = 0; n < SKIP_FRAMES + FIT_FRAMES; ++n) {
+	for (i = 0; i < spf_in; ++i) {
+	    double t = (double)(n * spf_in + i) / rate_in;
+	    in[i] = (pj_int16_t)(AMPLITUDE * sin(2 * PI * freq * t));
+	}
+
+	pjmedia_resample_run(rs, in, out);
+
+	if (n < SKIP_FRAMES)
+	    continue;
+
+	/* Correlate with the tone, whatever the delay of the filter is */
+	for (i = 0; i < spf_out; ++i, ++cnt) {
+	    double t = (double)(n * spf_out + i) / rate_out;
+	    c += out[i] * cos(2 * PI * freq * t);
+	    s += out[i] * sin(2 * PI * freq * t);
+	    tot += (double)out[i] * out[i];
+	}
+    }
+
+    /* Power of the fitted sine and of the residual */
+    *sig_pwr = 2.0 * (c*c + s*s) / cnt / cnt;
+    *err_pwr = tot / cnt - *sig_pwr;
+    if (*err_pwr < 1e-3)
+	*err_pwr = 1e-3;
+
+    return 0;
+}
+
+static int test_rate(pj_pool_t *pool, unsigned rate_in, unsigned rate_out)
+{
+    unsigned spf_in = rate_in * PTIME / 1000;
+    pj_int16_t in[48000 * PTIME / 1000], out[48000 * PTIME / 1000];
+    pjmedia_resample *rs;
+    double sig, err, snr, alias = 0;
+    pj_bool_t has_alias;
+    char alias_str[16];
+    pj_timestamp t0, t1;
+    pj_uint32_t usec;
+    unsigned i;
+    pj_status_t status;
+    int rc;
+
+    /* Quality: SNR of 1 KHz tone */
+    status = pjmedia_resample_create(pool, PJ_TRUE, PJ_FALSE, 1, rate_in,
+				     rate_out, spf_in, &rs);
+    if (status != PJ_SUCCESS)
+	return -20;
+    rc = run_tone(rs, rate_in, rate_out, 1000, &sig, &err);
+    pjmedia_resample_destroy(rs);
+    if (rc != 0)
+	return rc;
+    snr = 10 * log10(sig / err);
+
+    /* Aliasing: tone well above the output Nyquist frequency (outside the
+     * transition band), compared with the input power.
+     */
+    has_alias = (rate_out * 6 / 10 < rate_in / 2);
+    if (has_alias) {
+	double freq = rate_out * 6 / 10;
+
+	status = pjmedia_resample_create(pool, PJ_TRUE, PJ_FALSE, 1, rate_in,
+					 rate_out, spf_in, &rs);
+	if (status != PJ_SUCCESS)
+	    return -30;
+	rc = run_tone(rs, rate_in, rate_out, freq, &sig, &err);
+	pjmedia_resample_destroy(rs);
+	if (rc != 0)
+	    return rc;
+	alias = 10 * log10(AMPLITUDE * AMPLITUDE / 2 / (sig + err));
+    }
+
+    /* Throughput */
+    status = pjmedia_resample_create(pool, PJ_TRUE, PJ_FALSE, 1, rate_in,
+				     rate_out, spf_in, &rs);
+    if (status != PJ_SUCCESS)
+	return -40;
+
+    for (i = 0; i < spf_in; ++i)
+	in[i] = (pj_int16_t)(AMPLITUDE * sin(2 * PI * i / 37));
+
+    pj_get_timestamp(&t0);
+    for (i = 0; i < PERF_FRAMES; ++i)
+	pjmedia_resample_run(rs, in, out);
+    pj_get_timestamp(&t1);
+    pjmedia_resample_destroy(rs);
+
+    usec = pj_elapsed_usec(&t0, &t1);
+    if (usec == 0)
+	usec = 1;
+
+    if (has_alias)
+	pj_ansi_snprintf(alias_str, sizeof(alias_str), "%5.1f dB", alias);
+    else
+	pj_ansi_strcpy(alias_str, "    -   ");
+
+    PJ_LOG(3,(THIS_FILE, "  %5u -> %5u: SNR %5.1f dB, alias rejection %s, "
+			 "%5u x realtime",
+	      rate_in, rate_out, snr, alias_str,
+	      (unsigned)((pj_uint64_t)PERF_FRAMES * PTIME * 1000 / usec)));
+
+    if (snr < MIN_SNR) {
+	PJ_LOG(3,(THIS_FILE, "  error: SNR too low"));
+	return -50;
+    }
+    if (has_alias && alias < MIN_ALIAS_REJ) {
+	PJ_LOG(3,(THIS_FILE, "  error: alias rejection too low"));
+	return -60;
+    }
+
+    return 0;
+}
+
+int resample_test(void)
+{
+    static const struct {
+	unsigned in, out;
+    } rates[] = {
+	{  8000, 16000 },
+	{ 16000,  8000 },
+	{  8000, 48000 },
+	{ 48000,  8000 },
+	{ 16000, 48000 },
+	{ 48000, 16000 },
+	{ 44100, 48000 },
+	{ 48000, 44100 },
+    };
+    pj_pool_t *pool;
+    unsigned i;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  resampling quality and throughput (%d ms "
+			 "frames, high quality):", PTIME));
+
+    pool = pj_pool_create(mem, "resample", 4000, 4000, NULL);
+
+    for (i = 0; i < PJ_ARRAY_SIZE(rates) && rc == 0; ++i)
+	rc = test_rate(pool, rates[i].in, rates[i].out);
+
+    pj_pool_release(pool);
+    return rc;
+}
+
+#endif	/* PJMEDIA_RESAMPLE_IMP != PJMEDIA_RESAMPLE_NONE */
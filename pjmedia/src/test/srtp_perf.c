@@ -0,0 +1,219 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+#if defined(PJMEDIA_HAS_SRTP) && (PJMEDIA_HAS_SRTP != 0)
+
+#include <srtp.h>
+#include <aes.h>
+
+#define THIS_FILE	"srtp_perf.c"
+
+/* Number of packets protected per measurement */
+#define PKT_COUNT	20000
+#define RTP_HDR_LEN	12
+#define MAX_PKT_LEN	(RTP_HDR_LEN + 1200 + 16)
+
+static const unsigned char test_key[30] =
+{
+    0xe1, 0xf9, 0x7a, 0x0d, 0x3e, 0x01, 0x8b, 0xe0,
+    0xd6, 0x4f, 0xa3, 0x2c, 0x06, 0xde, 0x41, 0x39,
+    0x0e, 0xc6, 0x75, 0xad, 0x49, 0x8a, 0xfe, 0xeb,
+    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6
+};
+
+static srtp_t create_session(ssrc_type_t type)
+{
+    srtp_policy_t policy;
+    srtp_t srtp;
+
+    pj_bzero(&policy, sizeof(policy));
+    crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy.rtp);
+    crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy.rtcp);
+    policy.ssrc.type = type;
+    policy.key = (unsigned char*)test_key;
+
+    if (srtp_create(&srtp, &policy) != err_status_ok)
+	return NULL;
+
+    return srtp;
+}
+
+static void init_packet(pj_uint8_t *pkt, unsigned payload_len,
+			pj_uint16_t seq)
+{
+    unsigned i;
+
+    pkt[0] = 0x80;
+    pkt[1] = 0;
+    pkt[2] = (pj_uint8_t)(seq >> 8);
+    pkt[3] = (pj_uint8_t)(seq & 0xFF);
+    pkt[4] = pkt[5] = pkt[6] = pkt[7] = 0;
+    pkt[8] = 0x12; pkt[9] = 0x34; pkt[10] = 0x56; pkt[11] = 0x78;
+    for (i=0; i<payload_len; ++i)
+	pkt[RTP_HDR_LEN + i] = (pj_uint8_t)i;
+}
+
+/* Protect one packet with the software and the accelerated AES and
+ * make sure both produce the same result and can be unprotected.
+ */
+static int verify(unsigned payload_len)
+{
+    pj_uint8_t pkt[2][MAX_PKT_LEN];
+    int len[2];
+    unsigned i;
+
+    for (i=0; i<2; ++i) {
+	srtp_t tx;
+
+	aes_use_hw_accel(i);
+
+	tx = create_session(ssrc_any_outbound);
+	if (!tx)
+	    return -10;
+
+	init_packet(pkt[i], payload_len, 1);
+	len[i] = RTP_HDR_LEN + payload_len;
+	if (srtp_protect(tx, pkt[i], &len[i]) != err_status_ok) {
+	    srtp_dealloc(tx);
+	    return -20;
+	}
+	srtp_dealloc(tx);
+    }
+
+    if (len[0] != len[1] || pj_memcmp(pkt[0], pkt[1], len[0]) != 0) {
+	PJ_LOG(3,(THIS_FILE, "  error: accelerated AES output mismatch"));
+	return -30;
+    }
+
+    for (i=0; i<2; ++i) {
+	srtp_t rx;
+	err_status_t err;
+
+	aes_use_hw_accel(i);
+
+	rx = create_session(ssrc_any_inbound);
+	if (!rx)
+	    return -40;
+
+	err = srtp_unprotect(rx, pkt[i], &len[i]);
+	srtp_dealloc(rx);
+	if (err != err_status_ok || len[i] != (int)(RTP_HDR_LEN+payload_len))
+	    return -50;
+    }
+
+    return 0;
+}
+
+static int run(unsigned payload_len, pj_bool_t hw_accel, unsigned *kpps)
+{
+    pj_uint8_t pkt[MAX_PKT_LEN];
+    pj_timestamp t0, t1;
+    pj_uint32_t usec;
+    srtp_t tx;
+    unsigned i;
+
+    aes_use_hw_accel(hw_accel);
+
+    tx = create_session(ssrc_any_outbound);
+    if (!tx)
+	return -100;
+
+    init_packet(pkt, payload_len, 0);
+
+    pj_get_timestamp(&t0);
+    for (i=0; i<PKT_COUNT; ++i) {
+	int len = RTP_HDR_LEN + payload_len;
+
+	pkt[2] = (pj_uint8_t)(i >> 8);
+	pkt[3] = (pj_uint8_t)(i & 0xFF);
+	if (srtp_protect(tx, pkt, &len) != err_status_ok) {
+	    srtp_dealloc(tx);
+	    return -110;
+	}
+    }
+    pj_get_timestamp(&t1);
+
+    srtp_dealloc(tx);
+
+    usec = pj_elapsed_usec(&t0, &t1);
+    if (usec == 0)
+	usec = 1;
+    *kpps = (unsigned)((pj_uint64_t)PKT_COUNT * 1000 / usec);
+
+    return 0;
+}
+
+int srtp_perf_test(void)
+{
+    const unsigned payload_lens[] = { 160, 1200 };
+    pj_bool_t has_hw;
+    unsigned i;
+    int rc = 0;
+
+    if (srtp_init() != err_status_ok)
+	return -1;
+
+    has_hw = aes_use_hw_accel(PJ_TRUE);
+    PJ_LOG(3,(THIS_FILE, "  AES_CM_128_HMAC_SHA1_80 protect throughput "
+			 "(hardware AES %savailable):",
+			 (has_hw ? "" : "not ")));
+
+    for (i=0; i<PJ_ARRAY_SIZE(payload_lens); ++i) {
+	unsigned sw_kpps, hw_kpps = 0;
+
+	if (has_hw) {
+	    rc = verify(payload_lens[i]);
+	    if (rc != 0)
+		break;
+	}
+
+	rc = run(payload_lens[i], PJ_FALSE, &sw_kpps);
+	if (rc != 0)
+	    break;
+
+	if (has_hw) {
+	    rc = run(payload_lens[i], PJ_TRUE, &hw_kpps);
+	    if (rc != 0)
+		break;
+	    PJ_LOG(3,(THIS_FILE, "  %4u bytes payload: software %6u Kpps, "
+				 "AES-NI %6u Kpps",
+				 payload_lens[i], sw_kpps, hw_kpps));
+	} else {
+	    PJ_LOG(3,(THIS_FILE, "  %4u bytes payload: software %6u Kpps",
+				 payload_lens[i], sw_kpps));
+	}
+    }
+
+    /* Restore the default */
+    aes_use_hw_accel(PJ_TRUE);
+    srtp_deinit();
+
+    return rc;
+}
+
+#else
+
+int srtp_perf_test(void)
+{
+    return 0;
+}
+
+#endif	/* PJMEDIA_HAS_SRTP */
@@ -0,0 +1,357 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+#include <pjmedia/alaw_ulaw.h>
+
+#define THIS_FILE   "stream_fwd_test.c"
+
+/*
+ * Encoded frame forwarding test, see pjmedia_stream_set_forward().
+ *
+ * Stream A (PCMU) and stream B (PCMA) each use a loop transport, so
+ * whatever a stream sends is received back by the same stream. PCM put
+ * to A comes back as PCMU payloads in A's jitter buffer, which are then
+ * forwarded to B as extended frames. B converts them to A-law and
+ * sends them, so they come back in B's jitter buffer.
+ */
+
+#if PJMEDIA_HAS_G711_CODEC
+
+#define FRAME_CNT	50
+#define SPF		160
+#define EXT_BUF_SIZE	1024
+
+struct fwd_stream
+{
+    pjmedia_transport	*tp;
+    pjmedia_stream	*stream;
+    pjmedia_port	*port;
+};
+
+static int create_stream(pjmedia_endpt *endpt, pj_pool_t *pool,
+			 const char *codec, struct fwd_stream *fs)
+{
+    pjmedia_codec_mgr *mgr = pjmedia_endpt_get_codec_mgr(endpt);
+    const pjmedia_codec_info *ci[1];
+    pjmedia_codec_param *param;
+    pjmedia_stream_info si;
+    unsigned count = 1;
+    pj_str_t codec_id;
+    pj_status_t status;
+
+    codec_id = pj_str((char*)codec);
+    status = pjmedia_codec_mgr_find_codecs_by_id(mgr, &codec_id, &count,
+						 ci, NULL);
+    if (status != PJ_SUCCESS)
+	return -10;
+
+    param = PJ_POOL_ZALLOC_T(pool, pjmedia_codec_param);
+    status = pjmedia_codec_mgr_get_default_param(mgr, ci[0], param);
+    if (status != PJ_SUCCESS)
+	return -20;
+
+    /* Every frame must be transmitted */
+    param->setting.vad = 0;
+    param->setting.plc = 0;
+
+    pj_bzero(&si, sizeof(si));
+    si.type = PJMEDIA_TYPE_AUDIO;
+    si.proto = PJMEDIA_TP_PROTO_RTP_AVP;
+    si.dir = PJMEDIA_DIR_ENCODING_DECODING;
+    pj_sockaddr_in_init(&si.rem_addr.ipv4, NULL, 4000);
+    pj_sockaddr_in_init(&si.rem_rtcp.ipv4, NULL, 4001);
+    pj_memcpy(&si.fmt, ci[0], sizeof(pjmedia_codec_info));
+    si.param = param;
+    si.tx_pt = si.rx_pt = ci[0]->pt;
+    si.tx_event_pt = 101;
+    si.rx_event_pt = 101;
+    si.ssrc = pj_rand();
+    si.jb_init = si.jb_min_pre = si.jb_max_pre = si.jb_max = -1;
+
+    status = pjmedia_transport_loop_create(endpt, &fs->tp);
+    if (status != PJ_SUCCESS)
+	return -30;
+
+    status = pjmedia_stream_create(endpt, pool, &si, fs->tp, NULL,
+				   &fs->stream);
+    if (status != PJ_SUCCESS)
+	return -40;
+
+    status = pjmedia_stream_start(fs->stream);
+    if (status != PJ_SUCCESS)
+	return -50;
+
+    pjmedia_stream_get_port(fs->stream, &fs->port);
+    if (PJMEDIA_PIA_SPF(&fs->port->info) != SPF)
+	return -60;
+
+    return 0;
+}
+
+static void destroy_stream(struct fwd_stream *fs)
+{
+    if (fs->stream)
+	pjmedia_stream_destroy(fs->stream);
+    if (fs->tp)
+	pjmedia_transport_close(fs->tp);
+}
+
+/* Get an extended frame, which header is in the buffer as well */
+static pj_status_t get_ext_frame(pjmedia_port *port, pj_uint8_t *buf)
+{
+    pjmedia_frame *frame = (pjmedia_frame*)buf;
+    pj_status_t status;
+
+    pj_bzero(buf, sizeof(pjmedia_frame_ext));
+    frame->size = EXT_BUF_SIZE - sizeof(pjmedia_frame_ext);
+
+    status = pjmedia_port_get_frame(port, frame);
+    if (status == PJ_SUCCESS && frame->type != PJMEDIA_FRAME_TYPE_EXTENDED)
+	status = PJ_EINVALIDOP;
+
+    return status;
+}
+
+/* Join the subframes (one per codec frame) of an extended frame into
+ * the payload, returns zero if any subframe is empty.
+ */
+static unsigned get_payload(const pj_uint8_t *buf, pj_uint8_t *payload)
+{
+    const pjmedia_frame_ext *f = (const pjmedia_frame_ext*)buf;
+    unsigned i, len = 0;
+
+    for (i = 0; i < f->subframe_cnt; ++i) {
+	const pjmedia_frame_ext_subframe *sf;
+	unsigned n;
+
+	sf = pjmedia_frame_ext_get_subframe(f, i);
+	n = sf->bitlen >> 3;
+	if (n == 0 || len + n > SPF)
+	    return 0;
+
+	pj_memcpy(payload + len, sf->data, n);
+	len += n;
+    }
+
+    return len;
+}
+
+/* Find the earliest input frame, starting from *idx, which encodes to
+ * the payload.
+ */
+static pj_bool_t match_payload(pj_int16_t in[][SPF], unsigned *idx,
+			       const pj_uint8_t *payload, pj_bool_t alaw)
+{
+    pj_uint8_t enc[SPF];
+    unsigned i;
+
+    for (i = *idx; i < FRAME_CNT; ++i) {
+	pjmedia_ulaw_encode(enc, in[i], SPF);
+	if (alaw)
+	    pjmedia_ulaw_to_alaw(enc, enc, SPF);
+	if (pj_memcmp(enc, payload, SPF) == 0) {
+	    *idx = i + 1;
+	    return PJ_TRUE;
+	}
+    }
+
+    return PJ_FALSE;
+}
+
+static int fwd_test(pjmedia_endpt *endpt, pj_pool_t *pool)
+{
+    struct fwd_stream a, b;
+    pj_int16_t (*in)[SPF];
+    pj_int16_t pcm[SPF], expected[SPF];
+    pj_uint8_t *ext_buf, *ext_buf2;
+    unsigned i, j, a_idx = 0, b_idx = 0, a_cnt = 0, b_cnt = 0, pcm_cnt = 0;
+    int rc;
+
+    pj_bzero(&a, sizeof(a));
+    pj_bzero(&b, sizeof(b));
+
+    in = (pj_int16_t(*)[SPF]) pj_pool_alloc(pool, FRAME_CNT * SPF * 2);
+    ext_buf = (pj_uint8_t*) pj_pool_alloc(pool, EXT_BUF_SIZE);
+    ext_buf2 = (pj_uint8_t*) pj_pool_alloc(pool, EXT_BUF_SIZE);
+    for (i = 0; i < FRAME_CNT; ++i) {
+	for (j = 0; j < SPF; ++j)
+	    in[i][j] = (pj_int16_t)((pj_rand() % 16000) - 8000);
+    }
+
+    rc = create_stream(endpt, pool, "PCMU", &a);
+    if (rc == 0)
+	rc = create_stream(endpt, pool, "PCMA", &b);
+    if (rc != 0)
+	goto on_return;
+
+    if (pjmedia_stream_set_forward(a.stream, b.stream) != PJ_SUCCESS ||
+	pjmedia_stream_set_forward(b.stream, a.stream) != PJ_SUCCESS)
+    {
+	rc = -100;
+	goto on_return;
+    }
+
+    for (i = 0; i < FRAME_CNT; ++i) {
+	pj_uint8_t payload[SPF];
+	pjmedia_frame frame;
+	unsigned len;
+
+	/* PCM put to A is still encoded */
+	pj_bzero(&frame, sizeof(frame));
+	frame.type = PJMEDIA_FRAME_TYPE_AUDIO;
+	frame.buf = in[i];
+	frame.size = SPF * 2;
+	if (pjmedia_port_put_frame(a.port, &frame) != PJ_SUCCESS) {
+	    rc = -110;
+	    goto on_return;
+	}
+
+	/* A returns the received PCMU payload without decoding */
+	if (get_ext_frame(a.port, ext_buf) != PJ_SUCCESS) {
+	    rc = -120;
+	    goto on_return;
+	}
+
+	len = get_payload(ext_buf, payload);
+	if (len) {
+	    if (len != SPF || !match_payload(in, &a_idx, payload, PJ_FALSE))
+	    {
+		PJ_LOG(3,(THIS_FILE, "  forwarded PCMU payload mismatch"));
+		rc = -130;
+		goto on_return;
+	    }
+	    ++a_cnt;
+	}
+
+	/* Forward it to B, which sends it as A-law */
+	if (pjmedia_port_put_frame(b.port, (pjmedia_frame*)ext_buf)
+	    != PJ_SUCCESS)
+	{
+	    rc = -140;
+	    goto on_return;
+	}
+
+	if (get_ext_frame(b.port, ext_buf2) != PJ_SUCCESS) {
+	    rc = -150;
+	    goto on_return;
+	}
+
+	len = get_payload(ext_buf2, payload);
+	if (len) {
+	    if (len != SPF || !match_payload(in, &b_idx, payload, PJ_TRUE))
+	    {
+		PJ_LOG(3,(THIS_FILE, "  converted PCMA payload mismatch"));
+		rc = -160;
+		goto on_return;
+	    }
+	    ++b_cnt;
+	}
+    }
+
+    /* Disabling forwarding on B must return to decoding */
+    if (pjmedia_stream_set_forward(b.stream, NULL) != PJ_SUCCESS) {
+	rc = -200;
+	goto on_return;
+    }
+
+    for (i = 0; i < FRAME_CNT; ++i) {
+	pj_uint8_t enc[SPF];
+	pjmedia_frame frame;
+
+	pj_bzero(&frame, sizeof(frame));
+	frame.type = PJMEDIA_FRAME_TYPE_AUDIO;
+	frame.buf = in[i];
+	frame.size = SPF * 2;
+	if (pjmedia_port_put_frame(b.port, &frame) != PJ_SUCCESS) {
+	    rc = -210;
+	    goto on_return;
+	}
+
+	pj_bzero(&frame, sizeof(frame));
+	frame.buf = pcm;
+	frame.size = sizeof(pcm);
+	if (pjmedia_port_get_frame(b.port, &frame) != PJ_SUCCESS ||
+	    frame.type == PJMEDIA_FRAME_TYPE_EXTENDED)
+	{
+	    rc = -220;
+	    goto on_return;
+	}
+
+	pjmedia_alaw_encode(enc, in[i], SPF);
+	pjmedia_alaw_decode(expected, enc, SPF);
+	if (frame.type == PJMEDIA_FRAME_TYPE_AUDIO &&
+	    pj_memcmp(expected, pcm, sizeof(pcm)) == 0)
+	{
+	    ++pcm_cnt;
+	}
+    }
+
+    PJ_LOG(3,(THIS_FILE, "  %d frames: %d forwarded, %d converted, "
+	      "%d decoded after disabling", FRAME_CNT, a_cnt, b_cnt,
+	      pcm_cnt));
+
+    if (a_cnt < FRAME_CNT / 2 || b_cnt < FRAME_CNT / 2 ||
+	pcm_cnt < FRAME_CNT / 2)
+    {
+	rc = -300;
+    }
+
+on_return:
+    destroy_stream(&b);
+    destroy_stream(&a);
+    return rc;
+}
+
+int stream_fwd_test(void)
+{
+    pjmedia_endpt *endpt;
+    pj_pool_t *pool;
+    pj_status_t status;
+    int rc;
+
+    status = pjmedia_endpt_create(mem, NULL, 0, &endpt);
+    if (status != PJ_SUCCESS)
+	return -1;
+
+    status = pjmedia_codec_g711_init(endpt);
+    if (status != PJ_SUCCESS) {
+	pjmedia_endpt_destroy(endpt);
+	return -2;
+    }
+
+    pool = pj_pool_create(mem, "stream_fwd", 4000, 4000, NULL);
+
+    rc = fwd_test(endpt, pool);
+
+    pj_pool_release(pool);
+    pjmedia_codec_g711_deinit();
+    pjmedia_endpt_destroy(endpt);
+
+    return rc;
+}
+
+#else	/* PJMEDIA_HAS_G711_CODEC */
+
+int stream_fwd_test(void)
+{
+    return 0;
+}
+
+#endif	/* PJMEDIA_HAS_G711_CODEC */
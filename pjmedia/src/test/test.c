@@ -88,6 +88,14 @@ int test_main(void)
     DO_TEST(vid_codec_test());
 #endif
 
+#if HAS_VID_STREAM_TEST
+    DO_TEST(vid_stream_test());
+#endif
+
+#if HAS_H264_TEST
+    DO_TEST(h264_test());
+#endif
+
 #if HAS_SDP_NEG_TEST
     DO_TEST(sdp_neg_test());
 #endif
@@ -103,6 +111,27 @@ int test_main(void)
 #if HAS_CODEC_VECTOR_TEST
     DO_TEST(codec_test_vectors());
 #endif
+#if HAS_SRTP_PERF_TEST
+    DO_TEST(srtp_perf_test());
+#endif
+#if HAS_G711_TEST
+    DO_TEST(g711_test());
+#endif
+#if HAS_RESAMPLE_TEST
+    DO_TEST(resample_test());
+#endif
+#if HAS_STREAM_FWD_TEST
+    DO_TEST(stream_fwd_test());
+#endif
+#if HAS_CLOCK_TEST
+    DO_TEST(clock_test());
+#endif
+#if HAS_ECHO_TEST
+    DO_TEST(echo_test());
+#endif
+#if HAS_PORT_PROF_TEST
+    DO_TEST(port_prof_test());
+#endif
 
     PJ_LOG(3,(THIS_FILE," "));
 
@@ -26,10 +26,19 @@
 #define HAS_VID_DEV_TEST	PJMEDIA_HAS_VIDEO
 #define HAS_VID_PORT_TEST	PJMEDIA_HAS_VIDEO
 #define HAS_VID_CODEC_TEST	PJMEDIA_HAS_VIDEO
+#define HAS_VID_STREAM_TEST	PJMEDIA_HAS_VIDEO
 #define HAS_SDP_NEG_TEST	1
 #define HAS_JBUF_TEST		1
 #define HAS_MIPS_TEST		1
 #define HAS_CODEC_VECTOR_TEST	1
+#define HAS_SRTP_PERF_TEST	PJMEDIA_HAS_SRTP
+#define HAS_G711_TEST		1
+#define HAS_RESAMPLE_TEST	(PJMEDIA_RESAMPLE_IMP!=PJMEDIA_RESAMPLE_NONE)
+#define HAS_STREAM_FWD_TEST	1
+#define HAS_CLOCK_TEST		1
+#define HAS_ECHO_TEST		1
+#define HAS_H264_TEST		PJMEDIA_HAS_VIDEO
+#define HAS_PORT_PROF_TEST	PJMEDIA_PORT_HAS_PROFILING
 
 int session_test(void);
 int rtp_test(void);
@@ -38,7 +47,16 @@ int jbuf_main(void);
 int sdp_neg_test(void);
 int mips_test(void);
 int codec_test_vectors(void);
+int srtp_perf_test(void);
+int g711_test(void);
+int resample_test(void);
+int stream_fwd_test(void);
+int clock_test(void);
+int echo_test(void);
+int h264_test(void);
+int port_prof_test(void);
 int vid_codec_test(void);
+int vid_stream_test(void);
 int vid_dev_test(void);
 int vid_port_test(void);
 
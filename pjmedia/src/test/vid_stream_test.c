@@ -0,0 +1,477 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+#define THIS_FILE   "vid_stream_test.c"
+
+#if defined(PJMEDIA_HAS_VIDEO) && (PJMEDIA_HAS_VIDEO != 0)
+
+/*
+ * Video stream async encoding (async_enc) test. The stream uses a loop
+ * transport, so it receives whatever it sends, and a dummy codec, which
+ * encodes a picture into a single packet carrying the picture number,
+ * so the test can see which pictures have been encoded.
+ */
+
+#define PT		PJMEDIA_RTP_PT_DYNAMIC
+#define FMT_ID		PJMEDIA_FORMAT_PACK('T', 'E', 'S', 'T')
+#define WIDTH		176
+#define HEIGHT		144
+#define FPS		15
+#define PIC_CNT		8
+#define MAX_ENC_CNT	64
+#define SLOW_ENC_MSEC	50
+
+/* Dummy codec factory, and the state shared with the test */
+static struct dummy_factory
+{
+    pjmedia_vid_codec_factory base;
+    pj_pool_t		     *pool;
+    unsigned		      codec_cnt;	/* Allocated codecs	*/
+    unsigned		      enc_msec;		/* Encoding time	*/
+    volatile unsigned	      enc_cnt;		/* Encoded pictures	*/
+    volatile unsigned	      dec_cnt;		/* Decoded pictures	*/
+    pj_uint32_t		      enc_pic[MAX_ENC_CNT]; /* Encoded numbers	*/
+} dummy;
+
+static pj_status_t dummy_init(pjmedia_vid_codec *codec, pj_pool_t *pool)
+{
+    PJ_UNUSED_ARG(codec);
+    PJ_UNUSED_ARG(pool);
+    return PJ_SUCCESS;
+}
+
+static pj_status_t dummy_open(pjmedia_vid_codec *codec,
+			      pjmedia_vid_codec_param *param)
+{
+    pj_memcpy(codec->codec_data, param, sizeof(*param));
+    return PJ_SUCCESS;
+}
+
+static pj_status_t dummy_close(pjmedia_vid_codec *codec)
+{
+    PJ_UNUSED_ARG(codec);
+    return PJ_SUCCESS;
+}
+
+static pj_status_t dummy_modify(pjmedia_vid_codec *codec,
+				const pjmedia_vid_codec_param *param)
+{
+    pj_memcpy(codec->codec_data, param, sizeof(*param));
+    return PJ_SUCCESS;
+}
+
+static pj_status_t dummy_get_param(pjmedia_vid_codec *codec,
+				   pjmedia_vid_codec_param *param)
+{
+    pj_memcpy(param, codec->codec_data, sizeof(*param));
+    return PJ_SUCCESS;
+}
+
+static pj_status_t dummy_encode_begin(pjmedia_vid_codec *codec,
+				      const pjmedia_vid_encode_opt *opt,
+				      const pjmedia_frame *input,
+				      unsigned out_size,
+				      pjmedia_frame *output,
+				      pj_bool_t *has_more)
+{
+    PJ_UNUSED_ARG(codec);
+    PJ_UNUSED_ARG(opt);
+
+    if (out_size < sizeof(pj_uint32_t))
+	return PJMEDIA_CODEC_EFRMTOOSHORT;
+
+    if (dummy.enc_msec)
+	pj_thread_sleep(dummy.enc_msec);
+
+    pj_memcpy(output->buf, input->buf, sizeof(pj_uint32_t));
+    output->type = PJMEDIA_FRAME_TYPE_VIDEO;
+    output->size = sizeof(pj_uint32_t);
+    output->bit_info = PJMEDIA_VID_FRM_KEYFRAME;
+    output->timestamp = input->timestamp;
+    *has_more = PJ_FALSE;
+
+    if (dummy.enc_cnt < MAX_ENC_CNT)
+	pj_memcpy(&dummy.enc_pic[dummy.enc_cnt], input->buf,
+		  sizeof(pj_uint32_t));
+    ++dummy.enc_cnt;
+
+    return PJ_SUCCESS;
+}
+
+static pj_status_t dummy_encode_more(pjmedia_vid_codec *codec,
+				     unsigned out_size,
+				     pjmedia_frame *output,
+				     pj_bool_t *has_more)
+{
+    PJ_UNUSED_ARG(codec);
+    PJ_UNUSED_ARG(out_size);
+
+    output->size = 0;
+    *has_more = PJ_FALSE;
+    return PJ_SUCCESS;
+}
+
+static pj_status_t dummy_decode(pjmedia_vid_codec *codec,
+				pj_size_t count,
+				pjmedia_frame packets[],
+				unsigned out_size,
+				pjmedia_frame *output)
+{
+    PJ_UNUSED_ARG(codec);
+
+    if (count != 1 || packets[0].size != sizeof(pj_uint32_t) ||
+	out_size < sizeof(pj_uint32_t))
+    {
+	return PJMEDIA_CODEC_EFAILED;
+    }
+
+    pj_memcpy(output->buf, packets[0].buf, sizeof(pj_uint32_t));
+    output->type = PJMEDIA_FRAME_TYPE_VIDEO;
+    output->size = sizeof(pj_uint32_t);
+    output->timestamp = packets[0].timestamp;
+    ++dummy.dec_cnt;
+
+    return PJ_SUCCESS;
+}
+
+static pjmedia_vid_codec_op dummy_op =
+{
+    &dummy_init,
+    &dummy_open,
+    &dummy_close,
+    &dummy_modify,
+    &dummy_get_param,
+    &dummy_encode_begin,
+    &dummy_encode_more,
+    &dummy_decode,
+    NULL
+};
+
+static pj_status_t dummy_test_alloc(pjmedia_vid_codec_factory *factory,
+				    const pjmedia_vid_codec_info *info)
+{
+    PJ_UNUSED_ARG(factory);
+    return (info->fmt_id == FMT_ID && info->pt == PT) ? PJ_SUCCESS :
+	   PJMEDIA_CODEC_EUNSUP;
+}
+
+static pj_status_t dummy_default_attr(pjmedia_vid_codec_factory *factory,
+				      const pjmedia_vid_codec_info *info,
+				      pjmedia_vid_codec_param *attr)
+{
+    PJ_UNUSED_ARG(factory);
+    PJ_UNUSED_ARG(info);
+
+    pj_bzero(attr, sizeof(*attr));
+    attr->dir = PJMEDIA_DIR_ENCODING_DECODING;
+    attr->packing = PJMEDIA_VID_PACKING_PACKETS;
+    pjmedia_format_init_video(&attr->enc_fmt, FMT_ID, WIDTH, HEIGHT,
+			      FPS, 1);
+    pjmedia_format_init_video(&attr->dec_fmt, PJMEDIA_FORMAT_I420, WIDTH,
+			      HEIGHT, FPS, 1);
+    attr->enc_fmt.det.vid.avg_bps = attr->enc_fmt.det.vid.max_bps = 256000;
+    attr->enc_mtu = PJMEDIA_MAX_MTU;
+
+    return PJ_SUCCESS;
+}
+
+static pj_status_t dummy_enum_info(pjmedia_vid_codec_factory *factory,
+				   unsigned *count,
+				   pjmedia_vid_codec_info codecs[])
+{
+    PJ_UNUSED_ARG(factory);
+
+    if (*count == 0)
+	return PJ_SUCCESS;
+
+    pj_bzero(&codecs[0], sizeof(codecs[0]));
+    codecs[0].fmt_id = FMT_ID;
+    codecs[0].pt = PT;
+    codecs[0].encoding_name = pj_str("TESTVID");
+    codecs[0].clock_rate = 90000;
+    codecs[0].dir = PJMEDIA_DIR_ENCODING_DECODING;
+    codecs[0].dec_fmt_id_cnt = 1;
+    codecs[0].dec_fmt_id[0] = PJMEDIA_FORMAT_I420;
+    codecs[0].packings = PJMEDIA_VID_PACKING_PACKETS;
+    *count = 1;
+
+    return PJ_SUCCESS;
+}
+
+static pj_status_t dummy_alloc_codec(pjmedia_vid_codec_factory *factory,
+				     const pjmedia_vid_codec_info *info,
+				     pjmedia_vid_codec **p_codec)
+{
+    pjmedia_vid_codec *codec;
+
+    PJ_UNUSED_ARG(info);
+
+    codec = PJ_POOL_ZALLOC_T(dummy.pool, pjmedia_vid_codec);
+    codec->op = &dummy_op;
+    codec->factory = factory;
+    codec->codec_data = PJ_POOL_ZALLOC_T(dummy.pool,
+					 pjmedia_vid_codec_param);
+    ++dummy.codec_cnt;
+
+    *p_codec = codec;
+    return PJ_SUCCESS;
+}
+
+static pj_status_t dummy_dealloc_codec(pjmedia_vid_codec_factory *factory,
+				       pjmedia_vid_codec *codec)
+{
+    PJ_UNUSED_ARG(factory);
+    PJ_UNUSED_ARG(codec);
+
+    --dummy.codec_cnt;
+    return PJ_SUCCESS;
+}
+
+static pjmedia_vid_codec_factory_op dummy_factory_op =
+{
+    &dummy_test_alloc,
+    &dummy_default_attr,
+    &dummy_enum_info,
+    &dummy_alloc_codec,
+    &dummy_dealloc_codec
+};
+
+/* Create and start the stream with async encoding */
+static int create_stream(pjmedia_endpt *endpt, pj_pool_t *pool,
+			 pjmedia_transport **p_tp,
+			 pjmedia_vid_stream **p_stream,
+			 pjmedia_port **p_port)
+{
+    pjmedia_vid_stream_info si;
+    unsigned count = 1;
+    pj_status_t status;
+
+    pj_bzero(&si, sizeof(si));
+    si.type = PJMEDIA_TYPE_VIDEO;
+    si.proto = PJMEDIA_TP_PROTO_RTP_AVP;
+    si.dir = PJMEDIA_DIR_ENCODING_DECODING;
+    pj_sockaddr_in_init(&si.rem_addr.ipv4, NULL, 4000);
+    pj_sockaddr_in_init(&si.rem_rtcp.ipv4, NULL, 4001);
+    dummy_enum_info(&dummy.base, &count, &si.codec_info);
+    si.tx_pt = si.rx_pt = PT;
+    si.ssrc = pj_rand();
+    si.jb_init = si.jb_min_pre = si.jb_max_pre = si.jb_max = -1;
+    pjmedia_vid_stream_rc_config_default(&si.rc_cfg);
+    si.async_enc = PJ_TRUE;
+
+    status = pjmedia_transport_loop_create(endpt, p_tp);
+    if (status != PJ_SUCCESS)
+	return -10;
+
+    status = pjmedia_vid_stream_create(endpt, pool, &si, *p_tp, NULL,
+				       p_stream);
+    if (status != PJ_SUCCESS) {
+	app_perror(status, "error creating video stream");
+	return -20;
+    }
+
+    status = pjmedia_vid_stream_start(*p_stream);
+    if (status != PJ_SUCCESS)
+	return -30;
+
+    pjmedia_vid_stream_get_port(*p_stream, PJMEDIA_DIR_ENCODING, p_port);
+
+    return 0;
+}
+
+/* Put a picture, which is identified by its number */
+static pj_status_t put_pic(pjmedia_port *port, pjmedia_frame *frame,
+			   pj_uint32_t pic)
+{
+    pj_memcpy(frame->buf, &pic, sizeof(pic));
+    frame->timestamp.u64 = pic * (90000 / FPS);
+    return pjmedia_port_put_frame(port, frame);
+}
+
+/* Wait until the encoder has been called cnt times */
+static pj_bool_t wait_enc(unsigned cnt)
+{
+    unsigned i;
+
+    for (i = 0; i < 200 && dummy.enc_cnt < cnt; ++i)
+	pj_thread_sleep(5);
+
+    return dummy.enc_cnt >= cnt;
+}
+
+static int async_enc_test(pjmedia_endpt *endpt, pj_pool_t *pool)
+{
+    pjmedia_transport *tp = NULL;
+    pjmedia_vid_stream *stream = NULL;
+    pjmedia_port *port;
+    pjmedia_frame frame;
+    pjmedia_rtcp_stat stat;
+    pj_uint32_t pic = 0;
+    unsigned i, enc_cnt;
+    int rc;
+
+    dummy.enc_cnt = dummy.dec_cnt = dummy.enc_msec = 0;
+
+    rc = create_stream(endpt, pool, &tp, &stream, &port);
+    if (rc != 0)
+	goto on_return;
+
+    pj_bzero(&frame, sizeof(frame));
+    frame.type = PJMEDIA_FRAME_TYPE_VIDEO;
+    frame.size = WIDTH * HEIGHT * 3 / 2;
+    frame.buf = pj_pool_zalloc(pool, frame.size);
+
+    /* Every picture is encoded and sent in order, when the encoder keeps
+     * up.
+     */
+    PJ_LOG(3,(THIS_FILE, "  encoding"));
+    for (i = 0; i < PIC_CNT; ++i) {
+	if (put_pic(port, &frame, pic++) != PJ_SUCCESS) {
+	    rc = -100;
+	    goto on_return;
+	}
+	if (!wait_enc(i + 1)) {
+	    rc = -110;
+	    goto on_return;
+	}
+    }
+    for (i = 0; i < PIC_CNT; ++i) {
+	if (dummy.enc_pic[i] != i) {
+	    rc = -120;
+	    goto on_return;
+	}
+    }
+
+    /* The loop transport gives the packets back to the stream, wait for
+     * the last one, which is sent after it is encoded.
+     */
+    for (i = 0; i < 200; ++i) {
+	pjmedia_vid_stream_get_stat(stream, &stat);
+	if (stat.rx.pkt >= PIC_CNT)
+	    break;
+	pj_thread_sleep(5);
+    }
+    if (stat.tx.pkt != PIC_CNT || stat.rx.pkt != PIC_CNT ||
+	dummy.dec_cnt == 0)
+    {
+	PJ_LOG(3,(THIS_FILE, "    tx %d, rx %d, decoded %d packets",
+		  stat.tx.pkt, stat.rx.pkt, dummy.dec_cnt));
+	rc = -130;
+	goto on_return;
+    }
+
+    /* Pictures put while paused are not encoded */
+    PJ_LOG(3,(THIS_FILE, "  pause and resume"));
+    pjmedia_vid_stream_pause(stream, PJMEDIA_DIR_ENCODING);
+    for (i = 0; i < PIC_CNT; ++i) {
+	if (put_pic(port, &frame, pic++) != PJ_SUCCESS) {
+	    rc = -200;
+	    goto on_return;
+	}
+    }
+    pj_thread_sleep(100);
+    if (dummy.enc_cnt != PIC_CNT) {
+	rc = -210;
+	goto on_return;
+    }
+
+    /* Encoding continues after resume */
+    pjmedia_vid_stream_resume(stream, PJMEDIA_DIR_ENCODING);
+    if (put_pic(port, &frame, pic) != PJ_SUCCESS) {
+	rc = -220;
+	goto on_return;
+    }
+    if (!wait_enc(PIC_CNT + 1) || dummy.enc_pic[PIC_CNT] != pic) {
+	rc = -230;
+	goto on_return;
+    }
+    ++pic;
+
+    /* A slow encoder doesn't block put_frame(), the oldest pictures are
+     * dropped instead. Destroy the stream while pictures are still queued.
+     */
+    PJ_LOG(3,(THIS_FILE, "  destroy with queued pictures"));
+    dummy.enc_msec = SLOW_ENC_MSEC;
+    enc_cnt = dummy.enc_cnt;
+    for (i = 0; i < PIC_CNT; ++i) {
+	if (put_pic(port, &frame, pic++) != PJ_SUCCESS) {
+	    rc = -300;
+	    goto on_return;
+	}
+    }
+
+    pjmedia_vid_stream_destroy(stream);
+    stream = NULL;
+
+    if (dummy.enc_cnt - enc_cnt >= PIC_CNT) {
+	rc = -310;
+	goto on_return;
+    }
+
+    /* Nothing is encoded after the stream is destroyed */
+    enc_cnt = dummy.enc_cnt;
+    pj_thread_sleep(SLOW_ENC_MSEC * 2);
+    if (dummy.enc_cnt != enc_cnt)
+	rc = -320;
+
+on_return:
+    if (stream)
+	pjmedia_vid_stream_destroy(stream);
+    if (tp)
+	pjmedia_transport_close(tp);
+    if (rc == 0 && dummy.codec_cnt != 0)
+	rc = -400;
+    return rc;
+}
+
+int vid_stream_test(void)
+{
+    pjmedia_endpt *endpt;
+    pj_pool_t *pool;
+    pj_status_t status;
+    int rc;
+
+    status = pjmedia_endpt_create(mem, NULL, 0, &endpt);
+    if (status != PJ_SUCCESS)
+	return -1;
+
+    pool = pj_pool_create(mem, "vidstream", 4000, 4000, NULL);
+
+    pj_bzero(&dummy, sizeof(dummy));
+    dummy.base.op = &dummy_factory_op;
+    dummy.pool = pool;
+    status = pjmedia_vid_codec_mgr_register_factory(NULL, &dummy.base);
+    if (status != PJ_SUCCESS) {
+	pj_pool_release(pool);
+	pjmedia_endpt_destroy(endpt);
+	return -2;
+    }
+
+    rc = async_enc_test(endpt, pool);
+
+    pjmedia_vid_codec_mgr_unregister_factory(NULL, &dummy.base);
+    pj_pool_release(pool);
+    pjmedia_endpt_destroy(endpt);
+
+    return rc;
+}
+
+#endif /* PJMEDIA_HAS_VIDEO */
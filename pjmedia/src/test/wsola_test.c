@@ -19,9 +19,11 @@
  */
 #include <pjmedia/wsola.h>
 #include <pj/log.h>
+#include <pj/math.h>
 #include <pj/pool.h>
 #include <pj/os.h>
 #include <stdio.h>
+#include <math.h>
 #include <assert.h>
 
 #define CLOCK_RATE	    16000
@@ -195,6 +197,83 @@ int expand(pj_pool_t *pool, const char *filein, const char *fileout,
     return 0;
 }
 
+/* Simulate a packet loss event hitting many streams at once: every stream
+ * conceals two lost frames after a run of good frames. Reports the time
+ * spent in pjmedia_wsola_generate() per concealed frame, and the SNR of
+ * the concealed frames relative to those of the first (full search) run.
+ */
+static void plc_bench(pj_pool_t *pool, unsigned options, const char *title,
+		      short *ref)
+{
+    enum { STREAM_CNT = 1000, GOOD_CNT = 6, LOST_CNT = 2 };
+    short frame[SAMPLES_PER_FRAME];
+    pjmedia_wsola **wsola;
+    pj_timestamp elapsed, zero;
+    double sig = 0, err = 0;
+    unsigned i, j, k;
+
+    wsola = (pjmedia_wsola**) pj_pool_calloc(pool, STREAM_CNT,
+					     sizeof(pjmedia_wsola*));
+    for (i=0; i<STREAM_CNT; ++i) {
+	pjmedia_wsola_create(pool, CLOCK_RATE, SAMPLES_PER_FRAME, 1,
+			     PJMEDIA_WSOLA_NO_DISCARD | options, &wsola[i]);
+    }
+
+    elapsed.u64 = 0;
+
+    for (i=0; i<STREAM_CNT; ++i) {
+	/* Voiced speech like signal, with the pitch varying per stream */
+	double f0 = 90.0 + (i % 160);
+
+	for (j=0; j<GOOD_CNT; ++j) {
+	    for (k=0; k<SAMPLES_PER_FRAME; ++k) {
+		double t = (double)(j*SAMPLES_PER_FRAME + k) / CLOCK_RATE;
+		frame[k] = (short)(4000 * sin(2 * PJ_PI * f0 * t) +
+				   2000 * sin(2 * PJ_PI * 3 * f0 * t + 1) +
+				   1000 * sin(2 * PJ_PI * 5 * f0 * t + 2));
+	    }
+	    pjmedia_wsola_save(wsola[i], frame, PJ_FALSE);
+	}
+
+	for (j=0; j<LOST_CNT; ++j) {
+	    short *out = ref + (i*LOST_CNT + j) * SAMPLES_PER_FRAME;
+	    pj_timestamp t1, t2;
+
+	    pj_get_timestamp(&t1);
+	    pjmedia_wsola_generate(wsola[i], frame);
+	    pj_get_timestamp(&t2);
+
+	    pj_sub_timestamp(&t2, &t1);
+	    pj_add_timestamp(&elapsed, &t2);
+
+	    /* The first run (full search) is the reference */
+	    for (k=0; k<SAMPLES_PER_FRAME; ++k) {
+		double d = (double)frame[k] - out[k];
+
+		if (options == 0) {
+		    out[k] = frame[k];
+		} else {
+		    sig += (double)out[k] * out[k];
+		    err += d * d;
+		}
+	    }
+	}
+    }
+
+    for (i=0; i<STREAM_CNT; ++i)
+	pjmedia_wsola_destroy(wsola[i]);
+
+    zero.u64 = 0;
+    zero.u64 = pj_elapsed_usec(&zero, &elapsed);
+
+    PJ_LOG(3,("test.c", "%s: %u streams, %.2f usec per concealed frame",
+	      title, STREAM_CNT, (double)zero.u32.lo / (STREAM_CNT * LOST_CNT)));
+    if (options != 0) {
+	PJ_LOG(3,("test.c", "  SNR vs full search: %.1f dB",
+		  (err > 0 ? 10 * log10(sig / err) : 99.0)));
+    }
+}
+
 static void save_file(const char *file, 
 		      short frame[], unsigned count)
 {
@@ -348,6 +427,17 @@ int main()
 
     srand(2);
 
+    {
+	short *ref = (short*)
+		     pj_pool_calloc(pool, 1000 * 2 * SAMPLES_PER_FRAME,
+				    sizeof(short));
+
+	PJ_LOG(3,("test.c", "PLC similarity search (SSE2 %s):",
+		  (PJMEDIA_WSOLA_SSE2 ? "enabled" : "disabled")));
+	plc_bench(pool, 0, "Full search  ", ref);
+	plc_bench(pool, PJMEDIA_WSOLA_COARSE_SEARCH, "Coarse search", ref);
+    }
+
     rc = expand(pool, "galileo16.pcm", "temp1.pcm", 20, 0, 0);
     rc = compress(pool, "temp1.pcm", "output.pcm", 1);
 
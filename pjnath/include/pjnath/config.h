@@ -109,6 +109,19 @@
 #endif
 
 
+/**
+ * Number of authentication keys to be cached by each STUN session, to
+ * avoid recalculating the key and the HMAC-SHA1 pads every time a
+ * message is authenticated with the same credential. Set to zero to
+ * disable the cache.
+ *
+ * Default: 4
+ */
+#ifndef PJ_STUN_AUTH_KEY_CACHE_SIZE
+#   define PJ_STUN_AUTH_KEY_CACHE_SIZE		    4
+#endif
+
+
 /**
  * Maximum size of STUN message.
  */
@@ -211,6 +224,21 @@
 #endif
 
 
+/**
+ * When a TURN permission needs to be refreshed, other permissions which 
+ * expire within this number of seconds are refreshed in the same 
+ * CreatePermission request. This coalesces the refreshes of many peers 
+ * into few requests and keeps their expiration times aligned, so that 
+ * they continue to be refreshed together. Set to zero to refresh each 
+ * permission only when it is due.
+ *
+ * Default: 60
+ */
+#ifndef PJ_TURN_PERM_REFRESH_WINDOW
+#   define PJ_TURN_PERM_REFRESH_WINDOW		    60
+#endif
+
+
 /**
  * The TURN session timer heart beat interval. When this timer occurs, the 
  * TURN session will scan all the permissions/channel bindings to see which
@@ -245,6 +273,30 @@
 #endif
 
 
+/**
+ * Number of hash table buckets used by each shared socket of an ICE
+ * stream transport mux (#pj_ice_strans_mux) to demultiplex incoming
+ * packets to the ICE stream transports.
+ *
+ * Default: 1023
+ */
+#ifndef PJ_ICE_ST_MUX_HT_SIZE
+#   define PJ_ICE_ST_MUX_HT_SIZE		    1023
+#endif
+
+
+/**
+ * Maximum number of outgoing packets queued by each shared socket of an
+ * ICE stream transport mux (#pj_ice_strans_mux) while the socket is not
+ * writable. Packets sent when the queue is full are dropped.
+ *
+ * Default: 16
+ */
+#ifndef PJ_ICE_ST_MUX_SEND_QUEUE_SIZE
+#   define PJ_ICE_ST_MUX_SEND_QUEUE_SIZE	    16
+#endif
+
+
 /**
  * The number of bits to represent component IDs. This will affect
  * the maximum number of components (PJ_ICE_MAX_COMP) value.
@@ -315,6 +367,18 @@
 #endif
 
 
+/**
+ * Default maximum number of connectivity checks that a shared ICE pacer
+ * (#pj_ice_sess_pacer) starts on each Ta interval, across all ICE
+ * sessions attached to it.
+ *
+ * Default: 32
+ */
+#ifndef PJ_ICE_PACER_MAX_CHECKS
+#   define PJ_ICE_PACER_MAX_CHECKS		    32
+#endif
+
+
 /**
  * According to ICE Section 8.2. Updating States, if an In-Progress pair in 
  * the check list is for the same component as a nominated pair, the agent 
@@ -170,6 +170,9 @@ typedef struct pj_ice_sess pj_ice_sess;
 /** Forward declaration for pj_ice_sess_check */
 typedef struct pj_ice_sess_check pj_ice_sess_check;
 
+/** Forward declaration for pj_ice_sess_pacer */
+typedef struct pj_ice_sess_pacer pj_ice_sess_pacer;
+
 
 /**
  * This structure describes ICE component. 
@@ -599,9 +602,36 @@ typedef struct pj_ice_sess_options
      */
     int			controlled_agent_want_nom_timeout;
 
+    /**
+     * Optional shared pacer to schedule the periodic connectivity checks
+     * of this session. When set, the session does not run its own Ta
+     * timer; instead the pacer starts checks for all sessions attached
+     * to it from a single timer, in round-robin fashion. The pacer must
+     * outlive all sessions using it. See #pj_ice_sess_pacer_create().
+     *
+     * Default: NULL (the session paces its own checks)
+     */
+    pj_ice_sess_pacer  *pacer;
+
 } pj_ice_sess_options;
 
 
+/**
+ * This structure is used by the ICE session to queue itself in a shared
+ * pacer (#pj_ice_sess_pacer) while it has connectivity checks pending.
+ * Application should not need to access this structure.
+ */
+typedef struct pj_ice_sess_pacer_entry
+{
+    PJ_DECL_LIST_MEMBER(struct pj_ice_sess_pacer_entry); /**< List    */
+
+    pj_ice_sess_pacer	*pacer;		/**< Pacer where this entry is
+					     queued, or NULL.		*/
+    pj_ice_sess		*ice;		/**< The ICE session.		*/
+
+} pj_ice_sess_pacer_entry;
+
+
 /**
  * This structure describes the ICE session. For this version of PJNATH,
  * an ICE session corresponds to a single media stream (unlike the ICE
@@ -660,6 +690,18 @@ struct pj_ice_sess
 
     /* Checklist */
     pj_ice_sess_checklist clist;		    /**< Active checklist   */
+
+    /* Lookup indexes, so incoming checks don't need to scan the lists.
+     * The entries hold the candidate or check index plus one, zero means
+     * empty.
+     */
+    pj_uint16_t		 rcand_idx[PJ_ICE_MAX_CAND*2]; /**< Remote cand.
+							    by address  */
+    pj_uint16_t		 check_idx[PJ_ICE_MAX_CAND][PJ_ICE_MAX_CAND];
+						    /**< Check by pair	    */
+
+    /* Shared pacer */
+    pj_ice_sess_pacer_entry pacer_entry;	    /**< Pacer queue entry  */
     
     /* Valid list */
     pj_ice_sess_checklist valid_list;		    /**< Valid list.	    */
@@ -708,6 +750,41 @@ PJ_DECL(void) pj_ice_calc_foundation(pj_pool_t *pool,
 				     pj_ice_cand_type type,
 				     const pj_sockaddr *base_addr);
 
+/**
+ * Create a pacer to be shared by multiple ICE sessions. A pacer replaces
+ * the per-session Ta timers with a single timer, which on every Ta
+ * interval starts at most \a max_checks connectivity checks across the
+ * sessions attached to it (see \a pacer field in #pj_ice_sess_options),
+ * serving the sessions in round-robin order. This keeps the timer heap
+ * small and bounds the rate of outgoing checks when many sessions are
+ * running their checklists at the same time.
+ *
+ * @param stun_cfg	The STUN configuration, containing the pool factory
+ *			and the timer heap to be used by the pacer.
+ * @param ta_msec	The pacing interval, in milliseconds. Specify zero
+ *			to use PJ_ICE_TA_VAL.
+ * @param max_checks	Maximum number of checks to start on each interval.
+ *			Specify zero to use PJ_ICE_PACER_MAX_CHECKS.
+ * @param p_pacer	Pointer to receive the pacer instance.
+ *
+ * @return		PJ_SUCCESS on success, or the appropriate error.
+ */
+PJ_DECL(pj_status_t) pj_ice_sess_pacer_create(const pj_stun_config *stun_cfg,
+					      unsigned ta_msec,
+					      unsigned max_checks,
+					      pj_ice_sess_pacer **p_pacer);
+
+/**
+ * Destroy the pacer. All ICE sessions using the pacer must have been
+ * destroyed before this function is called.
+ *
+ * @param pacer		The pacer.
+ *
+ * @return		PJ_SUCCESS on success, or the appropriate error.
+ */
+PJ_DECL(pj_status_t) pj_ice_sess_pacer_destroy(pj_ice_sess_pacer *pacer);
+
+
 /**
  * Initialize ICE session options with library default values.
  *
@@ -116,6 +116,9 @@ PJ_BEGIN_DECL
 /** Forward declaration for ICE stream transport. */
 typedef struct pj_ice_strans pj_ice_strans;
 
+/** Forward declaration for pool of UDP sockets shared by ICE transports */
+typedef struct pj_ice_strans_mux pj_ice_strans_mux;
+
 /** Transport operation types to be reported on \a on_status() callback */
 typedef enum pj_ice_strans_op
 {
@@ -277,6 +280,22 @@ typedef struct pj_ice_strans_cfg
 	 */
 	pj_bool_t	     ignore_stun_error;
 
+	/**
+	 * Optional pool of UDP sockets shared by many ICE stream
+	 * transports, created with #pj_ice_strans_mux_create(). When
+	 * this is set, the components don't create their own sockets;
+	 * instead each component is bound to one of the shared sockets
+	 * and incoming packets are demultiplexed by the local username
+	 * fragment of STUN requests, or by the remote address for other
+	 * packets. STUN mapped address resolution is not performed on
+	 * shared sockets (the \a server field is ignored), so only host
+	 * candidates, and relayed candidates if TURN is configured, are
+	 * added. The mux must outlive the ICE stream transports using it.
+	 *
+	 * The default value is NULL.
+	 */
+	pj_ice_strans_mux   *mux;
+
     } stun;
 
     /**
@@ -454,6 +473,44 @@ typedef enum pj_ice_strans_state
 } pj_ice_strans_state;
 
 
+/**
+ * Create a pool of UDP sockets to be shared by ICE stream transports
+ * (see \a mux field in the STUN settings of #pj_ice_strans_cfg). Using
+ * a small number of shared sockets instead of a socket per component
+ * greatly reduces the number of file descriptors and ioqueue keys when
+ * running many ICE stream transports. The components of one ICE stream
+ * transport are bound to different sockets, so \a sock_cnt must not be
+ * lower than the number of components of the ICE stream transports.
+ *
+ * @param stun_cfg	The STUN configuration, containing the pool factory
+ *			and the ioqueue to be used.
+ * @param af		Address family, pj_AF_INET() or pj_AF_INET6().
+ * @param sock_cfg	Optional socket settings (bound address, port range,
+ *			QoS, buffer sizes, and the number of concurrent
+ *			read operations). If NULL, the defaults from
+ *			#pj_stun_sock_cfg_default() are used.
+ * @param sock_cnt	Number of sockets to create.
+ * @param p_mux		Pointer to receive the mux instance.
+ *
+ * @return		PJ_SUCCESS on success, or the appropriate error.
+ */
+PJ_DECL(pj_status_t) pj_ice_strans_mux_create(const pj_stun_config *stun_cfg,
+					      int af,
+					      const pj_stun_sock_cfg *sock_cfg,
+					      unsigned sock_cnt,
+					      pj_ice_strans_mux **p_mux);
+
+/**
+ * Destroy the shared sockets. All ICE stream transports using the mux
+ * must have been destroyed before this function is called.
+ *
+ * @param mux		The mux.
+ *
+ * @return		PJ_SUCCESS on success, or the appropriate error.
+ */
+PJ_DECL(pj_status_t) pj_ice_strans_mux_destroy(pj_ice_strans_mux *mux);
+
+
 /** 
  * Initialize ICE transport configuration with default values.
  *
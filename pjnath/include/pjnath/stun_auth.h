@@ -445,6 +445,115 @@ PJ_DECL(pj_status_t) pj_stun_authenticate_response(const pj_uint8_t *pkt,
 					           const pj_str_t *key);
 
 
+/**
+ * Opaque declaration of STUN authentication key cache. The cache keeps
+ * the keys derived from recently used credentials, together with the
+ * HMAC-SHA1 context already initialized with each key, so that
+ * authenticating messages with the same credential doesn't need to
+ * calculate the MD5 key and the HMAC pads over and over again.
+ *
+ * The cache is not thread safe; application must serialize access to
+ * it (STUN session uses its own cache while holding its lock).
+ */
+typedef struct pj_stun_auth_key_cache pj_stun_auth_key_cache;
+
+
+/**
+ * Create authentication key cache.
+ *
+ * @param pool		Pool to allocate memory for the cache.
+ * @param max_cnt	Maximum number of keys to be kept in the cache.
+ *			When the cache is full, least recently used key
+ *			will be replaced.
+ * @param p_cache	Pointer to receive the cache.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pj_stun_auth_key_cache_create(pj_pool_t *pool,
+						   unsigned max_cnt,
+						   pj_stun_auth_key_cache **p_cache);
+
+/**
+ * Remove all keys from the cache, e.g. when the credential is changed.
+ *
+ * @param cache		The key cache.
+ */
+PJ_DECL(void) pj_stun_auth_key_cache_clear(pj_stun_auth_key_cache *cache);
+
+/**
+ * Create authentication key like #pj_stun_create_key(), but take the
+ * key from the cache if it has been calculated for the same credential
+ * before.
+ *
+ * @param cache		The key cache.
+ * @param pool		Pool to allocate memory for the key.
+ * @param key		String to receive the key.
+ * @param realm		The realm of the credential, if long term credential
+ *			is to be used.
+ * @param username	The username.
+ * @param data_type	Password encoding.
+ * @param data		The password.
+ */
+PJ_DECL(void) pj_stun_auth_key_cache_get_key(pj_stun_auth_key_cache *cache,
+					     pj_pool_t *pool,
+					     pj_str_t *key,
+					     const pj_str_t *realm,
+					     const pj_str_t *username,
+					     pj_stun_passwd_type data_type,
+					     const pj_str_t *data);
+
+/**
+ * Verify credential in the STUN request, using keys from the specified
+ * key cache. This is the same as #pj_stun_authenticate_request() in all
+ * other respects.
+ *
+ * @param pkt		The original packet which has been parsed into
+ *			the message.
+ * @param pkt_len	The length of the packet.
+ * @param msg		The parsed message to be verified.
+ * @param cred		Pointer to credential to be used to authenticate
+ *			the message.
+ * @param cache		Optional key cache.
+ * @param pool		If response is to be created, then memory will
+ *			be allocated from this pool.
+ * @param info		Optional pointer to receive authentication information.
+ * @param p_response	Optional pointer to receive the response message
+ *			then the credential in the request fails to
+ *			authenticate.
+ *
+ * @return		PJ_SUCCESS if credential is verified successfully.
+ */
+PJ_DECL(pj_status_t) pj_stun_authenticate_request2(const pj_uint8_t *pkt,
+						   unsigned pkt_len,
+						   const pj_stun_msg *msg,
+						   pj_stun_auth_cred *cred,
+						   pj_stun_auth_key_cache *cache,
+						   pj_pool_t *pool,
+						   pj_stun_req_cred_info *info,
+						   pj_stun_msg **p_response);
+
+/**
+ * Verify credential in the STUN response, using the HMAC context from
+ * the specified key cache. This is the same as
+ * #pj_stun_authenticate_response() in all other respects.
+ *
+ * @param pkt		The original packet which has been parsed into
+ *			the message.
+ * @param pkt_len	The length of the packet.
+ * @param msg		The parsed message to be verified.
+ * @param cache		Optional key cache.
+ * @param key		Authentication key to calculate MESSAGE-INTEGRITY
+ *			value.
+ *
+ * @return		PJ_SUCCESS if credential is verified successfully.
+ */
+PJ_DECL(pj_status_t) pj_stun_authenticate_response2(const pj_uint8_t *pkt,
+						    unsigned pkt_len,
+						    const pj_stun_msg *msg,
+						    pj_stun_auth_key_cache *cache,
+						    const pj_str_t *key);
+
+
 /**
  * @}
  */
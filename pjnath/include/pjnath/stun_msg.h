@@ -26,6 +26,7 @@
  */
 
 #include <pjnath/types.h>
+#include <pjlib-util/hmac_sha1.h>
 #include <pj/sock.h>
 
 
@@ -1414,6 +1415,392 @@ PJ_DECL(pj_status_t) pj_stun_msg_decode(pj_pool_t *pool,
 					pj_size_t *p_parsed_len,
 				        pj_stun_msg **p_response);
 
+/**
+ * This structure describes a STUN message which has been validated and
+ * indexed in place by #pj_stun_msg_view_parse(). Unlike #pj_stun_msg,
+ * no memory is allocated and attribute values are not decoded up front.
+ * Instead they are read from the packet buffer on demand with the
+ * pj_stun_msg_view_get_*() functions, so the packet buffer must remain
+ * valid and unchanged while the view is being used.
+ */
+typedef struct pj_stun_msg_view
+{
+    /**
+     * The packet buffer.
+     */
+    const pj_uint8_t   *pdu;
+
+    /**
+     * STUN message header, in host byte order.
+     */
+    pj_stun_msg_hdr	hdr;
+
+    /**
+     * Number of attributes in the STUN message.
+     */
+    unsigned		attr_count;
+
+    /**
+     * Array of attribute locations.
+     */
+    struct {
+	pj_uint16_t	type;	    /**< Attribute type.		    */
+	pj_uint16_t	length;	    /**< Attribute value length.	    */
+	unsigned	offset;	    /**< Offset of attribute in pdu.	    */
+    } attr[PJ_STUN_MAX_ATTR];
+
+} pj_stun_msg_view;
+
+
+/**
+ * Validate and index incoming packet as STUN message without decoding
+ * it. The message structure is checked the same way as
+ * #pj_stun_msg_decode() does (attribute lengths, unknown mandatory
+ * attributes, and position of MESSAGE-INTEGRITY and FINGERPRINT), but
+ * the attribute values are only validated when they are read with the
+ * pj_stun_msg_view_get_*() functions. No response is created when the
+ * message is invalid; use #pj_stun_msg_decode() to get one.
+ *
+ * @param pdu		The incoming packet to be parsed.
+ * @param pdu_len	The length of the incoming packet.
+ * @param options	Parsing flags, according to pj_stun_decode_options.
+ * @param view		The view to be initialized.
+ * @param p_parsed_len	Optional pointer to receive how many bytes have
+ *			been parsed for the STUN message.
+ *
+ * @return		PJ_SUCCESS if the packet is a valid STUN message.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_view_parse(const pj_uint8_t *pdu,
+					    pj_size_t pdu_len,
+					    unsigned options,
+					    pj_stun_msg_view *view,
+					    pj_size_t *p_parsed_len);
+
+/**
+ * Find STUN attribute in the message view, starting from the specified
+ * index.
+ *
+ * @param view		The message view.
+ * @param attr_type	The attribute type to be found, from pj_stun_attr_type.
+ * @param start_index	The start index of the attribute in the message.
+ *
+ * @return		The attribute index, or -1 if it cannot be found.
+ */
+PJ_DECL(int) pj_stun_msg_view_find_attr(const pj_stun_msg_view *view,
+					int attr_type,
+					unsigned start_index);
+
+/**
+ * Get the value of socket address attribute (such as MAPPED-ADDRESS or
+ * XOR-MAPPED-ADDRESS) in the message view. XOR-ed addresses are
+ * converted back to the real address.
+ *
+ * @param view		The message view.
+ * @param index		The attribute index.
+ * @param addr		Pointer to receive the address.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_view_get_sockaddr(const pj_stun_msg_view *view,
+						   unsigned index,
+						   pj_sockaddr *addr);
+
+/**
+ * Get the value of string attribute (such as USERNAME) in the message
+ * view. The string points to the packet buffer and is not NULL
+ * terminated.
+ *
+ * @param view		The message view.
+ * @param index		The attribute index.
+ * @param value		Pointer to receive the string.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_view_get_string(const pj_stun_msg_view *view,
+						 unsigned index,
+						 pj_str_t *value);
+
+/**
+ * Get the value of 32bit integer attribute (such as PRIORITY) in the
+ * message view.
+ *
+ * @param view		The message view.
+ * @param index		The attribute index.
+ * @param value		Pointer to receive the value, in host byte order.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_view_get_uint(const pj_stun_msg_view *view,
+					       unsigned index,
+					       pj_uint32_t *value);
+
+/**
+ * Get the value of 64bit integer attribute (such as ICE-CONTROLLING) in
+ * the message view.
+ *
+ * @param view		The message view.
+ * @param index		The attribute index.
+ * @param value		Pointer to receive the value, in host byte order.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_view_get_uint64(const pj_stun_msg_view *view,
+						 unsigned index,
+						 pj_timestamp *value);
+
+/**
+ * Get the value of binary attribute (such as DATA) in the message view.
+ * The data points to the packet buffer.
+ *
+ * @param view		The message view.
+ * @param index		The attribute index.
+ * @param data		Pointer to receive the data.
+ * @param length	Pointer to receive the data length.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_view_get_binary(const pj_stun_msg_view *view,
+						 unsigned index,
+						 const pj_uint8_t **data,
+						 unsigned *length);
+
+/**
+ * This structure is used to encode STUN message directly into a buffer
+ * with the pj_stun_msg_builder_*() functions, without creating
+ * #pj_stun_msg and attribute objects in a pool first. Each attribute is
+ * written to the buffer as soon as it is added, and MESSAGE-INTEGRITY
+ * and FINGERPRINT are calculated over the bytes which have been written
+ * so far, so a message is never encoded twice.
+ *
+ * The first error is remembered by the builder and returned by
+ * #pj_stun_msg_builder_finish(), and once an error has occurred the
+ * subsequent add functions do nothing. Application may therefore add
+ * all attributes and only check the result at the end.
+ */
+typedef struct pj_stun_msg_builder
+{
+    /**
+     * The output buffer.
+     */
+    pj_uint8_t	       *buf;
+
+    /**
+     * The size of the output buffer.
+     */
+    unsigned		buf_size;
+
+    /**
+     * Number of bytes encoded so far, including the message header.
+     */
+    unsigned		len;
+
+    /**
+     * STUN message header, in host byte order.
+     */
+    pj_stun_msg_hdr	hdr;
+
+    /**
+     * Type of the last attribute added, to check the position of
+     * MESSAGE-INTEGRITY and FINGERPRINT.
+     */
+    pj_uint16_t		last_attr;
+
+    /**
+     * The first error, or PJ_SUCCESS.
+     */
+    pj_status_t		status;
+
+} pj_stun_msg_builder;
+
+
+/**
+ * Start encoding a STUN message into the buffer. The message header is
+ * written to the buffer immediately.
+ *
+ * @param b		The builder to be initialized.
+ * @param buf		The buffer to encode the message to. The buffer
+ *			must remain valid until the message has been sent.
+ * @param buf_size	The size of the buffer.
+ * @param msg_type	The message type (for example
+ *			PJ_STUN_BINDING_REQUEST).
+ * @param magic		Magic value to be put to the mesage; for requests,
+ *			the value normally should be PJ_STUN_MAGIC.
+ * @param tsx_id	Optional transaction ID, or NULL to let the
+ *			function generates a random transaction ID.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_builder_init(pj_stun_msg_builder *b,
+					      pj_uint8_t *buf,
+					      unsigned buf_size,
+					      unsigned msg_type,
+					      pj_uint32_t magic,
+					      const pj_uint8_t tsx_id[12]);
+
+/**
+ * Encode socket address attribute (such as XOR-MAPPED-ADDRESS or
+ * XOR-PEER-ADDRESS) to the message.
+ *
+ * @param b		The builder.
+ * @param attr_type	The attribute type, from #pj_stun_attr_type.
+ * @param xor_ed	If non-zero, the port and address will be XOR-ed
+ *			with magic, to make the XOR-MAPPED-ADDRESS attribute.
+ * @param addr		The socket address.
+ * @param addr_len	Length of \a addr.
+ *
+ * @return		PJ_SUCCESS, or the first error of the builder.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_builder_add_sockaddr_attr(
+					      pj_stun_msg_builder *b,
+					      int attr_type, 
+					      pj_bool_t xor_ed,
+					      const pj_sockaddr_t *addr,
+					      unsigned addr_len);
+
+/**
+ * Encode string attribute (such as USERNAME or SOFTWARE) to the message.
+ *
+ * @param b		The builder.
+ * @param attr_type	The attribute type, from #pj_stun_attr_type.
+ * @param value		The string value.
+ *
+ * @return		PJ_SUCCESS, or the first error of the builder.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_builder_add_string_attr(
+					      pj_stun_msg_builder *b,
+					      int attr_type,
+					      const pj_str_t *value);
+
+/**
+ * Encode 32bit integer attribute (such as PRIORITY or LIFETIME) to the
+ * message.
+ *
+ * @param b		The builder.
+ * @param attr_type	The attribute type, from #pj_stun_attr_type.
+ * @param value		The value, in host byte order.
+ *
+ * @return		PJ_SUCCESS, or the first error of the builder.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_builder_add_uint_attr(
+					      pj_stun_msg_builder *b,
+					      int attr_type,
+					      pj_uint32_t value);
+
+/**
+ * Encode 64bit integer attribute (such as ICE-CONTROLLING) to the
+ * message.
+ *
+ * @param b		The builder.
+ * @param attr_type	The attribute type, from #pj_stun_attr_type.
+ * @param value		The value.
+ *
+ * @return		PJ_SUCCESS, or the first error of the builder.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_builder_add_uint64_attr(
+					      pj_stun_msg_builder *b,
+					      int attr_type,
+					      const pj_timestamp *value);
+
+/**
+ * Encode binary attribute (such as DATA) to the message.
+ *
+ * @param b		The builder.
+ * @param attr_type	The attribute type, from #pj_stun_attr_type.
+ * @param data		The data, may be NULL if \a length is zero.
+ * @param length	Length of the data.
+ *
+ * @return		PJ_SUCCESS, or the first error of the builder.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_builder_add_binary_attr(
+					      pj_stun_msg_builder *b,
+					      int attr_type,
+					      const pj_uint8_t *data,
+					      unsigned length);
+
+/**
+ * Encode empty attribute (such as USE-CANDIDATE) to the message.
+ *
+ * @param b		The builder.
+ * @param attr_type	The attribute type, from #pj_stun_attr_type.
+ *
+ * @return		PJ_SUCCESS, or the first error of the builder.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_builder_add_empty_attr(
+					      pj_stun_msg_builder *b,
+					      int attr_type);
+
+/**
+ * Encode ERROR-CODE attribute to the message.
+ *
+ * @param b		The builder.
+ * @param err_code	STUN error code.
+ * @param err_reason	Optional STUN error reason. If NULL is given, the
+ *			standard error reason will be given.
+ *
+ * @return		PJ_SUCCESS, or the first error of the builder.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_builder_add_errcode_attr(
+					      pj_stun_msg_builder *b,
+					      int err_code,
+					      const pj_str_t *err_reason);
+
+/**
+ * Calculate and encode MESSAGE-INTEGRITY attribute over the attributes
+ * which have been added so far. Only FINGERPRINT may be added after this
+ * attribute.
+ *
+ * @param b		The builder.
+ * @param key		The authentication key, as created by
+ *			#pj_stun_create_key().
+ *
+ * @return		PJ_SUCCESS, or the first error of the builder.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_builder_add_msgint_attr(
+					      pj_stun_msg_builder *b,
+					      const pj_str_t *key);
+
+/**
+ * Calculate and encode MESSAGE-INTEGRITY attribute like
+ * #pj_stun_msg_builder_add_msgint_attr(), starting from a HMAC-SHA1
+ * context which has been initialized with the key and kept, so that the
+ * key pads are not hashed again for every message.
+ *
+ * @param b		The builder.
+ * @param key_ctx	HMAC-SHA1 context which has just been initialized
+ *			with the authentication key. It is not modified.
+ *
+ * @return		PJ_SUCCESS, or the first error of the builder.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_builder_add_msgint_attr2(
+					      pj_stun_msg_builder *b,
+					      const pj_hmac_sha1_context *key_ctx);
+
+/**
+ * Calculate and encode FINGERPRINT attribute. This must be the last
+ * attribute of the message.
+ *
+ * @param b		The builder.
+ *
+ * @return		PJ_SUCCESS, or the first error of the builder.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_builder_add_fingerprint_attr(
+					      pj_stun_msg_builder *b);
+
+/**
+ * Finish encoding the message.
+ *
+ * @param b		The builder.
+ * @param p_msg_len	Optional pointer to receive the length of the
+ *			encoded message.
+ *
+ * @return		PJ_SUCCESS if the message has been encoded
+ *			successfully, or the first error that occurred
+ *			while adding the attributes.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_builder_finish(pj_stun_msg_builder *b,
+					        pj_size_t *p_msg_len);
+
+
 /**
  * Dump STUN message to a printable string output.
  *
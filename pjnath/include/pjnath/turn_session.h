@@ -373,6 +373,24 @@ typedef struct pj_turn_session_info
      */
     int		    lifetime;
 
+    /**
+     * Number of CreatePermission requests sent to refresh permissions,
+     * including the permissions of bound channels.
+     */
+    unsigned	    perm_refresh_cnt;
+
+    /**
+     * Number of refresh requests saved by refreshing several permissions
+     * in one CreatePermission request (a request refreshing N permissions
+     * saves N-1 requests).
+     */
+    unsigned	    perm_refresh_saved;
+
+    /**
+     * Number of ChannelBind requests sent to refresh channel bindings.
+     */
+    unsigned	    ch_refresh_cnt;
+
 } pj_turn_session_info;
 
 
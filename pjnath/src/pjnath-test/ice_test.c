@@ -90,6 +90,9 @@ struct sess_param
 
     pj_bool_t		 destroy_after_create;
     pj_bool_t		 destroy_after_one_done;
+
+    pj_ice_sess_pacer	*pacer;
+    pj_ice_strans_mux	*mux[2];	/* Caller's and callee's	*/
 };
 
 /* The test session */
@@ -149,6 +152,8 @@ static int create_ice_strans(struct test_sess *test_sess,
     pj_memcpy(&ice_cfg.stun_cfg, test_sess->stun_cfg, sizeof(pj_stun_config));
     if ((ept->cfg.enable_stun & SRV)==SRV || (ept->cfg.enable_turn & SRV)==SRV)
 	ice_cfg.resolver = test_sess->resolver;
+    ice_cfg.opt.pacer = test_sess->param->pacer;
+    ice_cfg.stun.mux = test_sess->param->mux[ept==&test_sess->caller ? 0 : 1];
 
     if (ept->cfg.enable_stun & YES) {
 	if ((ept->cfg.enable_stun & SRV) == SRV) {
@@ -762,6 +767,63 @@ int ice_test(void)
 	if (rc != 0)
 	    goto on_return;
     }
+
+    /* Same, with both sessions paced by a shared pacer */
+    if (1) {
+	struct sess_cfg_t cfg = 
+	{
+	    "Basic with host candidates, shared pacer",
+	    0x0,
+	    /*  Role    comp#   host?   stun?   turn?   flag?  ans_del snd_del des_del */
+	    {ROLE1,	2,	YES,     NO,	    NO,	    0,	    0,	    0,	    0, {PJ_SUCCESS, PJ_SUCCESS}},
+	    {ROLE2,	2,	YES,     NO,	    NO,	    0,	    0,	    0,	    0, {PJ_SUCCESS, PJ_SUCCESS}}
+	};
+	struct sess_param test_param;
+
+	pj_bzero(&test_param, sizeof(test_param));
+	rc = pj_ice_sess_pacer_create(&stun_cfg, 0, 1, &test_param.pacer);
+	if (rc != PJ_SUCCESS)
+	    goto on_return;
+
+	rc = perform_test2(cfg.title, &stun_cfg, cfg.server_flag, 
+			   &cfg.ua1, &cfg.ua2, &test_param);
+	pj_ice_sess_pacer_destroy(test_param.pacer);
+	if (rc != 0)
+	    goto on_return;
+    }
+
+    /* Same, with each side's components on shared sockets */
+    if (1) {
+	struct sess_cfg_t cfg = 
+	{
+	    "Basic with host candidates, shared sockets",
+	    0x0,
+	    /*  Role    comp#   host?   stun?   turn?   flag?  ans_del snd_del des_del */
+	    {ROLE1,	2,	YES,     NO,	    NO,	    0,	    0,	    0,	    0, {PJ_SUCCESS, PJ_SUCCESS}},
+	    {ROLE2,	2,	YES,     NO,	    NO,	    0,	    0,	    0,	    0, {PJ_SUCCESS, PJ_SUCCESS}}
+	};
+	struct sess_param test_param;
+
+	pj_bzero(&test_param, sizeof(test_param));
+	for (i=0; i<2; ++i) {
+	    rc = pj_ice_strans_mux_create(&stun_cfg, pj_AF_INET(), NULL, 3,
+					  &test_param.mux[i]);
+	    if (rc != PJ_SUCCESS)
+		break;
+	}
+
+	if (rc == PJ_SUCCESS) {
+	    rc = perform_test2(cfg.title, &stun_cfg, cfg.server_flag, 
+			       &cfg.ua1, &cfg.ua2, &test_param);
+	}
+
+	for (i=0; i<2; ++i) {
+	    if (test_param.mux[i])
+		pj_ice_strans_mux_destroy(test_param.mux[i]);
+	}
+	if (rc != 0)
+	    goto on_return;
+    }
     
     /* Simple test first with srflx candidate */
     if (1) {
@@ -564,6 +564,8 @@ static pj_bool_t turn_on_data_recvfrom(pj_activesock_t *asock,
 	    } else
 		resp = create_success_response(test_srv, alloc, req, pool, 0, &auth_key);
 	} else if (req->hdr.type == PJ_STUN_CREATE_PERM_REQUEST) {
+	    test_srv->turn_stat.rx_create_perm_cnt++;
+
 	    for (i=0; i<req->attr_count; ++i) {
 		if (req->attr[i]->type == PJ_STUN_ATTR_XOR_PEER_ADDR) {
 		    pj_stun_xor_peer_addr_attr *pa = (pj_stun_xor_peer_addr_attr*)req->attr[i];
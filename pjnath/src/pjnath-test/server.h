@@ -32,7 +32,7 @@
 #define TURN_PASSWD	"apass"
 
 #define MAX_TURN_ALLOC	    16
-#define MAX_TURN_PERM	    16
+#define MAX_TURN_PERM	    32
 
 enum test_server_flags
 {
@@ -88,6 +88,7 @@ struct test_server
     struct turn_stat {
 	unsigned	 rx_allocate_cnt;
 	unsigned	 rx_refresh_cnt;
+	unsigned	 rx_create_perm_cnt;
 	unsigned	 rx_send_ind_cnt;
     } turn_stat;
 
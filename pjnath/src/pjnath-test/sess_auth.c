@@ -751,6 +751,137 @@ static int long_term_check3(void)
 //
 
 
+/* Authenticate request and response, with and without the authentication
+ * key cache. The time is only measured with INCLUDE_STUN_AUTH_PERF_TEST,
+ * otherwise each is only done once.
+ */
+static int auth_benchmark(void)
+{
+#if !INCLUDE_STUN_AUTH_PERF_TEST
+    enum { LOOP = 1 };
+#elif defined(PJ_DEBUG) && PJ_DEBUG!=0
+    enum { LOOP = 10000 };
+#else
+    enum { LOOP = 100000 };
+#endif
+    pj_pool_t *pool, *tmp_pool;
+    pj_stun_msg *msg;
+    pj_stun_auth_cred cred;
+    pj_stun_auth_key_cache *cache;
+    pj_str_t realm, username, nonce, password, key;
+    pj_uint8_t pkt[PJ_STUN_MAX_PKT_LEN];
+    pj_size_t pkt_len;
+    unsigned i, j;
+    pj_status_t status;
+    int rc = 0;
+
+#if INCLUDE_STUN_AUTH_PERF_TEST
+    PJ_LOG(3,(THIS_FILE, "  authentication benchmark"));
+#else
+    PJ_LOG(3,(THIS_FILE, "  authentication with key cache"));
+#endif
+
+    pool = pj_pool_create(mem, "authbench", 1000, 1000, NULL);
+    tmp_pool = pj_pool_create(mem, "authbenchtmp", 1000, 1000, NULL);
+
+    realm = pj_str(REALM);
+    username = pj_str(USERNAME);
+    nonce = pj_str(NONCE);
+    password = pj_str(PASSWORD);
+
+    /* Long term credential request */
+    pj_stun_create_key(pool, &key, &realm, &username, PJ_STUN_PASSWD_PLAIN,
+		       &password);
+    status = pj_stun_msg_create(pool, PJ_STUN_BINDING_REQUEST, PJ_STUN_MAGIC,
+				NULL, &msg);
+    status |= pj_stun_msg_add_string_attr(pool, msg, PJ_STUN_ATTR_USERNAME,
+					  &username);
+    status |= pj_stun_msg_add_string_attr(pool, msg, PJ_STUN_ATTR_REALM,
+					  &realm);
+    status |= pj_stun_msg_add_string_attr(pool, msg, PJ_STUN_ATTR_NONCE,
+					  &nonce);
+    status |= pj_stun_msg_add_msgint_attr(pool, msg);
+    status |= pj_stun_msg_add_uint_attr(pool, msg, PJ_STUN_ATTR_FINGERPRINT,
+					0);
+    status |= pj_stun_msg_encode(msg, pkt, sizeof(pkt), 0, &key, &pkt_len);
+    status |= pj_stun_msg_decode(pool, pkt, pkt_len, PJ_STUN_IS_DATAGRAM,
+				 &msg, NULL, NULL);
+    status |= pj_stun_auth_key_cache_create(pool, 4, &cache);
+    if (status != PJ_SUCCESS) {
+	rc = -1200;
+	goto on_return;
+    }
+
+    pj_bzero(&cred, sizeof(cred));
+    cred.type = PJ_STUN_AUTH_CRED_STATIC;
+    cred.data.static_cred.realm = realm;
+    cred.data.static_cred.username = username;
+    cred.data.static_cred.data_type = PJ_STUN_PASSWD_PLAIN;
+    cred.data.static_cred.data = password;
+    cred.data.static_cred.nonce = nonce;
+
+    for (i=0; i<4; ++i) {
+	static const char *titles[] = 
+	{
+	    "request",
+	    "request, cached key",
+	    "response",
+	    "response, cached key"
+	};
+	pj_timestamp t1, t2;
+	pj_uint32_t usec;
+
+	pj_get_timestamp(&t1);
+	for (j=0; j<LOOP; ++j) {
+	    pj_pool_reset(tmp_pool);
+
+	    switch (i) {
+	    case 0:
+		status = pj_stun_authenticate_request(pkt, (unsigned)pkt_len,
+						      msg, &cred, tmp_pool,
+						      NULL, NULL);
+		break;
+	    case 1:
+		status = pj_stun_authenticate_request2(pkt, (unsigned)pkt_len,
+						       msg, &cred, cache,
+						       tmp_pool, NULL, NULL);
+		break;
+	    case 2:
+		status = pj_stun_authenticate_response(pkt, (unsigned)pkt_len,
+						       msg, &key);
+		break;
+	    default:
+		status = pj_stun_authenticate_response2(pkt, (unsigned)pkt_len,
+							msg, cache, &key);
+		break;
+	    }
+
+	    if (status != PJ_SUCCESS) {
+		app_perror("    authentication failed", status);
+		rc = -1210;
+		goto on_return;
+	    }
+	}
+	pj_get_timestamp(&t2);
+
+#if INCLUDE_STUN_AUTH_PERF_TEST
+	usec = pj_elapsed_usec(&t1, &t2);
+	if (usec == 0) usec = 1;
+	PJ_LOG(3,(THIS_FILE, "    %-20s: %6u usec (%u/sec)", titles[i],
+		  usec, (unsigned)(LOOP * 1000000.0 / usec)));
+#else
+	PJ_UNUSED_ARG(titles);
+	PJ_UNUSED_ARG(usec);
+#endif
+    }
+
+on_return:
+    pj_pool_release(tmp_pool);
+    pj_pool_release(pool);
+    return rc;
+}
+
+
 int sess_auth_test(void)
 {
     pj_pool_t *pool;
@@ -1138,6 +1269,11 @@ int sess_auth_test(void)
 
     /* Valid dynamic long term (with NONCE) */
 
+    rc = auth_benchmark();
+    if (rc != 0) {
+	goto done;
+    }
+
 
 done:
     pj_timer_heap_destroy(stun_cfg.timer_heap);
@@ -241,6 +241,7 @@ static int decode_test(void)
     for (i=0; i<PJ_ARRAY_SIZE(tests); ++i) {
 	struct test *t = &tests[i];
 	pj_stun_msg *msg, *msg2;
+	pj_stun_msg_view view;
 	pj_uint8_t buf[1500];
 	pj_str_t key;
 	pj_size_t len;
@@ -261,6 +262,18 @@ static int decode_test(void)
 		goto on_return;
 	    }
 
+	    /* In-place parsing must agree with the decoder */
+	    status = pj_stun_msg_view_parse((pj_uint8_t*)t->pdu, t->pdu_len,
+					    PJ_STUN_IS_DATAGRAM | 
+					      PJ_STUN_CHECK_PACKET,
+					    &view, NULL);
+	    if (t->expected_status != status) {
+		PJ_LOG(1,(THIS_FILE, "    view: expecting status %d, got %d",
+		          t->expected_status, status));
+		rc = -15;
+		goto on_return;
+	    }
+
 	} else {
 	    msg = t->create(pool);
 	    status = PJ_SUCCESS;
@@ -955,6 +968,293 @@ static int handle_unknown_non_mandatory(void)
     return rc==0 ? 0 : -4410;
 }
 
+/* Compare in-place message view against the decoded message */
+static int view_test(void)
+{
+    pj_pool_t *pool = pj_pool_create(mem, NULL, 1000, 1000, NULL);
+    pj_stun_msg *msg0, *msg1;
+    pj_stun_msg_view view;
+    pj_uint8_t data[] = { 1, 2, 3, 4, 5, 6};
+    pj_uint8_t packet[500];
+    pj_sockaddr addr4, addr6, addr;
+    pj_timestamp ts0, ts;
+    pj_str_t str, s;
+    const pj_uint8_t *bin;
+    unsigned bin_len;
+    pj_uint32_t val;
+    pj_size_t len, parsed_len;
+    int idx;
+    pj_status_t rc;
+
+    PJ_LOG(3,(THIS_FILE, "  message view"));
+
+    pj_sockaddr_init(pj_AF_INET(), &addr4, pj_cstr(&str, "192.0.2.1"), 32853);
+    pj_sockaddr_init(pj_AF_INET6(), &addr6, 
+		     pj_cstr(&str, "2001:db8:1234:5678:11:2233:4455:6677"),
+		     32853);
+    ts0.u32.hi = 0x01020304;
+    ts0.u32.lo = 0x05060708;
+
+    rc = pj_stun_msg_create(pool, PJ_STUN_BINDING_RESPONSE, PJ_STUN_MAGIC, 
+			    NULL, &msg0);
+    rc += pj_stun_msg_add_sockaddr_attr(pool, msg0, 
+					PJ_STUN_ATTR_XOR_MAPPED_ADDR, PJ_TRUE,
+					&addr4, sizeof(pj_sockaddr_in));
+    rc += pj_stun_msg_add_sockaddr_attr(pool, msg0, 
+					PJ_STUN_ATTR_XOR_MAPPED_ADDR, PJ_TRUE,
+					&addr6, sizeof(pj_sockaddr_in6));
+    rc += pj_stun_msg_add_sockaddr_attr(pool, msg0, PJ_STUN_ATTR_MAPPED_ADDR,
+					PJ_FALSE, &addr4, 
+					sizeof(pj_sockaddr_in));
+    rc += pj_stun_msg_add_string_attr(pool, msg0, PJ_STUN_ATTR_USERNAME, 
+				      &USERNAME);
+    rc += pj_stun_msg_add_uint_attr(pool, msg0, PJ_STUN_ATTR_PRIORITY, 
+				    0x6e0001ff);
+    rc += pj_stun_msg_add_uint64_attr(pool, msg0, 
+				      PJ_STUN_ATTR_ICE_CONTROLLING, &ts0);
+    rc += pj_stun_msg_add_binary_attr(pool, msg0, PJ_STUN_ATTR_DATA, data, 
+				      sizeof(data));
+    rc += pj_stun_msg_add_msgint_attr(pool, msg0);
+    rc += pj_stun_msg_encode(msg0, packet, sizeof(packet), 0, &PASSWORD, &len);
+    if (rc != 0) {
+	rc = -4500;
+	goto on_return;
+    }
+
+    rc = pj_stun_msg_decode(pool, packet, len, 
+			    PJ_STUN_IS_DATAGRAM | PJ_STUN_CHECK_PACKET,
+			    &msg1, NULL, NULL);
+    if (rc != 0) {
+	rc = -4510;
+	goto on_return;
+    }
+
+    rc = pj_stun_msg_view_parse(packet, len, 
+				PJ_STUN_IS_DATAGRAM | PJ_STUN_CHECK_PACKET,
+				&view, &parsed_len);
+    if (rc != 0 || parsed_len != len) {
+	rc = -4520;
+	goto on_return;
+    }
+
+    if (view.hdr.type != msg1->hdr.type || view.hdr.magic != msg1->hdr.magic ||
+	pj_memcmp(view.hdr.tsx_id, msg1->hdr.tsx_id, 12) != 0 ||
+	view.attr_count != msg1->attr_count)
+    {
+	rc = -4530;
+	goto on_return;
+    }
+
+    /* Both XOR-MAPPED-ADDRESS attributes */
+    idx = pj_stun_msg_view_find_attr(&view, PJ_STUN_ATTR_XOR_MAPPED_ADDR, 0);
+    if (idx < 0 || pj_stun_msg_view_get_sockaddr(&view, idx, &addr) != 0 ||
+	pj_sockaddr_cmp(&addr, &addr4) != 0)
+    {
+	rc = -4540;
+	goto on_return;
+    }
+    idx = pj_stun_msg_view_find_attr(&view, PJ_STUN_ATTR_XOR_MAPPED_ADDR, 
+				     idx+1);
+    if (idx < 0 || pj_stun_msg_view_get_sockaddr(&view, idx, &addr) != 0 ||
+	pj_sockaddr_cmp(&addr, &addr6) != 0)
+    {
+	rc = -4550;
+	goto on_return;
+    }
+
+    /* MAPPED-ADDRESS */
+    idx = pj_stun_msg_view_find_attr(&view, PJ_STUN_ATTR_MAPPED_ADDR, 0);
+    if (idx < 0 || pj_stun_msg_view_get_sockaddr(&view, idx, &addr) != 0 ||
+	pj_sockaddr_cmp(&addr, &addr4) != 0)
+    {
+	rc = -4560;
+	goto on_return;
+    }
+
+    /* USERNAME */
+    idx = pj_stun_msg_view_find_attr(&view, PJ_STUN_ATTR_USERNAME, 0);
+    if (idx < 0 || pj_stun_msg_view_get_string(&view, idx, &s) != 0 ||
+	pj_strcmp(&s, &USERNAME) != 0)
+    {
+	rc = -4570;
+	goto on_return;
+    }
+
+    /* PRIORITY */
+    idx = pj_stun_msg_view_find_attr(&view, PJ_STUN_ATTR_PRIORITY, 0);
+    if (idx < 0 || pj_stun_msg_view_get_uint(&view, idx, &val) != 0 ||
+	val != 0x6e0001ff)
+    {
+	rc = -4580;
+	goto on_return;
+    }
+
+    /* ICE-CONTROLLING */
+    idx = pj_stun_msg_view_find_attr(&view, PJ_STUN_ATTR_ICE_CONTROLLING, 0);
+    if (idx < 0 || pj_stun_msg_view_get_uint64(&view, idx, &ts) != 0 ||
+	ts.u64 != ts0.u64)
+    {
+	rc = -4590;
+	goto on_return;
+    }
+
+    /* DATA */
+    idx = pj_stun_msg_view_find_attr(&view, PJ_STUN_ATTR_DATA, 0);
+    if (idx < 0 || 
+	pj_stun_msg_view_get_binary(&view, idx, &bin, &bin_len) != 0 ||
+	bin_len != sizeof(data) || pj_memcmp(bin, data, sizeof(data)) != 0)
+    {
+	rc = -4600;
+	goto on_return;
+    }
+
+    /* Wrong attribute length */
+    if (pj_stun_msg_view_get_uint(&view, idx, &val) != 
+	PJNATH_ESTUNINATTRLEN)
+    {
+	rc = -4610;
+	goto on_return;
+    }
+
+    /* Missing attribute */
+    if (pj_stun_msg_view_find_attr(&view, PJ_STUN_ATTR_FINGERPRINT, 0) >= 0) {
+	rc = -4620;
+	goto on_return;
+    }
+
+    rc = 0;
+
+on_return:
+    pj_pool_release(pool);
+    return rc;
+}
+
+
+
+/* Compare direct-to-buffer encoding against pj_stun_msg_encode() */
+static int builder_test(void)
+{
+    pj_pool_t *pool = pj_pool_create(mem, NULL, 1000, 1000, NULL);
+    pj_uint8_t tsx_id[12] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    pj_uint8_t data[] = { 1, 2, 3, 4, 5, 6};
+    pj_uint8_t packet0[500], packet1[500];
+    pj_stun_msg *msg0;
+    pj_stun_msg_builder b;
+    pj_hmac_sha1_context key_ctx;
+    pj_sockaddr addr4, addr6;
+    pj_timestamp ts;
+    pj_str_t str;
+    pj_size_t len0, len1;
+    pj_status_t rc;
+
+    PJ_LOG(3,(THIS_FILE, "  message builder"));
+
+    pj_sockaddr_init(pj_AF_INET(), &addr4, pj_cstr(&str, "192.0.2.1"), 32853);
+    pj_sockaddr_init(pj_AF_INET6(), &addr6, 
+		     pj_cstr(&str, "2001:db8:1234:5678:11:2233:4455:6677"),
+		     32853);
+    ts.u32.hi = 0x01020304;
+    ts.u32.lo = 0x05060708;
+
+    /* Encode with the message object */
+    rc = pj_stun_msg_create(pool, PJ_STUN_BINDING_REQUEST, PJ_STUN_MAGIC, 
+			    tsx_id, &msg0);
+    rc += pj_stun_msg_add_string_attr(pool, msg0, PJ_STUN_ATTR_USERNAME, 
+				      &USERNAME);
+    rc += pj_stun_msg_add_uint_attr(pool, msg0, PJ_STUN_ATTR_PRIORITY, 
+				    0x6e0001ff);
+    rc += pj_stun_msg_add_uint64_attr(pool, msg0, 
+				      PJ_STUN_ATTR_ICE_CONTROLLING, &ts);
+    rc += pj_stun_msg_add_empty_attr(pool, msg0, PJ_STUN_ATTR_USE_CANDIDATE);
+    rc += pj_stun_msg_add_sockaddr_attr(pool, msg0, 
+					PJ_STUN_ATTR_XOR_PEER_ADDR, PJ_TRUE,
+					&addr4, sizeof(pj_sockaddr_in));
+    rc += pj_stun_msg_add_sockaddr_attr(pool, msg0, 
+					PJ_STUN_ATTR_XOR_PEER_ADDR, PJ_TRUE,
+					&addr6, sizeof(pj_sockaddr_in6));
+    rc += pj_stun_msg_add_binary_attr(pool, msg0, PJ_STUN_ATTR_DATA, data, 
+				      sizeof(data));
+    rc += pj_stun_msg_add_errcode_attr(pool, msg0, PJ_STUN_SC_ROLE_CONFLICT,
+				       NULL);
+    rc += pj_stun_msg_add_msgint_attr(pool, msg0);
+    rc += pj_stun_msg_add_uint_attr(pool, msg0, PJ_STUN_ATTR_FINGERPRINT, 0);
+    pj_bzero(packet0, sizeof(packet0));
+    rc += pj_stun_msg_encode(msg0, packet0, sizeof(packet0), 0, &PASSWORD, 
+			     &len0);
+    if (rc != 0) {
+	rc = -4700;
+	goto on_return;
+    }
+
+    /* Same message with the builder, with HMAC context for the key */
+    pj_hmac_sha1_init(&key_ctx, (const pj_uint8_t*)PASSWORD.ptr,
+		      (unsigned)PASSWORD.slen);
+    pj_bzero(packet1, sizeof(packet1));
+    pj_stun_msg_builder_init(&b, packet1, sizeof(packet1), 
+			     PJ_STUN_BINDING_REQUEST, PJ_STUN_MAGIC, tsx_id);
+    pj_stun_msg_builder_add_string_attr(&b, PJ_STUN_ATTR_USERNAME, &USERNAME);
+    pj_stun_msg_builder_add_uint_attr(&b, PJ_STUN_ATTR_PRIORITY, 0x6e0001ff);
+    pj_stun_msg_builder_add_uint64_attr(&b, PJ_STUN_ATTR_ICE_CONTROLLING, &ts);
+    pj_stun_msg_builder_add_empty_attr(&b, PJ_STUN_ATTR_USE_CANDIDATE);
+    pj_stun_msg_builder_add_sockaddr_attr(&b, PJ_STUN_ATTR_XOR_PEER_ADDR, 
+					  PJ_TRUE, &addr4, 
+					  sizeof(pj_sockaddr_in));
+    pj_stun_msg_builder_add_sockaddr_attr(&b, PJ_STUN_ATTR_XOR_PEER_ADDR, 
+					  PJ_TRUE, &addr6, 
+					  sizeof(pj_sockaddr_in6));
+    pj_stun_msg_builder_add_binary_attr(&b, PJ_STUN_ATTR_DATA, data, 
+					sizeof(data));
+    pj_stun_msg_builder_add_errcode_attr(&b, PJ_STUN_SC_ROLE_CONFLICT, NULL);
+    pj_stun_msg_builder_add_msgint_attr2(&b, &key_ctx);
+    pj_stun_msg_builder_add_fingerprint_attr(&b);
+    rc = pj_stun_msg_builder_finish(&b, &len1);
+    if (rc != 0) {
+	rc = -4710;
+	goto on_return;
+    }
+
+    if (len0 != len1 || pj_memcmp(packet0, packet1, len0) != 0) {
+	PJ_LOG(1,(THIS_FILE, "    builder output differs"));
+	rc = -4720;
+	goto on_return;
+    }
+
+    /* The result must pass the packet check, including FINGERPRINT */
+    rc = pj_stun_msg_check(packet1, len1, 
+			   PJ_STUN_IS_DATAGRAM | PJ_STUN_CHECK_PACKET);
+    if (rc != 0) {
+	rc = -4730;
+	goto on_return;
+    }
+
+    /* Nothing but FINGERPRINT after MESSAGE-INTEGRITY */
+    pj_stun_msg_builder_init(&b, packet1, sizeof(packet1), 
+			     PJ_STUN_BINDING_REQUEST, PJ_STUN_MAGIC, NULL);
+    pj_stun_msg_builder_add_msgint_attr(&b, &PASSWORD);
+    pj_stun_msg_builder_add_uint_attr(&b, PJ_STUN_ATTR_PRIORITY, 1);
+    if (pj_stun_msg_builder_finish(&b, &len1) != PJNATH_ESTUNMSGINTPOS) {
+	rc = -4740;
+	goto on_return;
+    }
+
+    /* Buffer too small, the error sticks */
+    pj_stun_msg_builder_init(&b, packet1, 24, PJ_STUN_BINDING_REQUEST, 
+			     PJ_STUN_MAGIC, NULL);
+    pj_stun_msg_builder_add_string_attr(&b, PJ_STUN_ATTR_USERNAME, &USERNAME);
+    pj_stun_msg_builder_add_empty_attr(&b, PJ_STUN_ATTR_USE_CANDIDATE);
+    if (pj_stun_msg_builder_finish(&b, &len1) != PJ_ETOOSMALL) {
+	rc = -4750;
+	goto on_return;
+    }
+
+    rc = 0;
+
+on_return:
+    pj_pool_release(pool);
+    return rc;
+}
+
+
 
 int stun_test(void)
 {
@@ -978,6 +1278,14 @@ int stun_test(void)
     if (rc != 0)
 	goto on_return;
 
+    rc = view_test();
+    if (rc != 0)
+	goto on_return;
+
+    rc = builder_test();
+    if (rc != 0)
+	goto on_return;
+
 on_return:
     pj_stun_set_padding_char(pad);
     return rc;
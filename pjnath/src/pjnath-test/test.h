@@ -26,6 +26,7 @@
 #define INCLUDE_STUN_SOCK_TEST	    1
 #define INCLUDE_TURN_SOCK_TEST	    1
 #define INCLUDE_CONCUR_TEST    	    1
+#define INCLUDE_STUN_AUTH_PERF_TEST 0
 
 int stun_test(void);
 int sess_auth_test(void);
@@ -480,6 +480,122 @@ static int destroy_test(pj_stun_config  *stun_cfg,
 }
 
 
+/////////////////////////////////////////////////////////////////////
+
+/* Set more permissions than a single CreatePermission request can carry */
+static int create_perm_test(pj_stun_config  *stun_cfg)
+{
+    struct test_session_cfg test_cfg = 
+    {
+	{   /* Client cfg */
+	    /* DNS SRV */   /* Destroy on state */
+	    PJ_FALSE,	    0xFFFF
+	},
+	{   /* Server cfg */
+	    0xFFFFFFFF,	    /* flags */
+	    PJ_TRUE,	    /* respond to allocate  */
+	    PJ_TRUE	    /* respond to refresh   */
+	}
+    };
+    enum { TIMEOUT = 60, PERM_CNT = 2 * PJ_STUN_MAX_ATTR };
+    pj_sockaddr peer[PERM_CNT];
+    struct test_session *sess;
+    pj_turn_session_info info;
+    pj_time_val tstart;
+    unsigned i, perm_cnt = 0;
+    int rc = 0;
+
+    PJ_LOG(3,("", "  create permission test"));
+
+    pj_assert(PERM_CNT <= MAX_TURN_PERM);
+
+    rc = create_test_session(stun_cfg, &test_cfg, &sess);
+    if (rc != 0)
+	return rc;
+
+    /* Wait until state is READY */
+    pj_bzero(&info, sizeof(info));
+    pj_gettimeofday(&tstart);
+    while (sess->turn_sock) {
+	pj_time_val now;
+
+	poll_events(stun_cfg, 10, PJ_FALSE);
+	if (pj_turn_sock_get_info(sess->turn_sock, &info) != PJ_SUCCESS ||
+	    info.state >= PJ_TURN_STATE_READY)
+	{
+	    break;
+	}
+
+	pj_gettimeofday(&now);
+	if (now.sec - tstart.sec > TIMEOUT)
+	    break;
+    }
+
+    if (info.state != PJ_TURN_STATE_READY) {
+	PJ_LOG(3,("", "    error: state is not READY"));
+	rc = -200;
+	goto on_return;
+    }
+
+    /* Permissions are installed per IP address */
+    for (i=0; i<PERM_CNT; ++i) {
+	char peer_ip[PJ_INET6_ADDRSTRLEN];
+	pj_str_t peer_addr;
+
+	pj_ansi_snprintf(peer_ip, sizeof(peer_ip), "192.0.2.%u", i + 1);
+	pj_sockaddr_init(pj_AF_INET(), &peer[i], pj_cstr(&peer_addr, peer_ip),
+			 10000);
+    }
+
+    if (pj_turn_sock_set_perm(sess->turn_sock, PERM_CNT, peer, 1) !=
+	PJ_SUCCESS)
+    {
+	PJ_LOG(3,("", "    error: setting permissions failed"));
+	rc = -210;
+	goto on_return;
+    }
+
+    /* Wait until the server has installed all permissions */
+    pj_gettimeofday(&tstart);
+    while (sess->turn_sock) {
+	pj_time_val now;
+
+	poll_events(stun_cfg, 10, PJ_FALSE);
+	perm_cnt = sess->test_srv->turn_alloc_cnt ?
+		   sess->test_srv->turn_alloc[0].perm_cnt : 0;
+	if (perm_cnt == PERM_CNT)
+	    break;
+
+	pj_gettimeofday(&now);
+	if (now.sec - tstart.sec > TIMEOUT)
+	    break;
+    }
+
+    if (perm_cnt != PERM_CNT) {
+	PJ_LOG(3,("", "    error: server has %d permissions, expecting %d",
+		  perm_cnt, PERM_CNT));
+	rc = -220;
+	goto on_return;
+    }
+
+    if (sess->test_srv->turn_stat.rx_create_perm_cnt < 3) {
+	PJ_LOG(3,("", "    error: permissions not split into requests"));
+	rc = -230;
+	goto on_return;
+    }
+
+on_return:
+    if (sess->turn_sock) {
+	sess->destroy_called = PJ_TRUE;
+	pj_turn_sock_destroy(sess->turn_sock);
+    }
+    poll_events(stun_cfg, 2000, PJ_FALSE);
+    sess->turn_sock = NULL;
+    destroy_session(sess);
+    return rc;
+}
+
+
 /////////////////////////////////////////////////////////////////////
 
 int turn_sock_test(void)
@@ -499,6 +615,10 @@ int turn_sock_test(void)
     if (rc != 0) 
 	goto on_return;
 
+    rc = create_perm_test(&stun_cfg);
+    if (rc != 0) 
+	goto on_return;
+
     for (i=0; i<=1; ++i) {
 	int j;
 	for (j=0; j<=1; ++j) {
@@ -102,6 +102,7 @@ static pj_uint8_t cand_type_prefs[PJ_ICE_CAND_TYPE_MAX] =
 #define LOG4(expr)		PJ_LOG(4,expr)
 #define LOG5(expr)		PJ_LOG(4,expr)
 #define GET_LCAND_ID(cand)	(unsigned)(cand - ice->lcand)
+#define GET_RCAND_ID(cand)	(unsigned)(cand - ice->rcand)
 #define GET_CHECK_ID(cl, chk)	(chk - (cl)->checks)
 
 
@@ -126,6 +127,26 @@ typedef struct timer_data
 } timer_data;
 
 
+/* Shared pacer to start the periodic checks of multiple ICE sessions
+ * from a single timer.
+ */
+struct pj_ice_sess_pacer
+{
+    pj_pool_t		    *pool;
+    pj_grp_lock_t	    *grp_lock;
+    pj_timer_heap_t	    *timer_heap;
+    pj_timer_entry	     timer;
+    pj_time_val		     ta;
+    unsigned		     max_checks;
+    pj_bool_t		     in_tick;
+    pj_bool_t		     is_destroying;
+
+    /* Sessions with pending checks, in round-robin order */
+    unsigned		     queue_cnt;
+    pj_ice_sess_pacer_entry  queue;
+};
+
+
 /* This is the data that will be attached as token to outgoing
  * STUN messages.
  */
@@ -143,6 +164,9 @@ static pj_status_t start_periodic_check(pj_timer_heap_t *th,
 static void start_nominated_check(pj_ice_sess *ice);
 static void periodic_timer(pj_timer_heap_t *th, 
 			  pj_timer_entry *te);
+static pj_status_t schedule_periodic_check(pj_ice_sess *ice,
+					   const pj_time_val *delay);
+static void pacer_dequeue(pj_ice_sess_pacer_entry *e);
 static void handle_incoming_check(pj_ice_sess *ice,
 				  const pj_ice_rx_check *rcheck);
 
@@ -417,6 +441,8 @@ PJ_DEF(pj_status_t) pj_ice_sess_create(pj_stun_config *stun_cfg,
     }
 
     pj_list_init(&ice->early_check);
+    pj_list_init(&ice->pacer_entry);
+    ice->pacer_entry.ice = ice;
 
     /* Done */
     *p_ice = ice;
@@ -503,6 +529,7 @@ static void destroy_ice(pj_ice_sess *ice,
     pj_timer_heap_cancel_if_active(ice->stun_cfg.timer_heap,
                                    &ice->clist.timer,
                                    PJ_FALSE);
+    pacer_dequeue(&ice->pacer_entry);
 
     pj_grp_lock_dec_ref(ice->grp_lock);
     pj_grp_lock_release(ice->grp_lock);
@@ -963,6 +990,70 @@ static void clist_set_state(pj_ice_sess *ice, pj_ice_sess_checklist *clist,
     }
 }
 
+/* The lookup indexes store the candidate or check index plus one */
+#if PJ_ICE_MAX_CAND >= 0xFFFF || PJ_ICE_MAX_CHECKS >= 0xFFFF
+#   error PJ_ICE_MAX_CAND and PJ_ICE_MAX_CHECKS must be less than 65535
+#endif
+
+/* Calculate the slot of a transport address in the remote candidate
+ * index.
+ */
+static unsigned rcand_idx_slot(const pj_ice_sess *ice,
+			       const pj_sockaddr *addr)
+{
+    pj_uint16_t port = pj_sockaddr_get_port(addr);
+    pj_uint32_t hval;
+
+    hval = pj_hash_calc(0, pj_sockaddr_get_addr(addr),
+			pj_sockaddr_get_addr_len(addr));
+    hval = pj_hash_calc(hval, &port, sizeof(port));
+    return hval % PJ_ARRAY_SIZE(ice->rcand_idx);
+}
+
+/* Add remote candidate to the index. The index has twice as many slots
+ * as there can be remote candidates, so there is always a free slot.
+ */
+static void index_rcand(pj_ice_sess *ice, const pj_ice_sess_cand *rcand)
+{
+    unsigned slot = rcand_idx_slot(ice, &rcand->addr);
+
+    while (ice->rcand_idx[slot])
+	slot = (slot + 1) % PJ_ARRAY_SIZE(ice->rcand_idx);
+    ice->rcand_idx[slot] = (pj_uint16_t)(GET_RCAND_ID(rcand) + 1);
+}
+
+/* Find remote candidate by its transport address */
+static pj_ice_sess_cand *find_rcand(pj_ice_sess *ice,
+				    const pj_sockaddr *addr)
+{
+    unsigned slot = rcand_idx_slot(ice, addr);
+
+    while (ice->rcand_idx[slot]) {
+	pj_ice_sess_cand *rcand = &ice->rcand[ice->rcand_idx[slot] - 1];
+	if (pj_sockaddr_cmp(addr, &rcand->addr)==0)
+	    return rcand;
+	slot = (slot + 1) % PJ_ARRAY_SIZE(ice->rcand_idx);
+    }
+    return NULL;
+}
+
+/* Rebuild the index of checks by candidate pair, after the checklist
+ * has been sorted and pruned.
+ */
+static void index_checklist(pj_ice_sess *ice)
+{
+    unsigned i;
+
+    pj_bzero(ice->check_idx, sizeof(ice->check_idx));
+    for (i=0; i<ice->clist.count; ++i) {
+	const pj_ice_sess_check *c = &ice->clist.checks[i];
+	pj_uint16_t *idx = &ice->check_idx[GET_LCAND_ID(c->lcand)]
+					  [GET_RCAND_ID(c->rcand)];
+	if (*idx == 0)
+	    *idx = (pj_uint16_t)(i + 1);
+    }
+}
+
 /* Sort checklist based on priority */
 static void sort_checklist(pj_ice_sess *ice, pj_ice_sess_checklist *clist)
 {
@@ -1634,6 +1725,7 @@ PJ_DEF(pj_status_t) pj_ice_sess_create_check_list(
 
     /* Save remote candidates */
     ice->rcand_cnt = 0;
+    pj_bzero(ice->rcand_idx, sizeof(ice->rcand_idx));
     for (i=0; i<rcand_cnt; ++i) {
 	pj_ice_sess_cand *cn = &ice->rcand[ice->rcand_cnt];
 
@@ -1647,6 +1739,7 @@ PJ_DEF(pj_status_t) pj_ice_sess_create_check_list(
 
 	pj_memcpy(cn, &rcand[i], sizeof(pj_ice_sess_cand));
 	pj_strdup(ice->pool, &cn->foundation, &rcand[i].foundation);
+	index_rcand(ice, cn);
 	ice->rcand_cnt++;
     }
 
@@ -1702,6 +1795,9 @@ PJ_DEF(pj_status_t) pj_ice_sess_create_check_list(
 	return status;
     }
 
+    /* Index the checks by candidate pair for incoming checks */
+    index_checklist(ice);
+
     /* Disable our components which don't have matching component */
     for (i=highest_comp; i<ice->comp_cnt; ++i) {
 	if (ice->comp[i].stun_sess) {
@@ -1838,9 +1934,12 @@ static pj_status_t start_periodic_check(pj_timer_heap_t *th,
     timer_data *td;
     pj_ice_sess *ice;
     pj_ice_sess_checklist *clist;
-    unsigned i, start_count=0;
+    unsigned i;
+    int check_id = -1, frozen_id = -1;
     pj_status_t status;
 
+    PJ_UNUSED_ARG(th);
+
     td = (struct timer_data*) te->user_data;
     ice = td->ice;
     clist = td->clist;
@@ -1862,54 +1961,40 @@ static pj_status_t start_periodic_check(pj_timer_heap_t *th,
     pj_log_push_indent();
 
     /* Send STUN Binding request for check with highest priority on
-     * Waiting state.
+     * Waiting state. If we don't have anything in Waiting state, perform
+     * check to highest priority pair that is in Frozen state. Both are
+     * found in the same pass.
      */
     for (i=0; i<clist->count; ++i) {
 	pj_ice_sess_check *check = &clist->checks[i];
 
 	if (check->state == PJ_ICE_SESS_CHECK_STATE_WAITING) {
-	    status = perform_check(ice, clist, i, ice->is_nominating);
-	    if (status != PJ_SUCCESS) {
-		pj_grp_lock_release(ice->grp_lock);
-		pj_log_pop_indent();
-		return status;
-	    }
-
-	    ++start_count;
+	    check_id = i;
 	    break;
+	} else if (check->state == PJ_ICE_SESS_CHECK_STATE_FROZEN &&
+		   frozen_id < 0)
+	{
+	    frozen_id = i;
 	}
     }
-
-    /* If we don't have anything in Waiting state, perform check to
-     * highest priority pair that is in Frozen state.
-     */
-    if (start_count==0) {
-	for (i=0; i<clist->count; ++i) {
-	    pj_ice_sess_check *check = &clist->checks[i];
-
-	    if (check->state == PJ_ICE_SESS_CHECK_STATE_FROZEN) {
-		status = perform_check(ice, clist, i, ice->is_nominating);
-		if (status != PJ_SUCCESS) {
-		    pj_grp_lock_release(ice->grp_lock);
-		    pj_log_pop_indent();
-		    return status;
-		}
-
-		++start_count;
-		break;
-	    }
-	}
-    }
+    if (check_id < 0)
+	check_id = frozen_id;
 
     /* Cannot start check because there's no suitable candidate pair.
      */
-    if (start_count!=0) {
+    if (check_id >= 0) {
 	/* Schedule for next timer */
 	pj_time_val timeout = {0, PJ_ICE_TA_VAL};
 
+	status = perform_check(ice, clist, check_id, ice->is_nominating);
+	if (status != PJ_SUCCESS) {
+	    pj_grp_lock_release(ice->grp_lock);
+	    pj_log_pop_indent();
+	    return status;
+	}
+
 	pj_time_val_normalize(&timeout);
-	pj_timer_heap_schedule_w_grp_lock(th, te, &timeout, PJ_TRUE,
-	                                  ice->grp_lock);
+	schedule_periodic_check(ice, &timeout);
     }
 
     pj_grp_lock_release(ice->grp_lock);
@@ -1965,10 +2050,7 @@ static void start_nominated_check(pj_ice_sess *ice)
                                    &ice->clist.timer, PJ_FALSE);
 
     delay.sec = delay.msec = 0;
-    status = pj_timer_heap_schedule_w_grp_lock(ice->stun_cfg.timer_heap,
-                                               &ice->clist.timer, &delay,
-                                               PJ_TRUE,
-                                               ice->grp_lock);
+    status = schedule_periodic_check(ice, &delay);
     if (status == PJ_SUCCESS) {
 	LOG5((ice->obj_name, "Periodic timer rescheduled.."));
     }
@@ -1985,6 +2067,205 @@ static void periodic_timer(pj_timer_heap_t *th,
 }
 
 
+/* Queue the session in the pacer. Session lock must be held. */
+static void pacer_enqueue(pj_ice_sess_pacer *pacer,
+			  pj_ice_sess_pacer_entry *e)
+{
+    pj_grp_lock_acquire(pacer->grp_lock);
+
+    if (e->pacer == NULL && !pacer->is_destroying) {
+	e->pacer = pacer;
+	pj_list_push_back(&pacer->queue, e);
+	++pacer->queue_cnt;
+
+	/* Start the pacer if it's idle. If it's in the middle of a tick,
+	 * the tick will reschedule the timer.
+	 */
+	if (!pacer->in_tick && pacer->timer.id == PJ_FALSE) {
+	    pj_time_val delay = {0, 0};
+	    pj_timer_heap_schedule_w_grp_lock(pacer->timer_heap,
+					      &pacer->timer, &delay,
+					      PJ_TRUE, pacer->grp_lock);
+	}
+    }
+
+    pj_grp_lock_release(pacer->grp_lock);
+}
+
+/* Remove the session from the pacer queue. Session lock must be held. */
+static void pacer_dequeue(pj_ice_sess_pacer_entry *e)
+{
+    pj_ice_sess_pacer *pacer = e->pacer;
+
+    if (pacer == NULL)
+	return;
+
+    pj_grp_lock_acquire(pacer->grp_lock);
+    if (e->pacer) {
+	pj_list_erase(e);
+	--pacer->queue_cnt;
+	e->pacer = NULL;
+    }
+    pj_grp_lock_release(pacer->grp_lock);
+}
+
+/* Pacer timer callback: start one check for each of the next sessions
+ * in the queue, up to max_checks sessions.
+ */
+static void pacer_on_timer(pj_timer_heap_t *th, pj_timer_entry *te)
+{
+    pj_ice_sess_pacer *pacer = (pj_ice_sess_pacer*) te->user_data;
+    unsigned i, cnt;
+
+    pj_grp_lock_acquire(pacer->grp_lock);
+
+    te->id = PJ_FALSE;
+    if (pacer->is_destroying) {
+	pj_grp_lock_release(pacer->grp_lock);
+	return;
+    }
+
+    pacer->in_tick = PJ_TRUE;
+
+    /* Sessions which still have pending checks are queued back at the
+     * tail, so serve at most the sessions queued when the tick starts.
+     */
+    cnt = pacer->queue_cnt;
+    if (cnt > pacer->max_checks)
+	cnt = pacer->max_checks;
+
+    for (i=0; i<cnt && !pj_list_empty(&pacer->queue); ++i) {
+	pj_ice_sess_pacer_entry *e = pacer->queue.next;
+	pj_ice_sess *ice = e->ice;
+
+	pj_list_erase(e);
+	--pacer->queue_cnt;
+	e->pacer = NULL;
+
+	/* Keep the session alive while we release the pacer lock, which
+	 * must not be held while acquiring the session lock.
+	 */
+	pj_grp_lock_add_ref(ice->grp_lock);
+	pj_grp_lock_release(pacer->grp_lock);
+
+	start_periodic_check(th, &ice->clist.timer);
+
+	pj_grp_lock_dec_ref(ice->grp_lock);
+	pj_grp_lock_acquire(pacer->grp_lock);
+    }
+
+    pacer->in_tick = PJ_FALSE;
+
+    if (!pacer->is_destroying && !pj_list_empty(&pacer->queue)) {
+	pj_timer_heap_schedule_w_grp_lock(pacer->timer_heap, &pacer->timer,
+					  &pacer->ta, PJ_TRUE,
+					  pacer->grp_lock);
+    }
+
+    pj_grp_lock_release(pacer->grp_lock);
+}
+
+/* Schedule the periodic check, either with the session's own timer or
+ * by queueing the session in the shared pacer.
+ */
+static pj_status_t schedule_periodic_check(pj_ice_sess *ice,
+					   const pj_time_val *delay)
+{
+    if (ice->opt.pacer) {
+	pacer_enqueue(ice->opt.pacer, &ice->pacer_entry);
+	return PJ_SUCCESS;
+    }
+
+    return pj_timer_heap_schedule_w_grp_lock(ice->stun_cfg.timer_heap,
+					     &ice->clist.timer, delay,
+					     PJ_TRUE, ice->grp_lock);
+}
+
+/* Callback to really destroy the pacer */
+static void pacer_on_destroy(void *obj)
+{
+    pj_ice_sess_pacer *pacer = (pj_ice_sess_pacer*) obj;
+
+    if (pacer->pool) {
+	pj_pool_t *pool = pacer->pool;
+	pacer->pool = NULL;
+	pj_pool_release(pool);
+    }
+}
+
+/*
+ * Create pacer to be shared by multiple ICE sessions.
+ */
+PJ_DEF(pj_status_t) pj_ice_sess_pacer_create(const pj_stun_config *stun_cfg,
+					     unsigned ta_msec,
+					     unsigned max_checks,
+					     pj_ice_sess_pacer **p_pacer)
+{
+    pj_pool_t *pool;
+    pj_ice_sess_pacer *pacer;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(stun_cfg && stun_cfg->pf && stun_cfg->timer_heap &&
+		     p_pacer, PJ_EINVAL);
+
+    pool = pj_pool_create(stun_cfg->pf, "icepacer%p", 512, 512, NULL);
+    pacer = PJ_POOL_ZALLOC_T(pool, pj_ice_sess_pacer);
+    pacer->pool = pool;
+    pacer->timer_heap = stun_cfg->timer_heap;
+    pacer->ta.msec = ta_msec ? ta_msec : PJ_ICE_TA_VAL;
+    pj_time_val_normalize(&pacer->ta);
+    pacer->max_checks = max_checks ? max_checks : PJ_ICE_PACER_MAX_CHECKS;
+    pj_list_init(&pacer->queue);
+    pj_timer_entry_init(&pacer->timer, PJ_FALSE, pacer, &pacer_on_timer);
+
+    status = pj_grp_lock_create(pool, NULL, &pacer->grp_lock);
+    if (status != PJ_SUCCESS) {
+	pj_pool_release(pool);
+	return status;
+    }
+
+    pj_grp_lock_add_ref(pacer->grp_lock);
+    pj_grp_lock_add_handler(pacer->grp_lock, pool, pacer,
+			    &pacer_on_destroy);
+
+    *p_pacer = pacer;
+    return PJ_SUCCESS;
+}
+
+/*
+ * Destroy pacer.
+ */
+PJ_DEF(pj_status_t) pj_ice_sess_pacer_destroy(pj_ice_sess_pacer *pacer)
+{
+    PJ_ASSERT_RETURN(pacer, PJ_EINVAL);
+
+    pj_grp_lock_acquire(pacer->grp_lock);
+
+    if (pacer->is_destroying) {
+	pj_grp_lock_release(pacer->grp_lock);
+	return PJ_SUCCESS;
+    }
+
+    pacer->is_destroying = PJ_TRUE;
+    pj_timer_heap_cancel_if_active(pacer->timer_heap, &pacer->timer,
+				   PJ_FALSE);
+
+    /* There shouldn't be any session left, but detach them anyway */
+    pj_assert(pj_list_empty(&pacer->queue));
+    while (!pj_list_empty(&pacer->queue)) {
+	pj_ice_sess_pacer_entry *e = pacer->queue.next;
+	pj_list_erase(e);
+	e->pacer = NULL;
+    }
+    pacer->queue_cnt = 0;
+
+    pj_grp_lock_dec_ref(pacer->grp_lock);
+    pj_grp_lock_release(pacer->grp_lock);
+
+    return PJ_SUCCESS;
+}
+
+
 /* Utility: find string in string array */
 const pj_str_t *find_str(const pj_str_t *strlist[], unsigned count,
 			 const pj_str_t *str)
@@ -2104,9 +2385,7 @@ PJ_DEF(pj_status_t) pj_ice_sess_start_check(pj_ice_sess *ice)
      * return start_periodic_check(ice->stun_cfg.timer_heap, &clist->timer);
      */
     delay.sec = delay.msec = 0;
-    status = pj_timer_heap_schedule_w_grp_lock(ice->stun_cfg.timer_heap,
-                                               &clist->timer, &delay,
-                                               PJ_TRUE, ice->grp_lock);
+    status = schedule_periodic_check(ice, &delay);
     if (status != PJ_SUCCESS) {
 	clist->timer.id = PJ_FALSE;
     }
@@ -2632,17 +2911,14 @@ static void handle_incoming_check(pj_ice_sess *ice,
     /* Find remote candidate based on the source transport address of 
      * the request.
      */
-    for (i=0; i<ice->rcand_cnt; ++i) {
-	if (pj_sockaddr_cmp(&rcheck->src_addr, &ice->rcand[i].addr)==0)
-	    break;
-    }
+    rcand = find_rcand(ice, &rcheck->src_addr);
 
     /* 7.2.1.3.  Learning Peer Reflexive Candidates
      * If the source transport address of the request does not match any
      * existing remote candidates, it represents a new peer reflexive remote
      * candidate.
      */
-    if (i == ice->rcand_cnt) {
+    if (rcand == NULL) {
 	char raddr[PJ_INET6_ADDRSTRLEN];
 	if (ice->rcand_cnt >= PJ_ICE_MAX_CAND) {
 	    LOG4((ice->obj_name, 
@@ -2663,14 +2939,12 @@ static void handle_incoming_check(pj_ice_sess *ice,
 						  "f%p", 
 						  rcand->foundation.ptr);
 
+	index_rcand(ice, rcand);
+
 	LOG4((ice->obj_name, 
 	      "Added new remote candidate from the request: %s:%d",
 	      pj_sockaddr_print(&rcand->addr, raddr, sizeof(raddr), 0),
 	      pj_sockaddr_get_port(&rcand->addr)));
-
-    } else {
-	/* Remote candidate found */
-	rcand = &ice->rcand[i];
     }
 
 #if 0
@@ -2722,11 +2996,8 @@ static void handle_incoming_check(pj_ice_sess *ice,
      * Now that we have local and remote candidate, check if we already
      * have this pair in our checklist.
      */
-    for (i=0; i<ice->clist.count; ++i) {
-	pj_ice_sess_check *c = &ice->clist.checks[i];
-	if (c->lcand == lcand && c->rcand == rcand)
-	    break;
-    }
+    i = ice->check_idx[GET_LCAND_ID(lcand)][GET_RCAND_ID(rcand)];
+    i = i ? i - 1 : ice->clist.count;
 
     /* If the pair is already on the check list:
      * - If the state of that pair is Waiting or Frozen, its state is
@@ -2830,6 +3101,9 @@ static void handle_incoming_check(pj_ice_sess *ice,
 
 	nominate = (c->nominated || ice->is_nominating);
 
+	ice->check_idx[GET_LCAND_ID(lcand)][GET_RCAND_ID(rcand)] =
+	    (pj_uint16_t)(ice->clist.count + 1);
+
 	LOG4((ice->obj_name, "New triggered check added: %d", 
 	     ice->clist.count));
 	pj_log_push_indent();
@@ -2988,9 +3262,23 @@ PJ_DEF(pj_status_t) pj_ice_sess_on_rx_pkt(pj_ice_sess *ice,
     			       PJ_STUN_IS_DATAGRAM |
     			         PJ_STUN_NO_FINGERPRINT_CHECK);
     if (status == PJ_SUCCESS) {
-	status = pj_stun_session_on_rx_pkt(comp->stun_sess, pkt, pkt_size,
-					   PJ_STUN_IS_DATAGRAM, msg_data,
-					   NULL, src_addr, src_addr_len);
+	pj_stun_msg_view view;
+
+	/* Binding Indication keep-alives carry nothing we need, so
+	 * don't bother decoding them in the STUN session.
+	 */
+	status = pj_stun_msg_view_parse((const pj_uint8_t*)pkt, pkt_size,
+					PJ_STUN_IS_DATAGRAM, &view, NULL);
+	if (status == PJ_SUCCESS &&
+	    view.hdr.type == PJ_STUN_BINDING_INDICATION)
+	{
+	    LOG5((ice->obj_name, "Received Binding Indication keep-alive "
+		  "for component %d", comp_id));
+	} else {
+	    status = pj_stun_session_on_rx_pkt(comp->stun_sess, pkt, pkt_size,
+					       PJ_STUN_IS_DATAGRAM, msg_data,
+					       NULL, src_addr, src_addr_len);
+	}
 	if (status != PJ_SUCCESS) {
 	    pj_strerror(status, ice->tmp.errmsg, sizeof(ice->tmp.errmsg));
 	    LOG4((ice->obj_name, "Error processing incoming message: %s",
@@ -19,9 +19,11 @@
  */
 #include <pjnath/ice_strans.h>
 #include <pjnath/errno.h>
+#include <pj/activesock.h>
 #include <pj/addr_resolv.h>
 #include <pj/array.h>
 #include <pj/assert.h>
+#include <pj/hash.h>
 #include <pj/ip_helper.h>
 #include <pj/lock.h>
 #include <pj/log.h>
@@ -129,9 +131,83 @@ static void turn_on_state(pj_turn_sock *turn_sock, pj_turn_state_t old_state,
 /* Forward decls */
 static void ice_st_on_destroy(void *obj);
 static void destroy_ice_st(pj_ice_strans *ice_st);
+
+/* Shared socket (mux) callbacks */
+static pj_bool_t mux_on_data_recvfrom(pj_activesock_t *asock,
+				      void *data,
+				      pj_size_t size,
+				      const pj_sockaddr_t *src_addr,
+				      int addr_len,
+				      pj_status_t status);
+static pj_bool_t mux_on_data_sent(pj_activesock_t *asock,
+				  pj_ioqueue_op_key_t *send_key,
+				  pj_ssize_t sent);
 #define ice_st_perror(ice_st,msg,rc) pjnath_perror(ice_st->obj_name,msg,rc)
 static void sess_init_update(pj_ice_strans *ice_st);
 
+/* Length of the demultiplexing key of a remote address: port and IPv6
+ * address.
+ */
+#define MUX_ADDR_KEY_LEN    18
+
+/* Remote address registered by a component in a shared socket */
+typedef struct mux_addr
+{
+    pj_uint8_t		 key[MUX_ADDR_KEY_LEN];
+    unsigned		 key_len;
+    pj_hash_entry_buf	 he;
+} mux_addr;
+
+/* Route value of a remote address used by more than one component of a
+ * shared socket, packets from such address are not routed.
+ */
+static char mux_addr_conflict;
+#define MUX_ADDR_CONFLICT   ((void*)&mux_addr_conflict)
+
+/* Send operation queued in a shared socket, when the socket is busy */
+typedef struct mux_send_op
+{
+    pj_ioqueue_op_key_t	 key;
+    pj_bool_t		 busy;
+    char		*buf;
+} mux_send_op;
+
+/* Shared UDP socket in the ICE stream transport mux */
+typedef struct mux_sock
+{
+    pj_ice_strans_mux	*mux;
+    unsigned		 idx;
+    pj_sock_t		 fd;
+    pj_activesock_t	*asock;
+
+    /* Demultiplexing tables, protected by the lock */
+    pj_lock_t		*lock;
+    pj_hash_table_t	*ufrag_ht;	/* Local ufrag -> component	*/
+    pj_hash_table_t	*addr_ht;	/* Remote address -> component	*/
+
+    /* Queued sends, protected by the lock */
+    unsigned		 max_pkt_size;
+    unsigned		 send_pending;
+    mux_send_op		 send_op[PJ_ICE_ST_MUX_SEND_QUEUE_SIZE];
+
+    unsigned		 alias_cnt;
+    pj_sockaddr		 aliases[PJ_ICE_ST_MAX_CAND];
+} mux_sock;
+
+/* Pool of UDP sockets shared by many ICE stream transports */
+struct pj_ice_strans_mux
+{
+    char		*obj_name;
+    pj_pool_t		*pool;
+    pj_grp_lock_t	*grp_lock;
+    int			 af;
+    unsigned		 sock_cnt;
+    mux_sock		*sock;
+    unsigned		 next_sock;
+    pj_bool_t		 is_destroying;
+};
+
+
 /**
  * This structure describes an ICE stream transport component. A component
  * in ICE stream transport typically corresponds to a single socket created
@@ -158,6 +234,14 @@ typedef struct pj_ice_strans_comp
 
     unsigned		 default_cand;	/**< Default candidate.		*/
 
+    mux_sock		*mux_sock;	/**< Shared socket, if any.	*/
+    pj_str_t		 mux_ufrag;	/**< Ufrag routed to us.	*/
+    pj_hash_entry_buf	 mux_ufrag_he;	/**< Ufrag table entry.		*/
+    unsigned		 mux_addr_cnt;	/**< # of addresses routed to us*/
+    mux_addr		 mux_addr[PJ_ICE_MAX_CAND]; /**< Remote addresses */
+    pj_sockaddr		 mux_last_dst;	/**< Last registered address,
+					     protected by the socket lock*/
+
 } pj_ice_strans_comp;
 
 
@@ -241,6 +325,283 @@ PJ_DEF(void) pj_ice_strans_cfg_copy( pj_pool_t *pool,
 }
 
 
+/* Build the demultiplexing key of a remote transport address */
+static unsigned mux_addr_key(const pj_sockaddr_t *addr,
+			     pj_uint8_t key[MUX_ADDR_KEY_LEN])
+{
+    const pj_sockaddr *a = (const pj_sockaddr*) addr;
+    pj_uint16_t port = pj_sockaddr_get_port(a);
+    unsigned addr_len = pj_sockaddr_get_addr_len(a);
+
+    key[0] = (pj_uint8_t)(port >> 8);
+    key[1] = (pj_uint8_t)(port & 0xFF);
+    pj_memcpy(key+2, pj_sockaddr_get_addr(a), addr_len);
+    return addr_len + 2;
+}
+
+/* Route packets from the remote address to the component. Socket lock
+ * must be held.
+ */
+static void mux_add_addr_locked(pj_ice_strans_comp *comp,
+				const pj_sockaddr_t *addr)
+{
+    mux_sock *msock = comp->mux_sock;
+    pj_uint8_t key[MUX_ADDR_KEY_LEN];
+    unsigned key_len;
+    void *route;
+    mux_addr *ma;
+
+    key_len = mux_addr_key(addr, key);
+
+    route = pj_hash_get(msock->addr_ht, key, key_len, NULL);
+    if (route == comp || route == MUX_ADDR_CONFLICT)
+	return;
+
+    /* Another component is talking to the same remote address over the
+     * same socket, we can't tell their packets apart. Rather than giving
+     * the packets to the wrong one, stop routing the address. The entry
+     * stays owned by the first component.
+     */
+    if (route != NULL) {
+	char addrinfo[PJ_INET6_ADDRSTRLEN+10];
+
+	PJ_LOG(3,(comp->ice_st->obj_name,
+		  "Comp %d: remote address %s is used by another transport "
+		  "on shared socket %d, packets from it won't be routed",
+		  comp->comp_id,
+		  pj_sockaddr_print(addr, addrinfo, sizeof(addrinfo), 3),
+		  msock->idx));
+	pj_hash_set_np(msock->addr_ht, key, key_len, 0, NULL,
+		       MUX_ADDR_CONFLICT);
+	return;
+    }
+
+    if (comp->mux_addr_cnt >= PJ_ARRAY_SIZE(comp->mux_addr)) {
+	PJ_LOG(4,(comp->ice_st->obj_name,
+		  "Comp %d: too many remote addresses on shared socket",
+		  comp->comp_id));
+	return;
+    }
+
+    ma = &comp->mux_addr[comp->mux_addr_cnt++];
+    pj_memcpy(ma->key, key, key_len);
+    ma->key_len = key_len;
+    pj_hash_set_np(msock->addr_ht, ma->key, key_len, 0, ma->he, comp);
+}
+
+/* Check if the packet is a STUN error response. These are also sent to
+ * sources of unauthenticated requests, so they must not create routes.
+ */
+static pj_bool_t mux_is_stun_error(const void *pkt, pj_size_t size)
+{
+    const pj_uint8_t *p = (const pj_uint8_t*) pkt;
+
+    if (pj_stun_msg_check(p, size, PJ_STUN_IS_DATAGRAM) != PJ_SUCCESS)
+	return PJ_FALSE;
+
+    return PJ_STUN_IS_ERROR_RESPONSE((p[0] << 8) | p[1]);
+}
+
+/* Replace the local ufrag routed to the component, and forget the
+ * remote addresses. Specify NULL ufrag to remove all routes.
+ */
+static void mux_set_ufrag(pj_ice_strans_comp *comp, const pj_str_t *ufrag)
+{
+    mux_sock *msock = comp->mux_sock;
+    unsigned i;
+
+    pj_lock_acquire(msock->lock);
+
+    if (comp->mux_ufrag.slen) {
+	pj_hash_set_np(msock->ufrag_ht, comp->mux_ufrag.ptr,
+		       (unsigned)comp->mux_ufrag.slen, 0,
+		       comp->mux_ufrag_he, NULL);
+	comp->mux_ufrag.slen = 0;
+    }
+
+    for (i=0; i<comp->mux_addr_cnt; ++i) {
+	mux_addr *ma = &comp->mux_addr[i];
+	pj_hash_set_np(msock->addr_ht, ma->key, ma->key_len, 0, ma->he,
+		       NULL);
+    }
+    comp->mux_addr_cnt = 0;
+    pj_bzero(&comp->mux_last_dst, sizeof(comp->mux_last_dst));
+
+    if (ufrag && ufrag->slen) {
+	if (pj_hash_get(msock->ufrag_ht, ufrag->ptr, (unsigned)ufrag->slen,
+			NULL) == NULL)
+	{
+	    pj_strdup(comp->ice_st->pool, &comp->mux_ufrag, ufrag);
+	    pj_hash_set_np(msock->ufrag_ht, comp->mux_ufrag.ptr,
+			   (unsigned)comp->mux_ufrag.slen, 0,
+			   comp->mux_ufrag_he, comp);
+	} else {
+	    PJ_LOG(2,(comp->ice_st->obj_name,
+		      "Comp %d: ufrag %.*s is already used on shared socket",
+		      comp->comp_id, (int)ufrag->slen, ufrag->ptr));
+	}
+    }
+
+    pj_lock_release(msock->lock);
+}
+
+/* Find the component for an incoming packet. Socket lock must be held. */
+static pj_ice_strans_comp *mux_find_comp(mux_sock *msock,
+					 const void *pkt,
+					 pj_size_t size,
+					 const pj_sockaddr_t *src_addr)
+{
+    pj_uint8_t key[MUX_ADDR_KEY_LEN];
+    unsigned key_len;
+    void *route;
+
+    /* Connectivity checks are routed by the local ufrag, which is the
+     * part of USERNAME before the colon. The source address is not
+     * learnt, as the request has not been authenticated yet.
+     */
+    if (pj_stun_msg_check((const pj_uint8_t*)pkt, size,
+			  PJ_STUN_IS_DATAGRAM | PJ_STUN_CHECK_PACKET) ==
+	PJ_SUCCESS)
+    {
+	pj_stun_msg_view view;
+	int idx;
+	pj_str_t ufrag;
+
+	if (pj_stun_msg_view_parse((const pj_uint8_t*)pkt, size,
+				   PJ_STUN_IS_DATAGRAM, &view, NULL) ==
+		PJ_SUCCESS &&
+	    PJ_STUN_IS_REQUEST(view.hdr.type) &&
+	    (idx = pj_stun_msg_view_find_attr(&view, PJ_STUN_ATTR_USERNAME,
+					      0)) >= 0 &&
+	    pj_stun_msg_view_get_string(&view, idx, &ufrag) == PJ_SUCCESS)
+	{
+	    pj_ice_strans_comp *comp;
+	    char *colon;
+
+	    colon = (char*) pj_memchr(ufrag.ptr, ':', ufrag.slen);
+	    if (colon)
+		ufrag.slen = colon - ufrag.ptr;
+
+	    comp = (pj_ice_strans_comp*)
+		   pj_hash_get(msock->ufrag_ht, ufrag.ptr,
+			       (unsigned)ufrag.slen, NULL);
+	    if (comp)
+		return comp;
+	}
+    }
+
+    key_len = mux_addr_key(src_addr, key);
+    route = pj_hash_get(msock->addr_ht, key, key_len, NULL);
+    return (route == MUX_ADDR_CONFLICT)? NULL : (pj_ice_strans_comp*)route;
+}
+
+/* Queue a packet to be sent when the shared socket is writable again.
+ * The packet is copied, as the caller doesn't keep it.
+ */
+static pj_status_t mux_queue_send(mux_sock *msock,
+				  const void *pkt, pj_size_t size,
+				  const pj_sockaddr_t *dst_addr,
+				  unsigned dst_addr_len)
+{
+    mux_send_op *op = NULL;
+    pj_ssize_t len = size;
+    unsigned i;
+    pj_status_t status;
+
+    if (size > msock->max_pkt_size)
+	return PJ_ETOOBIG;
+
+    pj_lock_acquire(msock->lock);
+    for (i=0; i<PJ_ARRAY_SIZE(msock->send_op); ++i) {
+	if (!msock->send_op[i].busy) {
+	    op = &msock->send_op[i];
+	    op->busy = PJ_TRUE;
+	    ++msock->send_pending;
+	    break;
+	}
+    }
+    pj_lock_release(msock->lock);
+
+    if (!op)
+	return PJ_ETOOMANY;
+
+    pj_memcpy(op->buf, pkt, size);
+    status = pj_activesock_sendto(msock->asock, &op->key, op->buf, &len, 0,
+				  dst_addr, dst_addr_len);
+    if (status != PJ_EPENDING) {
+	pj_lock_acquire(msock->lock);
+	op->busy = PJ_FALSE;
+	--msock->send_pending;
+	pj_lock_release(msock->lock);
+    }
+
+    return status;
+}
+
+/* Send packet with the shared socket. Returns PJ_EPENDING when the
+ * packet is queued because the socket is busy.
+ */
+static pj_status_t mux_sendto(pj_ice_strans_comp *comp,
+			      const void *pkt, pj_size_t size,
+			      const pj_sockaddr_t *dst_addr,
+			      unsigned dst_addr_len)
+{
+    mux_sock *msock = comp->mux_sock;
+    pj_ssize_t len = size;
+    pj_bool_t queued;
+    pj_status_t status;
+
+    pj_lock_acquire(msock->lock);
+
+    /* Route packets from the destination to the component. Routes are
+     * only learnt from the packets we send, i.e: to the remote candidates
+     * and to the peer reflexive candidates found by authenticated checks.
+     * Most packets go to the same destination as the previous one.
+     */
+    if (pj_sockaddr_cmp(dst_addr, &comp->mux_last_dst) != 0 &&
+	!mux_is_stun_error(pkt, size))
+    {
+	mux_add_addr_locked(comp, dst_addr);
+	pj_sockaddr_cp(&comp->mux_last_dst, dst_addr);
+    }
+    queued = (msock->send_pending != 0);
+
+    pj_lock_release(msock->lock);
+
+    /* Keep the order of packets already waiting for the socket */
+    if (!queued) {
+	status = pj_sock_sendto(msock->fd, pkt, &len, 0, dst_addr,
+				dst_addr_len);
+	if (status != PJ_STATUS_FROM_OS(OSERR_EWOULDBLOCK))
+	    return status;
+    }
+
+    return mux_queue_send(msock, pkt, size, dst_addr, dst_addr_len);
+}
+
+/* Bind the component to a shared socket. The components of an ICE
+ * stream transport use consecutive sockets, so they get different
+ * transport addresses.
+ */
+static void mux_attach(pj_ice_strans_comp *comp)
+{
+    pj_ice_strans_mux *mux = comp->ice_st->cfg.stun.mux;
+    unsigned idx;
+
+    if (comp->comp_id == 1) {
+	pj_grp_lock_acquire(mux->grp_lock);
+	idx = mux->next_sock;
+	mux->next_sock = (mux->next_sock + 1) % mux->sock_cnt;
+	pj_grp_lock_release(mux->grp_lock);
+    } else {
+	idx = comp->ice_st->comp[0]->mux_sock->idx + comp->comp_id - 1;
+	idx %= mux->sock_cnt;
+    }
+
+    comp->mux_sock = &mux->sock[idx];
+}
+
+
 /*
  * Add or update TURN candidate.
  */
@@ -372,8 +733,65 @@ static pj_status_t create_comp(pj_ice_strans *ice_st, unsigned comp_id)
     /* Initialize default candidate */
     comp->default_cand = 0;
 
+    /* Use shared socket if configured */
+    if (ice_st->cfg.stun.mux) {
+	mux_sock *msock;
+	unsigned i;
+
+	mux_attach(comp);
+	msock = comp->mux_sock;
+
+	if (ice_st->cfg.stun.server.slen) {
+	    PJ_LOG(4,(ice_st->obj_name, 
+		      "Comp %d: STUN server is ignored on shared socket",
+		      comp_id));
+	}
+
+	for (i=0; i<msock->alias_cnt && 
+		  i<ice_st->cfg.stun.max_host_cands; ++i) 
+	{
+	    char addrinfo[PJ_INET6_ADDRSTRLEN+10];
+	    const pj_sockaddr *addr = &msock->aliases[i];
+	    pj_ice_sess_cand *cand;
+
+	    /* Leave one candidate for relay */
+	    if (comp->cand_cnt >= PJ_ICE_ST_MAX_CAND-1)
+		break;
+
+	    /* Ignore loopback addresses unless cfg->stun.loop_addr 
+	     * is set 
+	     */
+	    if (addr->addr.sa_family == pj_AF_INET() &&
+		(pj_ntohl(addr->ipv4.sin_addr.s_addr)>>24)==127 &&
+		ice_st->cfg.stun.loop_addr==PJ_FALSE)
+	    {
+		continue;
+	    }
+
+	    cand = &comp->cand_list[comp->cand_cnt++];
+
+	    cand->type = PJ_ICE_CAND_TYPE_HOST;
+	    cand->status = PJ_SUCCESS;
+	    cand->local_pref = HOST_PREF;
+	    cand->transport_id = TP_STUN;
+	    cand->comp_id = (pj_uint8_t) comp_id;
+	    pj_sockaddr_cp(&cand->addr, addr);
+	    pj_sockaddr_cp(&cand->base_addr, addr);
+	    pj_bzero(&cand->rel_addr, sizeof(cand->rel_addr));
+	    pj_ice_calc_foundation(ice_st->pool, &cand->foundation,
+				   cand->type, &cand->base_addr);
+
+	    PJ_LOG(4,(ice_st->obj_name, 
+		      "Comp %d: host candidate %s added (shared socket %d)",
+		      comp_id, pj_sockaddr_print(&cand->addr, addrinfo,
+						 sizeof(addrinfo), 3),
+		      msock->idx));
+	}
+    }
     /* Create STUN transport if configured */
-    if (ice_st->cfg.stun.server.slen || ice_st->cfg.stun.max_host_cands) {
+    else if (ice_st->cfg.stun.server.slen || 
+	     ice_st->cfg.stun.max_host_cands) 
+    {
 	pj_stun_sock_cb stun_sock_cb;
 	pj_ice_sess_cand *cand;
 
@@ -553,6 +971,8 @@ PJ_DEF(pj_status_t) pj_ice_strans_create( const char *name,
 
     PJ_ASSERT_RETURN(comp_cnt && cb && p_ice_st &&
 		     comp_cnt <= PJ_ICE_MAX_COMP , PJ_EINVAL);
+    PJ_ASSERT_RETURN(!cfg->stun.mux || comp_cnt <= cfg->stun.mux->sock_cnt,
+		     PJ_ETOOMANY);
 
     if (name == NULL)
 	name = "ice%p";
@@ -660,6 +1080,10 @@ static void destroy_ice_st(pj_ice_strans *ice_st)
     /* Destroy all components */
     for (i=0; i<ice_st->comp_cnt; ++i) {
 	if (ice_st->comp[i]) {
+	    if (ice_st->comp[i]->mux_sock) {
+		mux_set_ufrag(ice_st->comp[i], NULL);
+		ice_st->comp[i]->mux_sock = NULL;
+	    }
 	    if (ice_st->comp[i]->stun_sock) {
 		pj_stun_sock_destroy(ice_st->comp[i]->stun_sock);
 		ice_st->comp[i]->stun_sock = NULL;
@@ -847,6 +1271,12 @@ PJ_DEF(pj_status_t) pj_ice_strans_init_ice(pj_ice_strans *ice_st,
     /* Set options */
     pj_ice_sess_set_options(ice_st->ice, &ice_st->cfg.opt);
 
+    /* Route connectivity checks for our ufrag on the shared sockets */
+    for (i=0; i<ice_st->comp_cnt; ++i) {
+	if (ice_st->comp[i]->mux_sock)
+	    mux_set_ufrag(ice_st->comp[i], &ice_st->ice->rx_ufrag);
+    }
+
     /* If default candidate for components are SRFLX one, upload a custom
      * type priority to ICE session so that SRFLX candidates will get
      * checked first.
@@ -1149,6 +1579,8 @@ pj_ice_strans_get_valid_pair(const pj_ice_strans *ice_st,
  */
 PJ_DEF(pj_status_t) pj_ice_strans_stop_ice(pj_ice_strans *ice_st)
 {
+    unsigned i;
+
     PJ_ASSERT_RETURN(ice_st, PJ_EINVAL);
 
     if (ice_st->ice) {
@@ -1156,6 +1588,11 @@ PJ_DEF(pj_status_t) pj_ice_strans_stop_ice(pj_ice_strans *ice_st)
 	ice_st->ice = NULL;
     }
 
+    for (i=0; i<ice_st->comp_cnt; ++i) {
+	if (ice_st->comp[i] && ice_st->comp[i]->mux_sock)
+	    mux_set_ufrag(ice_st->comp[i], NULL);
+    }
+
     ice_st->state = PJ_ICE_STRANS_STATE_INIT;
     return PJ_SUCCESS;
 }
@@ -1232,6 +1669,11 @@ PJ_DEF(pj_status_t) pj_ice_strans_sendto( pj_ice_strans *ice_st,
 					 dst_addr, dst_addr_len);
 	    return (status==PJ_SUCCESS||status==PJ_EPENDING) ? 
 		    PJ_SUCCESS : status;
+	} else if (comp->mux_sock) {
+	    status = mux_sendto(comp, data, data_len, dst_addr,
+				dst_addr_len);
+	    return (status==PJ_SUCCESS||status==PJ_EPENDING) ? 
+		    PJ_SUCCESS : status;
 	} else {
 	    pkt_size = data_len;
 	    status = pj_stun_sock_sendto(comp->stun_sock, NULL, data, 
@@ -1378,9 +1820,13 @@ static pj_status_t ice_tx_pkt(pj_ice_sess *ice,
 	    status = PJ_EINVALIDOP;
 	}
     } else if (transport_id == TP_STUN) {
-	status = pj_stun_sock_sendto(comp->stun_sock, NULL, 
-				     pkt, (unsigned)size, 0,
-				     dst_addr, dst_addr_len);
+	if (comp->mux_sock) {
+	    status = mux_sendto(comp, pkt, size, dst_addr, dst_addr_len);
+	} else {
+	    status = pj_stun_sock_sendto(comp->stun_sock, NULL, 
+					 pkt, (unsigned)size, 0,
+					 dst_addr, dst_addr_len);
+	}
     } else {
 	pj_assert(!"Invalid transport ID");
 	status = PJ_EINVALIDOP;
@@ -1409,25 +1855,18 @@ static void ice_rx_data(pj_ice_sess *ice,
     }
 }
 
-/* Notification when incoming packet has been received from
- * the STUN socket. 
+/* Incoming packet for the component, from its STUN socket or from the
+ * shared socket.
  */
-static pj_bool_t stun_on_rx_data(pj_stun_sock *stun_sock,
+static pj_bool_t comp_on_rx_data(pj_ice_strans_comp *comp,
 				 void *pkt,
 				 unsigned pkt_len,
 				 const pj_sockaddr_t *src_addr,
 				 unsigned addr_len)
 {
-    pj_ice_strans_comp *comp;
     pj_ice_strans *ice_st;
     pj_status_t status;
 
-    comp = (pj_ice_strans_comp*) pj_stun_sock_get_user_data(stun_sock);
-    if (comp == NULL) {
-	/* We have disassociated ourselves from the STUN socket */
-	return PJ_FALSE;
-    }
-
     ice_st = comp->ice_st;
 
     pj_grp_lock_add_ref(ice_st->grp_lock);
@@ -1458,6 +1897,83 @@ static pj_bool_t stun_on_rx_data(pj_stun_sock *stun_sock,
     return pj_grp_lock_dec_ref(ice_st->grp_lock) ? PJ_FALSE : PJ_TRUE;
 }
 
+/* Notification when incoming packet has been received from
+ * the STUN socket. 
+ */
+static pj_bool_t stun_on_rx_data(pj_stun_sock *stun_sock,
+				 void *pkt,
+				 unsigned pkt_len,
+				 const pj_sockaddr_t *src_addr,
+				 unsigned addr_len)
+{
+    pj_ice_strans_comp *comp;
+
+    comp = (pj_ice_strans_comp*) pj_stun_sock_get_user_data(stun_sock);
+    if (comp == NULL) {
+	/* We have disassociated ourselves from the STUN socket */
+	return PJ_FALSE;
+    }
+
+    return comp_on_rx_data(comp, pkt, pkt_len, src_addr, addr_len);
+}
+
+/* Notification when incoming packet has been received from a shared
+ * socket.
+ */
+static pj_bool_t mux_on_data_recvfrom(pj_activesock_t *asock,
+				      void *data,
+				      pj_size_t size,
+				      const pj_sockaddr_t *src_addr,
+				      int addr_len,
+				      pj_status_t status)
+{
+    mux_sock *msock = (mux_sock*) pj_activesock_get_user_data(asock);
+    pj_ice_strans_comp *comp;
+    pj_grp_lock_t *grp_lock = NULL;
+
+    if (status != PJ_SUCCESS) {
+	PJ_PERROR(2,(msock->mux->obj_name, status, "recvfrom() error"));
+	return PJ_TRUE;
+    }
+
+    pj_lock_acquire(msock->lock);
+    comp = mux_find_comp(msock, data, size, src_addr);
+    if (comp) {
+	/* Keep the ICE stream transport alive after releasing the lock */
+	grp_lock = comp->ice_st->grp_lock;
+	pj_grp_lock_add_ref(grp_lock);
+    }
+    pj_lock_release(msock->lock);
+
+    if (comp) {
+	comp_on_rx_data(comp, data, (unsigned)size, src_addr, addr_len);
+	pj_grp_lock_dec_ref(grp_lock);
+    } else {
+	TRACE_PKT((msock->mux->obj_name,
+		   "Socket %d: dropping packet with no route", msock->idx));
+    }
+
+    return PJ_TRUE;
+}
+
+/* Notification when a queued send of a shared socket has completed. */
+static pj_bool_t mux_on_data_sent(pj_activesock_t *asock,
+				  pj_ioqueue_op_key_t *send_key,
+				  pj_ssize_t sent)
+{
+    mux_sock *msock = (mux_sock*) pj_activesock_get_user_data(asock);
+    mux_send_op *op = (mux_send_op*) send_key->user_data;
+
+    PJ_UNUSED_ARG(sent);
+
+    pj_lock_acquire(msock->lock);
+    op->busy = PJ_FALSE;
+    --msock->send_pending;
+    pj_lock_release(msock->lock);
+
+    return PJ_TRUE;
+}
+
 /* Notifification when asynchronous send operation to the STUN socket
  * has completed. 
  */
@@ -1773,3 +2289,238 @@ static void turn_on_state(pj_turn_sock *turn_sock, pj_turn_state_t old_state,
     pj_log_pop_indent();
 }
 
+
+/* Create and bind one shared socket */
+static pj_status_t mux_sock_create(pj_ice_strans_mux *mux,
+				   mux_sock *msock,
+				   const pj_stun_config *stun_cfg,
+				   const pj_stun_sock_cfg *cfg)
+{
+    pj_sockaddr bound_addr;
+    int addr_len;
+    pj_uint16_t max_bind_retry;
+    pj_activesock_cfg activesock_cfg;
+    pj_activesock_cb activesock_cb;
+    unsigned i;
+    pj_status_t status;
+
+    status = pj_sock_socket(mux->af, pj_SOCK_DGRAM(), 0, &msock->fd);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    /* Apply QoS and socket buffer size, if specified */
+    status = pj_sock_apply_qos2(msock->fd, cfg->qos_type, &cfg->qos_params,
+				2, mux->obj_name, NULL);
+    if (status != PJ_SUCCESS && !cfg->qos_ignore_error)
+	return status;
+
+    if (cfg->so_rcvbuf_size > 0) {
+	unsigned sobuf_size = cfg->so_rcvbuf_size;
+	status = pj_sock_setsockopt_sobuf(msock->fd, pj_SO_RCVBUF(),
+					  PJ_TRUE, &sobuf_size);
+	if (status != PJ_SUCCESS)
+	    pj_perror(3, mux->obj_name, status, "Failed setting SO_RCVBUF");
+    }
+    if (cfg->so_sndbuf_size > 0) {
+	unsigned sobuf_size = cfg->so_sndbuf_size;
+	status = pj_sock_setsockopt_sobuf(msock->fd, pj_SO_SNDBUF(),
+					  PJ_TRUE, &sobuf_size);
+	if (status != PJ_SUCCESS)
+	    pj_perror(3, mux->obj_name, status, "Failed setting SO_SNDBUF");
+    }
+
+    /* Bind socket */
+    max_bind_retry = 100;
+    if (cfg->port_range && cfg->port_range < max_bind_retry)
+	max_bind_retry = cfg->port_range;
+    pj_sockaddr_init(mux->af, &bound_addr, NULL, 0);
+    if (cfg->bound_addr.addr.sa_family == pj_AF_INET() || 
+	cfg->bound_addr.addr.sa_family == pj_AF_INET6())
+    {
+	pj_sockaddr_cp(&bound_addr, &cfg->bound_addr);
+    }
+    status = pj_sock_bind_random(msock->fd, &bound_addr, cfg->port_range,
+				 max_bind_retry);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    /* Get the host addresses now, they are the same for all components
+     * using this socket.
+     */
+    addr_len = sizeof(bound_addr);
+    status = pj_sock_getsockname(msock->fd, &bound_addr, &addr_len);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    if (pj_sockaddr_has_addr(&bound_addr)) {
+	msock->alias_cnt = 1;
+	pj_sockaddr_cp(&msock->aliases[0], &bound_addr);
+    } else {
+	msock->alias_cnt = PJ_ARRAY_SIZE(msock->aliases);
+	status = pj_enum_ip_interface(mux->af, &msock->alias_cnt,
+				      msock->aliases);
+	if (status != PJ_SUCCESS)
+	    return status;
+
+	for (i=0; i<msock->alias_cnt; ++i) {
+	    pj_sockaddr_set_port(&msock->aliases[i],
+				 pj_sockaddr_get_port(&bound_addr));
+	}
+    }
+
+    /* Create the demultiplexing tables */
+    status = pj_lock_create_simple_mutex(mux->pool, NULL, &msock->lock);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    msock->ufrag_ht = pj_hash_create(mux->pool, PJ_ICE_ST_MUX_HT_SIZE);
+    msock->addr_ht = pj_hash_create(mux->pool, PJ_ICE_ST_MUX_HT_SIZE);
+
+    /* Buffers to queue packets when the socket is busy */
+    msock->max_pkt_size = cfg->max_pkt_size;
+    for (i=0; i<PJ_ARRAY_SIZE(msock->send_op); ++i) {
+	mux_send_op *op = &msock->send_op[i];
+
+	pj_ioqueue_op_key_init(&op->key, sizeof(op->key));
+	op->key.user_data = op;
+	op->buf = (char*) pj_pool_alloc(mux->pool, cfg->max_pkt_size);
+    }
+
+    /* Start reading. Callbacks may run concurrently, since the socket
+     * lock must not be held while the packet is given to the ICE stream
+     * transport.
+     */
+    pj_activesock_cfg_default(&activesock_cfg);
+    activesock_cfg.grp_lock = mux->grp_lock;
+    activesock_cfg.async_cnt = cfg->async_cnt;
+    activesock_cfg.concurrency = 1;
+
+    pj_bzero(&activesock_cb, sizeof(activesock_cb));
+    activesock_cb.on_data_recvfrom = &mux_on_data_recvfrom;
+    activesock_cb.on_data_sent = &mux_on_data_sent;
+
+    status = pj_activesock_create(mux->pool, msock->fd, pj_SOCK_DGRAM(),
+				  &activesock_cfg, stun_cfg->ioqueue,
+				  &activesock_cb, msock, &msock->asock);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    return pj_activesock_start_recvfrom(msock->asock, mux->pool,
+					cfg->max_pkt_size, 0);
+}
+
+/* Callback to really destroy the mux */
+static void mux_on_destroy(void *obj)
+{
+    pj_ice_strans_mux *mux = (pj_ice_strans_mux*) obj;
+    unsigned i;
+
+    for (i=0; i<mux->sock_cnt; ++i) {
+	if (mux->sock[i].lock)
+	    pj_lock_destroy(mux->sock[i].lock);
+    }
+
+    PJ_LOG(4,(mux->obj_name, "ICE shared sockets destroyed"));
+    pj_pool_release(mux->pool);
+}
+
+/*
+ * Create pool of UDP sockets shared by ICE stream transports.
+ */
+PJ_DEF(pj_status_t) pj_ice_strans_mux_create(const pj_stun_config *stun_cfg,
+					     int af,
+					     const pj_stun_sock_cfg *sock_cfg,
+					     unsigned sock_cnt,
+					     pj_ice_strans_mux **p_mux)
+{
+    pj_pool_t *pool;
+    pj_ice_strans_mux *mux;
+    pj_stun_sock_cfg default_cfg;
+    unsigned i;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(stun_cfg && sock_cnt && p_mux, PJ_EINVAL);
+    PJ_ASSERT_RETURN(af==pj_AF_INET()||af==pj_AF_INET6(), PJ_EAFNOTSUP);
+
+    status = pj_stun_config_check_valid(stun_cfg);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    if (sock_cfg == NULL) {
+	pj_stun_sock_cfg_default(&default_cfg);
+	sock_cfg = &default_cfg;
+    }
+
+    pool = pj_pool_create(stun_cfg->pf, "icemux%p", 1000, 1000, NULL);
+    mux = PJ_POOL_ZALLOC_T(pool, pj_ice_strans_mux);
+    mux->pool = pool;
+    mux->obj_name = pool->obj_name;
+    mux->af = af;
+
+    status = pj_grp_lock_create(pool, NULL, &mux->grp_lock);
+    if (status != PJ_SUCCESS) {
+	pj_pool_release(pool);
+	return status;
+    }
+
+    pj_grp_lock_add_ref(mux->grp_lock);
+    pj_grp_lock_add_handler(mux->grp_lock, pool, mux, &mux_on_destroy);
+
+    mux->sock = (mux_sock*) pj_pool_calloc(pool, sock_cnt, sizeof(mux_sock));
+    mux->sock_cnt = sock_cnt;
+    for (i=0; i<sock_cnt; ++i) {
+	mux->sock[i].mux = mux;
+	mux->sock[i].idx = i;
+	mux->sock[i].fd = PJ_INVALID_SOCKET;
+    }
+
+    for (i=0; i<sock_cnt; ++i) {
+	status = mux_sock_create(mux, &mux->sock[i], stun_cfg, sock_cfg);
+	if (status != PJ_SUCCESS) {
+	    pj_ice_strans_mux_destroy(mux);
+	    return status;
+	}
+    }
+
+    PJ_LOG(4,(mux->obj_name, "ICE shared sockets created, count=%d",
+	      sock_cnt));
+
+    *p_mux = mux;
+    return PJ_SUCCESS;
+}
+
+/*
+ * Destroy the shared sockets.
+ */
+PJ_DEF(pj_status_t) pj_ice_strans_mux_destroy(pj_ice_strans_mux *mux)
+{
+    unsigned i;
+
+    PJ_ASSERT_RETURN(mux, PJ_EINVAL);
+
+    pj_grp_lock_acquire(mux->grp_lock);
+
+    if (mux->is_destroying) {
+	pj_grp_lock_release(mux->grp_lock);
+	return PJ_SUCCESS;
+    }
+
+    mux->is_destroying = PJ_TRUE;
+
+    for (i=0; i<mux->sock_cnt; ++i) {
+	mux_sock *msock = &mux->sock[i];
+
+	if (msock->asock) {
+	    pj_activesock_close(msock->asock);
+	    msock->asock = NULL;
+	} else if (msock->fd != PJ_INVALID_SOCKET) {
+	    pj_sock_close(msock->fd);
+	}
+	msock->fd = PJ_INVALID_SOCKET;
+    }
+
+    pj_grp_lock_dec_ref(mux->grp_lock);
+    pj_grp_lock_release(mux->grp_lock);
+
+    return PJ_SUCCESS;
+}
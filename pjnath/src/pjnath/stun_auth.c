@@ -23,6 +23,7 @@
 #include <pjlib-util/md5.h>
 #include <pjlib-util/sha1.h>
 #include <pj/assert.h>
+#include <pj/hash.h>
 #include <pj/log.h>
 #include <pj/pool.h>
 #include <pj/string.h>
@@ -149,6 +150,218 @@ PJ_DEF(void) pj_stun_create_key(pj_pool_t *pool,
 }
 
 
+/* Storage for the credential and the key of each key cache entry. Longer
+ * credentials are not cached.
+ */
+#define KEY_CACHE_BUF_LEN   256
+
+/* Key cache entry */
+typedef struct key_cache_entry
+{
+    pj_bool_t		    has_cred;	/* Credential is set, or key only */
+    pj_uint32_t		    hval;	/* Hash of the credential	  */
+    pj_stun_passwd_type	    data_type;	/* Password encoding		  */
+    pj_str_t		    realm;	/* The realm			  */
+    pj_str_t		    username;	/* The username			  */
+    pj_str_t		    data;	/* The password			  */
+    pj_str_t		    key;	/* The key			  */
+    pj_hmac_sha1_context    hmac;	/* HMAC initialized with the key  */
+    unsigned		    last_use;	/* For LRU replacement		  */
+    char		    buf[KEY_CACHE_BUF_LEN];
+} key_cache_entry;
+
+struct pj_stun_auth_key_cache
+{
+    unsigned		    max_cnt;
+    unsigned		    count;
+    unsigned		    use_cnt;
+    key_cache_entry	   *entries;
+};
+
+
+PJ_DEF(pj_status_t) pj_stun_auth_key_cache_create(pj_pool_t *pool,
+						  unsigned max_cnt,
+						  pj_stun_auth_key_cache **p_cache)
+{
+    pj_stun_auth_key_cache *cache;
+
+    PJ_ASSERT_RETURN(pool && max_cnt && p_cache, PJ_EINVAL);
+
+    cache = PJ_POOL_ZALLOC_T(pool, pj_stun_auth_key_cache);
+    cache->max_cnt = max_cnt;
+    cache->entries = (key_cache_entry*)
+		     pj_pool_calloc(pool, max_cnt, sizeof(key_cache_entry));
+
+    *p_cache = cache;
+    return PJ_SUCCESS;
+}
+
+
+PJ_DEF(void) pj_stun_auth_key_cache_clear(pj_stun_auth_key_cache *cache)
+{
+    PJ_ASSERT_ON_FAIL(cache, return);
+    cache->count = 0;
+}
+
+
+/* Get an entry to be (re)used for a new key */
+static key_cache_entry *alloc_key_entry(pj_stun_auth_key_cache *cache)
+{
+    key_cache_entry *e;
+    unsigned i;
+
+    if (cache->count < cache->max_cnt)
+	return &cache->entries[cache->count++];
+
+    /* Replace the least recently used one */
+    e = &cache->entries[0];
+    for (i=1; i<cache->count; ++i) {
+	if (cache->use_cnt - cache->entries[i].last_use >
+	    cache->use_cnt - e->last_use)
+	{
+	    e = &cache->entries[i];
+	}
+    }
+    return e;
+}
+
+
+/* Copy string to the entry's buffer */
+static void set_key_entry_str(key_cache_entry *e, unsigned *pos,
+			      pj_str_t *dst, const pj_str_t *src)
+{
+    dst->ptr = e->buf + *pos;
+    dst->slen = src->slen;
+    pj_memcpy(dst->ptr, src->ptr, src->slen);
+    *pos += (unsigned)src->slen;
+}
+
+
+/* Find or create cache entry for the credential. Returns NULL if the
+ * credential can't be cached.
+ */
+static key_cache_entry *get_key_entry(pj_stun_auth_key_cache *cache,
+				      const pj_str_t *realm,
+				      const pj_str_t *username,
+				      pj_stun_passwd_type data_type,
+				      const pj_str_t *data)
+{
+    pj_str_t empty = {NULL, 0};
+    key_cache_entry *e;
+    pj_uint32_t hval;
+    unsigned i, pos;
+
+    if (!realm)
+	realm = &empty;
+
+    hval = pj_hash_calc(0, realm->ptr, (unsigned)realm->slen);
+    hval = pj_hash_calc(hval, username->ptr, (unsigned)username->slen);
+    hval = pj_hash_calc(hval, data->ptr, (unsigned)data->slen);
+
+    for (i=0; i<cache->count; ++i) {
+	e = &cache->entries[i];
+	if (e->has_cred && e->hval == hval && e->data_type == data_type &&
+	    pj_strcmp(&e->realm, realm)==0 &&
+	    pj_strcmp(&e->username, username)==0 &&
+	    pj_strcmp(&e->data, data)==0)
+	{
+	    e->last_use = ++cache->use_cnt;
+	    return e;
+	}
+    }
+
+    /* Need room for the credential and a key as long as the password or
+     * the MD5 digest.
+     */
+    if (realm->slen + username->slen + 2 * data->slen + 16 >
+	KEY_CACHE_BUF_LEN)
+    {
+	return NULL;
+    }
+
+    e = alloc_key_entry(cache);
+    e->has_cred = PJ_TRUE;
+    e->hval = hval;
+    e->data_type = data_type;
+    pos = 0;
+    set_key_entry_str(e, &pos, &e->realm, realm);
+    set_key_entry_str(e, &pos, &e->username, username);
+    set_key_entry_str(e, &pos, &e->data, data);
+
+    e->key.ptr = e->buf + pos;
+    if (realm->slen && data_type == PJ_STUN_PASSWD_PLAIN) {
+	calc_md5_key((pj_uint8_t*)e->key.ptr, realm, username, data);
+	e->key.slen = 16;
+    } else {
+	pj_assert(realm->slen || data_type == PJ_STUN_PASSWD_PLAIN);
+	pj_memcpy(e->key.ptr, data->ptr, data->slen);
+	e->key.slen = data->slen;
+    }
+
+    pj_hmac_sha1_init(&e->hmac, (const pj_uint8_t*)e->key.ptr,
+		      (unsigned)e->key.slen);
+    e->last_use = ++cache->use_cnt;
+
+    return e;
+}
+
+
+/* Get the HMAC context initialized with the key, or NULL if the key
+ * can't be cached.
+ */
+static const pj_hmac_sha1_context *get_key_hmac(pj_stun_auth_key_cache *cache,
+						const pj_str_t *key)
+{
+    key_cache_entry *e;
+    unsigned i, pos;
+
+    for (i=0; i<cache->count; ++i) {
+	e = &cache->entries[i];
+	if (pj_strcmp(&e->key, key)==0) {
+	    e->last_use = ++cache->use_cnt;
+	    return &e->hmac;
+	}
+    }
+
+    if (key->slen > KEY_CACHE_BUF_LEN)
+	return NULL;
+
+    e = alloc_key_entry(cache);
+    e->has_cred = PJ_FALSE;
+    pos = 0;
+    set_key_entry_str(e, &pos, &e->key, key);
+    pj_hmac_sha1_init(&e->hmac, (const pj_uint8_t*)e->key.ptr,
+		      (unsigned)e->key.slen);
+    e->last_use = ++cache->use_cnt;
+
+    return &e->hmac;
+}
+
+
+/*
+ * Create authentication key, using the cache.
+ */
+PJ_DEF(void) pj_stun_auth_key_cache_get_key(pj_stun_auth_key_cache *cache,
+					    pj_pool_t *pool,
+					    pj_str_t *key,
+					    const pj_str_t *realm,
+					    const pj_str_t *username,
+					    pj_stun_passwd_type data_type,
+					    const pj_str_t *data)
+{
+    key_cache_entry *e;
+
+    PJ_ASSERT_ON_FAIL(cache && pool && key && username && data, return);
+
+    e = get_key_entry(cache, realm, username, data_type, data);
+    if (e) {
+	pj_strdup(pool, key, &e->key);
+    } else {
+	pj_stun_create_key(pool, key, realm, username, data_type, data);
+    }
+}
+
+
 PJ_INLINE(pj_uint16_t) GET_VAL16(const pj_uint8_t *pdu, unsigned pos)
 {
     return (pj_uint16_t) ((pdu[pos] << 8) + pdu[pos+1]);
@@ -211,6 +424,33 @@ static pj_status_t create_challenge(pj_pool_t *pool,
 }
 
 
+/* Create key for authenticating the request, and get the HMAC context
+ * for it from the cache if possible.
+ */
+static void create_req_key(pj_stun_auth_key_cache *cache,
+			   pj_pool_t *pool,
+			   pj_str_t *key,
+			   const pj_str_t *realm,
+			   const pj_str_t *username,
+			   pj_stun_passwd_type data_type,
+			   const pj_str_t *data,
+			   const pj_hmac_sha1_context **p_hmac)
+{
+    key_cache_entry *e = NULL;
+
+    if (cache)
+	e = get_key_entry(cache, realm, username, data_type, data);
+
+    if (e) {
+	pj_strdup(pool, key, &e->key);
+	*p_hmac = &e->hmac;
+    } else {
+	pj_stun_create_key(pool, key, realm, username, data_type, data);
+	*p_hmac = NULL;
+    }
+}
+
+
 /* Verify credential in the request */
 PJ_DEF(pj_status_t) pj_stun_authenticate_request(const pj_uint8_t *pkt,
 					         unsigned pkt_len,
@@ -219,6 +459,21 @@ PJ_DEF(pj_status_t) pj_stun_authenticate_request(const pj_uint8_t *pkt,
 					         pj_pool_t *pool,
 						 pj_stun_req_cred_info *p_info,
 					         pj_stun_msg **p_response)
+{
+    return pj_stun_authenticate_request2(pkt, pkt_len, msg, cred, NULL,
+					 pool, p_info, p_response);
+}
+
+
+/* Verify credential in the request, with key cache */
+PJ_DEF(pj_status_t) pj_stun_authenticate_request2(const pj_uint8_t *pkt,
+						  unsigned pkt_len,
+						  const pj_stun_msg *msg,
+						  pj_stun_auth_cred *cred,
+						  pj_stun_auth_key_cache *cache,
+						  pj_pool_t *pool,
+						  pj_stun_req_cred_info *p_info,
+						  pj_stun_msg **p_response)
 {
     pj_stun_req_cred_info tmp_info;
     const pj_stun_msgint_attr *amsgi;
@@ -227,6 +482,7 @@ PJ_DEF(pj_status_t) pj_stun_authenticate_request(const pj_uint8_t *pkt,
     const pj_stun_username_attr *auser;
     const pj_stun_realm_attr *arealm;
     const pj_stun_realm_attr *anonce;
+    const pj_hmac_sha1_context *key_hmac = NULL;
     pj_hmac_sha1_context ctx;
     pj_uint8_t digest[PJ_SHA1_DIGEST_SIZE];
     pj_stun_status err_code;
@@ -325,9 +581,9 @@ PJ_DEF(pj_status_t) pj_stun_authenticate_request(const pj_uint8_t *pkt,
 	if (username_ok) {
 	    pj_strdup(pool, &p_info->username, 
 		      &cred->data.static_cred.username);
-	    pj_stun_create_key(pool, &p_info->auth_key, &p_info->realm,
-			       &auser->value, cred->data.static_cred.data_type,
-			       &cred->data.static_cred.data);
+	    create_req_key(cache, pool, &p_info->auth_key, &p_info->realm,
+			   &auser->value, cred->data.static_cred.data_type,
+			   &cred->data.static_cred.data, &key_hmac);
 	} else {
 	    /* Username mismatch */
 	    /* According to rfc3489bis-10 Sec 10.1.2/10.2.2, we should 
@@ -348,9 +604,9 @@ PJ_DEF(pj_status_t) pj_stun_authenticate_request(const pj_uint8_t *pkt,
 					      &data_type, &password);
 	if (rc == PJ_SUCCESS) {
 	    pj_strdup(pool, &p_info->username, &auser->value);
-	    pj_stun_create_key(pool, &p_info->auth_key, 
-			       (arealm?&arealm->value:NULL), &auser->value, 
-			       data_type, &password);
+	    create_req_key(cache, pool, &p_info->auth_key, 
+			   (arealm?&arealm->value:NULL), &auser->value, 
+			   data_type, &password, &key_hmac);
 	} else {
 	    err_code = PJ_STUN_SC_UNAUTHORIZED;
 	    goto on_auth_failed;
@@ -442,8 +698,12 @@ PJ_DEF(pj_status_t) pj_stun_authenticate_request(const pj_uint8_t *pkt,
     }
 
     /* Now calculate HMAC of the message. */
-    pj_hmac_sha1_init(&ctx, (pj_uint8_t*)p_info->auth_key.ptr, 
-		      (unsigned)p_info->auth_key.slen);
+    if (key_hmac) {
+	ctx = *key_hmac;
+    } else {
+	pj_hmac_sha1_init(&ctx, (pj_uint8_t*)p_info->auth_key.ptr, 
+			  (unsigned)p_info->auth_key.slen);
+    }
 
 #if PJ_STUN_OLD_STYLE_MI_FINGERPRINT
     /* Pre rfc3489bis-06 style of calculation */
@@ -545,10 +805,22 @@ PJ_DEF(pj_status_t) pj_stun_authenticate_response(const pj_uint8_t *pkt,
 					          unsigned pkt_len,
 					          const pj_stun_msg *msg,
 					          const pj_str_t *key)
+{
+    return pj_stun_authenticate_response2(pkt, pkt_len, msg, NULL, key);
+}
+
+
+/* Authenticate MESSAGE-INTEGRITY in the response, with key cache */
+PJ_DEF(pj_status_t) pj_stun_authenticate_response2(const pj_uint8_t *pkt,
+						   unsigned pkt_len,
+						   const pj_stun_msg *msg,
+						   pj_stun_auth_key_cache *cache,
+						   const pj_str_t *key)
 {
     const pj_stun_msgint_attr *amsgi;
     unsigned i, amsgi_pos;
     pj_bool_t has_attr_beyond_mi;
+    const pj_hmac_sha1_context *key_hmac = NULL;
     pj_hmac_sha1_context ctx;
     pj_uint8_t digest[PJ_SHA1_DIGEST_SIZE];
 
@@ -587,7 +859,13 @@ PJ_DEF(pj_status_t) pj_stun_authenticate_response(const pj_uint8_t *pkt,
     }
 
     /* Now calculate HMAC of the message. */
-    pj_hmac_sha1_init(&ctx, (pj_uint8_t*)key->ptr, (unsigned)key->slen);
+    if (cache)
+	key_hmac = get_key_hmac(cache, key);
+    if (key_hmac) {
+	ctx = *key_hmac;
+    } else {
+	pj_hmac_sha1_init(&ctx, (pj_uint8_t*)key->ptr, (unsigned)key->slen);
+    }
 
 #if PJ_STUN_OLD_STYLE_MI_FINGERPRINT
     /* Pre rfc3489bis-06 style of calculation */
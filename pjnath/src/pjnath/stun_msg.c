@@ -2086,6 +2086,29 @@ static void* clone_binary_attr(pj_pool_t *pool, const void *src)
 
 //////////////////////////////////////////////////////////////////////////////
 
+/*
+ * Generate random transaction ID.
+ */
+static void create_tsx_id(pj_uint8_t tsx_id[12])
+{
+    struct transaction_id
+    {
+	pj_uint32_t	    proc_id;
+	pj_uint32_t	    random;
+	pj_uint32_t	    counter;
+    } id;
+    static pj_uint32_t pj_stun_tsx_id_counter;
+
+    if (!pj_stun_tsx_id_counter)
+	pj_stun_tsx_id_counter = pj_rand();
+
+    id.proc_id = pj_getpid();
+    id.random = pj_rand();
+    id.counter = pj_stun_tsx_id_counter++;
+
+    pj_memcpy(tsx_id, &id, 12);
+}
+
 /*
  * Initialize a generic STUN message.
  */
@@ -2104,22 +2127,7 @@ PJ_DEF(pj_status_t) pj_stun_msg_init( pj_stun_msg *msg,
     if (tsx_id) {
 	pj_memcpy(&msg->hdr.tsx_id, tsx_id, sizeof(msg->hdr.tsx_id));
     } else {
-	struct transaction_id
-	{
-	    pj_uint32_t	    proc_id;
-	    pj_uint32_t	    random;
-	    pj_uint32_t	    counter;
-	} id;
-	static pj_uint32_t pj_stun_tsx_id_counter;
-
-	if (!pj_stun_tsx_id_counter)
-	    pj_stun_tsx_id_counter = pj_rand();
-
-	id.proc_id = pj_getpid();
-	id.random = pj_rand();
-	id.counter = pj_stun_tsx_id_counter++;
-
-	pj_memcpy(&msg->hdr.tsx_id, &id, sizeof(msg->hdr.tsx_id));
+	create_tsx_id(msg->hdr.tsx_id);
     }
 
     return PJ_SUCCESS;
@@ -2546,6 +2554,610 @@ PJ_DEF(pj_status_t) pj_stun_msg_decode(pj_pool_t *pool,
     return PJ_SUCCESS;
 }
 
+
+/*
+ * Validate and index incoming packet as STUN message, in place.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_view_parse(const pj_uint8_t *pdu,
+					   pj_size_t pdu_len,
+					   unsigned options,
+					   pj_stun_msg_view *view,
+					   pj_size_t *p_parsed_len)
+{
+    unsigned pos, end;
+    pj_bool_t has_msg_int = PJ_FALSE;
+    pj_bool_t has_fingerprint = PJ_FALSE;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(pdu && pdu_len && view, PJ_EINVAL);
+
+    if (p_parsed_len)
+	*p_parsed_len = 0;
+
+    /* Check if this is a STUN message, if necessary */
+    if (options & PJ_STUN_CHECK_PACKET) {
+	status = pj_stun_msg_check(pdu, pdu_len, options);
+	if (status != PJ_SUCCESS)
+	    return status;
+    }
+
+    if (pdu_len < sizeof(pj_stun_msg_hdr))
+	return PJNATH_EINSTUNMSGLEN;
+
+    /* Copy the header and convert to host byte order */
+    view->pdu = pdu;
+    pj_memcpy(&view->hdr, pdu, sizeof(pj_stun_msg_hdr));
+    view->hdr.type = pj_ntohs(view->hdr.type);
+    view->hdr.length = pj_ntohs(view->hdr.length);
+    view->hdr.magic = pj_ntohl(view->hdr.magic);
+    view->attr_count = 0;
+
+    if (view->hdr.length + sizeof(pj_stun_msg_hdr) > pdu_len)
+	return PJNATH_EINSTUNMSGLEN;
+
+    /* Index attributes */
+    pos = sizeof(pj_stun_msg_hdr);
+    end = pos + view->hdr.length;
+    while (end - pos >= ATTR_HDR_LEN) {
+	unsigned attr_type, attr_len, attr_val_len;
+
+	attr_type = GETVAL16H(pdu, pos);
+	attr_len = GETVAL16H(pdu, pos+2);
+	attr_val_len = (attr_len + 3) & (~3);
+
+	/* Check length */
+	if (end - pos - ATTR_HDR_LEN < attr_val_len)
+	    return PJNATH_ESTUNINATTRLEN;
+
+	if (find_attr_desc(attr_type) == NULL) {
+	    /* Unrecognized attribute, only fatal if it's mandatory */
+	    if (attr_type <= 0x7FFF)
+		return PJ_STATUS_FROM_STUN_CODE(PJ_STUN_SC_UNKNOWN_ATTRIBUTE);
+
+	} else if (attr_type == PJ_STUN_ATTR_MESSAGE_INTEGRITY &&
+		   !has_fingerprint)
+	{
+	    if (has_msg_int)
+		return PJNATH_ESTUNDUPATTR;
+	    has_msg_int = PJ_TRUE;
+
+	} else if (attr_type == PJ_STUN_ATTR_FINGERPRINT) {
+	    if (has_fingerprint)
+		return PJNATH_ESTUNDUPATTR;
+	    has_fingerprint = PJ_TRUE;
+
+	} else if (has_fingerprint) {
+	    return PJNATH_ESTUNFINGERPOS;
+	}
+
+	/* Make sure we have rooms for the new attribute */
+	if (view->attr_count >= PJ_STUN_MAX_ATTR)
+	    return PJNATH_ESTUNTOOMANYATTR;
+
+	view->attr[view->attr_count].type = (pj_uint16_t)attr_type;
+	view->attr[view->attr_count].length = (pj_uint16_t)attr_len;
+	view->attr[view->attr_count].offset = pos;
+	++view->attr_count;
+
+	/* Next attribute */
+	pos += ATTR_HDR_LEN + attr_val_len;
+    }
+
+    if (pos != end) {
+	/* Stray trailing bytes */
+	return PJNATH_EINSTUNMSGLEN;
+    }
+
+    if (p_parsed_len)
+	*p_parsed_len = end;
+
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Find attribute in the message view.
+ */
+PJ_DEF(int) pj_stun_msg_view_find_attr(const pj_stun_msg_view *view,
+				       int attr_type,
+				       unsigned start_index)
+{
+    PJ_ASSERT_RETURN(view, -1);
+
+    for (; start_index < view->attr_count; ++start_index) {
+	if (view->attr[start_index].type == attr_type)
+	    return (int)start_index;
+    }
+
+    return -1;
+}
+
+
+/*
+ * Get socket address attribute value from the message view.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_view_get_sockaddr(const pj_stun_msg_view *view,
+						  unsigned index,
+						  pj_sockaddr *addr)
+{
+    const struct attr_desc *adesc;
+    const pj_uint8_t *buf;
+    unsigned i, addr_len;
+    pj_uint8_t *dst;
+    int af;
+
+    PJ_ASSERT_RETURN(view && addr && index < view->attr_count, PJ_EINVAL);
+
+    adesc = find_attr_desc(view->attr[index].type);
+    PJ_ASSERT_RETURN(adesc && 
+		     (adesc->decode_attr == &decode_sockaddr_attr ||
+		      adesc->decode_attr == &decode_xored_sockaddr_attr),
+		     PJ_EINVAL);
+
+    buf = view->pdu + view->attr[index].offset;
+
+    /* Check address family and attribute length */
+    if (buf[ATTR_HDR_LEN+1] == 1) {
+	if (view->attr[index].length != STUN_GENERIC_IPV4_ADDR_LEN)
+	    return PJNATH_ESTUNINATTRLEN;
+	af = pj_AF_INET();
+	addr_len = 4;
+    } else if (buf[ATTR_HDR_LEN+1] == 2) {
+	if (view->attr[index].length != STUN_GENERIC_IPV6_ADDR_LEN)
+	    return PJNATH_ESTUNINATTRLEN;
+	af = pj_AF_INET6();
+	addr_len = 16;
+    } else {
+	return PJNATH_EINVAF;
+    }
+
+    /* Get port and address */
+    pj_sockaddr_init(af, addr, NULL, 0);
+    pj_sockaddr_set_port(addr, GETVAL16H(buf, ATTR_HDR_LEN+2));
+    dst = (pj_uint8_t*) pj_sockaddr_get_addr(addr);
+    pj_memcpy(dst, buf+ATTR_HDR_LEN+4, addr_len);
+
+    if (adesc->decode_attr == &decode_xored_sockaddr_attr) {
+	/* X-Port is XOR'ed with the most significant 16 bits of the
+	 * magic cookie, and X-Address with the magic cookie (and the
+	 * transaction ID for IPv6), all in network byte order.
+	 */
+	pj_uint32_t magic = pj_htonl(PJ_STUN_MAGIC);
+
+	pj_sockaddr_set_port(addr, (pj_uint16_t)
+			     (pj_sockaddr_get_port(addr) ^ 
+			      (PJ_STUN_MAGIC >> 16)));
+	for (i=0; i<4; ++i) {
+	    dst[i] ^= ((const pj_uint8_t*)&magic)[i];
+	}
+	for (i=4; i<addr_len; ++i) {
+	    dst[i] ^= view->hdr.tsx_id[i-4];
+	}
+    }
+
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Get string attribute value from the message view.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_view_get_string(const pj_stun_msg_view *view,
+						unsigned index,
+						pj_str_t *value)
+{
+    PJ_ASSERT_RETURN(view && value && index < view->attr_count, PJ_EINVAL);
+
+    value->ptr = (char*)(view->pdu + view->attr[index].offset + ATTR_HDR_LEN);
+    value->slen = view->attr[index].length;
+
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Get 32bit integer attribute value from the message view.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_view_get_uint(const pj_stun_msg_view *view,
+					      unsigned index,
+					      pj_uint32_t *value)
+{
+    PJ_ASSERT_RETURN(view && value && index < view->attr_count, PJ_EINVAL);
+
+    if (view->attr[index].length != 4)
+	return PJNATH_ESTUNINATTRLEN;
+
+    *value = GETVAL32H(view->pdu, view->attr[index].offset + ATTR_HDR_LEN);
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Get 64bit integer attribute value from the message view.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_view_get_uint64(const pj_stun_msg_view *view,
+						unsigned index,
+						pj_timestamp *value)
+{
+    PJ_ASSERT_RETURN(view && value && index < view->attr_count, PJ_EINVAL);
+
+    if (view->attr[index].length != 8)
+	return PJNATH_ESTUNINATTRLEN;
+
+    GETVAL64H(view->pdu, view->attr[index].offset + ATTR_HDR_LEN, value);
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Get binary attribute value from the message view.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_view_get_binary(const pj_stun_msg_view *view,
+						unsigned index,
+						const pj_uint8_t **data,
+						unsigned *length)
+{
+    PJ_ASSERT_RETURN(view && data && length && index < view->attr_count,
+		     PJ_EINVAL);
+
+    *data = view->pdu + view->attr[index].offset + ATTR_HDR_LEN;
+    *length = view->attr[index].length;
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * Start encoding message directly into buffer.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_builder_init(pj_stun_msg_builder *b,
+					     pj_uint8_t *buf,
+					     unsigned buf_size,
+					     unsigned msg_type,
+					     pj_uint32_t magic,
+					     const pj_uint8_t tsx_id[12])
+{
+    PJ_ASSERT_RETURN(b && buf && msg_type, PJ_EINVAL);
+
+    pj_bzero(b, sizeof(*b));
+    b->buf = buf;
+    b->buf_size = buf_size;
+    b->hdr.type = (pj_uint16_t) msg_type;
+    b->hdr.magic = magic;
+
+    if (tsx_id) {
+	pj_memcpy(b->hdr.tsx_id, tsx_id, sizeof(b->hdr.tsx_id));
+    } else {
+	create_tsx_id(b->hdr.tsx_id);
+    }
+
+    if (buf_size < sizeof(pj_stun_msg_hdr)) {
+	b->status = PJ_ETOOSMALL;
+	return b->status;
+    }
+
+    PUTVAL16H(buf, 0, b->hdr.type);
+    PUTVAL16H(buf, 2, 0);
+    PUTVAL32H(buf, 4, b->hdr.magic);
+    pj_memcpy(buf+8, b->hdr.tsx_id, sizeof(b->hdr.tsx_id));
+    b->len = sizeof(pj_stun_msg_hdr);
+
+    return PJ_SUCCESS;
+}
+
+/* Encode the attribute at the end of the builder's buffer */
+static pj_status_t builder_add(pj_stun_msg_builder *b, 
+			       const void *attr,
+			       pj_status_t (*encode_attr)(const void *a, 
+						pj_uint8_t *buf, 
+						unsigned len,
+						const pj_stun_msg_hdr *msghdr,
+						unsigned *printed))
+{
+    pj_uint16_t type = ((const pj_stun_attr_hdr*)attr)->type;
+    unsigned printed = 0;
+    pj_status_t status;
+
+    if (b->status != PJ_SUCCESS)
+	return b->status;
+
+    /* There mustn't be any attribute after FINGERPRINT, and only
+     * FINGERPRINT after MESSAGE-INTEGRITY.
+     */
+    if (b->last_attr == PJ_STUN_ATTR_FINGERPRINT) {
+	status = PJNATH_ESTUNFINGERPOS;
+    } else if (b->last_attr == PJ_STUN_ATTR_MESSAGE_INTEGRITY &&
+	       type != PJ_STUN_ATTR_FINGERPRINT)
+    {
+	status = PJNATH_ESTUNMSGINTPOS;
+    } else {
+	status = (*encode_attr)(attr, b->buf + b->len, b->buf_size - b->len,
+				&b->hdr, &printed);
+    }
+
+    if (status != PJ_SUCCESS) {
+	b->status = status;
+	return status;
+    }
+
+    b->len += printed;
+    b->hdr.length = (pj_uint16_t)(b->len - sizeof(pj_stun_msg_hdr));
+    b->last_attr = type;
+    PUTVAL16H(b->buf, 2, b->hdr.length);
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * Encode socket address attribute.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_builder_add_sockaddr_attr(
+					      pj_stun_msg_builder *b,
+					      int attr_type, 
+					      pj_bool_t xor_ed,
+					      const pj_sockaddr_t *addr,
+					      unsigned addr_len)
+{
+    pj_stun_sockaddr_attr attr;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(b && addr, PJ_EINVAL);
+
+    if (b->status != PJ_SUCCESS)
+	return b->status;
+
+    status = pj_stun_sockaddr_attr_init(&attr, attr_type, xor_ed, 
+				        addr, addr_len);
+    if (status != PJ_SUCCESS) {
+	b->status = status;
+	return status;
+    }
+
+    return builder_add(b, &attr, &encode_sockaddr_attr);
+}
+
+/*
+ * Encode string attribute.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_builder_add_string_attr(
+					      pj_stun_msg_builder *b,
+					      int attr_type,
+					      const pj_str_t *value)
+{
+    pj_stun_string_attr attr;
+
+    PJ_ASSERT_RETURN(b && value, PJ_EINVAL);
+
+    INIT_ATTR(&attr, attr_type, value->slen);
+    attr.value = *value;
+
+    return builder_add(b, &attr, &encode_string_attr);
+}
+
+/*
+ * Encode 32bit integer attribute.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_builder_add_uint_attr(
+					      pj_stun_msg_builder *b,
+					      int attr_type,
+					      pj_uint32_t value)
+{
+    pj_stun_uint_attr attr;
+
+    PJ_ASSERT_RETURN(b, PJ_EINVAL);
+
+    INIT_ATTR(&attr, attr_type, 4);
+    attr.value = value;
+
+    return builder_add(b, &attr, &encode_uint_attr);
+}
+
+/*
+ * Encode 64bit integer attribute.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_builder_add_uint64_attr(
+					      pj_stun_msg_builder *b,
+					      int attr_type,
+					      const pj_timestamp *value)
+{
+    pj_stun_uint64_attr attr;
+
+    PJ_ASSERT_RETURN(b && value, PJ_EINVAL);
+
+    INIT_ATTR(&attr, attr_type, 8);
+    attr.value.u64 = value->u64;
+
+    return builder_add(b, &attr, &encode_uint64_attr);
+}
+
+/*
+ * Encode binary attribute.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_builder_add_binary_attr(
+					      pj_stun_msg_builder *b,
+					      int attr_type,
+					      const pj_uint8_t *data,
+					      unsigned length)
+{
+    pj_stun_binary_attr attr;
+
+    PJ_ASSERT_RETURN(b && (data || !length), PJ_EINVAL);
+
+    INIT_ATTR(&attr, attr_type, length);
+    attr.magic = PJ_STUN_MAGIC;
+    attr.length = length;
+    attr.data = (pj_uint8_t*) data;
+
+    return builder_add(b, &attr, &encode_binary_attr);
+}
+
+/*
+ * Encode empty attribute.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_builder_add_empty_attr(
+					      pj_stun_msg_builder *b,
+					      int attr_type)
+{
+    pj_stun_empty_attr attr;
+
+    PJ_ASSERT_RETURN(b, PJ_EINVAL);
+
+    INIT_ATTR(&attr, attr_type, 0);
+
+    return builder_add(b, &attr, &encode_empty_attr);
+}
+
+/*
+ * Encode ERROR-CODE attribute.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_builder_add_errcode_attr(
+					      pj_stun_msg_builder *b,
+					      int err_code,
+					      const pj_str_t *err_reason)
+{
+    pj_stun_errcode_attr attr;
+    char err_buf[80];
+    pj_str_t str;
+
+    PJ_ASSERT_RETURN(b && err_code, PJ_EINVAL);
+
+    if (err_reason == NULL) {
+	str = pj_stun_get_err_reason(err_code);
+	if (str.slen == 0) {
+	    str.slen = pj_ansi_snprintf(err_buf, sizeof(err_buf),
+				        "Unknown error %d", err_code);
+	    str.ptr = err_buf;
+	}
+	err_reason = &str;
+    }
+
+    INIT_ATTR(&attr, PJ_STUN_ATTR_ERROR_CODE, 4+err_reason->slen);
+    attr.err_code = err_code;
+    attr.reason = *err_reason;
+
+    return builder_add(b, &attr, &encode_errcode_attr);
+}
+
+/*
+ * Calculate and encode MESSAGE-INTEGRITY with the key.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_builder_add_msgint_attr(
+					      pj_stun_msg_builder *b,
+					      const pj_str_t *key)
+{
+    pj_hmac_sha1_context ctx;
+
+    PJ_ASSERT_RETURN(b && key, PJ_EINVAL);
+
+    if (b->status != PJ_SUCCESS)
+	return b->status;
+
+    pj_hmac_sha1_init(&ctx, (const pj_uint8_t*)key->ptr, 
+		      (unsigned)key->slen);
+    return pj_stun_msg_builder_add_msgint_attr2(b, &ctx);
+}
+
+/*
+ * Calculate and encode MESSAGE-INTEGRITY with the key context.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_builder_add_msgint_attr2(
+					      pj_stun_msg_builder *b,
+					      const pj_hmac_sha1_context *key_ctx)
+{
+    pj_stun_msgint_attr attr;
+    pj_hmac_sha1_context ctx;
+
+    PJ_ASSERT_RETURN(b && key_ctx, PJ_EINVAL);
+
+    if (b->status != PJ_SUCCESS)
+	return b->status;
+
+#if PJ_STUN_OLD_STYLE_MI_FINGERPRINT
+    /* Old style length depends on the attributes after this one */
+    b->status = PJ_ENOTSUP;
+    return b->status;
+#else
+    if (b->last_attr == PJ_STUN_ATTR_MESSAGE_INTEGRITY ||
+	b->last_attr == PJ_STUN_ATTR_FINGERPRINT)
+    {
+	b->status = PJNATH_ESTUNMSGINTPOS;
+	return b->status;
+    }
+
+    if (b->buf_size - b->len < ATTR_HDR_LEN + 20) {
+	b->status = PJ_ETOOSMALL;
+	return b->status;
+    }
+
+    /* The length must include MESSAGE-INTEGRITY attribute before the
+     * digest is calculated.
+     */
+    PUTVAL16H(b->buf, 2, (pj_uint16_t)(b->len - sizeof(pj_stun_msg_hdr) +
+				       ATTR_HDR_LEN + 20));
+
+    INIT_ATTR(&attr, PJ_STUN_ATTR_MESSAGE_INTEGRITY, 20);
+    pj_memcpy(&ctx, key_ctx, sizeof(ctx));
+    pj_hmac_sha1_update(&ctx, b->buf, b->len);
+    pj_hmac_sha1_final(&ctx, attr.hmac);
+
+    return builder_add(b, &attr, &encode_msgint_attr);
+#endif
+}
+
+/*
+ * Calculate and encode FINGERPRINT.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_builder_add_fingerprint_attr(
+					      pj_stun_msg_builder *b)
+{
+    pj_stun_fingerprint_attr attr;
+
+    PJ_ASSERT_RETURN(b, PJ_EINVAL);
+
+    if (b->status != PJ_SUCCESS)
+	return b->status;
+
+#if PJ_STUN_OLD_STYLE_MI_FINGERPRINT
+    b->status = PJ_ENOTSUP;
+    return b->status;
+#else
+    if (b->last_attr == PJ_STUN_ATTR_FINGERPRINT) {
+	b->status = PJNATH_ESTUNFINGERPOS;
+	return b->status;
+    }
+
+    if (b->buf_size - b->len < ATTR_HDR_LEN + 4) {
+	b->status = PJ_ETOOSMALL;
+	return b->status;
+    }
+
+    /* Include FINGERPRINT in the length before calculating the CRC */
+    PUTVAL16H(b->buf, 2, (pj_uint16_t)(b->len - sizeof(pj_stun_msg_hdr) +
+				       ATTR_HDR_LEN + 4));
+
+    INIT_ATTR(&attr, PJ_STUN_ATTR_FINGERPRINT, 4);
+    attr.value = pj_crc32_calc(b->buf, b->len) ^ STUN_XOR_FINGERPRINT;
+
+    return builder_add(b, &attr, &encode_uint_attr);
+#endif
+}
+
+/*
+ * Finish encoding.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_builder_finish(pj_stun_msg_builder *b,
+					       pj_size_t *p_msg_len)
+{
+    PJ_ASSERT_RETURN(b, PJ_EINVAL);
+
+    if (b->status != PJ_SUCCESS)
+	return b->status;
+
+    if (p_msg_len)
+	*p_msg_len = b->len;
+
+    return PJ_SUCCESS;
+}
+
 /*
 static char *print_binary(const pj_uint8_t *data, unsigned data_len)
 {
@@ -41,6 +41,7 @@ struct pj_stun_session
 
     pj_stun_auth_type	 auth_type;
     pj_stun_auth_cred	 cred;
+    pj_stun_auth_key_cache *key_cache;
     int			 auth_retry;
     pj_str_t		 next_nonce;
     pj_str_t		 server_realm;
@@ -101,16 +102,16 @@ static pj_status_t tsx_erase(pj_stun_session *sess,
 }
 
 static pj_stun_tx_data* tsx_lookup(pj_stun_session *sess,
-				   const pj_stun_msg *msg)
+				   const pj_stun_msg_hdr *hdr)
 {
     pj_stun_tx_data *tdata;
 
     tdata = sess->pending_request_list.next;
     while (tdata != &sess->pending_request_list) {
-	pj_assert(sizeof(tdata->msg_key)==sizeof(msg->hdr.tsx_id));
-	if (tdata->msg_magic == msg->hdr.magic &&
-	    pj_memcmp(tdata->msg_key, msg->hdr.tsx_id, 
-		      sizeof(msg->hdr.tsx_id))==0)
+	pj_assert(sizeof(tdata->msg_key)==sizeof(hdr->tsx_id));
+	if (tdata->msg_magic == hdr->magic &&
+	    pj_memcmp(tdata->msg_key, hdr->tsx_id, 
+		      sizeof(hdr->tsx_id))==0)
 	{
 	    return tdata;
 	}
@@ -531,6 +532,11 @@ PJ_DEF(pj_status_t) pj_stun_session_create( pj_stun_config *cfg,
 				   PJNATH_POOL_LEN_STUN_TDATA,
 				   PJNATH_POOL_INC_STUN_TDATA, NULL);
 
+#if PJ_STUN_AUTH_KEY_CACHE_SIZE > 0
+    pj_stun_auth_key_cache_create(pool, PJ_STUN_AUTH_KEY_CACHE_SIZE,
+				  &sess->key_cache);
+#endif
+
     pj_list_init(&sess->pending_request_list);
     pj_list_init(&sess->cached_response_list);
 
@@ -654,6 +660,8 @@ PJ_DEF(pj_status_t) pj_stun_session_set_credential(pj_stun_session *sess,
 	sess->auth_type = PJ_STUN_AUTH_NONE;
 	pj_bzero(&sess->cred, sizeof(sess->cred));
     }
+    if (sess->key_cache)
+	pj_stun_auth_key_cache_clear(sess->key_cache);
     pj_grp_lock_release(sess->grp_lock);
 
     return PJ_SUCCESS;
@@ -678,6 +686,23 @@ PJ_DEF(pj_bool_t) pj_stun_session_use_fingerprint(pj_stun_session *sess,
     return old_use;
 }
 
+/* Create authentication key, from the cache if we have one */
+static void create_key(pj_stun_session *sess,
+		       pj_pool_t *pool,
+		       pj_str_t *key,
+		       const pj_str_t *realm,
+		       const pj_str_t *username,
+		       pj_stun_passwd_type data_type,
+		       const pj_str_t *data)
+{
+    if (sess->key_cache) {
+	pj_stun_auth_key_cache_get_key(sess->key_cache, pool, key, realm,
+				       username, data_type, data);
+    } else {
+	pj_stun_create_key(pool, key, realm, username, data_type, data);
+    }
+}
+
 static pj_status_t get_auth(pj_stun_session *sess,
 			    pj_stun_tx_data *tdata)
 {
@@ -687,11 +712,11 @@ static pj_status_t get_auth(pj_stun_session *sess,
 	tdata->auth_info.username = sess->cred.data.static_cred.username;
 	tdata->auth_info.nonce = sess->cred.data.static_cred.nonce;
 
-	pj_stun_create_key(tdata->pool, &tdata->auth_info.auth_key, 
-			   &tdata->auth_info.realm,
-			   &tdata->auth_info.username,
-			   sess->cred.data.static_cred.data_type,
-			   &sess->cred.data.static_cred.data);
+	create_key(sess, tdata->pool, &tdata->auth_info.auth_key, 
+		   &tdata->auth_info.realm,
+		   &tdata->auth_info.username,
+		   sess->cred.data.static_cred.data_type,
+		   &sess->cred.data.static_cred.data);
 
     } else if (sess->cred.type == PJ_STUN_AUTH_CRED_DYNAMIC) {
 	pj_str_t password;
@@ -708,9 +733,9 @@ static pj_status_t get_auth(pj_stun_session *sess,
 	if (rc != PJ_SUCCESS)
 	    return rc;
 
-	pj_stun_create_key(tdata->pool, &tdata->auth_info.auth_key, 
-			   &tdata->auth_info.realm, &tdata->auth_info.username,
-			   data_type, &password);
+	create_key(sess, tdata->pool, &tdata->auth_info.auth_key, 
+		   &tdata->auth_info.realm, &tdata->auth_info.username,
+		   data_type, &password);
 
     } else {
 	pj_assert(!"Unknown credential type");
@@ -1200,9 +1225,9 @@ static pj_status_t authenticate_req(pj_stun_session *sess,
 	return PJ_SUCCESS;
     }
 
-    status = pj_stun_authenticate_request(pkt, pkt_len, rdata->msg, 
-					  &sess->cred, tmp_pool, &rdata->info,
-					  &response);
+    status = pj_stun_authenticate_request2(pkt, pkt_len, rdata->msg, 
+					   &sess->cred, sess->key_cache,
+					   tmp_pool, &rdata->info, &response);
     if (status != PJ_SUCCESS && response != NULL) {
 	PJ_LOG(5,(SNAME(sess), "Message authentication failed"));
 	send_response(sess, token, tmp_pool, response, &rdata->info, 
@@ -1226,7 +1251,7 @@ static pj_status_t on_incoming_response(pj_stun_session *sess,
     pj_status_t status;
 
     /* Lookup pending client transaction */
-    tdata = tsx_lookup(sess, msg);
+    tdata = tsx_lookup(sess, &msg->hdr);
     if (tdata == NULL) {
 	PJ_LOG(5,(SNAME(sess), 
 		  "Transaction not found, response silently discarded"));
@@ -1243,8 +1268,9 @@ static pj_status_t on_incoming_response(pj_stun_session *sess,
 	tdata->auth_info.auth_key.slen != 0 && 
 	pj_stun_auth_valid_for_msg(msg))
     {
-	status = pj_stun_authenticate_response(pkt, pkt_len, msg, 
-					       &tdata->auth_info.auth_key);
+	status = pj_stun_authenticate_response2(pkt, pkt_len, msg, 
+						sess->key_cache,
+						&tdata->auth_info.auth_key);
 	if (status != PJ_SUCCESS) {
 	    PJ_LOG(5,(SNAME(sess), 
 		      "Response authentication failed"));
@@ -1269,7 +1295,7 @@ static pj_status_t on_incoming_response(pj_stun_session *sess,
 /* For requests, check if we cache the response */
 static pj_status_t check_cached_response(pj_stun_session *sess,
 					 pj_pool_t *tmp_pool,
-					 const pj_stun_msg *msg,
+					 const pj_stun_msg_hdr *hdr,
 					 const pj_sockaddr_t *src_addr,
 					 unsigned src_addr_len)
 {
@@ -1278,10 +1304,10 @@ static pj_status_t check_cached_response(pj_stun_session *sess,
     /* First lookup response in response cache */
     t = sess->cached_response_list.next;
     while (t != &sess->cached_response_list) {
-	if (t->msg_magic == msg->hdr.magic &&
-	    t->msg->hdr.type == msg->hdr.type &&
-	    pj_memcmp(t->msg_key, msg->hdr.tsx_id, 
-		      sizeof(msg->hdr.tsx_id))==0)
+	if (t->msg_magic == hdr->magic &&
+	    t->msg->hdr.type == hdr->type &&
+	    pj_memcmp(t->msg_key, hdr->tsx_id, 
+		      sizeof(hdr->tsx_id))==0)
 	{
 	    break;
 	}
@@ -1418,7 +1444,9 @@ PJ_DEF(pj_status_t) pj_stun_session_on_rx_pkt(pj_stun_session *sess,
 					      const pj_sockaddr_t *src_addr,
 					      unsigned src_addr_len)
 {
+    pj_stun_msg_view view;
     pj_stun_msg *msg, *response;
+    pj_bool_t viewed;
     pj_status_t status;
 
     PJ_ASSERT_RETURN(sess && packet && pkt_size, PJ_EINVAL);
@@ -1436,6 +1464,33 @@ PJ_DEF(pj_status_t) pj_stun_session_on_rx_pkt(pj_stun_session *sess,
     /* Reset pool */
     pj_pool_reset(sess->rx_pool);
 
+    /* Index the message in place first, so that request retransmissions
+     * and stray responses can be dealt with without decoding the
+     * whole message.
+     */
+    status = pj_stun_msg_view_parse((const pj_uint8_t*)packet, pkt_size,
+				    options, &view, parsed_len);
+    viewed = (status == PJ_SUCCESS);
+    if (viewed) {
+	/* For requests, check if we have cached response */
+	status = check_cached_response(sess, sess->rx_pool, &view.hdr,
+				       src_addr, src_addr_len);
+	if (status == PJ_SUCCESS) {
+	    goto on_return;
+	}
+
+	/* Discard response which doesn't match any pending transaction */
+	if ((PJ_STUN_IS_SUCCESS_RESPONSE(view.hdr.type) ||
+	     PJ_STUN_IS_ERROR_RESPONSE(view.hdr.type)) &&
+	    tsx_lookup(sess, &view.hdr) == NULL)
+	{
+	    PJ_LOG(5,(SNAME(sess), 
+		      "Transaction not found, response silently discarded"));
+	    status = PJ_SUCCESS;
+	    goto on_return;
+	}
+    }
+
     /* Try to parse the message */
     status = pj_stun_msg_decode(sess->rx_pool, (const pj_uint8_t*)packet,
 			        pkt_size, options, 
@@ -1451,11 +1506,15 @@ PJ_DEF(pj_status_t) pj_stun_session_on_rx_pkt(pj_stun_session *sess,
 
     dump_rx_msg(sess, msg, (unsigned)pkt_size, src_addr);
 
-    /* For requests, check if we have cached response */
-    status = check_cached_response(sess, sess->rx_pool, msg, 
-				   src_addr, src_addr_len);
-    if (status == PJ_SUCCESS) {
-	goto on_return;
+    /* For requests, check if we have cached response, unless it's been
+     * done above.
+     */
+    if (!viewed) {
+	status = check_cached_response(sess, sess->rx_pool, &msg->hdr, 
+				       src_addr, src_addr_len);
+	if (status == PJ_SUCCESS) {
+	    goto on_return;
+	}
     }
 
     /* Handle message */
@@ -36,6 +36,12 @@
 #define PJ_TURN_CHANNEL_HTABLE_SIZE 8
 #define PJ_TURN_PERM_HTABLE_SIZE    8
 
+/* Maximum number of XOR-PEER-ADDRESS attributes in one CreatePermission
+ * request, leaving room for SOFTWARE, USERNAME, REALM, NONCE,
+ * MESSAGE-INTEGRITY and FINGERPRINT attributes.
+ */
+#define PJ_TURN_PERM_PER_REQ	    (PJ_STUN_MAX_ATTR - 6)
+
 static const char *state_names[] = 
 {
     "Null",
@@ -93,6 +99,12 @@ struct perm_t
     /* Automatically renew this permission once it expires? */
     pj_bool_t	    renew;
 
+    /* Is there a bound channel to this IP address? The permission is
+     * then renewed with CreatePermission together with the other
+     * permissions, instead of with the less frequent ChannelBind.
+     */
+    pj_bool_t	    ch_bound;
+
     /* The permission expiration */
     pj_time_val	    expiry;
 
@@ -122,6 +134,7 @@ struct pj_turn_session
     pj_bool_t		 pending_destroy;
 
     pj_stun_session	*stun;
+    pj_str_t		 sw_name;
 
     unsigned		 lifetime;
     int			 ka_interval;
@@ -152,6 +165,10 @@ struct pj_turn_session
     pj_uint8_t		 tx_pkt[PJ_TURN_MAX_PKT_LEN];
 
     pj_uint16_t		 next_ch;
+
+    unsigned		 perm_refresh_cnt;
+    unsigned		 perm_refresh_saved;
+    unsigned		 ch_refresh_cnt;
 };
 
 
@@ -199,6 +216,10 @@ static struct perm_t *lookup_perm(pj_turn_session *sess,
 				  pj_bool_t update);
 static void invalidate_perm(pj_turn_session *sess,
 			    struct perm_t *perm);
+static pj_status_t send_create_perm(pj_turn_session *sess,
+				    const pj_sockaddr *addr[],
+				    unsigned addr_cnt,
+				    void *req_token);
 static void on_timer_event(pj_timer_heap_t *th, pj_timer_entry *e);
 
 
@@ -270,6 +291,7 @@ PJ_DEF(pj_status_t) pj_turn_session_create( const pj_stun_config *cfg,
 
     /* Copy STUN session */
     pj_memcpy(&sess->stun_cfg, cfg, sizeof(pj_stun_config));
+    pj_strdup(pool, &sess->sw_name, &cfg->software_name);
 
     /* Copy callback */
     pj_memcpy(&sess->cb, cb, sizeof(*cb));
@@ -491,6 +513,9 @@ PJ_DEF(pj_status_t) pj_turn_session_get_info( pj_turn_session *sess,
     info->conn_type = sess->conn_type;
     info->lifetime = sess->expiry.sec - now.sec;
     info->last_status = sess->last_status;
+    info->perm_refresh_cnt = sess->perm_refresh_cnt;
+    info->perm_refresh_saved = sess->perm_refresh_saved;
+    info->ch_refresh_cnt = sess->ch_refresh_cnt;
 
     if (sess->srv_addr)
 	pj_memcpy(&info->server, sess->srv_addr, sizeof(info->server));
@@ -557,6 +582,15 @@ PJ_DEF(pj_status_t) pj_turn_session_set_software_name( pj_turn_session *sess,
 
     pj_grp_lock_acquire(sess->grp_lock);
     status = pj_stun_session_set_software_name(sess->stun, sw);
+    if (status == PJ_SUCCESS) {
+	/* Keep a copy for the keep-alive Send indication, which is built
+	 * without the STUN session.
+	 */
+	if (sw && sw->slen)
+	    pj_strdup(sess->pool, &sess->sw_name, sw);
+	else
+	    sess->sw_name.slen = 0;
+    }
     pj_grp_lock_release(sess->grp_lock);
 
     return status;
@@ -793,31 +827,25 @@ PJ_DEF(pj_status_t) pj_turn_session_set_perm( pj_turn_session *sess,
 					      const pj_sockaddr addr[],
 					      unsigned options)
 {
-    pj_stun_tx_data *tdata;
+    const pj_sockaddr *addr_batch[PJ_TURN_PERM_PER_REQ];
+    unsigned batch_cnt = 0;
     pj_hash_iterator_t it_buf, *it;
     void *req_token;
-    unsigned i, attr_added=0;
-    pj_status_t status;
+    unsigned i;
+    pj_status_t status = PJ_SUCCESS;
 
     PJ_ASSERT_RETURN(sess && addr_cnt && addr, PJ_EINVAL);
 
     pj_grp_lock_acquire(sess->grp_lock);
 
-    /* Create a bare CreatePermission request */
-    status = pj_stun_session_create_req(sess->stun, 
-					PJ_STUN_CREATE_PERM_REQUEST,
-					PJ_STUN_MAGIC, NULL, &tdata);
-    if (status != PJ_SUCCESS) {
-	pj_grp_lock_release(sess->grp_lock);
-	return status;
-    }
-
     /* Create request token to map the request to the perm structures
      * which the request belongs.
      */
     req_token = (void*)(pj_ssize_t)pj_rand();
 
-    /* Process the addresses */
+    /* Process the addresses, in as many CreatePermission requests as
+     * needed.
+     */
     for (i=0; i<addr_cnt; ++i) {
 	struct perm_t *perm;
 
@@ -829,44 +857,32 @@ PJ_DEF(pj_status_t) pj_turn_session_set_perm( pj_turn_session *sess,
 	/* Only add to the request if the request doesn't contain this
 	 * address yet.
 	 */
-	if (perm->req_token != req_token) {
-	    perm->req_token = req_token;
-
-	    /* Add XOR-PEER-ADDRESS */
-	    status = pj_stun_msg_add_sockaddr_attr(tdata->pool, tdata->msg,
-						   PJ_STUN_ATTR_XOR_PEER_ADDR,
-						   PJ_TRUE,
-						   &addr[i],
-						   sizeof(addr[i]));
+	if (perm->req_token == req_token)
+	    continue;
+
+	perm->req_token = req_token;
+	addr_batch[batch_cnt++] = &addr[i];
+
+	if (batch_cnt == PJ_ARRAY_SIZE(addr_batch)) {
+	    status = send_create_perm(sess, addr_batch, batch_cnt, req_token);
 	    if (status != PJ_SUCCESS)
 		goto on_error;
 
-	    ++attr_added;
+	    batch_cnt = 0;
+	    req_token = (void*)(pj_ssize_t)pj_rand();
 	}
     }
 
-    pj_assert(attr_added != 0);
-
-    /* Send the request */
-    status = pj_stun_session_send_msg(sess->stun, req_token, PJ_FALSE, 
-				      (sess->conn_type==PJ_TURN_TP_UDP),
-				      sess->srv_addr,
-				      pj_sockaddr_get_len(sess->srv_addr), 
-				      tdata);
-    if (status != PJ_SUCCESS) {
-	/* tdata is already destroyed */
-	tdata = NULL;
-	goto on_error;
+    if (batch_cnt) {
+	status = send_create_perm(sess, addr_batch, batch_cnt, req_token);
+	if (status != PJ_SUCCESS)
+	    goto on_error;
     }
 
     pj_grp_lock_release(sess->grp_lock);
     return PJ_SUCCESS;
 
 on_error:
-    /* destroy tdata */
-    if (tdata) {
-	pj_stun_msg_destroy_tdata(sess->stun, tdata);
-    }
     /* invalidate perm structures associated with this request */
     it = pj_hash_first(sess->perm_table, &it_buf);
     while (it) {
@@ -997,36 +1013,25 @@ PJ_DEF(pj_status_t) pj_turn_session_sendto( pj_turn_session *sess,
 
     } else {
 	/* Use Send Indication. */
-	pj_stun_sockaddr_attr peer_attr;
-	pj_stun_binary_attr data_attr;
-	pj_stun_msg send_ind;
+	pj_stun_msg_builder send_ind;
 	pj_size_t send_ind_len;
 
 	/* Increment counter */
 	++sess->send_ind_tsx_id[2];
 
-	/* Create blank SEND-INDICATION */
-	status = pj_stun_msg_init(&send_ind, PJ_STUN_SEND_INDICATION,
-				  PJ_STUN_MAGIC, 
-				  (const pj_uint8_t*)sess->send_ind_tsx_id);
-	if (status != PJ_SUCCESS)
-	    goto on_return;
-
-	/* Add XOR-PEER-ADDRESS */
-	pj_stun_sockaddr_attr_init(&peer_attr, PJ_STUN_ATTR_XOR_PEER_ADDR,
-				   PJ_TRUE, addr, addr_len);
-	pj_stun_msg_add_attr(&send_ind, (pj_stun_attr_hdr*)&peer_attr);
-
-	/* Add DATA attribute */
-	pj_stun_binary_attr_init(&data_attr, NULL, PJ_STUN_ATTR_DATA, NULL, 0);
-	data_attr.data = (pj_uint8_t*)pkt;
-	data_attr.length = pkt_len;
-	pj_stun_msg_add_attr(&send_ind, (pj_stun_attr_hdr*)&data_attr);
-
-	/* Encode the message */
-	status = pj_stun_msg_encode(&send_ind, sess->tx_pkt, 
-				    sizeof(sess->tx_pkt), 0,
-				    NULL, &send_ind_len);
+	/* Encode SEND-INDICATION with XOR-PEER-ADDRESS and DATA straight
+	 * into the transmit buffer.
+	 */
+	pj_stun_msg_builder_init(&send_ind, sess->tx_pkt, 
+				 sizeof(sess->tx_pkt), 
+				 PJ_STUN_SEND_INDICATION, PJ_STUN_MAGIC,
+				 (const pj_uint8_t*)sess->send_ind_tsx_id);
+	pj_stun_msg_builder_add_sockaddr_attr(&send_ind, 
+					      PJ_STUN_ATTR_XOR_PEER_ADDR,
+					      PJ_TRUE, addr, addr_len);
+	pj_stun_msg_builder_add_binary_attr(&send_ind, PJ_STUN_ATTR_DATA,
+					    (const pj_uint8_t*)pkt, pkt_len);
+	status = pj_stun_msg_builder_finish(&send_ind, &send_ind_len);
 	if (status != PJ_SUCCESS)
 	    goto on_return;
 
@@ -1106,6 +1111,57 @@ on_return:
 }
 
 
+/*
+ * Deliver Data indication to application without decoding it in the
+ * STUN session. Anything other than a well formed Data indication is
+ * left for the STUN session to handle (and report).
+ */
+static pj_status_t on_rx_data_ind(pj_turn_session *sess,
+				  const pj_uint8_t *pkt,
+				  pj_size_t pkt_len,
+				  unsigned options,
+				  pj_size_t *parsed_len)
+{
+    pj_stun_msg_view view;
+    pj_sockaddr peer_addr;
+    const pj_uint8_t *data;
+    unsigned data_len;
+    int peer_idx, data_idx;
+    pj_status_t status;
+
+    status = pj_stun_msg_view_parse(pkt, pkt_len, options, &view, 
+				    parsed_len);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    if (view.hdr.type != PJ_STUN_DATA_INDICATION ||
+	pj_stun_msg_view_find_attr(&view, PJ_STUN_ATTR_ICMP, 0) >= 0)
+    {
+	return PJ_EIGNORED;
+    }
+
+    peer_idx = pj_stun_msg_view_find_attr(&view, 
+					  PJ_STUN_ATTR_XOR_PEER_ADDR, 0);
+    data_idx = pj_stun_msg_view_find_attr(&view, PJ_STUN_ATTR_DATA, 0);
+    if (peer_idx < 0 || data_idx < 0)
+	return PJ_EIGNORED;
+
+    status = pj_stun_msg_view_get_sockaddr(&view, peer_idx, &peer_addr);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    pj_stun_msg_view_get_binary(&view, data_idx, &data, &data_len);
+
+    /* Notify application */
+    if (sess->cb.on_rx_data) {
+	(*sess->cb.on_rx_data)(sess, (void*)data, data_len, &peer_addr,
+			       pj_sockaddr_get_len(&peer_addr));
+    }
+
+    return PJ_SUCCESS;
+}
+
+
 /**
  * Notify TURN client session upon receiving a packet from server.
  * The packet maybe a STUN packet or ChannelData packet.
@@ -1138,10 +1194,16 @@ PJ_DEF(pj_status_t) pj_turn_session_on_rx_pkt(pj_turn_session *sess,
 	options = PJ_STUN_CHECK_PACKET | PJ_STUN_NO_FINGERPRINT_CHECK;
 	if (is_datagram)
 	    options |= PJ_STUN_IS_DATAGRAM;
-	status=pj_stun_session_on_rx_pkt(sess->stun, pkt, pkt_len,
-					 options, NULL, parsed_len,
-					 sess->srv_addr,
-					 pj_sockaddr_get_len(sess->srv_addr));
+
+	/* Data indications are delivered straight from the packet */
+	status = on_rx_data_ind(sess, (const pj_uint8_t*)pkt, pkt_len,
+				options, parsed_len);
+	if (status != PJ_SUCCESS) {
+	    status=pj_stun_session_on_rx_pkt(sess->stun, pkt, pkt_len,
+					     options, NULL, parsed_len,
+					     sess->srv_addr,
+					     pj_sockaddr_get_len(sess->srv_addr));
+	}
 
     } else {
 	/* This must be ChannelData. */
@@ -1768,7 +1830,7 @@ static struct ch_t *lookup_ch_by_addr(pj_turn_session *sess,
 
     if (ch && update) {
 	pj_gettimeofday(&ch->expiry);
-	ch->expiry.sec += PJ_TURN_PERM_TIMEOUT - sess->ka_interval - 1;
+	ch->expiry.sec += PJ_TURN_CHANNEL_TIMEOUT - sess->ka_interval - 1;
 
 	if (bind_channel) {
 	    pj_uint32_t hval = 0;
@@ -1858,64 +1920,145 @@ static void invalidate_perm(pj_turn_session *sess,
 }
 
 /*
- * Scan permission's hash table to refresh the permission.
+ * Send CreatePermission request for the peer addresses. The request token
+ * maps the response to the permissions.
+ */
+static pj_status_t send_create_perm(pj_turn_session *sess,
+				    const pj_sockaddr *addr[],
+				    unsigned addr_cnt,
+				    void *req_token)
+{
+    pj_stun_tx_data *tdata;
+    unsigned i;
+    pj_status_t status;
+
+    pj_assert(addr_cnt && addr_cnt <= PJ_TURN_PERM_PER_REQ);
+
+    /* Create a bare CreatePermission request */
+    status = pj_stun_session_create_req(sess->stun, 
+					PJ_STUN_CREATE_PERM_REQUEST,
+					PJ_STUN_MAGIC, NULL, &tdata);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    /* Add XOR-PEER-ADDRESS */
+    for (i=0; i<addr_cnt; ++i) {
+	status = pj_stun_msg_add_sockaddr_attr(tdata->pool, tdata->msg,
+					       PJ_STUN_ATTR_XOR_PEER_ADDR,
+					       PJ_TRUE,
+					       addr[i],
+					       sizeof(*addr[i]));
+	if (status != PJ_SUCCESS) {
+	    pj_stun_msg_destroy_tdata(sess->stun, tdata);
+	    return status;
+	}
+    }
+
+    /* Send the request, tdata is destroyed on failure */
+    return pj_stun_session_send_msg(sess->stun, req_token, PJ_FALSE, 
+				    (sess->conn_type==PJ_TURN_TP_UDP),
+				    sess->srv_addr,
+				    pj_sockaddr_get_len(sess->srv_addr), 
+				    tdata);
+}
+
+/*
+ * Refresh permissions with CreatePermission request. The permissions
+ * are only updated once the request has been sent, otherwise they'll be
+ * retried on the next timer event.
+ */
+static pj_status_t refresh_perm_batch(pj_turn_session *sess,
+				      struct perm_t *perm[],
+				      unsigned perm_cnt,
+				      const pj_time_val *now)
+{
+    const pj_sockaddr *addr[PJ_TURN_PERM_PER_REQ];
+    void *req_token;
+    unsigned i;
+    pj_status_t status;
+
+    for (i=0; i<perm_cnt; ++i)
+	addr[i] = &perm[i]->addr;
+
+    /* Create request token to map the request to the perm structures
+     * which the request belongs.
+     */
+    req_token = (void*)(pj_ssize_t)pj_rand();
+
+    status = send_create_perm(sess, addr, perm_cnt, req_token);
+    if (status != PJ_SUCCESS) {
+	PJ_PERROR(1,(sess->obj_name, status,
+		     "Error sending CreatePermission request"));
+	return status;
+    }
+
+    for (i=0; i<perm_cnt; ++i) {
+	perm[i]->expiry = *now;
+	perm[i]->expiry.sec += PJ_TURN_PERM_TIMEOUT-sess->ka_interval-1;
+	perm[i]->req_token = req_token;
+    }
+
+    PJ_LOG(5,(sess->obj_name, 
+	      "Refreshing %d permission(s) in one request", perm_cnt));
+    ++sess->perm_refresh_cnt;
+    sess->perm_refresh_saved += perm_cnt - 1;
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * Scan permission's hash table to refresh the permission. Permissions 
+ * expiring within PJ_TURN_PERM_REFRESH_WINDOW of a due permission are
+ * refreshed early in the same request, or in several requests when they
+ * don't fit in one.
  */
 static unsigned refresh_permissions(pj_turn_session *sess, 
 				    const pj_time_val *now)
 {
-    pj_stun_tx_data *tdata = NULL;
+    struct perm_t *perm_batch[PJ_TURN_PERM_PER_REQ];
+    unsigned perm_cnt = 0;
     unsigned count = 0;
-    void *req_token = NULL;
     pj_hash_iterator_t *it, itbuf;
-    pj_status_t status;
+    long deadline;
 
+    /* Nothing to do until at least one permission is due */
     it = pj_hash_first(sess->perm_table, &itbuf);
     while (it) {
 	struct perm_t *perm = (struct perm_t*)
 			      pj_hash_this(sess->perm_table, it);
 
+	if (perm->expiry.sec-1 <= now->sec)
+	    break;
+
 	it = pj_hash_next(sess->perm_table, it);
+    }
 
-	if (perm->expiry.sec-1 <= now->sec) {
-	    if (perm->renew) {
-		/* Renew this permission */
-		if (tdata == NULL) {
-		    /* Create a bare CreatePermission request */
-		    status = pj_stun_session_create_req(
-					sess->stun, 
-					PJ_STUN_CREATE_PERM_REQUEST,
-					PJ_STUN_MAGIC, NULL, &tdata);
-		    if (status != PJ_SUCCESS) {
-			PJ_LOG(1,(sess->obj_name, 
-				 "Error creating CreatePermission request: %d",
-				 status));
-			return 0;
-		    }
+    if (it == NULL)
+	return 0;
 
-		    /* Create request token to map the request to the perm
-		     * structures which the request belongs.
-		     */
-		    req_token = (void*)(pj_ssize_t)pj_rand();
-		}
+    deadline = now->sec + PJ_TURN_PERM_REFRESH_WINDOW;
 
-		status = pj_stun_msg_add_sockaddr_attr(
-					tdata->pool, 
-					tdata->msg,
-					PJ_STUN_ATTR_XOR_PEER_ADDR,
-					PJ_TRUE,
-					&perm->addr,
-					sizeof(perm->addr));
-		if (status != PJ_SUCCESS) {
-		    pj_stun_msg_destroy_tdata(sess->stun, tdata);
-		    return 0;
-		}
+    it = pj_hash_first(sess->perm_table, &itbuf);
+    while (it) {
+	struct perm_t *perm = (struct perm_t*)
+			      pj_hash_this(sess->perm_table, it);
 
-		perm->expiry = *now;
-		perm->expiry.sec += PJ_TURN_PERM_TIMEOUT-sess->ka_interval-1;
-		perm->req_token = req_token;
-		++count;
+	it = pj_hash_next(sess->perm_table, it);
 
-	    } else {
+	if (perm->expiry.sec-1 <= deadline) {
+	    if (perm->renew || perm->ch_bound) {
+		/* Renew this permission */
+		perm_batch[perm_cnt++] = perm;
+		if (perm_cnt == PJ_ARRAY_SIZE(perm_batch)) {
+		    if (refresh_perm_batch(sess, perm_batch, perm_cnt,
+					   now) == PJ_SUCCESS)
+		    {
+			count += perm_cnt;
+		    }
+		    perm_cnt = 0;
+		}
+
+	    } else if (perm->expiry.sec-1 <= now->sec) {
 		/* This permission has expired and app doesn't want
 		 * us to renew, so delete it from the hash table.
 		 */
@@ -1924,19 +2067,10 @@ static unsigned refresh_permissions(pj_turn_session *sess,
 	}
     }
 
-    if (tdata) {
-	status = pj_stun_session_send_msg(sess->stun, req_token, PJ_FALSE, 
-					  (sess->conn_type==PJ_TURN_TP_UDP),
-					  sess->srv_addr,
-					  pj_sockaddr_get_len(sess->srv_addr), 
-					  tdata);
-	if (status != PJ_SUCCESS) {
-	    PJ_LOG(1,(sess->obj_name, 
-		      "Error sending CreatePermission request: %d",
-		      status));
-	    count = 0;
-	}
-
+    if (perm_cnt &&
+	refresh_perm_batch(sess, perm_batch, perm_cnt, now) == PJ_SUCCESS)
+    {
+	count += perm_cnt;
     }
 
     return count;
@@ -1994,7 +2128,19 @@ static void on_timer_event(pj_timer_heap_t *th, pj_timer_entry *e)
 		 */
 		pj_turn_session_bind_channel(sess, &ch->addr,
 					     pj_sockaddr_get_len(&ch->addr));
+		++sess->ch_refresh_cnt;
 		pkt_sent = PJ_TRUE;
+
+	    } else if (ch->bound) {
+		/* Permission expires sooner than the channel binding,
+		 * have it refreshed with the other permissions.
+		 */
+		struct perm_t *perm;
+
+		perm = lookup_perm(sess, &ch->addr,
+				   pj_sockaddr_get_len(&ch->addr), PJ_FALSE);
+		if (perm)
+		    perm->ch_bound = PJ_TRUE;
 	    }
 
 	    it = pj_hash_next(sess->ch_table, it);
@@ -2008,22 +2154,26 @@ static void on_timer_event(pj_timer_heap_t *th, pj_timer_entry *e)
 	 * refresh local NAT.
 	 */
 	if (!pkt_sent && sess->alloc_param.ka_interval > 0) {
-	    pj_stun_tx_data *tdata;
-	    pj_status_t rc;
-
-	    /* Create blank SEND-INDICATION */
-	    rc = pj_stun_session_create_ind(sess->stun, 
-					    PJ_STUN_SEND_INDICATION, &tdata);
-	    if (rc == PJ_SUCCESS) {
-		/* Add DATA attribute with zero length */
-		pj_stun_msg_add_binary_attr(tdata->pool, tdata->msg,
-					    PJ_STUN_ATTR_DATA, NULL, 0);
-
-		/* Send the indication */
-		pj_stun_session_send_msg(sess->stun, NULL, PJ_FALSE, 
-					 PJ_FALSE, sess->srv_addr,
-					 pj_sockaddr_get_len(sess->srv_addr),
-					 tdata);
+	    pj_stun_msg_builder ind;
+	    pj_size_t ind_len;
+
+	    /* Create blank SEND-INDICATION with zero length DATA */
+	    pj_stun_msg_builder_init(&ind, sess->tx_pkt, sizeof(sess->tx_pkt),
+				     PJ_STUN_SEND_INDICATION, PJ_STUN_MAGIC,
+				     NULL);
+	    if (sess->sw_name.slen) {
+		pj_stun_msg_builder_add_string_attr(&ind,
+						    PJ_STUN_ATTR_SOFTWARE,
+						    &sess->sw_name);
+	    }
+	    pj_stun_msg_builder_add_binary_attr(&ind, PJ_STUN_ATTR_DATA,
+						NULL, 0);
+
+	    /* Send the indication */
+	    if (pj_stun_msg_builder_finish(&ind, &ind_len) == PJ_SUCCESS) {
+		(*sess->cb.on_send_pkt)(sess, sess->tx_pkt, (unsigned)ind_len,
+					sess->srv_addr,
+					pj_sockaddr_get_len(sess->srv_addr));
 	    }
 	}
 
@@ -33,6 +33,12 @@
 //#define OPTIONS		PJ_STUN_NO_AUTHENTICATE
 #define OPTIONS		0
 
+/* Relay throughput test settings */
+#define BENCH_PKT_CNT	20000		    /* Packets per direction	*/
+#define BENCH_PKT_LEN	160		    /* Payload size		*/
+#define BENCH_WINDOW	64		    /* Max packets in flight	*/
+#define BENCH_TIMEOUT	500		    /* Loss timeout, in msec	*/
+
 
 struct peer
 {
@@ -55,6 +61,13 @@ static struct global
     pj_sockaddr		 relay_addr;
 
     struct peer		 peer[2];
+
+    /* Relay throughput test state */
+    struct {
+	pj_bool_t	 active;
+	unsigned	 rx_cnt;
+	pj_timestamp	 last_rx;
+    } bench;
 } g;
 
 static struct options
@@ -321,6 +334,12 @@ static void turn_on_rx_data(pj_turn_sock *relay,
 {
     char addrinfo[80];
 
+    if (g.bench.active) {
+	++g.bench.rx_cnt;
+	pj_get_timestamp(&g.bench.last_rx);
+	return;
+    }
+
     pj_sockaddr_print(peer_addr, addrinfo, sizeof(addrinfo), 3);
 
     PJ_LOG(3,(THIS_FILE, "Client received %d bytes data from %s: %.*s",
@@ -390,6 +409,12 @@ static pj_bool_t stun_sock_on_rx_data(pj_stun_sock *stun_sock,
     struct peer *peer = (struct peer*) pj_stun_sock_get_user_data(stun_sock);
     char straddr[PJ_INET6_ADDRSTRLEN+10];
 
+    if (g.bench.active) {
+	++g.bench.rx_cnt;
+	pj_get_timestamp(&g.bench.last_rx);
+	return PJ_TRUE;
+    }
+
     ((char*)pkt)[pkt_len] = '\0';
 
     pj_sockaddr_print(src_addr, straddr, sizeof(straddr), 3);
@@ -400,6 +425,82 @@ static pj_bool_t stun_sock_on_rx_data(pj_stun_sock *stun_sock,
 }
 
 
+/*
+ * Send BENCH_PKT_CNT packets through the relay, either from the client
+ * to peer 0 or from peer 0 to the relay address, and report how many
+ * arrived and how fast. At most BENCH_WINDOW packets are kept in flight
+ * so that the socket buffers don't overflow.
+ */
+static void bench_run(const char *title, pj_bool_t from_client)
+{
+    pj_uint8_t pkt[BENCH_PKT_LEN];
+    pj_timestamp t0, t_wait, now;
+    unsigned sent;
+    pj_uint32_t usec;
+
+    pj_memset(pkt, 'x', sizeof(pkt));
+
+    g.bench.rx_cnt = 0;
+    pj_get_timestamp(&t0);
+    g.bench.last_rx = t0;
+    g.bench.active = PJ_TRUE;
+
+    for (sent=0; sent<BENCH_PKT_CNT; ++sent) {
+	pj_status_t status;
+
+	/* Wait until there is room in the window, give up if nothing
+	 * arrives within BENCH_TIMEOUT.
+	 */
+	pj_get_timestamp(&t_wait);
+	while (sent - g.bench.rx_cnt >= BENCH_WINDOW) {
+	    pj_get_timestamp(&now);
+	    if (pj_elapsed_msec(&t_wait, &now) > BENCH_TIMEOUT)
+		break;
+	    pj_thread_sleep(0);
+	}
+	if (sent - g.bench.rx_cnt >= BENCH_WINDOW) {
+	    PJ_LOG(3,(THIS_FILE, "%s: timed out waiting for packets",
+		      title));
+	    break;
+	}
+
+	if (from_client) {
+	    status = pj_turn_sock_sendto(g.relay, pkt, sizeof(pkt),
+					 &g.peer[0].mapped_addr,
+				pj_sockaddr_get_len(&g.peer[0].mapped_addr));
+	} else {
+	    status = pj_stun_sock_sendto(g.peer[0].stun_sock, NULL, pkt,
+					 sizeof(pkt), 0, &g.relay_addr,
+					 pj_sockaddr_get_len(&g.relay_addr));
+	}
+	if (status != PJ_SUCCESS && status != PJ_EPENDING) {
+	    my_perror(title, status);
+	    break;
+	}
+    }
+
+    /* Wait for the remaining packets */
+    pj_get_timestamp(&t_wait);
+    while (g.bench.rx_cnt < sent) {
+	pj_get_timestamp(&now);
+	if (pj_elapsed_msec(&t_wait, &now) > BENCH_TIMEOUT)
+	    break;
+	pj_thread_sleep(1);
+    }
+
+    g.bench.active = PJ_FALSE;
+
+    usec = pj_elapsed_usec(&t0, &g.bench.last_rx);
+    if (usec == 0)
+	usec = 1;
+
+    PJ_LOG(3,(THIS_FILE, "%s: %u of %u packets (%u bytes) received, "
+			 "%u pkt/s", title, g.bench.rx_cnt, sent,
+			 BENCH_PKT_LEN,
+			 (unsigned)((pj_uint64_t)g.bench.rx_cnt*1000000/usec)));
+}
+
+
 static void menu(void)
 {
     pj_turn_session_info info;
@@ -434,6 +535,7 @@ static void menu(void)
     puts("| p,pp   Set permission for peer 0/1 +--------------------------------+");
     puts("| s,ss   Send data to peer 0/1       |             PEER-1             |");
     puts("| b,bb   BindChannel to peer 0/1     |                                |");
+    puts("| t      Throughput test with peer 0 |                                |");
     printf("| x      Delete allocation           | Address: %-21s |\n",
 	  peer1_addr);
     puts("+------------------------------------+                                |");
@@ -510,6 +612,14 @@ static void console_main(void)
 	    if (status != PJ_SUCCESS)
 		my_perror("pj_turn_sock_set_perm() failed", status);
 	    break;
+	case 't':
+	    if (g.relay == NULL) {
+		puts("Error: no relay");
+		continue;
+	    }
+	    bench_run("Client to peer0", PJ_TRUE);
+	    bench_run("Peer0 to client", PJ_FALSE);
+	    break;
 	case 'x':
 	    if (g.relay == NULL) {
 		puts("Error: no relay");
@@ -56,6 +56,7 @@ typedef struct alloc_request
 
 /* Prototypes */
 static void destroy_allocation(pj_turn_allocation *alloc);
+static void alloc_on_destroy(void *arg);
 static pj_status_t create_relay(pj_turn_srv *srv,
 				pj_turn_allocation *alloc,
 				const pj_stun_msg *msg,
@@ -289,6 +290,7 @@ PJ_DEF(pj_status_t) pj_turn_allocation_create(pj_turn_transport *transport,
     pj_turn_allocation *alloc;
     pj_stun_session_cb sess_cb;
     char str_tmp[80];
+    int err_code = PJ_STUN_SC_BAD_REQUEST;
     pj_status_t status;
 
     /* Parse ALLOCATE request */
@@ -314,12 +316,15 @@ PJ_DEF(pj_status_t) pj_turn_allocation_create(pj_turn_transport *transport,
     alloc->hkey.tp_type = transport->listener->tp_type;
     pj_memcpy(&alloc->hkey.clt_addr, src_addr, src_addr_len);
 
-    status = pj_lock_create_recursive_mutex(pool, alloc->obj_name, 
-					    &alloc->lock);
+    status = pj_grp_lock_create(pool, NULL, &alloc->grp_lock);
     if (status != PJ_SUCCESS) {
 	goto on_error;
     }
 
+    /* The pool is released when the last reference is gone */
+    pj_grp_lock_add_ref(alloc->grp_lock);
+    pj_grp_lock_add_handler(alloc->grp_lock, pool, alloc, &alloc_on_destroy);
+
     /* Create peer hash table */
     alloc->peer_table = pj_hash_create(pool, PEER_TABLE_SIZE);
 
@@ -363,7 +368,11 @@ PJ_DEF(pj_status_t) pj_turn_allocation_create(pj_turn_transport *transport,
     }
 
     /* Register this allocation */
-    pj_turn_srv_register_allocation(srv, alloc);
+    status = pj_turn_srv_register_allocation(srv, alloc);
+    if (status != PJ_SUCCESS) {
+	err_code = PJ_STUN_SC_INSUFFICIENT_CAPACITY;
+	goto on_error;
+    }
 
     /* Respond to ALLOCATE request */
     status = send_allocate_response(alloc, srv_sess, transport, rdata);
@@ -383,7 +392,7 @@ PJ_DEF(pj_status_t) pj_turn_allocation_create(pj_turn_transport *transport,
 on_error:
     /* Send reply to the ALLOCATE request */
     pj_strerror(status, str_tmp, sizeof(str_tmp));
-    pj_stun_session_respond(srv_sess, rdata, PJ_STUN_SC_BAD_REQUEST, str_tmp, 
+    pj_stun_session_respond(srv_sess, rdata, err_code, str_tmp, 
 			    transport, PJ_TRUE, src_addr, src_addr_len);
 
     /* Cleanup */
@@ -415,24 +424,39 @@ static void destroy_relay(pj_turn_relay_res *relay)
 }
 
 
+/*
+ * Release the allocation's memory once nobody references it anymore.
+ */
+static void alloc_on_destroy(void *arg)
+{
+    pj_turn_allocation *alloc = (pj_turn_allocation*) arg;
+    pj_pool_t *pool = alloc->pool;
+
+    alloc->pool = NULL;
+    pj_pool_release(pool);
+}
+
+
 /*
  * Really destroy allocation.
  */
 static void destroy_allocation(pj_turn_allocation *alloc)
 {
-    pj_pool_t *pool;
-
     /* Unregister this allocation */
     pj_turn_srv_unregister_allocation(alloc->server, alloc);
 
     /* Destroy relay */
     destroy_relay(&alloc->relay);
 
-    /* Must lock only after destroying relay otherwise deadlock */
-    if (alloc->lock) {
-	pj_lock_acquire(alloc->lock);
+    if (!alloc->grp_lock) {
+	/* Failed early during creation */
+	pj_pool_release(alloc->pool);
+	return;
     }
 
+    /* Must lock only after destroying relay otherwise deadlock */
+    pj_grp_lock_acquire(alloc->grp_lock);
+
     /* Unreference transport */
     if (alloc->transport) {
 	pj_turn_transport_dec_ref(alloc->transport, alloc);
@@ -445,19 +469,11 @@ static void destroy_allocation(pj_turn_allocation *alloc)
 	alloc->sess = NULL;
     }
 
-    /* Destroy lock */
-    if (alloc->lock) {
-	pj_lock_release(alloc->lock);
-	pj_lock_destroy(alloc->lock);
-	alloc->lock = NULL;
-    }
-
-    /* Destroy pool */
-    pool = alloc->pool;
-    if (pool) {
-	alloc->pool = NULL;
-	pj_pool_release(pool);
-    }
+    /* Packet handlers which still hold a reference will see that the
+     * allocation is gone. The memory is released by alloc_on_destroy().
+     */
+    pj_grp_lock_dec_ref(alloc->grp_lock);
+    pj_grp_lock_release(alloc->grp_lock);
 }
 
 
@@ -711,12 +727,17 @@ static pj_status_t create_relay(pj_turn_srv *srv,
 	pj_sockaddr_copy_addr(&relay->hkey.addr, &tmp_addr);
     }
 
+    /* Random part of the Data indication transaction ID */
+    for (retry=0; retry<8; ++retry)
+	relay->tp.ind_tsx_id[retry] = (pj_uint8_t)pj_rand();
+
     /* Init ioqueue */
     pj_bzero(&icb, sizeof(icb));
     icb.on_read_complete = &on_rx_from_peer;
 
-    status = pj_ioqueue_register_sock(pool, srv->core.ioqueue, relay->tp.sock,
-				      relay, &icb, &relay->tp.key);
+    status = pj_ioqueue_register_sock2(pool, srv->core.ioqueue, 
+				       relay->tp.sock, alloc->grp_lock,
+				       relay, &icb, &relay->tp.key);
     if (status != PJ_SUCCESS) {
 	PJ_LOG(4,(THIS_FILE, "pj_ioqueue_register_sock() failed: err %d", 
 		  status));
@@ -822,13 +843,12 @@ static pj_turn_permission *create_permission(pj_turn_allocation *alloc,
 }
 
 /* Check if a permission isn't expired. Return NULL if expired. */
-static pj_turn_permission *check_permission_expiry(pj_turn_permission *perm)
+static pj_turn_permission *check_permission_expiry(pj_turn_permission *perm,
+						   const pj_time_val *now)
 {
     pj_turn_allocation *alloc = perm->allocation;
-    pj_time_val now;
 
-    pj_gettimeofday(&now);
-    if (PJ_TIME_VAL_GT(perm->expiry, now)) {
+    if (PJ_TIME_VAL_GT(perm->expiry, *now)) {
 	/* Permission has not expired */
 	return perm;
     }
@@ -851,7 +871,8 @@ static pj_turn_permission *check_permission_expiry(pj_turn_permission *perm)
 static pj_turn_permission*
 lookup_permission_by_addr(pj_turn_allocation *alloc,
 			  const pj_sockaddr_t *peer_addr,
-			  unsigned addr_len)
+			  unsigned addr_len,
+			  const pj_time_val *now)
 {
     pj_turn_permission *perm;
 
@@ -863,13 +884,14 @@ lookup_permission_by_addr(pj_turn_allocation *alloc,
 		       pj_sockaddr_get_addr(peer_addr),
 		       pj_sockaddr_get_addr_len(peer_addr), 
 		       NULL);
-    return perm ? check_permission_expiry(perm) : NULL;
+    return perm ? check_permission_expiry(perm, now) : NULL;
 }
 
 /* Lookup permission in hash table by the channel number */
 static pj_turn_permission*
 lookup_permission_by_chnum(pj_turn_allocation *alloc,
-			   unsigned chnum)
+			   unsigned chnum,
+			   const pj_time_val *now)
 {
     pj_uint16_t chnum16 = (pj_uint16_t)chnum;
     pj_turn_permission *perm;
@@ -877,15 +899,16 @@ lookup_permission_by_chnum(pj_turn_allocation *alloc,
     /* Lookup in peer hash table */
     perm = (pj_turn_permission*) pj_hash_get(alloc->ch_table, &chnum16,
 					    sizeof(chnum16), NULL);
-    return perm ? check_permission_expiry(perm) : NULL;
+    return perm ? check_permission_expiry(perm, now) : NULL;
 }
 
 /* Update permission because of data from client to peer. 
  * Return PJ_TRUE is permission is found.
  */
-static pj_bool_t refresh_permission(pj_turn_permission *perm)
+static pj_bool_t refresh_permission(pj_turn_permission *perm,
+				    const pj_time_val *now)
 {
-    pj_gettimeofday(&perm->expiry);
+    perm->expiry = *now;
     if (perm->channel == PJ_TURN_INVALID_CHANNEL)
 	perm->expiry.sec += PJ_TURN_PERM_TIMEOUT;
     else
@@ -893,6 +916,115 @@ static pj_bool_t refresh_permission(pj_turn_permission *perm)
     return PJ_TRUE;
 }
 
+/* Read/write 16bit value from/to unaligned buffer in network order */
+#define GETVAL16(p, pos)    ((pj_uint16_t)(((p)[pos] << 8) | (p)[(pos)+1]))
+
+static void putval16(pj_uint8_t *p, pj_uint16_t val)
+{
+    p[0] = (pj_uint8_t)(val >> 8);
+    p[1] = (pj_uint8_t)(val & 0xFF);
+}
+
+/*
+ * Relay Send indication from client to peer. This is the fast path for
+ * the most common STUN message once the allocation has been set up: the
+ * indication is parsed in place and the DATA is sent straight from the
+ * packet buffer, without decoding the message in the STUN session.
+ *
+ * Return PJ_FALSE if this is not a plain Send indication, in which case
+ * the packet should be given to the STUN session.
+ */
+static pj_bool_t relay_send_ind(pj_turn_allocation *alloc,
+				pj_turn_pkt *pkt)
+{
+    const pj_uint8_t *p = pkt->pkt;
+    const pj_uint8_t *peer_attr = NULL, *data = NULL;
+    unsigned pos, data_len = 0;
+    pj_uint16_t port;
+    pj_sockaddr peer_addr;
+    pj_turn_permission *perm;
+
+    if (pkt->len < sizeof(pj_stun_msg_hdr) ||
+	GETVAL16(p, 0) != PJ_STUN_SEND_INDICATION ||
+	GETVAL16(p, 2) + sizeof(pj_stun_msg_hdr) != pkt->len ||
+	GETVAL16(p, 4) != (PJ_STUN_MAGIC >> 16) ||
+	GETVAL16(p, 6) != (PJ_STUN_MAGIC & 0xFFFF))
+    {
+	return PJ_FALSE;
+    }
+
+    /* Find XOR-PEER-ADDRESS and DATA attributes */
+    pos = sizeof(pj_stun_msg_hdr);
+    while (pos + 4 <= pkt->len) {
+	unsigned type = GETVAL16(p, pos);
+	unsigned len = GETVAL16(p, pos+2);
+
+	if (pos + 4 + len > pkt->len)
+	    return PJ_FALSE;
+
+	if (type == PJ_STUN_ATTR_XOR_PEER_ADDR) {
+	    if (!peer_attr)
+		peer_attr = p + pos;
+	} else if (type == PJ_STUN_ATTR_DATA) {
+	    if (!data) {
+		data = p + pos + 4;
+		data_len = len;
+	    }
+	} else if (type < 0x8000) {
+	    /* Let the STUN session deal with other comprehension-required
+	     * attributes.
+	     */
+	    return PJ_FALSE;
+	}
+
+	pos += 4 + ((len + 3) & ~3);
+    }
+
+    if (peer_attr == NULL)
+	return PJ_FALSE;
+
+    /* Decode the peer address */
+    port = (pj_uint16_t)(GETVAL16(peer_attr, 6) ^ (PJ_STUN_MAGIC >> 16));
+    if (peer_attr[5] == 1 && GETVAL16(peer_attr, 2) == 8) {
+	pj_uint32_t addr;
+
+	pj_sockaddr_init(pj_AF_INET(), &peer_addr, NULL, port);
+	pj_memcpy(&addr, peer_attr+8, 4);
+	peer_addr.ipv4.sin_addr.s_addr = addr ^ pj_htonl(PJ_STUN_MAGIC);
+
+    } else if (peer_attr[5] == 2 && GETVAL16(peer_attr, 2) == 20) {
+	unsigned i;
+
+	/* The address is XOR'ed with magic cookie and transaction ID */
+	pj_sockaddr_init(pj_AF_INET6(), &peer_addr, NULL, port);
+	for (i=0; i<16; ++i)
+	    peer_addr.ipv6.sin6_addr.s6_addr[i] = peer_attr[8+i] ^ p[4+i];
+
+    } else {
+	return PJ_FALSE;
+    }
+
+    /* Create/update/refresh the permission */
+    perm = lookup_permission_by_addr(alloc, &peer_addr,
+				     pj_sockaddr_get_len(&peer_addr),
+				     &pkt->rx_time);
+    if (perm == NULL) {
+	perm = create_permission(alloc, &peer_addr,
+				 pj_sockaddr_get_len(&peer_addr));
+    }
+    refresh_permission(perm, &pkt->rx_time);
+
+    /* Relay the data to peer */
+    if (data) {
+	pj_ssize_t len = data_len;
+
+	pj_sock_sendto(alloc->relay.tp.sock, data, &len, 0, &peer_addr,
+		       pj_sockaddr_get_len(&peer_addr));
+    }
+
+    return PJ_TRUE;
+}
+
 /*
  * Handle incoming packet from client. This would have been called by
  * server upon receiving packet from a listener.
@@ -904,7 +1036,11 @@ PJ_DEF(void) pj_turn_allocation_on_rx_client_pkt(pj_turn_allocation *alloc,
     pj_status_t status;
 
     /* Lock this allocation */
-    pj_lock_acquire(alloc->lock);
+    pj_grp_lock_acquire(alloc->grp_lock);
+
+    /* Allocation may have been destroyed while we're waiting for the lock */
+    if (alloc->sess == NULL || alloc->transport == NULL)
+	goto on_return;
 
     /* Quickly check if this is STUN message */
     is_stun = ((*((pj_uint8_t*)pkt->pkt) & 0xC0) == 0);
@@ -924,9 +1060,16 @@ PJ_DEF(void) pj_turn_allocation_on_rx_client_pkt(pj_turn_allocation *alloc,
 	unsigned options = PJ_STUN_CHECK_PACKET | PJ_STUN_NO_FINGERPRINT_CHECK;
 	pj_size_t parsed_len = 0;
 
-	if (pkt->transport->listener->tp_type == PJ_TURN_TP_UDP)
+	if (pkt->transport->listener->tp_type == PJ_TURN_TP_UDP) {
 	    options |= PJ_STUN_IS_DATAGRAM;
 
+	    /* Relay Send indication without the STUN session */
+	    if (relay_send_ind(alloc, pkt)) {
+		pkt->len = 0;
+		goto on_return;
+	    }
+	}
+
 	status = pj_stun_session_on_rx_pkt(alloc->sess, pkt->pkt, pkt->len,
 					   options, NULL, &parsed_len,
 					   &pkt->src.clt_addr, 
@@ -972,7 +1115,8 @@ PJ_DEF(void) pj_turn_allocation_on_rx_client_pkt(pj_turn_allocation *alloc,
 	    goto on_return;
 	}
 
-	perm = lookup_permission_by_chnum(alloc, pj_ntohs(cd->ch_number));
+	perm = lookup_permission_by_chnum(alloc, pj_ntohs(cd->ch_number),
+					  &pkt->rx_time);
 	if (!perm) {
 	    /* Discard */
 	    PJ_LOG(4,(alloc->obj_name, 
@@ -988,18 +1132,20 @@ PJ_DEF(void) pj_turn_allocation_on_rx_client_pkt(pj_turn_allocation *alloc,
 		       pj_sockaddr_get_len(&perm->hkey.peer_addr));
 
 	/* Refresh permission */
-	refresh_permission(perm);
+	refresh_permission(perm, &pkt->rx_time);
     }
 
 on_return:
     /* Release lock */
-    pj_lock_release(alloc->lock);
+    pj_grp_lock_release(alloc->grp_lock);
 }
 
 
 /*
  * Handle incoming packet from peer. This function is called by 
- * on_rx_from_peer().
+ * on_rx_from_peer(). The packet is in the relay receive buffer, with
+ * PJ_TURN_RELAY_HDR_ROOM bytes free in front of it, so the ChannelData
+ * or Data indication is built around the payload without copying it.
  */
 static void handle_peer_pkt(pj_turn_allocation *alloc,
 			    pj_turn_relay_res *rel,
@@ -1007,10 +1153,12 @@ static void handle_peer_pkt(pj_turn_allocation *alloc,
 			    const pj_sockaddr *src_addr)
 {
     pj_turn_permission *perm;
+    pj_time_val now;
 
     /* Lookup permission */
+    pj_gettimeofday(&now);
     perm = lookup_permission_by_addr(alloc, src_addr, 
-				     pj_sockaddr_get_len(src_addr));
+				     pj_sockaddr_get_len(src_addr), &now);
     if (perm == NULL) {
 	/* No permission, discard data */
 	return;
@@ -1021,52 +1169,65 @@ static void handle_peer_pkt(pj_turn_allocation *alloc,
      */
     if (perm->channel != PJ_TURN_INVALID_CHANNEL) {
 	/* Send ChannelData */
-	pj_turn_channel_data *cd = (pj_turn_channel_data*)rel->tp.tx_pkt;
-
-	if (len > PJ_TURN_MAX_PKT_LEN) {
-	    char peer_addr[80];
-	    pj_sockaddr_print(src_addr, peer_addr, sizeof(peer_addr), 3);
-	    PJ_LOG(4,(alloc->obj_name, "Client %s: discarded data from %s "
-		      "because it's too long (%d bytes)",
-		      alloc->info, peer_addr, len));
-	    return;
-	}
+	pj_uint8_t *cd = (pj_uint8_t*)pkt - sizeof(pj_turn_channel_data);
 
 	/* Init header */
-	cd->ch_number = pj_htons(perm->channel);
-	cd->length = pj_htons((pj_uint16_t)len);
-
-	/* Copy data */
-	pj_memcpy(rel->tp.tx_pkt+sizeof(pj_turn_channel_data), pkt, len);
+	putval16(cd, perm->channel);
+	putval16(cd+2, (pj_uint16_t)len);
 
 	/* Send to client */
-	alloc->transport->sendto(alloc->transport, rel->tp.tx_pkt,
+	alloc->transport->sendto(alloc->transport, cd,
 			         len+sizeof(pj_turn_channel_data), 0,
 			         &alloc->hkey.clt_addr,
 			         pj_sockaddr_get_len(&alloc->hkey.clt_addr));
     } else {
 	/* Send Data Indication */
-	pj_stun_tx_data *tdata;
-	pj_status_t status;
-
-	status = pj_stun_session_create_ind(alloc->sess, 
-					    PJ_STUN_DATA_INDICATION, &tdata);
-	if (status != PJ_SUCCESS) {
-	    alloc_err(alloc, "Error creating Data indication", status);
-	    return;
-	}
+	pj_uint8_t *ind, *attr;
+	unsigned addr_len, hdr_len, pad, i;
+
+	addr_len = pj_sockaddr_get_addr_len(src_addr);
+	hdr_len = sizeof(pj_stun_msg_hdr) + 8 + addr_len + 4;
+	pad = (4 - (len & 0x03)) & 0x03;
+	ind = (pj_uint8_t*)pkt - hdr_len;
+
+	pj_assert(hdr_len <= PJ_TURN_RELAY_HDR_ROOM);
+
+	/* Next transaction ID */
+	for (i=11; i>=8 && ++rel->tp.ind_tsx_id[i]==0; --i)
+	    ;
+
+	/* STUN header */
+	putval16(ind, PJ_STUN_DATA_INDICATION);
+	putval16(ind+2, (pj_uint16_t)(hdr_len - sizeof(pj_stun_msg_hdr) +
+				     len + pad));
+	putval16(ind+4, (pj_uint16_t)(PJ_STUN_MAGIC >> 16));
+	putval16(ind+6, (pj_uint16_t)(PJ_STUN_MAGIC & 0xFFFF));
+	pj_memcpy(ind+8, rel->tp.ind_tsx_id, sizeof(rel->tp.ind_tsx_id));
+
+	/* XOR-PEER-ADDRESS, the address is XOR'ed with the magic cookie
+	 * (and the transaction ID for IPv6), which are at ind+4.
+	 */
+	attr = ind + sizeof(pj_stun_msg_hdr);
+	putval16(attr, PJ_STUN_ATTR_XOR_PEER_ADDR);
+	putval16(attr+2, (pj_uint16_t)(4 + addr_len));
+	attr[4] = 0;
+	attr[5] = (pj_uint8_t)(addr_len == 4 ? 1 : 2);
+	putval16(attr+6, (pj_uint16_t)(pj_sockaddr_get_port(src_addr) ^ 
+				       (PJ_STUN_MAGIC >> 16)));
+	pj_memcpy(attr+8, pj_sockaddr_get_addr(src_addr), addr_len);
+	for (i=0; i<addr_len; ++i)
+	    attr[8+i] ^= ind[4+i];
+
+	/* DATA attribute header, the payload is already in place */
+	attr += 8 + addr_len;
+	putval16(attr, PJ_STUN_ATTR_DATA);
+	putval16(attr+2, (pj_uint16_t)len);
+	pj_bzero(pkt+len, pad);
 
-	pj_stun_msg_add_sockaddr_attr(tdata->pool, tdata->msg, 
-				      PJ_STUN_ATTR_XOR_PEER_ADDR, PJ_TRUE,
-				      src_addr, pj_sockaddr_get_len(src_addr));
-	pj_stun_msg_add_binary_attr(tdata->pool, tdata->msg,
-				    PJ_STUN_ATTR_DATA, 
-				    (const pj_uint8_t*)pkt, len);
-
-	pj_stun_session_send_msg(alloc->sess, NULL, PJ_FALSE, 
-				 PJ_FALSE, &alloc->hkey.clt_addr, 
-				 pj_sockaddr_get_len(&alloc->hkey.clt_addr), 
-				 tdata);
+	/* Send to client */
+	alloc->transport->sendto(alloc->transport, ind, hdr_len+len+pad, 0,
+			         &alloc->hkey.clt_addr,
+			         pj_sockaddr_get_len(&alloc->hkey.clt_addr));
     }
 }
 
@@ -1083,19 +1244,27 @@ static void on_rx_from_peer(pj_ioqueue_key_t *key,
     rel = (pj_turn_relay_res*) pj_ioqueue_get_user_data(key);
 
     /* Lock the allocation */
-    pj_lock_acquire(rel->allocation->lock);
+    pj_grp_lock_acquire(rel->allocation->grp_lock);
+
+    /* Relay has been destroyed */
+    if (rel->tp.key == NULL) {
+	pj_grp_lock_release(rel->allocation->grp_lock);
+	return;
+    }
 
     do {
 	if (bytes_read > 0) {
-	    handle_peer_pkt(rel->allocation, rel, rel->tp.rx_pkt,
+	    handle_peer_pkt(rel->allocation, rel,
+			    rel->tp.rx_pkt + PJ_TURN_RELAY_HDR_ROOM,
 			    bytes_read, &rel->tp.src_addr);
 	}
 
-	/* Read next packet */
-	bytes_read = sizeof(rel->tp.rx_pkt);
+	/* Read next packet, leaving room for the header in front */
+	bytes_read = PJ_TURN_MAX_PKT_LEN;
 	rel->tp.src_addr_len = sizeof(rel->tp.src_addr);
 	status = pj_ioqueue_recvfrom(key, op_key,
-				     rel->tp.rx_pkt, &bytes_read, 0,
+				     rel->tp.rx_pkt + PJ_TURN_RELAY_HDR_ROOM,
+				     &bytes_read, 0,
 				     &rel->tp.src_addr, 
 				     &rel->tp.src_addr_len);
 
@@ -1105,7 +1274,7 @@ static void on_rx_from_peer(pj_ioqueue_key_t *key,
     } while (status != PJ_EPENDING && status != PJ_ECANCELLED);
 
     /* Release allocation lock */
-    pj_lock_release(rel->allocation->lock);
+    pj_grp_lock_release(rel->allocation->grp_lock);
 }
 
 /*
@@ -1219,6 +1388,7 @@ static pj_status_t stun_on_rx_request(pj_stun_session *sess,
 	pj_stun_channel_number_attr *ch_attr;
 	pj_stun_xor_peer_addr_attr *peer_attr;
 	pj_turn_permission *p1, *p2;
+	pj_time_val now;
 
 	ch_attr = (pj_stun_channel_number_attr*)
 		  pj_stun_msg_find_attr(msg, PJ_STUN_ATTR_CHANNEL_NUMBER, 0);
@@ -1232,7 +1402,9 @@ static pj_status_t stun_on_rx_request(pj_stun_session *sess,
 	}
 
 	/* Find permission with the channel number */
-	p1 = lookup_permission_by_chnum(alloc, PJ_STUN_GET_CH_NB(ch_attr->value));
+	pj_gettimeofday(&now);
+	p1 = lookup_permission_by_chnum(alloc, PJ_STUN_GET_CH_NB(ch_attr->value),
+					&now);
 
 	/* If permission is found, this is supposed to be a channel bind 
 	 * refresh. Make sure it's for the same peer.
@@ -1247,7 +1419,7 @@ static pj_status_t stun_on_rx_request(pj_stun_session *sess,
 	    }
 
 	    /* Refresh permission */
-	    refresh_permission(p1);
+	    refresh_permission(p1, &now);
 
 	    /* Send response */
 	    send_reply_ok(alloc, rdata);
@@ -1260,7 +1432,8 @@ static pj_status_t stun_on_rx_request(pj_stun_session *sess,
 	 * has not alreadyy assigned with a channel number.
 	 */
 	p2 = lookup_permission_by_addr(alloc, &peer_attr->sockaddr,
-				       pj_sockaddr_get_len(&peer_attr->sockaddr));
+				       pj_sockaddr_get_len(&peer_attr->sockaddr),
+				       &now);
 	if (p2 && p2->channel != PJ_TURN_INVALID_CHANNEL) {
 	    send_reply_err(alloc, rdata, PJ_TRUE, PJ_STUN_SC_BAD_REQUEST, 
 			   "Peer address already assigned a channel number");
@@ -1284,7 +1457,7 @@ static pj_status_t stun_on_rx_request(pj_stun_session *sess,
 		    sizeof(p2->channel), 0, p2);
 
 	/* Update */
-	refresh_permission(p2);
+	refresh_permission(p2, &now);
 
 	/* Reply */
 	send_reply_ok(alloc, rdata);
@@ -1324,6 +1497,7 @@ static pj_status_t stun_on_rx_indication(pj_stun_session *sess,
     pj_stun_data_attr *data_attr;
     pj_turn_allocation *alloc;
     pj_turn_permission *perm;
+    pj_time_val now;
     pj_ssize_t len;
 
     PJ_UNUSED_ARG(pkt);
@@ -1353,13 +1527,15 @@ static pj_status_t stun_on_rx_indication(pj_stun_session *sess,
 		pj_stun_msg_find_attr(msg, PJ_STUN_ATTR_DATA, 0);
 
     /* Create/update/refresh the permission */
+    pj_gettimeofday(&now);
     perm = lookup_permission_by_addr(alloc, &peer_attr->sockaddr,
-				     pj_sockaddr_get_len(&peer_attr->sockaddr));
+				     pj_sockaddr_get_len(&peer_attr->sockaddr),
+				     &now);
     if (perm == NULL) {
 	perm = create_permission(alloc, &peer_attr->sockaddr,
 				 pj_sockaddr_get_len(&peer_attr->sockaddr));
     }
-    refresh_permission(perm);
+    refresh_permission(perm, &now);
 
     /* Return if we don't have data */
     if (data_attr == NULL)
@@ -40,9 +40,8 @@ int err(const char *title, pj_status_t status)
 static void dump_status(pj_turn_srv *srv)
 {
     char addr[80];
-    pj_hash_iterator_t itbuf, *it;
     pj_time_val now;
-    unsigned i;
+    unsigned i, j, cnt;
 
     for (i=0; i<srv->core.lis_cnt; ++i) {
 	pj_turn_listener *lis = srv->core.listener[i];
@@ -56,11 +55,13 @@ static void dump_status(pj_turn_srv *srv)
 	   srv->ports.min_udp, srv->ports.max_udp);
     printf("TCP port range : %u %u %u (next/min/max)\n", srv->ports.next_tcp,
 	   srv->ports.min_tcp, srv->ports.max_tcp);
-    printf("Clients #      : %u\n", pj_hash_count(srv->tables.alloc));
+    cnt = (unsigned)pj_atomic_get(srv->tables.alloc_cnt);
+    printf("Clients #      : %u (max %u, %u table shards)\n", cnt,
+	   srv->tables.max_clients, srv->tables.shard_cnt);
 
     puts("");
 
-    if (pj_hash_count(srv->tables.alloc)==0) {
+    if (cnt==0) {
 	return;
     }
 
@@ -69,24 +70,34 @@ static void dump_status(pj_turn_srv *srv)
 
     pj_gettimeofday(&now);
 
-    it = pj_hash_first(srv->tables.alloc, &itbuf);
     i=1;
-    while (it) {
-	pj_turn_allocation *alloc = (pj_turn_allocation*) 
-				    pj_hash_this(srv->tables.alloc, it);
-	printf("%-3d %-22s %-22s %-8.*s %-4d %-4ld %-4d %-4d\n",
-	       i,
-	       alloc->info,
-	       pj_sockaddr_print(&alloc->relay.hkey.addr, addr, sizeof(addr), 3),
-	       (int)alloc->cred.data.static_cred.username.slen,
-	       alloc->cred.data.static_cred.username.ptr,
-	       alloc->relay.lifetime,
-	       alloc->relay.expiry.sec - now.sec,
-	       pj_hash_count(alloc->peer_table), 
-	       pj_hash_count(alloc->ch_table));
-
-	it = pj_hash_next(srv->tables.alloc, it);
-	++i;
+    for (j=0; j<srv->tables.shard_cnt; ++j) {
+	pj_turn_srv_shard *shard = &srv->tables.shard[j];
+	pj_hash_iterator_t itbuf, *it;
+
+	pj_lock_acquire(shard->lock);
+
+	it = pj_hash_first(shard->alloc, &itbuf);
+	while (it) {
+	    pj_turn_allocation *alloc = (pj_turn_allocation*) 
+					pj_hash_this(shard->alloc, it);
+	    printf("%-3d %-22s %-22s %-8.*s %-4d %-4ld %-4d %-4d\n",
+		   i,
+		   alloc->info,
+		   pj_sockaddr_print(&alloc->relay.hkey.addr, addr, 
+				     sizeof(addr), 3),
+		   (int)alloc->cred.data.static_cred.username.slen,
+		   alloc->cred.data.static_cred.username.ptr,
+		   alloc->relay.lifetime,
+		   alloc->relay.expiry.sec - now.sec,
+		   pj_hash_count(alloc->peer_table), 
+		   pj_hash_count(alloc->ch_table));
+
+	    it = pj_hash_next(shard->alloc, it);
+	    ++i;
+	}
+
+	pj_lock_release(shard->lock);
     }
 }
 
@@ -139,7 +150,7 @@ int main()
 
     pj_turn_auth_init(REALM);
 
-    status = pj_turn_srv_create(&g_cp.factory, &srv);
+    status = pj_turn_srv_create(&g_cp.factory, NULL, &srv);
     if (status != PJ_SUCCESS)
 	return err("Error creating server", status);
 
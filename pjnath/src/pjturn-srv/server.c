@@ -20,7 +20,9 @@
 #include "turn.h"
 #include "auth.h"
 
-#define MAX_CLIENTS		32
+#define DEF_MAX_CLIENTS		1024
+#define DEF_SHARDS		16
+#define MAX_SHARDS		256
 #define MAX_PEERS_PER_CLIENT	8
 //#define MAX_HANDLES		(MAX_CLIENTS*MAX_PEERS_PER_CLIENT+MAX_LISTENERS)
 #define MAX_HANDLES		PJ_IOQUEUE_MAX_HANDLES
@@ -28,7 +30,7 @@
 #define MIN_PORT		49152
 #define MAX_PORT		65535
 #define MAX_LISTENERS		16
-#define MAX_THREADS		2
+#define DEF_THREADS		2
 #define MAX_NET_EVENTS		1000
 
 /* Prototypes */
@@ -73,20 +75,54 @@ PJ_DEF(const char*) pj_turn_tp_type_name(int tp_type)
     }
 }
 
+/*
+ * Initialize server settings with default values.
+ */
+PJ_DEF(void) pj_turn_srv_cfg_default(pj_turn_srv_cfg *cfg)
+{
+    pj_bzero(cfg, sizeof(*cfg));
+    cfg->max_clients = DEF_MAX_CLIENTS;
+    cfg->shard_cnt = DEF_SHARDS;
+    cfg->thread_cnt = DEF_THREADS;
+}
+
+/*
+ * Get the shard for the specified hash table key, and calculate the hash
+ * value of the key. The upper bits of the hash value select the shard, 
+ * as the lower bits select the bucket inside the shard's hash tables.
+ */
+static pj_turn_srv_shard *get_shard(pj_turn_srv *srv,
+				    const void *key, unsigned keylen,
+				    pj_uint32_t *hval)
+{
+    *hval = pj_hash_calc(0, key, keylen);
+    return &srv->tables.shard[(*hval >> 16) & (srv->tables.shard_cnt - 1)];
+}
+
 /*
  * Create server.
  */
 PJ_DEF(pj_status_t) pj_turn_srv_create(pj_pool_factory *pf, 
+				       const pj_turn_srv_cfg *cfg,
 				       pj_turn_srv **p_srv)
 {
     pj_pool_t *pool;
     pj_stun_session_cb sess_cb;
+    pj_turn_srv_cfg default_cfg;
     pj_turn_srv *srv;
-    unsigned i;
+    unsigned i, bucket_cnt;
     pj_status_t status;
 
     PJ_ASSERT_RETURN(pf && p_srv, PJ_EINVAL);
 
+    if (cfg == NULL) {
+	pj_turn_srv_cfg_default(&default_cfg);
+	cfg = &default_cfg;
+    }
+    PJ_ASSERT_RETURN(cfg->max_clients && cfg->shard_cnt &&
+		     cfg->shard_cnt <= MAX_SHARDS && cfg->thread_cnt,
+		     PJ_EINVAL);
+
     /* Create server and init core settings */
     pool = pj_pool_create(pf, "srv%p", 1000, 1000, NULL);
     srv = PJ_POOL_ZALLOC_T(pool, pj_turn_srv);
@@ -128,9 +164,34 @@ PJ_DEF(pj_status_t) pj_turn_srv_create(pj_pool_factory *pf,
 			 pj_pool_calloc(pool, MAX_LISTENERS, 
 					sizeof(srv->core.listener[0]));
 
-    /* Create hash tables */
-    srv->tables.alloc = pj_hash_create(pool, MAX_CLIENTS);
-    srv->tables.res = pj_hash_create(pool, MAX_CLIENTS);
+    /* Create the sharded hash tables */
+    srv->tables.max_clients = cfg->max_clients;
+    status = pj_atomic_create(pool, 0, &srv->tables.alloc_cnt);
+    if (status != PJ_SUCCESS)
+	goto on_error;
+
+    srv->tables.shard_cnt = 1;
+    while (srv->tables.shard_cnt < cfg->shard_cnt)
+	srv->tables.shard_cnt <<= 1;
+
+    bucket_cnt = cfg->max_clients / srv->tables.shard_cnt;
+    if (bucket_cnt < 8)
+	bucket_cnt = 8;
+
+    srv->tables.shard = (pj_turn_srv_shard*)
+			pj_pool_calloc(pool, srv->tables.shard_cnt,
+				       sizeof(pj_turn_srv_shard));
+    for (i=0; i<srv->tables.shard_cnt; ++i) {
+	pj_turn_srv_shard *shard = &srv->tables.shard[i];
+
+	status = pj_lock_create_simple_mutex(pool, srv->obj_name, 
+					     &shard->lock);
+	if (status != PJ_SUCCESS)
+	    goto on_error;
+
+	shard->alloc = pj_hash_create(pool, bucket_cnt);
+	shard->res = pj_hash_create(pool, bucket_cnt);
+    }
 
     /* Init ports settings */
     srv->ports.min_udp = srv->ports.next_udp = MIN_PORT;
@@ -167,7 +228,7 @@ PJ_DEF(pj_status_t) pj_turn_srv_create(pj_pool_factory *pf,
 
 
     /* Array of worker threads */
-    srv->core.thread_cnt = MAX_THREADS;
+    srv->core.thread_cnt = cfg->thread_cnt;
     srv->core.thread = (pj_thread_t**)
 		       pj_pool_calloc(pool, srv->core.thread_cnt, 
 				      sizeof(pj_thread_t*));
@@ -181,8 +242,10 @@ PJ_DEF(pj_status_t) pj_turn_srv_create(pj_pool_factory *pf,
     }
 
     /* We're done. Application should add listeners now */
-    PJ_LOG(4,(srv->obj_name, "TURN server v%s is running", 
-	      pj_get_version()));
+    PJ_LOG(4,(srv->obj_name, "TURN server v%s is running (max %u clients, "
+	      "%u table shards, %u threads)", pj_get_version(),
+	      srv->tables.max_clients, srv->tables.shard_cnt,
+	      srv->core.thread_cnt));
 
     *p_srv = srv;
     return PJ_SUCCESS;
@@ -268,7 +331,6 @@ static int server_thread_proc(void *arg)
  */
 PJ_DEF(pj_status_t) pj_turn_srv_destroy(pj_turn_srv *srv)
 {
-    pj_hash_iterator_t itbuf, *it;
     unsigned i;
 
     /* Stop all worker threads */
@@ -281,13 +343,22 @@ PJ_DEF(pj_status_t) pj_turn_srv_destroy(pj_turn_srv *srv)
 	}
     }
 
-    /* Destroy all allocations FIRST */
-    if (srv->tables.alloc) {
-	it = pj_hash_first(srv->tables.alloc, &itbuf);
+    /* Destroy all allocations FIRST. The worker threads have stopped,
+     * so the shards don't need to be locked here, and destroying the
+     * allocation will lock the shard to unregister itself anyway.
+     */
+    for (i=0; srv->tables.shard && i<srv->tables.shard_cnt; ++i) {
+	pj_turn_srv_shard *shard = &srv->tables.shard[i];
+	pj_hash_iterator_t itbuf, *it;
+
+	if (!shard->alloc)
+	    continue;
+
+	it = pj_hash_first(shard->alloc, &itbuf);
 	while (it != NULL) {
 	    pj_turn_allocation *alloc = (pj_turn_allocation*)
-					pj_hash_this(srv->tables.alloc, it);
-	    pj_hash_iterator_t *next = pj_hash_next(srv->tables.alloc, it);
+					pj_hash_this(shard->alloc, it);
+	    pj_hash_iterator_t *next = pj_hash_next(shard->alloc, it);
 	    pj_turn_allocation_destroy(alloc);
 	    it = next;
 	}
@@ -308,9 +379,21 @@ PJ_DEF(pj_status_t) pj_turn_srv_destroy(pj_turn_srv *srv)
     }
 
     /* Destroy hash tables (well, sort of) */
-    if (srv->tables.alloc) {
-	srv->tables.alloc = NULL;
-	srv->tables.res = NULL;
+    for (i=0; srv->tables.shard && i<srv->tables.shard_cnt; ++i) {
+	pj_turn_srv_shard *shard = &srv->tables.shard[i];
+
+	if (shard->lock) {
+	    pj_lock_destroy(shard->lock);
+	    shard->lock = NULL;
+	}
+	shard->alloc = NULL;
+	shard->res = NULL;
+    }
+    srv->tables.shard = NULL;
+
+    if (srv->tables.alloc_cnt) {
+	pj_atomic_destroy(srv->tables.alloc_cnt);
+	srv->tables.alloc_cnt = NULL;
     }
     
     /* Destroy timer heap */
@@ -429,14 +512,31 @@ PJ_DEF(void) pj_turn_transport_dec_ref( pj_turn_transport *transport,
 PJ_DEF(pj_status_t) pj_turn_srv_register_allocation(pj_turn_srv *srv,
 						    pj_turn_allocation *alloc)
 {
+    pj_turn_srv_shard *shard;
+    pj_uint32_t hval;
+
+    /* Check capacity */
+    if ((unsigned)pj_atomic_inc_and_get(srv->tables.alloc_cnt) >
+	srv->tables.max_clients)
+    {
+	pj_atomic_dec(srv->tables.alloc_cnt);
+	return PJ_ETOOMANY;
+    }
+
     /* Add to hash tables */
-    pj_lock_acquire(srv->core.lock);
-    pj_hash_set(alloc->pool, srv->tables.alloc,
-		&alloc->hkey, sizeof(alloc->hkey), 0, alloc);
-    pj_hash_set(alloc->pool, srv->tables.res,
-		&alloc->relay.hkey, sizeof(alloc->relay.hkey), 0,
+    shard = get_shard(srv, &alloc->hkey, sizeof(alloc->hkey), &hval);
+    pj_lock_acquire(shard->lock);
+    pj_hash_set(alloc->pool, shard->alloc,
+		&alloc->hkey, sizeof(alloc->hkey), hval, alloc);
+    pj_lock_release(shard->lock);
+
+    shard = get_shard(srv, &alloc->relay.hkey, sizeof(alloc->relay.hkey),
+		      &hval);
+    pj_lock_acquire(shard->lock);
+    pj_hash_set(alloc->pool, shard->res,
+		&alloc->relay.hkey, sizeof(alloc->relay.hkey), hval,
 		&alloc->relay);
-    pj_lock_release(srv->core.lock);
+    pj_lock_release(shard->lock);
 
     return PJ_SUCCESS;
 }
@@ -448,18 +548,59 @@ PJ_DEF(pj_status_t) pj_turn_srv_register_allocation(pj_turn_srv *srv,
 PJ_DEF(pj_status_t) pj_turn_srv_unregister_allocation(pj_turn_srv *srv,
 						     pj_turn_allocation *alloc)
 {
+    pj_turn_srv_shard *shard;
+    pj_uint32_t hval;
+    pj_bool_t registered;
+
     /* Unregister from hash tables */
-    pj_lock_acquire(srv->core.lock);
-    pj_hash_set(alloc->pool, srv->tables.alloc,
-		&alloc->hkey, sizeof(alloc->hkey), 0, NULL);
-    pj_hash_set(alloc->pool, srv->tables.res,
-		&alloc->relay.hkey, sizeof(alloc->relay.hkey), 0, NULL);
-    pj_lock_release(srv->core.lock);
+    shard = get_shard(srv, &alloc->hkey, sizeof(alloc->hkey), &hval);
+    pj_lock_acquire(shard->lock);
+    registered = (pj_hash_get(shard->alloc, &alloc->hkey, sizeof(alloc->hkey),
+			      &hval) == alloc);
+    if (registered) {
+	pj_hash_set(NULL, shard->alloc,
+		    &alloc->hkey, sizeof(alloc->hkey), hval, NULL);
+    }
+    pj_lock_release(shard->lock);
+
+    if (!registered)
+	return PJ_ENOTFOUND;
+
+    shard = get_shard(srv, &alloc->relay.hkey, sizeof(alloc->relay.hkey),
+		      &hval);
+    pj_lock_acquire(shard->lock);
+    pj_hash_set(NULL, shard->res,
+		&alloc->relay.hkey, sizeof(alloc->relay.hkey), hval, NULL);
+    pj_lock_release(shard->lock);
+
+    pj_atomic_dec(srv->tables.alloc_cnt);
 
     return PJ_SUCCESS;
 }
 
 
+/*
+ * Find an allocation and add reference to it.
+ */
+PJ_DEF(pj_turn_allocation*) pj_turn_srv_find_allocation(pj_turn_srv *srv,
+					    const pj_turn_allocation_key *key)
+{
+    pj_turn_srv_shard *shard;
+    pj_turn_allocation *alloc;
+    pj_uint32_t hval;
+
+    shard = get_shard(srv, key, sizeof(*key), &hval);
+    pj_lock_acquire(shard->lock);
+    alloc = (pj_turn_allocation*)
+	    pj_hash_get(shard->alloc, key, sizeof(*key), &hval);
+    if (alloc)
+	pj_grp_lock_add_ref(alloc->grp_lock);
+    pj_lock_release(shard->lock);
+
+    return alloc;
+}
+
+
 /* Callback from our own STUN session whenever it needs to send 
  * outgoing STUN packet.
  */
@@ -603,17 +744,18 @@ PJ_DEF(void) pj_turn_srv_on_rx_pkt(pj_turn_srv *srv,
 {
     pj_turn_allocation *alloc;
 
-    /* Get TURN allocation from the source address */
-    pj_lock_acquire(srv->core.lock);
-    alloc = (pj_turn_allocation*)
-	    pj_hash_get(srv->tables.alloc, &pkt->src, sizeof(pkt->src), NULL);
-    pj_lock_release(srv->core.lock);
+    /* Get TURN allocation from the source address. Only the shard of
+     * the address is locked, and the reference keeps the allocation
+     * alive while the packet is being handled.
+     */
+    alloc = pj_turn_srv_find_allocation(srv, &pkt->src);
 
     /* If allocation is found, just hand over the packet to the
      * allocation.
      */
     if (alloc) {
 	pj_turn_allocation_on_rx_client_pkt(alloc, pkt);
+	pj_grp_lock_dec_ref(alloc->grp_lock);
     } else {
 	/* Otherwise this is a new client */
 	unsigned options;
@@ -34,6 +34,13 @@ typedef struct pj_turn_pkt	    pj_turn_pkt;
 
 #define PJ_TURN_INVALID_LIS_ID	    ((unsigned)-1)
 
+/**
+ * Room reserved in front of the relay receive buffer. This is large
+ * enough for the STUN header, an IPv6 XOR-PEER-ADDRESS attribute and
+ * the DATA attribute header of a Data indication.
+ */
+#define PJ_TURN_RELAY_HDR_ROOM	    (20 + 24 + 4)
+
 /** 
  * Get transport type name string.
  */
@@ -83,8 +90,13 @@ struct pj_turn_relay_res
 	/** Read operation key. */
 	pj_ioqueue_op_key_t read_key;
 
-	/** The incoming packet buffer */
-	char		    rx_pkt[PJ_TURN_MAX_PKT_LEN];
+	/** The incoming packet buffer. Packets from peers are received
+	 *  at offset PJ_TURN_RELAY_HDR_ROOM, so that the ChannelData or
+	 *  Data indication header can be built in front of the payload
+	 *  without copying it. The last four bytes hold the padding of
+	 *  the DATA attribute.
+	 */
+	char		    rx_pkt[PJ_TURN_RELAY_HDR_ROOM+PJ_TURN_MAX_PKT_LEN+4];
 
 	/** Source address of the packet. */
 	pj_sockaddr	    src_addr;
@@ -92,8 +104,10 @@ struct pj_turn_relay_res
 	/** Source address length */
 	int		    src_addr_len;
 
-	/** The outgoing packet buffer. This must be 3wbit aligned. */
-	char		    tx_pkt[PJ_TURN_MAX_PKT_LEN+4];
+	/** Transaction ID of outgoing Data indications. The first eight
+	 *  bytes are random, the last four are a running counter.
+	 */
+	pj_uint8_t	    ind_tsx_id[12];
     } tp;
 };
 
@@ -131,8 +145,10 @@ struct pj_turn_allocation
     /** Client info (IP address and port) */
     char		info[80];
 
-    /** Mutex */
-    pj_lock_t		*lock;
+    /** Group lock, also keeps the allocation alive while it is being
+     *  used by the packet path after it has been unregistered.
+     */
+    pj_grp_lock_t	*grp_lock;
 
     /** Server instance. */
     pj_turn_srv		*server;
@@ -374,6 +390,46 @@ PJ_DECL(void) pj_turn_transport_dec_ref(pj_turn_transport *transport,
 /*
  * TURN Server API
  */
+/**
+ * TURN server settings, see #pj_turn_srv_create().
+ */
+typedef struct pj_turn_srv_cfg
+{
+    /** Maximum number of allocations. Default: 1024 */
+    unsigned	max_clients;
+
+    /** Number of allocation table shards, each with its own lock. This
+     *  will be rounded up to a power of two. Default: 16
+     */
+    unsigned	shard_cnt;
+
+    /** Number of worker threads. Default: 2 */
+    unsigned	thread_cnt;
+
+} pj_turn_srv_cfg;
+
+
+/**
+ * One shard of the server allocation tables.
+ */
+typedef struct pj_turn_srv_shard
+{
+    /** Mutex protecting the tables in this shard. */
+    pj_lock_t	    *lock;
+
+    /** Allocations hash table, indexed by transport type and
+     *  client address. 
+     */
+    pj_hash_table_t *alloc;
+
+    /** Relay resource hash table, indexed by transport type and
+     *  relay address. 
+     */
+    pj_hash_table_t *res;
+
+} pj_turn_srv_shard;
+
+
 /**
  * This structure describes TURN pj_turn_srv instance.
  */
@@ -431,15 +487,17 @@ struct pj_turn_srv
     
     /** Hash tables */
     struct {
-	/** Allocations hash table, indexed by transport type and
-	 *  client address. 
-	 */
-	pj_hash_table_t *alloc;
+	/** Maximum number of allocations. */
+	unsigned	  max_clients;
 
-	/** Relay resource hash table, indexed by transport type and
-	 *  relay address. 
-	 */
-	pj_hash_table_t *res;
+	/** Current number of allocations. */
+	pj_atomic_t	 *alloc_cnt;
+
+	/** Number of shards (power of two). */
+	unsigned	  shard_cnt;
+
+	/** Array of shards, selected by the hash value of the key. */
+	pj_turn_srv_shard *shard;
 
     } tables;
 
@@ -468,10 +526,16 @@ struct pj_turn_srv
 };
 
 
+/**
+ * Initialize server settings with default values.
+ */
+PJ_DECL(void) pj_turn_srv_cfg_default(pj_turn_srv_cfg *cfg);
+
 /** 
- * Create server.
+ * Create server. The settings are optional.
  */
 PJ_DECL(pj_status_t) pj_turn_srv_create(pj_pool_factory *pf,
+					const pj_turn_srv_cfg *cfg,
 				        pj_turn_srv **p_srv);
 
 /** 
@@ -497,6 +561,14 @@ PJ_DECL(pj_status_t) pj_turn_srv_register_allocation(pj_turn_srv *srv,
 PJ_DECL(pj_status_t) pj_turn_srv_unregister_allocation(pj_turn_srv *srv,
 						       pj_turn_allocation *alloc);
 
+/**
+ * Find an allocation by its key. If found, a reference is added to the
+ * allocation's group lock and the caller must release it with
+ * pj_grp_lock_dec_ref().
+ */
+PJ_DECL(pj_turn_allocation*) pj_turn_srv_find_allocation(pj_turn_srv *srv,
+					    const pj_turn_allocation_key *key);
+
 /**
  * This callback is called by UDP listener on incoming packet.
  */
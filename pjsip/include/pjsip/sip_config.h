@@ -128,6 +128,17 @@ typedef struct pjsip_cfg_t
 	 */
 	pj_bool_t req_has_via_alias;
 
+	/**
+	 * Maximum size of a SIP message that can be received on connection
+	 * oriented transports (TCP and TLS). Messages that do not fit in the
+	 * transport's read buffer are assembled in a separate buffer which
+	 * grows on demand up to this size; larger messages are discarded
+	 * with PJSIP_ERXOVERFLOW.
+	 *
+	 * Default is PJSIP_MAX_STREAM_MSG_LEN.
+	 */
+	unsigned max_stream_msg_len;
+
     } endpt;
 
     /** Transaction layer settings. */
@@ -288,6 +299,20 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #endif
 
 
+/**
+ * Maximum size of a SIP message that can be received on connection
+ * oriented transports (TCP and TLS). Unlike datagram transports, these
+ * are not limited by PJSIP_MAX_PKT_LEN. This is the default value of
+ * \a max_stream_msg_len setting in pjsip_cfg_t, so it can also be
+ * changed at run-time.
+ *
+ * Default: 65536 (bytes)
+ */
+#ifndef PJSIP_MAX_STREAM_MSG_LEN
+#   define PJSIP_MAX_STREAM_MSG_LEN	65536
+#endif
+
+
 /**
  * RFC 3261 section 18.1.1:
  * If a request is within 200 bytes of the path MTU, or if it is larger
@@ -609,6 +634,55 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #endif
 
 
+/**
+ * Maximum size of the buffer used to coalesce SIP messages that are queued
+ * on a TCP connection while a previous write is still in progress, so that
+ * they are written to the socket with a single send() call. Messages
+ * larger than this are sent from their own buffer. Set to zero to disable
+ * coalescing.
+ *
+ * Default: 16000 (bytes)
+ *
+ * @see PJSIP_TLS_TX_COALESCE_SIZE
+ */
+#ifndef PJSIP_TCP_TX_COALESCE_SIZE
+#   define PJSIP_TCP_TX_COALESCE_SIZE	    16000
+#endif
+
+
+/**
+ * Maximum number of bytes that may be queued for transmission on a TCP
+ * connection while a previous write is still in progress. Once the limit
+ * is reached, sending further messages on the connection fails with
+ * PJ_ETOOMANY until the queue drains, so that the sender gets backpressure
+ * instead of growing the queue without bound. Set to zero for no limit.
+ *
+ * Default: 0 (no limit)
+ *
+ * @see PJSIP_TLS_TX_QUEUE_MAX_SIZE
+ */
+#ifndef PJSIP_TCP_TX_QUEUE_MAX_SIZE
+#   define PJSIP_TCP_TX_QUEUE_MAX_SIZE	    0
+#endif
+
+
+/**
+ * Size of the receive buffer of each TCP connection. Incoming data is
+ * parsed in place in this buffer, and consumed data is only moved away
+ * once the free space at the end of the buffer runs low, so a larger
+ * buffer means fewer memmove() calls when messages are pipelined.
+ * Messages larger than this buffer are still accepted, up to
+ * \a max_stream_msg_len setting in pjsip_cfg_t.
+ *
+ * Default: (2 * PJSIP_MAX_PKT_LEN)
+ *
+ * @see PJSIP_TLS_RX_BUF_SIZE
+ */
+#ifndef PJSIP_TCP_RX_BUF_SIZE
+#   define PJSIP_TCP_RX_BUF_SIZE	    (2 * PJSIP_MAX_PKT_LEN)
+#endif
+
+
 /**
  * Set the interval to send keep-alive packet for TLS transports.
  * If the value is zero, keep-alive will be disabled for TLS.
@@ -632,6 +706,50 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #endif
 
 
+/**
+ * Maximum size of the buffer used to coalesce SIP messages that are queued
+ * on a TLS connection while a previous write is still in progress. The
+ * coalesced messages are passed to the TLS session with a single write,
+ * so they normally go out in one TLS record. Set to zero to disable
+ * coalescing.
+ *
+ * Default: 16000 (bytes, which fits in a single TLS record)
+ *
+ * @see PJSIP_TCP_TX_COALESCE_SIZE
+ */
+#ifndef PJSIP_TLS_TX_COALESCE_SIZE
+#   define PJSIP_TLS_TX_COALESCE_SIZE	    16000
+#endif
+
+
+/**
+ * Maximum number of bytes that may be queued for transmission on a TLS
+ * connection while a previous write is still in progress. Once the limit
+ * is reached, sending further messages on the connection fails with
+ * PJ_ETOOMANY until the queue drains. Set to zero for no limit.
+ *
+ * Default: 0 (no limit)
+ *
+ * @see PJSIP_TCP_TX_QUEUE_MAX_SIZE
+ */
+#ifndef PJSIP_TLS_TX_QUEUE_MAX_SIZE
+#   define PJSIP_TLS_TX_QUEUE_MAX_SIZE	    0
+#endif
+
+
+/**
+ * Size of the receive buffer of each TLS connection, which holds the
+ * decrypted data. See PJSIP_TCP_RX_BUF_SIZE for details.
+ *
+ * Default: (2 * PJSIP_MAX_PKT_LEN)
+ *
+ * @see PJSIP_TCP_RX_BUF_SIZE
+ */
+#ifndef PJSIP_TLS_RX_BUF_SIZE
+#   define PJSIP_TLS_RX_BUF_SIZE	    (2 * PJSIP_MAX_PKT_LEN)
+#endif
+
+
 /**
  * This macro specifies whether full DNS resolution should be used.
  * When enabled, #pjsip_resolve() will perform asynchronous DNS SRV and
@@ -671,6 +789,23 @@ PJ_INLINE(pjsip_cfg_t*) pjsip_cfg(void)
 #endif
 
 
+/**
+ * Specify whether #pjsip_resolve() should report the server addresses as
+ * soon as the most preferred DNS SRV target has been resolved, instead of
+ * waiting for the DNS A resolution of all SRV targets to complete. This
+ * shortens the request setup time when some targets are slow to resolve,
+ * at the expense of fewer addresses being available for fail-over in
+ * that transaction (the remaining answers still end up in the DNS cache).
+ *
+ * Default: 0 (wait for all targets)
+ *
+ * @see PJSIP_HAS_RESOLVER
+ */
+#ifndef PJSIP_RESOLVE_EARLY_RESULT
+#   define PJSIP_RESOLVE_EARLY_RESULT	    0
+#endif
+
+
 /**
  * Enable TLS SIP transport support. For most systems this means that
  * OpenSSL must be installed.
@@ -768,6 +768,31 @@ typedef enum pjsip_transport_dir
 } pjsip_transport_dir;
 
 
+/**
+ * Transmit queue statistic of a transport. Connection oriented transports
+ * (TCP and TLS) keep at most one write outstanding on the connection, and
+ * messages sent while that write is in progress are queued and written
+ * out together once it completes.
+ *
+ * @see pjsip_transport_get_tx_stat()
+ */
+typedef struct pjsip_transport_tx_stat
+{
+    unsigned	    queue_depth;    /**< Number of messages currently
+					 queued for transmission.	    */
+    pj_size_t	    queue_bytes;    /**< Number of bytes currently queued
+					 for transmission.		    */
+    unsigned	    max_queue_depth;/**< Highest queue depth seen.	    */
+    pj_uint32_t	    tx_msgs;	    /**< Number of messages written.	    */
+    pj_uint32_t	    tx_writes;	    /**< Number of writes issued to the
+					 socket (or TLS session). This is
+					 lower than tx_msgs when queued
+					 messages have been coalesced.	    */
+    pj_uint32_t	    rejected_msgs;  /**< Number of messages rejected
+					 because the queue was full.	    */
+} pjsip_transport_tx_stat;
+
+
 /**
  * This structure represent the "public" interface of a SIP transport.
  * Applications normally extend this structure to include transport
@@ -862,6 +887,19 @@ struct pjsip_transport
      */
     pj_status_t (*destroy)(pjsip_transport *transport);
 
+    /**
+     * Optional function to get the transmit queue statistic of the
+     * transport. Application should use #pjsip_transport_get_tx_stat()
+     * instead.
+     *
+     * @param transport	    The transport.
+     * @param stat	    Structure to receive the statistic.
+     *
+     * @return		    PJ_SUCCESS on success.
+     */
+    pj_status_t (*get_tx_stat)(pjsip_transport *transport,
+			       pjsip_transport_tx_stat *stat);
+
     /*
      * Application may extend this structure..
      */
@@ -936,6 +974,19 @@ PJ_DECL(pj_status_t) pjsip_transport_add_ref( pjsip_transport *tp );
  */
 PJ_DECL(pj_status_t) pjsip_transport_dec_ref( pjsip_transport *tp );
 
+/**
+ * Get the transmit queue statistic of the specified transport.
+ *
+ * @param tp		The transport instance.
+ * @param stat		Structure to receive the statistic.
+ *
+ * @return		PJ_SUCCESS on success, or PJ_ENOTSUP if the
+ *			transport does not maintain transmit queue
+ *			statistic (e.g. UDP).
+ */
+PJ_DECL(pj_status_t) pjsip_transport_get_tx_stat(pjsip_transport *tp,
+						 pjsip_transport_tx_stat *stat);
+
 
 /**
  * This function is called by transport instances to report an incoming 
@@ -961,6 +1012,40 @@ PJ_DECL(pj_ssize_t) pjsip_tpmgr_receive_packet(pjsip_tpmgr *mgr,
 					       pjsip_rx_data *rdata);
 
 
+/**
+ * This function is called by stream oriented transports (e.g. TCP, TLS)
+ * that keep the received data in their own buffer rather than in
+ * \a pkt_info.packet member of the rdata, e.g. to avoid copying the
+ * data or to receive messages larger than PJSIP_MAX_PKT_LEN. The
+ * messages are parsed in place and \a msg_info.msg_buf of the rdata will
+ * point inside \a buf, hence the buffer must remain valid until the
+ * message has been processed. Other than that, the function behaves
+ * like #pjsip_tpmgr_receive_packet().
+ *
+ * @param mgr		The transport manager instance.
+ * @param rdata		The receive data buffer. The transport MUST fully
+ *			initialize tp_info and pkt_info member of the rdata,
+ *			except the packet and its length.
+ * @param buf		The buffer containing the received data. The buffer
+ *			MUST have room for one more byte after \a len bytes
+ *			for NULL termination.
+ * @param len		The length of the received data.
+ * @param max_len	Maximum size of a message. If the data does not
+ *			contain a complete message and \a len has reached
+ *			this value, the data will be discarded and reported
+ *			with PJSIP_ERXOVERFLOW status.
+ *
+ * @return		The number of bytes successfully processed from the
+ *			buffer. The transport MUST keep the remainder part
+ *			and report it again once more data is received.
+ */
+PJ_DECL(pj_ssize_t) pjsip_tpmgr_receive_stream(pjsip_tpmgr *mgr,
+					       pjsip_rx_data *rdata,
+					       char *buf,
+					       pj_size_t len,
+					       pj_size_t max_len);
+
+
 /*****************************************************************************
  *
  * TRANSPORT FACTORY
@@ -205,6 +205,15 @@ typedef struct pjsip_tls_setting
      */
     pj_bool_t qos_ignore_error;
 
+    /**
+     * Specify whether encryption of sent messages should be offloaded to
+     * the kernel (kTLS) when supported, see \a ktls field of
+     * #pj_ssl_sock_param.
+     *
+     * Default: PJ_FALSE
+     */
+    pj_bool_t ktls;
+
 } pjsip_tls_setting;
 
 
@@ -5723,6 +5723,28 @@ struct pjsua_media_config
      * Default: PJ_FALSE
      */
     pj_bool_t no_rtcp_sdes_bye;
+
+    /**
+     * Additional options (bitmask of pjmedia_clock_options) for the media
+     * clock which drives the conference bridge when the null sound device
+     * is used (see #pjsua_set_null_snd_dev()), for example
+     * PJMEDIA_CLOCK_HIGH_RES and PJMEDIA_CLOCK_REALTIME_PRIO.
+     *
+     * Default: 0
+     */
+    unsigned null_snd_clock_options;
+
+    /**
+     * The CPU to pin the media clock thread of the null sound device to,
+     * or -1 to not pin the thread. See #pjmedia_clock_set_cpu(). This only
+     * applies when the clock has a thread of its own, i.e. when
+     * \a null_snd_clock_options contains PJMEDIA_CLOCK_HIGH_RES or
+     * PJMEDIA_CLOCK_REALTIME_PRIO, or when PJMEDIA_MASTER_PORT_SHARED_CLOCK
+     * is disabled.
+     *
+     * Default: -1
+     */
+    int null_snd_clock_cpu;
 };
 
 
@@ -796,6 +796,7 @@ void print_call(const char *title,
 pj_status_t pjsua_aud_subsys_init(void);
 pj_status_t pjsua_aud_subsys_start(void);
 pj_status_t pjsua_aud_subsys_destroy(void);
+void pjsua_aud_dump(void);
 void pjsua_aud_stop_stream(pjsua_call_media *call_med);
 pj_status_t pjsua_aud_channel_update(pjsua_call_media *call_med,
                                      pj_pool_t *tmp_pool,
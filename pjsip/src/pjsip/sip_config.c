@@ -31,7 +31,8 @@ pjsip_cfg_t pjsip_sip_cfg_var =
        0,
        PJSIP_DONT_SWITCH_TO_TCP,
        PJSIP_FOLLOW_EARLY_MEDIA_FORK,
-       PJSIP_REQ_HAS_VIA_ALIAS
+       PJSIP_REQ_HAS_VIA_ALIAS,
+       PJSIP_MAX_STREAM_MSG_LEN
     },
 
     /* Transaction settings */
@@ -374,11 +374,16 @@ PJ_DEF(void) pjsip_resolve( pjsip_resolver_t *resolver,
 	       target->addr.port));
 
     if (query->query_type == PJ_DNS_TYPE_SRV) {
+	unsigned option = PJ_DNS_SRV_FALLBACK_A;
+
+#if PJSIP_RESOLVE_EARLY_RESULT
+	option |= PJ_DNS_SRV_RESOLVE_EARLY;
+#endif
 
 	status = pj_dns_srv_resolve(&query->naptr[0].name,
 				    &query->naptr[0].res_type,
 				    query->req.def_port, pool, resolver->res,
-				    PJ_TRUE, query, &srv_resolver_cb, NULL);
+				    option, query, &srv_resolver_cb, NULL);
 
     } else if (query->query_type == PJ_DNS_TYPE_A) {
 
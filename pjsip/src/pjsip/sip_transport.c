@@ -658,8 +658,14 @@ PJ_DEF(pj_status_t) pjsip_rx_data_clone( const pjsip_rx_data *src,
     /* pkt_info can be memcopied */
     pj_memcpy(&dst->pkt_info, &src->pkt_info, sizeof(src->pkt_info));
 
-    /* msg_info needs deep clone */
-    dst->msg_info.msg_buf = dst->pkt_info.packet;
+    /* msg_info needs deep clone. The message may not be located at the
+     * start of the packet buffer (or in it at all, for messages received
+     * by stream transports), so copy the message text itself.
+     */
+    dst->msg_info.msg_buf = (char*)pj_pool_alloc(pool, src->msg_info.len+1);
+    pj_memcpy(dst->msg_info.msg_buf, src->msg_info.msg_buf,
+	      src->msg_info.len);
+    dst->msg_info.msg_buf[src->msg_info.len] = '\0';
     dst->msg_info.len = src->msg_info.len;
     dst->msg_info.msg = pjsip_msg_clone(pool, src->msg_info.msg);
     pj_list_init(&dst->msg_info.parse_err);
@@ -1002,6 +1008,21 @@ PJ_DEF(pj_status_t) pjsip_transport_dec_ref( pjsip_transport *tp )
 }
 
 
+/*
+ * Get transmit queue statistic.
+ */
+PJ_DEF(pj_status_t) pjsip_transport_get_tx_stat(pjsip_transport *tp,
+						pjsip_transport_tx_stat *stat)
+{
+    PJ_ASSERT_RETURN(tp && stat, PJ_EINVAL);
+
+    if (tp->get_tx_stat == NULL)
+	return PJ_ENOTSUP;
+
+    return (*tp->get_tx_stat)(tp, stat);
+}
+
+
 /**
  * Register a transport.
  */
@@ -1568,12 +1589,16 @@ PJ_DEF(pj_status_t) pjsip_tpmgr_destroy( pjsip_tpmgr *mgr )
 
 
 /*
- * pjsip_tpmgr_receive_packet()
- *
- * Called by tranports when they receive a new packet.
+ * Parse and dispatch all SIP messages found in the buffer. Messages are
+ * parsed in place, the buffer must have room for one extra byte for the
+ * NULL termination. For stream transports, an incomplete message that
+ * has reached max_len bytes is reported as PJSIP_ERXOVERFLOW.
  */
-PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
-					       pjsip_rx_data *rdata)
+static pj_ssize_t tpmgr_receive_buf(pjsip_tpmgr *mgr,
+				    pjsip_rx_data *rdata,
+				    char *buf,
+				    pj_size_t len,
+				    pj_size_t max_len)
 {
     pjsip_transport *tr = rdata->tp_info.transport;
 
@@ -1581,13 +1606,8 @@ PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
     pj_size_t remaining_len;
     pj_size_t total_processed = 0;
 
-    /* Check size. */
-    pj_assert(rdata->pkt_info.len > 0);
-    if (rdata->pkt_info.len <= 0)
-	return -1;
-
-    current_pkt = rdata->pkt_info.packet;
-    remaining_len = rdata->pkt_info.len;
+    current_pkt = buf;
+    remaining_len = len;
     
     /* Must NULL terminate buffer. This is the requirement of the 
      * parser etc. 
@@ -1636,10 +1656,10 @@ PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
 	    msg_status = pjsip_find_msg(current_pkt, remaining_len, PJ_FALSE, 
                                         &msg_fragment_size);
 	    if (msg_status != PJ_SUCCESS) {
-		if (remaining_len == PJSIP_MAX_PKT_LEN) {
+		if (remaining_len >= max_len) {
 		    mgr->on_rx_msg(mgr->endpt, PJSIP_ERXOVERFLOW, rdata);
 		    /* Exhaust all data. */
-		    return rdata->pkt_info.len;
+		    return len;
 		} else {
 		    /* Not enough data in packet. */
 		    return total_processed;
@@ -1776,6 +1796,48 @@ finish_process_fragment:
 }
 
 
+/*
+ * pjsip_tpmgr_receive_packet()
+ *
+ * Called by tranports when they receive a new packet.
+ */
+PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_packet( pjsip_tpmgr *mgr,
+					       pjsip_rx_data *rdata)
+{
+    /* Check size. */
+    pj_assert(rdata->pkt_info.len > 0);
+    if (rdata->pkt_info.len <= 0)
+	return -1;
+
+    return tpmgr_receive_buf(mgr, rdata, rdata->pkt_info.packet,
+			     rdata->pkt_info.len, PJSIP_MAX_PKT_LEN);
+}
+
+
+/*
+ * pjsip_tpmgr_receive_stream()
+ *
+ * Called by stream transports to process data in their own buffer.
+ */
+PJ_DEF(pj_ssize_t) pjsip_tpmgr_receive_stream( pjsip_tpmgr *mgr,
+					       pjsip_rx_data *rdata,
+					       char *buf,
+					       pj_size_t len,
+					       pj_size_t max_len)
+{
+    PJ_ASSERT_RETURN(mgr && rdata && buf && max_len, -1);
+
+    /* Check size. */
+    pj_assert(len > 0);
+    if (len == 0)
+	return -1;
+
+    rdata->pkt_info.len = len;
+
+    return tpmgr_receive_buf(mgr, rdata, buf, len, max_len);
+}
+
+
 /*
  * pjsip_tpmgr_acquire_transport()
  *
@@ -2005,6 +2067,7 @@ PJ_DEF(void) pjsip_tpmgr_dump_transports(pjsip_tpmgr *mgr)
 	do {
 	    pjsip_transport *t = (pjsip_transport*) 
 	    			 pj_hash_this(mgr->table, itr);
+	    pjsip_transport_tx_stat tx_stat;
 
 	    PJ_LOG(3, (THIS_FILE, "  %s %s (refcnt=%d%s)", 
 		       t->obj_name,
@@ -2012,6 +2075,17 @@ PJ_DEF(void) pjsip_tpmgr_dump_transports(pjsip_tpmgr *mgr)
 		       pj_atomic_get(t->ref_cnt),
 		       (t->idle_timer.id ? " [idle]" : "")));
 
+	    if (pjsip_transport_get_tx_stat(t, &tx_stat) == PJ_SUCCESS) {
+		PJ_LOG(3, (THIS_FILE, "    tx queue=%u (%u bytes, max %u), "
+				      "msgs=%u, writes=%u, rejected=%u",
+			   tx_stat.queue_depth,
+			   (unsigned)tx_stat.queue_bytes,
+			   tx_stat.max_queue_depth,
+			   tx_stat.tx_msgs,
+			   tx_stat.tx_writes,
+			   tx_stat.rejected_msgs));
+	    }
+
 	    itr = pj_hash_next(mgr->table, itr);
 	} while (itr);
     }
@@ -68,7 +68,8 @@ struct tcp_listener
  * A delayed transmission occurs when application sends tx_data when
  * the TCP connect/establishment is still in progress. These delayed
  * transmission will be "flushed" once the socket is connected (either
- * successfully or with errors).
+ * successfully or with errors). The same structure is used to queue
+ * tx_data while another write is in progress on the socket.
  */
 struct delayed_tdata
 {
@@ -112,8 +113,33 @@ struct tcp_transport
      */
     pjsip_rx_data	     rdata;
 
+    /* Receive buffer. Incoming data is parsed in place, starting at
+     * rx_start, and unprocessed data is only moved to the front of the
+     * buffer when the free space at the end runs low. A message which
+     * doesn't fit in the receive buffer is assembled in rx_big instead,
+     * which grows on demand up to max_stream_msg_len setting.
+     */
+    char		    *rx_buf;
+    pj_size_t		     rx_start;
+    pj_pool_t		    *rx_big_pool;
+    char		    *rx_big;
+    pj_size_t		     rx_big_len;
+    pj_size_t		     rx_big_size;
+
     /* Pending transmission list. */
     struct delayed_tdata     delayed_list;
+
+    /* Transmit queue. Only one write is outstanding on the socket at any
+     * time (tx_busy). Messages sent in the mean time are put in tx_list,
+     * and written out once the current write completes, coalesced into
+     * tx_batch_buf when more than one message is waiting.
+     */
+    pj_bool_t		     tx_busy;
+    struct delayed_tdata     tx_list;
+    struct delayed_tdata     tx_batch;
+    pjsip_tx_data_op_key     tx_batch_op_key;
+    char		    *tx_batch_buf;
+    pjsip_transport_tx_stat  tx_stat;
 };
 
 
@@ -531,6 +557,9 @@ static pj_status_t tcp_destroy_transport(pjsip_transport *transport);
 static pj_status_t tcp_destroy(pjsip_transport *transport,
 			       pj_status_t reason);
 
+/* Discard the buffer used to assemble oversized message */
+static void tcp_rx_big_reset(struct tcp_transport *tcp);
+
 /* Callback on incoming data */
 static pj_bool_t on_data_read(pj_activesock_t *asock,
 			      void *data,
@@ -550,6 +579,13 @@ static pj_bool_t on_connect_complete(pj_activesock_t *asock,
 /* TCP keep-alive timer callback */
 static void tcp_keep_alive_timer(pj_timer_heap_t *th, pj_timer_entry *e);
 
+/* Called by transport manager to get transmit queue statistic */
+static pj_status_t tcp_get_tx_stat(pjsip_transport *transport,
+				   pjsip_transport_tx_stat *stat);
+
+/* Write out the messages in the transmit queue */
+static void tcp_flush_tx_queue(struct tcp_transport *tcp);
+
 /*
  * Common function to create TCP transport, called when pending accept() and
  * pending connect() complete.
@@ -587,6 +623,8 @@ static pj_status_t tcp_create( struct tcp_listener *listener,
     tcp->sock = sock;
     /*tcp->listener = listener;*/
     pj_list_init(&tcp->delayed_list);
+    pj_list_init(&tcp->tx_list);
+    pj_list_init(&tcp->tx_batch);
     tcp->base.pool = pool;
 
     pj_ansi_snprintf(tcp->base.obj_name, PJ_MAX_OBJ_NAME, 
@@ -626,6 +664,7 @@ static pj_status_t tcp_create( struct tcp_listener *listener,
     tcp->base.send_msg = &tcp_send_msg;
     tcp->base.do_shutdown = &tcp_shutdown;
     tcp->base.destroy = &tcp_destroy_transport;
+    tcp->base.get_tx_stat = &tcp_get_tx_stat;
 
     /* Create active socket */
     pj_activesock_cfg_default(&asock_cfg);
@@ -657,6 +696,10 @@ static pj_status_t tcp_create( struct tcp_listener *listener,
     pj_ioqueue_op_key_init(&tcp->ka_op_key.key, sizeof(pj_ioqueue_op_key_t));
     pj_strdup(tcp->base.pool, &tcp->ka_pkt, &ka_pkt);
 
+    /* Initialize the op_key used for coalesced writes */
+    pj_ioqueue_op_key_init(&tcp->tx_batch_op_key.key,
+			   sizeof(pj_ioqueue_op_key_t));
+
     /* Done setting up basic transport. */
     *p_tcp = tcp;
 
@@ -674,41 +717,267 @@ on_error:
 /* Flush all delayed transmision once the socket is connected. */
 static void tcp_flush_pending_tx(struct tcp_transport *tcp)
 {
+    struct delayed_tdata *insert_pos;
+    pj_bool_t start_tx = PJ_FALSE;
     pj_time_val now;
 
     pj_gettickcount(&now);
     pj_lock_acquire(tcp->base.lock);
+
+    /* Move the delayed transmissions to the head of the transmit queue,
+     * keeping their order.
+     */
+    insert_pos = tcp->tx_list.next;
     while (!pj_list_empty(&tcp->delayed_list)) {
 	struct delayed_tdata *pending_tx;
 	pjsip_tx_data *tdata;
-	pj_ioqueue_op_key_t *op_key;
-	pj_ssize_t size;
-	pj_status_t status;
 
 	pending_tx = tcp->delayed_list.next;
 	pj_list_erase(pending_tx);
 
-	tdata = pending_tx->tdata_op_key->tdata;
-	op_key = (pj_ioqueue_op_key_t*)pending_tx->tdata_op_key;
-
         if (pending_tx->timeout.sec > 0 &&
             PJ_TIME_VAL_GT(now, pending_tx->timeout))
         {
             continue;
         }
 
-	/* send! */
-	size = tdata->buf.cur - tdata->buf.start;
-	status = pj_activesock_send(tcp->asock, op_key, tdata->buf.start, 
-				    &size, 0);
-	if (status != PJ_EPENDING) {
-            pj_lock_release(tcp->base.lock);
-	    on_data_sent(tcp->asock, op_key, size);
-            pj_lock_acquire(tcp->base.lock);
+	tdata = pending_tx->tdata_op_key->tdata;
+	pj_list_insert_before(insert_pos, pending_tx);
+	++tcp->tx_stat.queue_depth;
+	tcp->tx_stat.queue_bytes += (tdata->buf.cur - tdata->buf.start);
+    }
+    if (tcp->tx_stat.queue_depth > tcp->tx_stat.max_queue_depth)
+	tcp->tx_stat.max_queue_depth = tcp->tx_stat.queue_depth;
+
+    if (!tcp->tx_busy && !pj_list_empty(&tcp->tx_list)) {
+	tcp->tx_busy = PJ_TRUE;
+	start_tx = PJ_TRUE;
+    }
+    pj_lock_release(tcp->base.lock);
+
+    if (start_tx)
+	tcp_flush_tx_queue(tcp);
+}
+
+
+/* Fail all messages in the specified list with the specified status. */
+static void tcp_fail_tx_list(struct tcp_transport *tcp,
+			     struct delayed_tdata *list,
+			     pj_status_t status)
+{
+    while (!pj_list_empty(list)) {
+	struct delayed_tdata *pending_tx;
+	pjsip_tx_data_op_key *op_key;
+
+	pending_tx = list->next;
+	pj_list_erase(pending_tx);
+
+	op_key = pending_tx->tdata_op_key;
+	op_key->tdata = NULL;
+	if (op_key->callback)
+	    op_key->callback(&tcp->base, op_key->token, -status);
+    }
+}
+
+
+/* Fail all queued messages after a write error, and release tx_busy. */
+static void tcp_abort_tx_queue(struct tcp_transport *tcp, pj_status_t status)
+{
+    struct delayed_tdata failed_list;
+
+    pj_list_init(&failed_list);
+
+    pj_lock_acquire(tcp->base.lock);
+    pj_list_merge_last(&failed_list, &tcp->tx_list);
+    tcp->tx_stat.queue_depth = 0;
+    tcp->tx_stat.queue_bytes = 0;
+    tcp->tx_busy = PJ_FALSE;
+    pj_lock_release(tcp->base.lock);
+
+    tcp_fail_tx_list(tcp, &failed_list, status);
+}
+
+
+/*
+ * Notify completion of a write. Messages which were coalesced into the
+ * write are reported individually. Returns PJ_FALSE if the write failed
+ * and the transport is being shutdown.
+ */
+static pj_bool_t tcp_on_tx_complete(struct tcp_transport *tcp,
+				    pj_ioqueue_op_key_t *op_key,
+				    pj_ssize_t bytes_sent)
+{
+    pjsip_tx_data_op_key *tdata_op_key = (pjsip_tx_data_op_key*)op_key;
+
+    if (bytes_sent == 0)
+	bytes_sent = -PJ_RETURN_OS_ERROR(OSERR_ENOTCONN);
+
+    if (tdata_op_key == &tcp->tx_batch_op_key) {
+	/* Coalesced write */
+	while (!pj_list_empty(&tcp->tx_batch)) {
+	    struct delayed_tdata *pending_tx;
+	    pjsip_tx_data *tdata;
+	    pj_ssize_t size;
+
+	    pending_tx = tcp->tx_batch.next;
+	    pj_list_erase(pending_tx);
+
+	    tdata_op_key = pending_tx->tdata_op_key;
+	    tdata = tdata_op_key->tdata;
+	    size = tdata->buf.cur - tdata->buf.start;
+	    tdata_op_key->tdata = NULL;
+
+	    /* Note: the callback may destroy tdata and pending_tx with it */
+	    if (tdata_op_key->callback) {
+		tdata_op_key->callback(&tcp->base, tdata_op_key->token,
+				       (bytes_sent > 0 ? size : bytes_sent));
+	    }
+	}
+	pj_gettimeofday(&tcp->last_activity);
+
+    } else {
+	/* Note that op_key may be the op_key from keep-alive, thus
+	 * it will not have tdata etc.
+	 */
+
+	tdata_op_key->tdata = NULL;
+
+	if (tdata_op_key->callback) {
+	    /*
+	     * Notify sip_transport.c that packet has been sent.
+	     */
+	    tdata_op_key->callback(&tcp->base, tdata_op_key->token, 
+				   bytes_sent);
+
+	    /* Mark last activity time */
+	    pj_gettimeofday(&tcp->last_activity);
+
 	}
+    }
+
+    /* Check for error/closure */
+    if (bytes_sent <= 0) {
+	pj_status_t status;
 
+	PJ_LOG(5,(tcp->base.obj_name, "TCP send() error, sent=%d", 
+		  bytes_sent));
+
+	status = (pj_status_t)-bytes_sent;
+
+	/* Messages queued behind the failed write won't make it either */
+	if (op_key != &tcp->ka_op_key.key)
+	    tcp_abort_tx_queue(tcp, status);
+
+	tcp_init_shutdown(tcp, status);
+
+	return PJ_FALSE;
     }
+
+    return PJ_TRUE;
+}
+
+
+/*
+ * Write out the messages in the transmit queue. This is called by the
+ * current writer (the one who has set tx_busy) once its write has
+ * completed, and returns once the queue is empty or a write is pending.
+ */
+static void tcp_flush_tx_queue(struct tcp_transport *tcp)
+{
+    for (;;) {
+	struct delayed_tdata *pending_tx;
+	pjsip_tx_data *tdata;
+	pj_ioqueue_op_key_t *op_key;
+	char *buf;
+	pj_ssize_t size, len;
+	pj_status_t status;
+
+	pj_lock_acquire(tcp->base.lock);
+
+	if (pj_list_empty(&tcp->tx_list) || tcp->is_closing) {
+	    tcp->tx_busy = PJ_FALSE;
+	    pj_lock_release(tcp->base.lock);
+	    return;
+	}
+
+	pending_tx = tcp->tx_list.next;
+	tdata = pending_tx->tdata_op_key->tdata;
+	len = tdata->buf.cur - tdata->buf.start;
+
+	if (PJSIP_TCP_TX_COALESCE_SIZE == 0 ||
+	    pending_tx->next == &tcp->tx_list ||
+	    len >= PJSIP_TCP_TX_COALESCE_SIZE)
+	{
+	    /* Send this message from its own buffer */
+	    pj_list_erase(pending_tx);
+	    --tcp->tx_stat.queue_depth;
+	    tcp->tx_stat.queue_bytes -= len;
+
+	    op_key = (pj_ioqueue_op_key_t*)pending_tx->tdata_op_key;
+	    buf = tdata->buf.start;
+	    size = len;
+	    ++tcp->tx_stat.tx_msgs;
+
+	} else {
+	    /* Coalesce as many queued messages as the buffer can hold */
+	    if (tcp->tx_batch_buf == NULL) {
+		tcp->tx_batch_buf = (char*)
+				    pj_pool_alloc(tcp->base.pool,
+						  PJSIP_TCP_TX_COALESCE_SIZE);
+	    }
+
+	    size = 0;
+	    while (!pj_list_empty(&tcp->tx_list)) {
+		pending_tx = tcp->tx_list.next;
+		tdata = pending_tx->tdata_op_key->tdata;
+		len = tdata->buf.cur - tdata->buf.start;
+
+		if (size + len > PJSIP_TCP_TX_COALESCE_SIZE)
+		    break;
+
+		pj_memcpy(tcp->tx_batch_buf + size, tdata->buf.start, len);
+		size += len;
+
+		pj_list_erase(pending_tx);
+		pj_list_push_back(&tcp->tx_batch, pending_tx);
+		--tcp->tx_stat.queue_depth;
+		tcp->tx_stat.queue_bytes -= len;
+		++tcp->tx_stat.tx_msgs;
+	    }
+
+	    op_key = &tcp->tx_batch_op_key.key;
+	    buf = tcp->tx_batch_buf;
+	}
+
+	++tcp->tx_stat.tx_writes;
+	pj_lock_release(tcp->base.lock);
+
+	status = pj_activesock_send(tcp->asock, op_key, buf, &size, 0);
+	if (status == PJ_EPENDING) {
+	    /* on_data_sent() will continue flushing the queue */
+	    return;
+	}
+
+	if (status != PJ_SUCCESS)
+	    size = -status;
+
+	if (!tcp_on_tx_complete(tcp, op_key, size))
+	    return;
+    }
+}
+
+
+/* Get transmit queue statistic */
+static pj_status_t tcp_get_tx_stat(pjsip_transport *transport,
+				   pjsip_transport_tx_stat *stat)
+{
+    struct tcp_transport *tcp = (struct tcp_transport*)transport;
+
+    pj_lock_acquire(tcp->base.lock);
+    pj_memcpy(stat, &tcp->tx_stat, sizeof(*stat));
     pj_lock_release(tcp->base.lock);
+
+    return PJ_SUCCESS;
 }
 
 
@@ -767,11 +1036,18 @@ static pj_status_t tcp_destroy(pjsip_transport *transport,
 	on_data_sent(tcp->asock, op_key, -reason);
     }
 
+    /* Cancel all queued transmits */
+    tcp_fail_tx_list(tcp, &tcp->tx_list, reason);
+    tcp->tx_stat.queue_depth = 0;
+    tcp->tx_stat.queue_bytes = 0;
+
     if (tcp->rdata.tp_info.pool) {
 	pj_pool_release(tcp->rdata.tp_info.pool);
 	tcp->rdata.tp_info.pool = NULL;
     }
 
+    tcp_rx_big_reset(tcp);
+
     if (tcp->asock) {
 	pj_activesock_close(tcp->asock);
 	tcp->asock = NULL;
@@ -781,6 +1057,9 @@ static pj_status_t tcp_destroy(pjsip_transport *transport,
 	tcp->sock = PJ_INVALID_SOCKET;
     }
 
+    /* Cancel coalesced write which was still in progress */
+    tcp_fail_tx_list(tcp, &tcp->tx_batch, reason);
+
     if (tcp->base.lock) {
 	pj_lock_destroy(tcp->base.lock);
 	tcp->base.lock = NULL;
@@ -856,8 +1135,13 @@ static pj_status_t tcp_start_read(struct tcp_transport *tcp)
                       sizeof(tcp->rdata.pkt_info.src_name), 0);
     tcp->rdata.pkt_info.src_port = pj_sockaddr_get_port(rem_addr);
 
-    size = sizeof(tcp->rdata.pkt_info.packet);
-    readbuf[0] = tcp->rdata.pkt_info.packet;
+    /* Allocate receive buffer, with room for NULL termination */
+    tcp->rx_buf = (char*) pj_pool_alloc(tcp->base.pool,
+					PJSIP_TCP_RX_BUF_SIZE + 1);
+    tcp->rx_start = 0;
+
+    size = PJSIP_TCP_RX_BUF_SIZE;
+    readbuf[0] = tcp->rx_buf;
     status = pj_activesock_start_read2(tcp->asock, tcp->base.pool, size,
 				       readbuf, 0);
     if (status != PJ_SUCCESS && status != PJ_EPENDING) {
@@ -1083,42 +1367,15 @@ static pj_bool_t on_data_sent(pj_activesock_t *asock,
 {
     struct tcp_transport *tcp = (struct tcp_transport*) 
     				pj_activesock_get_user_data(asock);
-    pjsip_tx_data_op_key *tdata_op_key = (pjsip_tx_data_op_key*)op_key;
-
-    /* Note that op_key may be the op_key from keep-alive, thus
-     * it will not have tdata etc.
-     */
-
-    tdata_op_key->tdata = NULL;
-
-    if (tdata_op_key->callback) {
-	/*
-	 * Notify sip_transport.c that packet has been sent.
-	 */
-	if (bytes_sent == 0)
-	    bytes_sent = -PJ_RETURN_OS_ERROR(OSERR_ENOTCONN);
-
-	tdata_op_key->callback(&tcp->base, tdata_op_key->token, bytes_sent);
-
-	/* Mark last activity time */
-	pj_gettimeofday(&tcp->last_activity);
-
-    }
-
-    /* Check for error/closure */
-    if (bytes_sent <= 0) {
-	pj_status_t status;
-
-	PJ_LOG(5,(tcp->base.obj_name, "TCP send() error, sent=%d", 
-		  bytes_sent));
-
-	status = (bytes_sent == 0) ? PJ_RETURN_OS_ERROR(OSERR_ENOTCONN) :
-				     (pj_status_t)-bytes_sent;
-
-	tcp_init_shutdown(tcp, status);
 
+    if (!tcp_on_tx_complete(tcp, op_key, bytes_sent))
 	return PJ_FALSE;
-    }
+
+    /* Write out the messages queued while this write was in progress.
+     * Keep-alive is not part of the transmit queue.
+     */
+    if (op_key != &tcp->ka_op_key.key)
+	tcp_flush_tx_queue(tcp);
 
     return PJ_TRUE;
 }
@@ -1198,11 +1455,45 @@ static pj_status_t tcp_send_msg(pjsip_transport *transport,
     } 
     
     if (!delayed) {
+	size = tdata->buf.cur - tdata->buf.start;
+
+	/* If another write is in progress, queue the message. It will be
+	 * written out (possibly coalesced with other queued messages) once
+	 * the current write completes.
+	 */
+	pj_lock_acquire(tcp->base.lock);
+	if (tcp->tx_busy) {
+	    struct delayed_tdata *queued_tdata;
+
+	    if (PJSIP_TCP_TX_QUEUE_MAX_SIZE &&
+		tcp->tx_stat.queue_bytes + size > PJSIP_TCP_TX_QUEUE_MAX_SIZE)
+	    {
+		++tcp->tx_stat.rejected_msgs;
+		pj_lock_release(tcp->base.lock);
+		tdata->op_key.tdata = NULL;
+		return PJ_ETOOMANY;
+	    }
+
+	    queued_tdata = PJ_POOL_ZALLOC_T(tdata->pool, struct delayed_tdata);
+	    queued_tdata->tdata_op_key = &tdata->op_key;
+	    pj_list_push_back(&tcp->tx_list, queued_tdata);
+
+	    tcp->tx_stat.queue_bytes += size;
+	    if (++tcp->tx_stat.queue_depth > tcp->tx_stat.max_queue_depth)
+		tcp->tx_stat.max_queue_depth = tcp->tx_stat.queue_depth;
+
+	    pj_lock_release(tcp->base.lock);
+	    return PJ_EPENDING;
+	}
+	tcp->tx_busy = PJ_TRUE;
+	++tcp->tx_stat.tx_msgs;
+	++tcp->tx_stat.tx_writes;
+	pj_lock_release(tcp->base.lock);
+
 	/*
 	 * Transport is ready to go. Send the packet to ioqueue to be
 	 * sent asynchronously.
 	 */
-	size = tdata->buf.cur - tdata->buf.start;
 	status = pj_activesock_send(tcp->asock, 
 				    (pj_ioqueue_op_key_t*)&tdata->op_key,
 				    tdata->buf.start, &size, 0);
@@ -1213,14 +1504,19 @@ static pj_status_t tcp_send_msg(pjsip_transport *transport,
 
 	    /* Shutdown transport on closure/errors */
 	    if (size <= 0) {
-
 		PJ_LOG(5,(tcp->base.obj_name, "TCP send() error, sent=%d", 
 			  size));
 
 		if (status == PJ_SUCCESS) 
 		    status = PJ_RETURN_OS_ERROR(OSERR_ENOTCONN);
 
+		/* Fail messages which were queued behind this one */
+		tcp_abort_tx_queue(tcp, status);
+
 		tcp_init_shutdown(tcp, status);
+	    } else {
+		/* Write out what has been queued in the mean time */
+		tcp_flush_tx_queue(tcp);
 	    }
 	}
     }
@@ -1246,6 +1542,161 @@ static pj_status_t tcp_shutdown(pjsip_transport *transport)
 }
 
 
+/* Discard the buffer used to assemble oversized message */
+static void tcp_rx_big_reset(struct tcp_transport *tcp)
+{
+    if (tcp->rx_big_pool) {
+	pj_pool_release(tcp->rx_big_pool);
+	tcp->rx_big_pool = NULL;
+    }
+    tcp->rx_big = NULL;
+    tcp->rx_big_len = tcp->rx_big_size = 0;
+}
+
+
+/* Append data to the buffer used to assemble oversized message, growing
+ * the buffer as necessary. No more than max_len bytes will be kept.
+ */
+static pj_status_t tcp_rx_big_append(struct tcp_transport *tcp,
+				     const char *data,
+				     pj_size_t len,
+				     pj_size_t max_len,
+				     pj_size_t *appended)
+{
+    if (len > max_len - tcp->rx_big_len)
+	len = max_len - tcp->rx_big_len;
+
+    if (tcp->rx_big_len + len > tcp->rx_big_size) {
+	pj_size_t size;
+	char *buf;
+
+	size = tcp->rx_big_size ? tcp->rx_big_size : PJSIP_TCP_RX_BUF_SIZE;
+	while (size < tcp->rx_big_len + len)
+	    size <<= 1;
+	if (size > max_len)
+	    size = max_len;
+
+	if (tcp->rx_big_pool == NULL) {
+	    tcp->rx_big_pool = pjsip_endpt_create_pool(tcp->base.endpt,
+						       "rxb%p", 256,
+						       PJSIP_TCP_RX_BUF_SIZE);
+	    if (!tcp->rx_big_pool)
+		return PJ_ENOMEM;
+	}
+
+	/* Old buffer is reclaimed when the pool is released */
+	buf = (char*) pj_pool_alloc(tcp->rx_big_pool, size + 1);
+	if (tcp->rx_big_len)
+	    pj_memcpy(buf, tcp->rx_big, tcp->rx_big_len);
+	tcp->rx_big = buf;
+	tcp->rx_big_size = size;
+    }
+
+    pj_memcpy(tcp->rx_big + tcp->rx_big_len, data, len);
+    tcp->rx_big_len += len;
+    *appended = len;
+
+    return PJ_SUCCESS;
+}
+
+
+/* Process size bytes of data in the receive buffer, and tell activesock
+ * how many bytes it must keep in the buffer.
+ */
+static pj_status_t tcp_process_rx(struct tcp_transport *tcp,
+				  pj_size_t size,
+				  pj_size_t *remainder)
+{
+    pjsip_rx_data *rdata = &tcp->rdata;
+    pjsip_tpmgr *mgr = tcp->base.tpmgr;
+    char *buf = tcp->rx_buf;
+    pj_size_t max_len, start, left, appended;
+    pj_status_t status;
+
+    max_len = pjsip_cfg()->endpt.max_stream_msg_len;
+    if (max_len < PJSIP_MAX_PKT_LEN)
+	max_len = PJSIP_MAX_PKT_LEN;
+
+    start = tcp->rx_start;
+
+    if (tcp->rx_big_len) {
+	pj_size_t eaten;
+
+	/* An oversized message is being assembled, in which case the
+	 * receive buffer only contains new data for it.
+	 */
+	status = tcp_rx_big_append(tcp, buf, size, max_len, &appended);
+	if (status != PJ_SUCCESS)
+	    return status;
+
+	eaten = pjsip_tpmgr_receive_stream(mgr, rdata, tcp->rx_big,
+					   tcp->rx_big_len, max_len);
+	if (eaten == 0) {
+	    *remainder = 0;
+	    return PJ_SUCCESS;
+	}
+
+	/* Done with the oversized message. Whatever follows it is the
+	 * beginning of the next message(s).
+	 */
+	left = tcp->rx_big_len - eaten;
+	if (left + (size - appended) >= PJSIP_TCP_RX_BUF_SIZE) {
+	    pj_memmove(tcp->rx_big, tcp->rx_big + eaten, left);
+	    tcp->rx_big_len = left;
+	    *remainder = 0;
+	    return PJ_SUCCESS;
+	}
+
+	pj_memmove(buf + left, buf + appended, size - appended);
+	pj_memcpy(buf, tcp->rx_big + eaten, left);
+	size = left + (size - appended);
+	start = 0;
+	tcp_rx_big_reset(tcp);
+    }
+
+    /* Report to transport manager.
+     * The transport manager will tell us how many bytes of the packet
+     * have been processed (as valid SIP message).
+     */
+    if (size > start) {
+	start += pjsip_tpmgr_receive_stream(mgr, rdata, buf + start,
+					    size - start, max_len);
+	pj_assert(start <= size);
+    }
+
+    left = size - start;
+    if (left == 0) {
+	/* Everything has been processed */
+	tcp->rx_start = 0;
+	*remainder = 0;
+
+    } else if (left == PJSIP_TCP_RX_BUF_SIZE) {
+	/* The buffer is full with an incomplete message */
+	status = tcp_rx_big_append(tcp, buf, left, max_len, &appended);
+	if (status != PJ_SUCCESS)
+	    return status;
+
+	tcp->rx_start = 0;
+	*remainder = 0;
+
+    } else if (PJSIP_TCP_RX_BUF_SIZE - size < PJSIP_TCP_RX_BUF_SIZE / 4) {
+	/* Running out of space, move unprocessed data to the front of
+	 * the buffer.
+	 */
+	pj_memmove(buf, buf + start, left);
+	tcp->rx_start = 0;
+	*remainder = left;
+
+    } else {
+	/* Keep the data in place, new data will be appended after it */
+	tcp->rx_start = start;
+	*remainder = size;
+    }
+
+    return PJ_SUCCESS;
+}
+
+
 /* 
  * Callback from ioqueue that an incoming data is received from the socket.
  */
@@ -1274,34 +1725,22 @@ static pj_bool_t on_data_read(pj_activesock_t *asock,
      * to be parsed.
      */
     if (status == PJ_SUCCESS) {
-	pj_size_t size_eaten;
 
 	/* Mark this as an activity */
 	pj_gettimeofday(&tcp->last_activity);
 
-	pj_assert((void*)rdata->pkt_info.packet == data);
+	pj_assert((void*)tcp->rx_buf == data);
 
 	/* Init pkt_info part. */
-	rdata->pkt_info.len = size;
 	rdata->pkt_info.zero = 0;
 	pj_gettimeofday(&rdata->pkt_info.timestamp);
 
-	/* Report to transport manager.
-	 * The transport manager will tell us how many bytes of the packet
-	 * have been processed (as valid SIP message).
-	 */
-	size_eaten = 
-	    pjsip_tpmgr_receive_packet(rdata->tp_info.transport->tpmgr, 
-				       rdata);
-
-	pj_assert(size_eaten <= (pj_size_t)rdata->pkt_info.len);
-
-	/* Move unprocessed data to the front of the buffer */
-	*remainder = size - size_eaten;
-	if (*remainder > 0 && *remainder != size) {
-	    pj_memmove(rdata->pkt_info.packet,
-		       rdata->pkt_info.packet + size_eaten,
-		       *remainder);
+	status = tcp_process_rx(tcp, size, remainder);
+	if (status != PJ_SUCCESS) {
+	    tcp_perror(tcp->base.obj_name, "Error processing received data",
+		       status);
+	    tcp_init_shutdown(tcp, status);
+	    return PJ_FALSE;
 	}
 
     } else {
@@ -1434,6 +1873,17 @@ static void tcp_keep_alive_timer(pj_timer_heap_t *th, pj_timer_entry *e)
     pj_gettimeofday(&now);
     PJ_TIME_VAL_SUB(now, tcp->last_activity);
 
+    if (tcp->tx_busy) {
+	/* A write is in progress, so there is no need for keep-alive */
+	delay.sec = PJSIP_TCP_KEEP_ALIVE_INTERVAL;
+	delay.msec = 0;
+
+	pjsip_endpt_schedule_timer(tcp->base.endpt, &tcp->ka_timer, 
+				   &delay);
+	tcp->ka_timer.id = PJ_TRUE;
+	return;
+    }
+
     if (now.sec > 0 && now.sec < PJSIP_TCP_KEEP_ALIVE_INTERVAL) {
 	/* There has been activity, so don't send keep-alive */
 	delay.sec = PJSIP_TCP_KEEP_ALIVE_INTERVAL - now.sec;
@@ -66,7 +66,8 @@ struct tls_listener
  * A delayed transmission occurs when application sends tx_data when
  * the TLS connect/establishment is still in progress. These delayed
  * transmission will be "flushed" once the socket is connected (either
- * successfully or with errors).
+ * successfully or with errors). The same structure is used to queue
+ * tx_data while another write is in progress on the TLS session.
  */
 struct delayed_tdata
 {
@@ -104,8 +105,34 @@ struct tls_transport
      */
     pjsip_rx_data	     rdata;
 
+    /* Receive buffer. Decrypted data is parsed in place, starting at
+     * rx_start, and unprocessed data is only moved to the front of the
+     * buffer when the free space at the end runs low. A message which
+     * doesn't fit in the receive buffer is assembled in rx_big instead,
+     * which grows on demand up to max_stream_msg_len setting.
+     */
+    char		    *rx_buf;
+    pj_size_t		     rx_start;
+    pj_pool_t		    *rx_big_pool;
+    char		    *rx_big;
+    pj_size_t		     rx_big_len;
+    pj_size_t		     rx_big_size;
+
     /* Pending transmission list. */
     struct delayed_tdata     delayed_list;
+
+    /* Transmit queue. Only one write is outstanding on the TLS session at
+     * any time (tx_busy). Messages sent in the mean time are put in
+     * tx_list, and written out once the current write completes,
+     * coalesced into tx_batch_buf (and hence a single TLS record) when
+     * more than one message is waiting.
+     */
+    pj_bool_t		     tx_busy;
+    struct delayed_tdata     tx_list;
+    struct delayed_tdata     tx_batch;
+    pjsip_tx_data_op_key     tx_batch_op_key;
+    char		    *tx_batch_buf;
+    pjsip_transport_tx_stat  tx_stat;
 };
 
 
@@ -119,6 +146,9 @@ static pj_bool_t on_accept_complete(pj_ssl_sock_t *ssock,
 				    const pj_sockaddr_t *src_addr,
 				    int src_addr_len);
 
+/* Discard the buffer used to assemble oversized message */
+static void tls_rx_big_reset(struct tls_transport *tls);
+
 /* Callback on incoming data */
 static pj_bool_t on_data_read(pj_ssl_sock_t *ssock,
 			      void *data,
@@ -340,6 +370,7 @@ PJ_DEF(pj_status_t) pjsip_tls_transport_start2( pjsip_endpoint *endpt,
     ssock_param.reuse_addr = listener->tls_setting.reuse_addr;
     ssock_param.qos_type = listener->tls_setting.qos_type;
     ssock_param.qos_ignore_error = listener->tls_setting.qos_ignore_error;
+    ssock_param.ktls = listener->tls_setting.ktls;
     pj_memcpy(&ssock_param.qos_params, &listener->tls_setting.qos_params,
 	      sizeof(ssock_param.qos_params));
 
@@ -562,6 +593,13 @@ static pj_bool_t on_connect_complete(pj_ssl_sock_t *ssock,
 /* TLS keep-alive timer callback */
 static void tls_keep_alive_timer(pj_timer_heap_t *th, pj_timer_entry *e);
 
+/* Called by transport manager to get transmit queue statistic */
+static pj_status_t tls_get_tx_stat(pjsip_transport *transport,
+				   pjsip_transport_tx_stat *stat);
+
+/* Write out the messages in the transmit queue */
+static void tls_flush_tx_queue(struct tls_transport *tls);
+
 /*
  * Common function to create TLS transport, called when pending accept() and
  * pending connect() complete.
@@ -597,6 +635,8 @@ static pj_status_t tls_create( struct tls_listener *listener,
     tls->is_server = is_server;
     tls->verify_server = listener->tls_setting.verify_server;
     pj_list_init(&tls->delayed_list);
+    pj_list_init(&tls->tx_list);
+    pj_list_init(&tls->tx_batch);
     tls->base.pool = pool;
 
     pj_ansi_snprintf(tls->base.obj_name, PJ_MAX_OBJ_NAME, 
@@ -653,6 +693,7 @@ static pj_status_t tls_create( struct tls_listener *listener,
     tls->base.send_msg = &tls_send_msg;
     tls->base.do_shutdown = &tls_shutdown;
     tls->base.destroy = &tls_destroy_transport;
+    tls->base.get_tx_stat = &tls_get_tx_stat;
 
     tls->ssock = ssock;
 
@@ -669,6 +710,10 @@ static pj_status_t tls_create( struct tls_listener *listener,
     tls->ka_timer.cb = &tls_keep_alive_timer;
     pj_ioqueue_op_key_init(&tls->ka_op_key.key, sizeof(pj_ioqueue_op_key_t));
     pj_strdup(tls->base.pool, &tls->ka_pkt, &ka_pkt);
+
+    /* Initialize the op_key used for coalesced writes */
+    pj_ioqueue_op_key_init(&tls->tx_batch_op_key.key,
+			   sizeof(pj_ioqueue_op_key_t));
     
     /* Done setting up basic transport. */
     *p_tls = tls;
@@ -687,41 +732,267 @@ on_error:
 /* Flush all delayed transmision once the socket is connected. */
 static void tls_flush_pending_tx(struct tls_transport *tls)
 {
+    struct delayed_tdata *insert_pos;
+    pj_bool_t start_tx = PJ_FALSE;
     pj_time_val now;
 
     pj_gettickcount(&now);
     pj_lock_acquire(tls->base.lock);
+
+    /* Move the delayed transmissions to the head of the transmit queue,
+     * keeping their order.
+     */
+    insert_pos = tls->tx_list.next;
     while (!pj_list_empty(&tls->delayed_list)) {
 	struct delayed_tdata *pending_tx;
 	pjsip_tx_data *tdata;
-	pj_ioqueue_op_key_t *op_key;
-	pj_ssize_t size;
-	pj_status_t status;
 
 	pending_tx = tls->delayed_list.next;
 	pj_list_erase(pending_tx);
 
-	tdata = pending_tx->tdata_op_key->tdata;
-	op_key = (pj_ioqueue_op_key_t*)pending_tx->tdata_op_key;
-
         if (pending_tx->timeout.sec > 0 &&
             PJ_TIME_VAL_GT(now, pending_tx->timeout))
         {
             continue;
         }
 
-	/* send! */
-	size = tdata->buf.cur - tdata->buf.start;
-	status = pj_ssl_sock_send(tls->ssock, op_key, tdata->buf.start, 
-				  &size, 0);
+	tdata = pending_tx->tdata_op_key->tdata;
+	pj_list_insert_before(insert_pos, pending_tx);
+	++tls->tx_stat.queue_depth;
+	tls->tx_stat.queue_bytes += (tdata->buf.cur - tdata->buf.start);
+    }
+    if (tls->tx_stat.queue_depth > tls->tx_stat.max_queue_depth)
+	tls->tx_stat.max_queue_depth = tls->tx_stat.queue_depth;
 
-	if (status != PJ_EPENDING) {
-            pj_lock_release(tls->base.lock);
-	    on_data_sent(tls->ssock, op_key, size);
-            pj_lock_acquire(tls->base.lock);
+    if (!tls->tx_busy && !pj_list_empty(&tls->tx_list)) {
+	tls->tx_busy = PJ_TRUE;
+	start_tx = PJ_TRUE;
+    }
+    pj_lock_release(tls->base.lock);
+
+    if (start_tx)
+	tls_flush_tx_queue(tls);
+}
+
+
+/* Fail all messages in the specified list with the specified status. */
+static void tls_fail_tx_list(struct tls_transport *tls,
+			     struct delayed_tdata *list,
+			     pj_status_t status)
+{
+    while (!pj_list_empty(list)) {
+	struct delayed_tdata *pending_tx;
+	pjsip_tx_data_op_key *op_key;
+
+	pending_tx = list->next;
+	pj_list_erase(pending_tx);
+
+	op_key = pending_tx->tdata_op_key;
+	op_key->tdata = NULL;
+	if (op_key->callback)
+	    op_key->callback(&tls->base, op_key->token, -status);
+    }
+}
+
+
+/* Fail all queued messages after a write error, and release tx_busy. */
+static void tls_abort_tx_queue(struct tls_transport *tls, pj_status_t status)
+{
+    struct delayed_tdata failed_list;
+
+    pj_list_init(&failed_list);
+
+    pj_lock_acquire(tls->base.lock);
+    pj_list_merge_last(&failed_list, &tls->tx_list);
+    tls->tx_stat.queue_depth = 0;
+    tls->tx_stat.queue_bytes = 0;
+    tls->tx_busy = PJ_FALSE;
+    pj_lock_release(tls->base.lock);
+
+    tls_fail_tx_list(tls, &failed_list, status);
+}
+
+
+/*
+ * Notify completion of a write. Messages which were coalesced into the
+ * write are reported individually. Returns PJ_FALSE if the write failed
+ * and the transport is being shutdown.
+ */
+static pj_bool_t tls_on_tx_complete(struct tls_transport *tls,
+				    pj_ioqueue_op_key_t *op_key,
+				    pj_ssize_t bytes_sent)
+{
+    pjsip_tx_data_op_key *tdata_op_key = (pjsip_tx_data_op_key*)op_key;
+
+    if (bytes_sent == 0)
+	bytes_sent = -PJ_RETURN_OS_ERROR(OSERR_ENOTCONN);
+
+    if (tdata_op_key == &tls->tx_batch_op_key) {
+	/* Coalesced write */
+	while (!pj_list_empty(&tls->tx_batch)) {
+	    struct delayed_tdata *pending_tx;
+	    pjsip_tx_data *tdata;
+	    pj_ssize_t size;
+
+	    pending_tx = tls->tx_batch.next;
+	    pj_list_erase(pending_tx);
+
+	    tdata_op_key = pending_tx->tdata_op_key;
+	    tdata = tdata_op_key->tdata;
+	    size = tdata->buf.cur - tdata->buf.start;
+	    tdata_op_key->tdata = NULL;
+
+	    /* Note: the callback may destroy tdata and pending_tx with it */
+	    if (tdata_op_key->callback) {
+		tdata_op_key->callback(&tls->base, tdata_op_key->token,
+				       (bytes_sent > 0 ? size : bytes_sent));
+	    }
 	}
+	pj_gettimeofday(&tls->last_activity);
+
+    } else {
+	/* Note that op_key may be the op_key from keep-alive, thus
+	 * it will not have tdata etc.
+	 */
+
+	tdata_op_key->tdata = NULL;
+
+	if (tdata_op_key->callback) {
+	    /*
+	     * Notify sip_transport.c that packet has been sent.
+	     */
+	    tdata_op_key->callback(&tls->base, tdata_op_key->token, 
+				   bytes_sent);
+
+	    /* Mark last activity time */
+	    pj_gettimeofday(&tls->last_activity);
+
+	}
+    }
+
+    /* Check for error/closure */
+    if (bytes_sent <= 0) {
+	pj_status_t status;
+
+	PJ_LOG(5,(tls->base.obj_name, "TLS send() error, sent=%d", 
+		  bytes_sent));
+
+	status = (pj_status_t)-bytes_sent;
+
+	/* Messages queued behind the failed write won't make it either */
+	if (op_key != &tls->ka_op_key.key)
+	    tls_abort_tx_queue(tls, status);
+
+	tls_init_shutdown(tls, status);
+
+	return PJ_FALSE;
     }
+
+    return PJ_TRUE;
+}
+
+
+/*
+ * Write out the messages in the transmit queue. This is called by the
+ * current writer (the one who has set tx_busy) once its write has
+ * completed, and returns once the queue is empty or a write is pending.
+ */
+static void tls_flush_tx_queue(struct tls_transport *tls)
+{
+    for (;;) {
+	struct delayed_tdata *pending_tx;
+	pjsip_tx_data *tdata;
+	pj_ioqueue_op_key_t *op_key;
+	char *buf;
+	pj_ssize_t size, len;
+	pj_status_t status;
+
+	pj_lock_acquire(tls->base.lock);
+
+	if (pj_list_empty(&tls->tx_list) || tls->is_closing) {
+	    tls->tx_busy = PJ_FALSE;
+	    pj_lock_release(tls->base.lock);
+	    return;
+	}
+
+	pending_tx = tls->tx_list.next;
+	tdata = pending_tx->tdata_op_key->tdata;
+	len = tdata->buf.cur - tdata->buf.start;
+
+	if (PJSIP_TLS_TX_COALESCE_SIZE == 0 ||
+	    pending_tx->next == &tls->tx_list ||
+	    len >= PJSIP_TLS_TX_COALESCE_SIZE)
+	{
+	    /* Send this message from its own buffer */
+	    pj_list_erase(pending_tx);
+	    --tls->tx_stat.queue_depth;
+	    tls->tx_stat.queue_bytes -= len;
+
+	    op_key = (pj_ioqueue_op_key_t*)pending_tx->tdata_op_key;
+	    buf = tdata->buf.start;
+	    size = len;
+	    ++tls->tx_stat.tx_msgs;
+
+	} else {
+	    /* Coalesce as many queued messages as the buffer can hold */
+	    if (tls->tx_batch_buf == NULL) {
+		tls->tx_batch_buf = (char*)
+				    pj_pool_alloc(tls->base.pool,
+						  PJSIP_TLS_TX_COALESCE_SIZE);
+	    }
+
+	    size = 0;
+	    while (!pj_list_empty(&tls->tx_list)) {
+		pending_tx = tls->tx_list.next;
+		tdata = pending_tx->tdata_op_key->tdata;
+		len = tdata->buf.cur - tdata->buf.start;
+
+		if (size + len > PJSIP_TLS_TX_COALESCE_SIZE)
+		    break;
+
+		pj_memcpy(tls->tx_batch_buf + size, tdata->buf.start, len);
+		size += len;
+
+		pj_list_erase(pending_tx);
+		pj_list_push_back(&tls->tx_batch, pending_tx);
+		--tls->tx_stat.queue_depth;
+		tls->tx_stat.queue_bytes -= len;
+		++tls->tx_stat.tx_msgs;
+	    }
+
+	    op_key = &tls->tx_batch_op_key.key;
+	    buf = tls->tx_batch_buf;
+	}
+
+	++tls->tx_stat.tx_writes;
+	pj_lock_release(tls->base.lock);
+
+	status = pj_ssl_sock_send(tls->ssock, op_key, buf, &size, 0);
+	if (status == PJ_EPENDING) {
+	    /* on_data_sent() will continue flushing the queue */
+	    return;
+	}
+
+	if (status != PJ_SUCCESS)
+	    size = -status;
+
+	if (!tls_on_tx_complete(tls, op_key, size))
+	    return;
+    }
+}
+
+
+/* Get transmit queue statistic */
+static pj_status_t tls_get_tx_stat(pjsip_transport *transport,
+				   pjsip_transport_tx_stat *stat)
+{
+    struct tls_transport *tls = (struct tls_transport*)transport;
+
+    pj_lock_acquire(tls->base.lock);
+    pj_memcpy(stat, &tls->tx_stat, sizeof(*stat));
     pj_lock_release(tls->base.lock);
+
+    return PJ_SUCCESS;
 }
 
 
@@ -780,15 +1051,25 @@ static pj_status_t tls_destroy(pjsip_transport *transport,
 	on_data_sent(tls->ssock, op_key, -reason);
     }
 
+    /* Cancel all queued transmits */
+    tls_fail_tx_list(tls, &tls->tx_list, reason);
+    tls->tx_stat.queue_depth = 0;
+    tls->tx_stat.queue_bytes = 0;
+
     if (tls->rdata.tp_info.pool) {
 	pj_pool_release(tls->rdata.tp_info.pool);
 	tls->rdata.tp_info.pool = NULL;
     }
 
+    tls_rx_big_reset(tls);
+
     if (tls->ssock) {
 	pj_ssl_sock_close(tls->ssock);
 	tls->ssock = NULL;
     }
+
+    /* Cancel coalesced write which was still in progress */
+    tls_fail_tx_list(tls, &tls->tx_batch, reason);
     if (tls->base.lock) {
 	pj_lock_destroy(tls->base.lock);
 	tls->base.lock = NULL;
@@ -864,8 +1145,13 @@ static pj_status_t tls_start_read(struct tls_transport *tls)
                           sizeof(tls->rdata.pkt_info.src_name), 0);
     tls->rdata.pkt_info.src_port = pj_sockaddr_get_port(rem_addr);
 
-    size = sizeof(tls->rdata.pkt_info.packet);
-    readbuf[0] = tls->rdata.pkt_info.packet;
+    /* Allocate receive buffer, with room for NULL termination */
+    tls->rx_buf = (char*) pj_pool_alloc(tls->base.pool,
+					PJSIP_TLS_RX_BUF_SIZE + 1);
+    tls->rx_start = 0;
+
+    size = PJSIP_TLS_RX_BUF_SIZE;
+    readbuf[0] = tls->rx_buf;
     status = pj_ssl_sock_start_read2(tls->ssock, tls->base.pool, size,
 				     readbuf, 0);
     if (status != PJ_SUCCESS && status != PJ_EPENDING) {
@@ -944,6 +1230,7 @@ static pj_status_t lis_create_transport(pjsip_tpfactory *factory,
     ssock_param.ciphers = listener->tls_setting.ciphers;
     ssock_param.qos_type = listener->tls_setting.qos_type;
     ssock_param.qos_ignore_error = listener->tls_setting.qos_ignore_error;
+    ssock_param.ktls = listener->tls_setting.ktls;
     pj_memcpy(&ssock_param.qos_params, &listener->tls_setting.qos_params,
 	      sizeof(ssock_param.qos_params));
 
@@ -1189,43 +1476,16 @@ static pj_bool_t on_data_sent(pj_ssl_sock_t *ssock,
 {
     struct tls_transport *tls = (struct tls_transport*) 
     				pj_ssl_sock_get_user_data(ssock);
-    pjsip_tx_data_op_key *tdata_op_key = (pjsip_tx_data_op_key*)op_key;
-
-    /* Note that op_key may be the op_key from keep-alive, thus
-     * it will not have tdata etc.
-     */
-
-    tdata_op_key->tdata = NULL;
 
-    if (tdata_op_key->callback) {
-	/*
-	 * Notify sip_transport.c that packet has been sent.
-	 */
-	if (bytes_sent == 0)
-	    bytes_sent = -PJ_RETURN_OS_ERROR(OSERR_ENOTCONN);
-
-	tdata_op_key->callback(&tls->base, tdata_op_key->token, bytes_sent);
-
-	/* Mark last activity time */
-	pj_gettimeofday(&tls->last_activity);
-
-    }
-
-    /* Check for error/closure */
-    if (bytes_sent <= 0) {
-	pj_status_t status;
-
-	PJ_LOG(5,(tls->base.obj_name, "TLS send() error, sent=%d", 
-		  bytes_sent));
-
-	status = (bytes_sent == 0) ? PJ_RETURN_OS_ERROR(OSERR_ENOTCONN) :
-				     (pj_status_t)-bytes_sent;
+    if (!tls_on_tx_complete(tls, op_key, bytes_sent))
+	return PJ_FALSE;
 
-	tls_init_shutdown(tls, status);
+    /* Write out the messages queued while this write was in progress.
+     * Keep-alive is not part of the transmit queue.
+     */
+    if (op_key != &tls->ka_op_key.key)
+	tls_flush_tx_queue(tls);
 
-	return PJ_FALSE;
-    }
-    
     return PJ_TRUE;
 }
 
@@ -1304,14 +1564,48 @@ static pj_status_t tls_send_msg(pjsip_transport *transport,
     } 
     
     if (!delayed) {
+	size = tdata->buf.cur - tdata->buf.start;
+
+	/* If another write is in progress, queue the message. It will be
+	 * written out (possibly coalesced with other queued messages) once
+	 * the current write completes.
+	 */
+	pj_lock_acquire(tls->base.lock);
+	if (tls->tx_busy) {
+	    struct delayed_tdata *queued_tdata;
+
+	    if (PJSIP_TLS_TX_QUEUE_MAX_SIZE &&
+		tls->tx_stat.queue_bytes + size > PJSIP_TLS_TX_QUEUE_MAX_SIZE)
+	    {
+		++tls->tx_stat.rejected_msgs;
+		pj_lock_release(tls->base.lock);
+		tdata->op_key.tdata = NULL;
+		return PJ_ETOOMANY;
+	    }
+
+	    queued_tdata = PJ_POOL_ZALLOC_T(tdata->pool, struct delayed_tdata);
+	    queued_tdata->tdata_op_key = &tdata->op_key;
+	    pj_list_push_back(&tls->tx_list, queued_tdata);
+
+	    tls->tx_stat.queue_bytes += size;
+	    if (++tls->tx_stat.queue_depth > tls->tx_stat.max_queue_depth)
+		tls->tx_stat.max_queue_depth = tls->tx_stat.queue_depth;
+
+	    pj_lock_release(tls->base.lock);
+	    return PJ_EPENDING;
+	}
+	tls->tx_busy = PJ_TRUE;
+	++tls->tx_stat.tx_msgs;
+	++tls->tx_stat.tx_writes;
+	pj_lock_release(tls->base.lock);
+
 	/*
 	 * Transport is ready to go. Send the packet to ioqueue to be
 	 * sent asynchronously.
 	 */
-	size = tdata->buf.cur - tdata->buf.start;
 	status = pj_ssl_sock_send(tls->ssock, 
-				    (pj_ioqueue_op_key_t*)&tdata->op_key,
-				    tdata->buf.start, &size, 0);
+				  (pj_ioqueue_op_key_t*)&tdata->op_key,
+				  tdata->buf.start, &size, 0);
 
 	if (status != PJ_EPENDING) {
 	    /* Not pending (could be immediate success or error) */
@@ -1319,14 +1613,19 @@ static pj_status_t tls_send_msg(pjsip_transport *transport,
 
 	    /* Shutdown transport on closure/errors */
 	    if (size <= 0) {
-
 		PJ_LOG(5,(tls->base.obj_name, "TLS send() error, sent=%d", 
 			  size));
 
 		if (status == PJ_SUCCESS) 
 		    status = PJ_RETURN_OS_ERROR(OSERR_ENOTCONN);
 
+		/* Fail messages which were queued behind this one */
+		tls_abort_tx_queue(tls, status);
+
 		tls_init_shutdown(tls, status);
+	    } else {
+		/* Write out what has been queued in the mean time */
+		tls_flush_tx_queue(tls);
 	    }
 	}
     }
@@ -1352,6 +1651,161 @@ static pj_status_t tls_shutdown(pjsip_transport *transport)
 }
 
 
+/* Discard the buffer used to assemble oversized message */
+static void tls_rx_big_reset(struct tls_transport *tls)
+{
+    if (tls->rx_big_pool) {
+	pj_pool_release(tls->rx_big_pool);
+	tls->rx_big_pool = NULL;
+    }
+    tls->rx_big = NULL;
+    tls->rx_big_len = tls->rx_big_size = 0;
+}
+
+
+/* Append data to the buffer used to assemble oversized message, growing
+ * the buffer as necessary. No more than max_len bytes will be kept.
+ */
+static pj_status_t tls_rx_big_append(struct tls_transport *tls,
+				     const char *data,
+				     pj_size_t len,
+				     pj_size_t max_len,
+				     pj_size_t *appended)
+{
+    if (len > max_len - tls->rx_big_len)
+	len = max_len - tls->rx_big_len;
+
+    if (tls->rx_big_len + len > tls->rx_big_size) {
+	pj_size_t size;
+	char *buf;
+
+	size = tls->rx_big_size ? tls->rx_big_size : PJSIP_TLS_RX_BUF_SIZE;
+	while (size < tls->rx_big_len + len)
+	    size <<= 1;
+	if (size > max_len)
+	    size = max_len;
+
+	if (tls->rx_big_pool == NULL) {
+	    tls->rx_big_pool = pjsip_endpt_create_pool(tls->base.endpt,
+						       "rxb%p", 256,
+						       PJSIP_TLS_RX_BUF_SIZE);
+	    if (!tls->rx_big_pool)
+		return PJ_ENOMEM;
+	}
+
+	/* Old buffer is reclaimed when the pool is released */
+	buf = (char*) pj_pool_alloc(tls->rx_big_pool, size + 1);
+	if (tls->rx_big_len)
+	    pj_memcpy(buf, tls->rx_big, tls->rx_big_len);
+	tls->rx_big = buf;
+	tls->rx_big_size = size;
+    }
+
+    pj_memcpy(tls->rx_big + tls->rx_big_len, data, len);
+    tls->rx_big_len += len;
+    *appended = len;
+
+    return PJ_SUCCESS;
+}
+
+
+/* Process size bytes of data in the receive buffer, and tell activesock
+ * how many bytes it must keep in the buffer.
+ */
+static pj_status_t tls_process_rx(struct tls_transport *tls,
+				  pj_size_t size,
+				  pj_size_t *remainder)
+{
+    pjsip_rx_data *rdata = &tls->rdata;
+    pjsip_tpmgr *mgr = tls->base.tpmgr;
+    char *buf = tls->rx_buf;
+    pj_size_t max_len, start, left, appended;
+    pj_status_t status;
+
+    max_len = pjsip_cfg()->endpt.max_stream_msg_len;
+    if (max_len < PJSIP_MAX_PKT_LEN)
+	max_len = PJSIP_MAX_PKT_LEN;
+
+    start = tls->rx_start;
+
+    if (tls->rx_big_len) {
+	pj_size_t eaten;
+
+	/* An oversized message is being assembled, in which case the
+	 * receive buffer only contains new data for it.
+	 */
+	status = tls_rx_big_append(tls, buf, size, max_len, &appended);
+	if (status != PJ_SUCCESS)
+	    return status;
+
+	eaten = pjsip_tpmgr_receive_stream(mgr, rdata, tls->rx_big,
+					   tls->rx_big_len, max_len);
+	if (eaten == 0) {
+	    *remainder = 0;
+	    return PJ_SUCCESS;
+	}
+
+	/* Done with the oversized message. Whatever follows it is the
+	 * beginning of the next message(s).
+	 */
+	left = tls->rx_big_len - eaten;
+	if (left + (size - appended) >= PJSIP_TLS_RX_BUF_SIZE) {
+	    pj_memmove(tls->rx_big, tls->rx_big + eaten, left);
+	    tls->rx_big_len = left;
+	    *remainder = 0;
+	    return PJ_SUCCESS;
+	}
+
+	pj_memmove(buf + left, buf + appended, size - appended);
+	pj_memcpy(buf, tls->rx_big + eaten, left);
+	size = left + (size - appended);
+	start = 0;
+	tls_rx_big_reset(tls);
+    }
+
+    /* Report to transport manager.
+     * The transport manager will tell us how many bytes of the packet
+     * have been processed (as valid SIP message).
+     */
+    if (size > start) {
+	start += pjsip_tpmgr_receive_stream(mgr, rdata, buf + start,
+					    size - start, max_len);
+	pj_assert(start <= size);
+    }
+
+    left = size - start;
+    if (left == 0) {
+	/* Everything has been processed */
+	tls->rx_start = 0;
+	*remainder = 0;
+
+    } else if (left == PJSIP_TLS_RX_BUF_SIZE) {
+	/* The buffer is full with an incomplete message */
+	status = tls_rx_big_append(tls, buf, left, max_len, &appended);
+	if (status != PJ_SUCCESS)
+	    return status;
+
+	tls->rx_start = 0;
+	*remainder = 0;
+
+    } else if (PJSIP_TLS_RX_BUF_SIZE - size < PJSIP_TLS_RX_BUF_SIZE / 4) {
+	/* Running out of space, move unprocessed data to the front of
+	 * the buffer.
+	 */
+	pj_memmove(buf, buf + start, left);
+	tls->rx_start = 0;
+	*remainder = left;
+
+    } else {
+	/* Keep the data in place, new data will be appended after it */
+	tls->rx_start = start;
+	*remainder = size;
+    }
+
+    return PJ_SUCCESS;
+}
+
+
 /* 
  * Callback from ioqueue that an incoming data is received from the socket.
  */
@@ -1380,34 +1834,22 @@ static pj_bool_t on_data_read(pj_ssl_sock_t *ssock,
      * to be parsed.
      */
     if (status == PJ_SUCCESS) {
-	pj_size_t size_eaten;
 
 	/* Mark this as an activity */
 	pj_gettimeofday(&tls->last_activity);
 
-	pj_assert((void*)rdata->pkt_info.packet == data);
+	pj_assert((void*)tls->rx_buf == data);
 
 	/* Init pkt_info part. */
-	rdata->pkt_info.len = size;
 	rdata->pkt_info.zero = 0;
 	pj_gettimeofday(&rdata->pkt_info.timestamp);
 
-	/* Report to transport manager.
-	 * The transport manager will tell us how many bytes of the packet
-	 * have been processed (as valid SIP message).
-	 */
-	size_eaten = 
-	    pjsip_tpmgr_receive_packet(rdata->tp_info.transport->tpmgr, 
-				       rdata);
-
-	pj_assert(size_eaten <= (pj_size_t)rdata->pkt_info.len);
-
-	/* Move unprocessed data to the front of the buffer */
-	*remainder = size - size_eaten;
-	if (*remainder > 0 && *remainder != size) {
-	    pj_memmove(rdata->pkt_info.packet,
-		       rdata->pkt_info.packet + size_eaten,
-		       *remainder);
+	status = tls_process_rx(tls, size, remainder);
+	if (status != PJ_SUCCESS) {
+	    tls_perror(tls->base.obj_name, "Error processing received data",
+		       status);
+	    tls_init_shutdown(tls, status);
+	    return PJ_FALSE;
 	}
 
     } else {
@@ -1656,6 +2098,17 @@ static void tls_keep_alive_timer(pj_timer_heap_t *th, pj_timer_entry *e)
     pj_gettimeofday(&now);
     PJ_TIME_VAL_SUB(now, tls->last_activity);
 
+    if (tls->tx_busy) {
+	/* A write is in progress, so there is no need for keep-alive */
+	delay.sec = PJSIP_TLS_KEEP_ALIVE_INTERVAL;
+	delay.msec = 0;
+
+	pjsip_endpt_schedule_timer(tls->base.endpt, &tls->ka_timer, 
+				   &delay);
+	tls->ka_timer.id = PJ_TRUE;
+	return;
+    }
+
     if (now.sec > 0 && now.sec < PJSIP_TLS_KEEP_ALIVE_INTERVAL) {
 	/* There has been activity, so don't send keep-alive */
 	delay.sec = PJSIP_TLS_KEEP_ALIVE_INTERVAL - now.sec;
@@ -496,6 +496,99 @@ pj_status_t pjsua_aud_subsys_destroy()
     return PJ_SUCCESS;
 }
 
+/* Dump media clock statistics and frame processing time of the media
+ * ports in the audio flow.
+ */
+void pjsua_aud_dump(void)
+{
+#if defined(PJMEDIA_PORT_HAS_PROFILING) && PJMEDIA_PORT_HAS_PROFILING != 0
+    unsigned i, j;
+#endif
+
+    PJSUA_LOCK();
+
+    if (pjsua_var.null_snd) {
+	pjmedia_clock_stat stat;
+	char hist[PJMEDIA_CLOCK_LATE_HIST_CNT * 11];
+	int len = 0;
+	unsigned n;
+
+	pjmedia_clock_get_stat(
+	    pjmedia_master_port_get_clock(pjsua_var.null_snd), &stat);
+
+	for (n = 0; n < PJMEDIA_CLOCK_LATE_HIST_CNT; ++n) {
+	    len += pj_ansi_snprintf(hist+len, sizeof(hist)-len, " %u",
+				    stat.late_hist[n]);
+	}
+
+	PJ_LOG(3,(THIS_FILE, "Null sound device clock: %u ticks, %u missed, "
+			     "%u resync, max burst %u, lateness avg %u usec, "
+			     "max %u usec, hist(100us,x2):%s",
+		  stat.tick_cnt, stat.missed_cnt, stat.resync_cnt,
+		  stat.max_burst,
+		  (unsigned)(stat.tick_cnt ?
+			     stat.total_late_usec / stat.tick_cnt : 0),
+		  stat.max_late_usec, hist));
+    }
+
+    if (pjsua_var.snd_port) {
+	pjmedia_echo_stat stat;
+
+	if (pjmedia_snd_port_get_ec_stat(pjsua_var.snd_port,
+					 &stat) == PJ_SUCCESS)
+	{
+	    PJ_LOG(3,(THIS_FILE, "Echo canceller: %u frames, %u processed, "
+				 "%u missed, batch %u, delay %u, "
+				 "processing avg %u usec, max %u usec "
+				 "per frame",
+		      stat.frame_cnt, stat.proc_cnt, stat.miss_cnt,
+		      stat.batch, stat.delay, stat.avg_proc_usec,
+		      stat.max_proc_usec));
+	}
+    }
+
+#if defined(PJMEDIA_PORT_HAS_PROFILING) && PJMEDIA_PORT_HAS_PROFILING != 0
+    PJ_LOG(3,(THIS_FILE, "Dumping media port frame processing time:"));
+
+    if (pjsua_var.mconf)
+	pjmedia_port_dump_prof(pjmedia_conf_get_master_port(pjsua_var.mconf),
+			       " ");
+
+    for (i=0; i<pjsua_var.ua_cfg.max_calls; ++i) {
+	pjsua_call *call = &pjsua_var.calls[i];
+
+	for (j = 0; j < call->med_cnt; ++j) {
+	    pjsua_call_media *call_med = &call->media[j];
+	    pjmedia_port *port;
+
+	    if (call_med->type != PJMEDIA_TYPE_AUDIO ||
+		call_med->strm.a.stream == NULL)
+	    {
+		continue;
+	    }
+
+	    if (pjmedia_stream_get_port(call_med->strm.a.stream,
+					&port) == PJ_SUCCESS)
+	    {
+		pjmedia_port_dump_prof(port, " ");
+	    }
+	}
+    }
+
+    for (i=0; i<PJ_ARRAY_SIZE(pjsua_var.player); ++i) {
+	if (pjsua_var.player[i].port)
+	    pjmedia_port_dump_prof(pjsua_var.player[i].port, " ");
+    }
+
+    for (i=0; i<PJ_ARRAY_SIZE(pjsua_var.recorder); ++i) {
+	if (pjsua_var.recorder[i].port)
+	    pjmedia_port_dump_prof(pjsua_var.recorder[i].port, " ");
+    }
+#endif
+
+    PJSUA_UNLOCK();
+}
+
 void pjsua_aud_stop_stream(pjsua_call_media *call_med)
 {
     pjmedia_stream *strm = call_med->strm.a.stream;
@@ -1989,8 +2082,9 @@ PJ_DEF(pj_status_t) pjsua_set_null_snd_dev(void)
     /* Create master port, connecting port0 of the conference bridge to
      * a null port.
      */
-    status = pjmedia_master_port_create(pjsua_var.snd_pool, pjsua_var.null_port,
-					conf_port, 0, &pjsua_var.null_snd);
+    status = pjmedia_master_port_create(
+		pjsua_var.snd_pool, pjsua_var.null_port, conf_port,
+		pjsua_var.media_cfg.null_snd_clock_options, &pjsua_var.null_snd);
     if (status != PJ_SUCCESS) {
 	pjsua_perror(THIS_FILE, "Unable to create null sound device",
 		     status);
@@ -1999,6 +2093,16 @@ PJ_DEF(pj_status_t) pjsua_set_null_snd_dev(void)
 	return status;
     }
 
+    if (pjsua_var.media_cfg.null_snd_clock_cpu >= 0) {
+	status = pjmedia_clock_set_cpu(
+		    pjmedia_master_port_get_clock(pjsua_var.null_snd),
+		    pjsua_var.media_cfg.null_snd_clock_cpu);
+	if (status != PJ_SUCCESS) {
+	    pjsua_perror(THIS_FILE, "Unable to pin null sound device clock",
+			 status);
+	}
+    }
+
     /* Start the master port */
     status = pjmedia_master_port_start(pjsua_var.null_snd);
     PJ_ASSERT_RETURN(status == PJ_SUCCESS, status);
@@ -345,6 +345,7 @@ PJ_DEF(void) pjsua_media_config_default(pjsua_media_config *cfg)
 
     cfg->turn_conn_type = PJ_TURN_TP_UDP;
     cfg->vid_preview_enable_native = PJ_TRUE;
+    cfg->null_snd_clock_cpu = -1;
 }
 
 /*****************************************************************************
@@ -2964,6 +2965,10 @@ PJ_DEF(void) pjsua_dump(pj_bool_t detail)
 	}
     }
 
+#if defined(PJSUA_MEDIA_HAS_PJMEDIA) && PJSUA_MEDIA_HAS_PJMEDIA != 0
+    pjsua_aud_dump();
+#endif
+
     pjsip_tsx_layer_dump(detail);
     pjsip_ua_dump(detail);
 
@@ -29,6 +29,368 @@
  * TCP transport test.
  */
 #if PJ_HAS_TCP
+
+/*
+ * Oversized message test: send messages larger than the TCP receive
+ * buffer, pipelined with small messages, from a raw TCP socket.
+ */
+#define BIG_BODY_LEN	20000
+
+static pj_bool_t big_on_rx_request(pjsip_rx_data *rdata);
+
+static struct mod_big_test
+{
+    pjsip_module    mod;
+    int		    next_seq;
+    pj_bool_t	    err;
+} mod_big = 
+{
+    {
+    NULL, NULL,				/* prev and next	*/
+    { "mod-big-test", 12},		/* Name.		*/
+    -1,					/* Id			*/
+    PJSIP_MOD_PRIORITY_TSX_LAYER-1,	/* Priority		*/
+    NULL,				/* load()		*/
+    NULL,				/* start()		*/
+    NULL,				/* stop()		*/
+    NULL,				/* unload()		*/
+    &big_on_rx_request,			/* on_rx_request()	*/
+    NULL,				/* on_rx_response()	*/
+    NULL,				/* tsx_handler()	*/
+    }
+};
+
+static pj_bool_t big_on_rx_request(pjsip_rx_data *rdata)
+{
+    pjsip_msg_body *body = rdata->msg_info.msg->body;
+    int seq = rdata->msg_info.cseq->cseq;
+    unsigned body_len = (seq % 4 == 3) ? BIG_BODY_LEN : 0;
+
+    if (seq != mod_big.next_seq || 
+	(body_len && (!body || body->len != body_len)))
+    {
+	PJ_LOG(1,(THIS_FILE, "    err: unexpected message cseq %d", seq));
+	mod_big.err = PJ_TRUE;
+    }
+    mod_big.next_seq = seq + 1;
+    return PJ_TRUE;
+}
+
+static int big_msg_test(const pj_sockaddr_in *addr)
+{
+    enum { COUNT = 16 };
+    char *buf, *body;
+    pj_pool_t *pool;
+    pj_sock_t sock = PJ_INVALID_SOCKET;
+    pj_ssize_t len, sent;
+    pj_time_val timeout;
+    int i, rc = 0;
+    pj_status_t status;
+
+    PJ_LOG(3,(THIS_FILE, "  oversized message test..."));
+
+    pool = pjsip_endpt_create_pool(endpt, "bigmsg", 4000, 4000);
+    buf = (char*) pj_pool_alloc(pool, COUNT * 512 + 
+				      (COUNT/4) * BIG_BODY_LEN);
+    body = (char*) pj_pool_alloc(pool, BIG_BODY_LEN);
+    pj_memset(body, 'x', BIG_BODY_LEN);
+
+    /* Every fourth message is larger than the receive buffer */
+    for (i=0, len=0; i<COUNT; ++i) {
+	int body_len = (i % 4 == 3) ? BIG_BODY_LEN : 0;
+
+	len += pj_ansi_sprintf(buf+len,
+			       "OPTIONS sip:bob@127.0.0.1 SIP/2.0\r\n"
+			       "Via: SIP/2.0/TCP 127.0.0.1:5060"
+			       ";branch=z9hG4bKbig%d\r\n"
+			       "From: <sip:alice@127.0.0.1>;tag=1234\r\n"
+			       "To: <sip:bob@127.0.0.1>\r\n"
+			       "Call-ID: big-msg-test\r\n"
+			       "CSeq: %d OPTIONS\r\n"
+			       "Max-Forwards: 70\r\n"
+			       "Content-Type: text/plain\r\n"
+			       "Content-Length: %d\r\n"
+			       "\r\n",
+			       i, i, body_len);
+	pj_memcpy(buf+len, body, body_len);
+	len += body_len;
+    }
+
+    if (mod_big.mod.id == -1) {
+	status = pjsip_endpt_register_module(endpt, &mod_big.mod);
+	if (status != PJ_SUCCESS) {
+	    app_perror("   error registering module", status);
+	    rc = -200;
+	    goto on_return;
+	}
+    }
+    mod_big.next_seq = 0;
+    mod_big.err = PJ_FALSE;
+
+    status = pj_sock_socket(pj_AF_INET(), pj_SOCK_STREAM(), 0, &sock);
+    if (status == PJ_SUCCESS)
+	status = pj_sock_connect(sock, addr, sizeof(*addr));
+    if (status != PJ_SUCCESS) {
+	app_perror("   error connecting", status);
+	rc = -210;
+	goto on_return;
+    }
+
+    /* Send in small chunks so that messages span several reads */
+    for (sent=0; sent<len; ) {
+	pj_ssize_t chunk = (len-sent > 1400) ? 1400 : len-sent;
+
+	status = pj_sock_send(sock, buf+sent, &chunk, 0);
+	if (status != PJ_SUCCESS) {
+	    app_perror("   error sending", status);
+	    rc = -220;
+	    goto on_return;
+	}
+	sent += chunk;
+	flush_events(1);
+    }
+
+    pj_gettimeofday(&timeout);
+    timeout.sec += 2;
+
+    while (mod_big.next_seq < COUNT && !mod_big.err) {
+	pj_time_val now, poll_interval = { 0, 10 };
+
+	pj_gettimeofday(&now);
+	if (PJ_TIME_VAL_GTE(now, timeout))
+	    break;
+	pjsip_endpt_handle_events(endpt, &poll_interval);
+    }
+
+    if (mod_big.err || mod_big.next_seq != COUNT) {
+	PJ_LOG(3,(THIS_FILE, "   error: received %d of %d messages", 
+		  mod_big.next_seq, COUNT));
+	rc = -230;
+    }
+
+on_return:
+    if (sock != PJ_INVALID_SOCKET)
+	pj_sock_close(sock);
+    if (mod_big.mod.id != -1) {
+	pjsip_endpt_unregister_module(endpt, &mod_big.mod);
+	mod_big.mod.id = -1;
+    }
+    pj_pool_release(pool);
+    flush_events(500);
+    return rc;
+}
+
+
+/*
+ * Write coalescing test: block the socket by filling the kernel buffers,
+ * then queue a burst of small messages. The burst must be written out
+ * with fewer writes than messages.
+ */
+#define BURST_CALL_ID	"burst-test"
+
+static pj_bool_t burst_on_rx_request(pjsip_rx_data *rdata);
+
+static struct mod_burst_test
+{
+    pjsip_module    mod;
+    int		    rx_cnt;
+    int		    tx_cnt;
+    int		    tx_err;
+} mod_burst = 
+{
+    {
+    NULL, NULL,				/* prev and next	*/
+    { "mod-burst-test", 14},		/* Name.		*/
+    -1,					/* Id			*/
+    PJSIP_MOD_PRIORITY_TSX_LAYER-1,	/* Priority		*/
+    NULL,				/* load()		*/
+    NULL,				/* start()		*/
+    NULL,				/* stop()		*/
+    NULL,				/* unload()		*/
+    &burst_on_rx_request,		/* on_rx_request()	*/
+    NULL,				/* on_rx_response()	*/
+    NULL,				/* tsx_handler()	*/
+    }
+};
+
+static pj_bool_t burst_on_rx_request(pjsip_rx_data *rdata)
+{
+    const pj_str_t call_id = { BURST_CALL_ID, sizeof(BURST_CALL_ID)-1 };
+
+    if (pj_strcmp(&rdata->msg_info.cid->id, &call_id) != 0)
+	return PJ_FALSE;
+
+    ++mod_burst.rx_cnt;
+    return PJ_TRUE;
+}
+
+static void burst_on_sent(void *token, pjsip_tx_data *tdata,
+			  pj_ssize_t bytes_sent)
+{
+    PJ_UNUSED_ARG(token);
+    PJ_UNUSED_ARG(tdata);
+
+    ++mod_burst.tx_cnt;
+    if (bytes_sent <= 0)
+	++mod_burst.tx_err;
+}
+
+static int coalesce_test(pjsip_transport *tcp, const pj_sockaddr_in *addr)
+{
+    enum { BURST = 32, FILL_MAX = 2000 };
+    pjsip_tpmgr *tpmgr = pjsip_endpt_get_tpmgr(endpt);
+    pjsip_tpselector sel;
+    pjsip_transport_tx_stat stat0, stat1;
+    pj_pool_t *pool;
+    char *msg;
+    pj_size_t big_len, small_len;
+    pj_time_val timeout;
+    unsigned msgs, writes;
+    int i, pending = 0, sent = 0, rc = 0;
+    pj_status_t status;
+
+    PJ_LOG(3,(THIS_FILE, "  write coalescing test..."));
+
+    pool = pjsip_endpt_create_pool(endpt, "burst", 4000, 4000);
+    msg = (char*) pj_pool_alloc(pool, 512 + BIG_BODY_LEN);
+
+    if (mod_burst.mod.id == -1) {
+	status = pjsip_endpt_register_module(endpt, &mod_burst.mod);
+	if (status != PJ_SUCCESS) {
+	    app_perror("   error registering module", status);
+	    rc = -300;
+	    goto on_return;
+	}
+    }
+    mod_burst.rx_cnt = mod_burst.tx_cnt = mod_burst.tx_err = 0;
+
+    pj_bzero(&sel, sizeof(sel));
+    sel.type = PJSIP_TPSELECTOR_TRANSPORT;
+    sel.u.transport = tcp;
+
+    status = pjsip_transport_get_tx_stat(tcp, &stat0);
+    if (status != PJ_SUCCESS) {
+	rc = -310;
+	goto on_return;
+    }
+
+    /* Fill the socket with large messages, without polling so that
+     * nothing is read on the other side, until a write is pending.
+     */
+    big_len = pj_ansi_sprintf(msg,
+			      "OPTIONS sip:bob@127.0.0.1 SIP/2.0\r\n"
+			      "Via: SIP/2.0/TCP 127.0.0.1:5060"
+			      ";branch=z9hG4bKburstbig\r\n"
+			      "From: <sip:alice@127.0.0.1>;tag=1234\r\n"
+			      "To: <sip:bob@127.0.0.1>\r\n"
+			      "Call-ID: " BURST_CALL_ID "\r\n"
+			      "CSeq: 1 OPTIONS\r\n"
+			      "Max-Forwards: 70\r\n"
+			      "Content-Type: text/plain\r\n"
+			      "Content-Length: %d\r\n"
+			      "\r\n",
+			      BIG_BODY_LEN);
+    pj_memset(msg + big_len, 'x', BIG_BODY_LEN);
+    big_len += BIG_BODY_LEN;
+
+    for (i=0; i<FILL_MAX && !pending; ++i) {
+	status = pjsip_tpmgr_send_raw(tpmgr, PJSIP_TRANSPORT_TCP, &sel, NULL,
+				      msg, big_len, addr, sizeof(*addr),
+				      NULL, &burst_on_sent);
+	if (status == PJ_EPENDING) {
+	    pending = 1;
+	} else if (status != PJ_SUCCESS) {
+	    app_perror("   error sending", status);
+	    rc = -320;
+	    goto on_return;
+	}
+	++sent;
+    }
+
+    if (!pending) {
+	PJ_LOG(3,(THIS_FILE, "   error: socket not blocked after %d writes",
+		  sent));
+	rc = -330;
+	goto on_return;
+    }
+
+    /* Queue the burst behind the pending write */
+    small_len = pj_ansi_sprintf(msg,
+				"OPTIONS sip:bob@127.0.0.1 SIP/2.0\r\n"
+				"Via: SIP/2.0/TCP 127.0.0.1:5060"
+				";branch=z9hG4bKburst\r\n"
+				"From: <sip:alice@127.0.0.1>;tag=1234\r\n"
+				"To: <sip:bob@127.0.0.1>\r\n"
+				"Call-ID: " BURST_CALL_ID "\r\n"
+				"CSeq: 2 OPTIONS\r\n"
+				"Max-Forwards: 70\r\n"
+				"Content-Length: 0\r\n"
+				"\r\n");
+    for (i=0; i<BURST; ++i) {
+	status = pjsip_tpmgr_send_raw(tpmgr, PJSIP_TRANSPORT_TCP, &sel, NULL,
+				      msg, small_len, addr, sizeof(*addr),
+				      NULL, &burst_on_sent);
+	if (status != PJ_EPENDING) {
+	    app_perror("   error: burst message was not queued", status);
+	    rc = -340;
+	    goto on_return;
+	}
+	++sent;
+	++pending;
+    }
+
+    /* Let the other side read everything */
+    pj_gettimeofday(&timeout);
+    timeout.sec += 5;
+
+    while (mod_burst.tx_cnt < pending || mod_burst.rx_cnt < sent) {
+	pj_time_val now, poll_interval = { 0, 10 };
+
+	pj_gettimeofday(&now);
+	if (PJ_TIME_VAL_GTE(now, timeout))
+	    break;
+	pjsip_endpt_handle_events(endpt, &poll_interval);
+    }
+
+    if (mod_burst.tx_cnt != pending || mod_burst.tx_err ||
+	mod_burst.rx_cnt != sent)
+    {
+	PJ_LOG(3,(THIS_FILE, "   error: sent %d/%d (%d errors), "
+		  "received %d/%d", mod_burst.tx_cnt, pending,
+		  mod_burst.tx_err, mod_burst.rx_cnt, sent));
+	rc = -350;
+	goto on_return;
+    }
+
+    status = pjsip_transport_get_tx_stat(tcp, &stat1);
+    if (status != PJ_SUCCESS) {
+	rc = -360;
+	goto on_return;
+    }
+
+    msgs = stat1.tx_msgs - stat0.tx_msgs;
+    writes = stat1.tx_writes - stat0.tx_writes;
+    PJ_LOG(3,(THIS_FILE, "   %d messages (burst of %d) in %u writes, "
+	      "max queue=%u", sent, BURST, writes, stat1.max_queue_depth));
+
+    /* The burst must have been coalesced */
+    if (msgs != (unsigned)sent || writes >= msgs ||
+	stat1.max_queue_depth < BURST ||
+	stat1.queue_depth != 0 || stat1.queue_bytes != 0)
+    {
+	rc = -370;
+    }
+
+on_return:
+    if (mod_burst.mod.id != -1) {
+	pjsip_endpt_unregister_module(endpt, &mod_burst.mod);
+	mod_burst.mod.id = -1;
+    }
+    pj_pool_release(pool);
+    return rc;
+}
+
+
 int transport_tcp_test(void)
 {
     enum { SEND_RECV_LOOP = 8 };
@@ -90,6 +452,10 @@ int transport_tcp_test(void)
     if (transport_load_test(url) != 0)
 	return -60;
 
+    /* Messages larger than the receive buffer */
+    if (big_msg_test(&rem_addr) != 0)
+	return -65;
+
     /* Basic transport's send/receive loopback test. */
     for (i=0; i<SEND_RECV_LOOP; ++i) {
 	status = transport_send_recv_test(PJSIP_TRANSPORT_TCP, tcp, url, &rtt[i]);
@@ -122,6 +488,36 @@ int transport_tcp_test(void)
     if (pkt_lost != 0)
 	PJ_LOG(3,(THIS_FILE, "   note: %d packet(s) was lost", pkt_lost));
 
+    /* Queued messages must be coalesced */
+    if (coalesce_test(tcp, &rem_addr) != 0) {
+	pjsip_transport_dec_ref(tcp);
+	return -74;
+    }
+
+    /* Check transmit queue statistic. All messages must have been
+     * written by now, with no more writes than messages.
+     */
+    {
+	pjsip_transport_tx_stat tx_stat;
+
+	status = pjsip_transport_get_tx_stat(tcp, &tx_stat);
+	if (status != PJ_SUCCESS) {
+	    pjsip_transport_dec_ref(tcp);
+	    return -75;
+	}
+
+	PJ_LOG(3,(THIS_FILE, "   tx stat: msgs=%u, writes=%u, max queue=%u",
+		  tx_stat.tx_msgs, tx_stat.tx_writes,
+		  tx_stat.max_queue_depth));
+
+	if (tx_stat.tx_msgs == 0 || tx_stat.tx_writes > tx_stat.tx_msgs ||
+	    tx_stat.queue_depth != 0 || tx_stat.queue_bytes != 0)
+	{
+	    pjsip_transport_dec_ref(tcp);
+	    return -77;
+	}
+    }
+
     /* Check again that reference counter is still 1. */
     if (pj_atomic_get(tcp->ref_cnt) != 1)
 	return -80;
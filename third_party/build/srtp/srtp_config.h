@@ -177,6 +177,22 @@
 /* #undef HAVE_SYSLOG_H */
 
 
+/* Use the AES-NI instructions for the AES block cipher (used by AES-CM
+ * and the key derivation) when the CPU supports them. Support is detected
+ * at run-time, so the library still runs on CPUs without AES-NI.
+ * Only available for GCC-compatible compilers on x86 and x86-64.
+ */
+#ifndef SRTP_HAS_AES_NI
+#   if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+       (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) || \
+	defined(__clang__))
+#	define SRTP_HAS_AES_NI	1
+#   else
+#	define SRTP_HAS_AES_NI	0
+#   endif
+#endif
+
+
 /* Define this to use ISMAcryp code. */
 /* #undef GENERIC_AESICM */
 
@@ -1909,9 +1909,79 @@ aes_inv_final_round(v128_t *state, const v128_t *round_key) {
 #endif  /* CPU type */
 
 
+#if SRTP_HAS_AES_NI
+
+#include <cpuid.h>
+#include <wmmintrin.h>
+
+/*
+ * AES-NI state: -1 means not probed yet, 0 means the software tables
+ * are used, 1 means the AES-NI instructions are used
+ */
+static int aes_ni_state = -1;
+
+static int
+aes_ni_probe(void) {
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return 0;
+
+  /* CPUID.01H:ECX.AESNI[bit 25] and CPUID.01H:EDX.SSE2[bit 26] */
+  return (ecx & bit_AES) && (edx & bit_SSE2);
+}
+
+/*
+ * the expanded key produced by aes_expand_encryption_key() is the
+ * standard FIPS-197 schedule in octet order, which is exactly what
+ * AESENC/AESENCLAST expect
+ */
+__attribute__((target("aes,sse2")))
+static void
+aes_ni_encrypt(v128_t *plaintext, const aes_expanded_key_t exp_key) {
+  __m128i state;
+
+  state = _mm_loadu_si128((const __m128i *)plaintext);
+  state = _mm_xor_si128(state, _mm_loadu_si128((const __m128i *)&exp_key[0]));
+  state = _mm_aesenc_si128(state, _mm_loadu_si128((const __m128i *)&exp_key[1]));
+  state = _mm_aesenc_si128(state, _mm_loadu_si128((const __m128i *)&exp_key[2]));
+  state = _mm_aesenc_si128(state, _mm_loadu_si128((const __m128i *)&exp_key[3]));
+  state = _mm_aesenc_si128(state, _mm_loadu_si128((const __m128i *)&exp_key[4]));
+  state = _mm_aesenc_si128(state, _mm_loadu_si128((const __m128i *)&exp_key[5]));
+  state = _mm_aesenc_si128(state, _mm_loadu_si128((const __m128i *)&exp_key[6]));
+  state = _mm_aesenc_si128(state, _mm_loadu_si128((const __m128i *)&exp_key[7]));
+  state = _mm_aesenc_si128(state, _mm_loadu_si128((const __m128i *)&exp_key[8]));
+  state = _mm_aesenc_si128(state, _mm_loadu_si128((const __m128i *)&exp_key[9]));
+  state = _mm_aesenclast_si128(state,
+			       _mm_loadu_si128((const __m128i *)&exp_key[10]));
+  _mm_storeu_si128((__m128i *)plaintext, state);
+}
+
+#endif /* SRTP_HAS_AES_NI */
+
+int
+aes_use_hw_accel(int enable) {
+#if SRTP_HAS_AES_NI
+  aes_ni_state = enable ? aes_ni_probe() : 0;
+  return aes_ni_state;
+#else
+  (void)enable;
+  return 0;
+#endif
+}
+
 void
 aes_encrypt(v128_t *plaintext, const aes_expanded_key_t exp_key) {
 
+#if SRTP_HAS_AES_NI
+  if (aes_ni_state < 0)
+    aes_ni_state = aes_ni_probe();
+  if (aes_ni_state) {
+    aes_ni_encrypt(plaintext, exp_key);
+    return;
+  }
+#endif
+
   /* add in the subkey */
   v128_xor_eq(plaintext, exp_key + 0);
 
@@ -69,6 +69,17 @@ aes_encrypt(v128_t *plaintext, const aes_expanded_key_t exp_key);
 void
 aes_decrypt(v128_t *plaintext, const aes_expanded_key_t exp_key);
 
+/*
+ * aes_use_hw_accel(enable) selects whether aes_encrypt() may use the
+ * AES-NI instructions (when compiled with SRTP_HAS_AES_NI and supported
+ * by the CPU).  By default hardware acceleration is used whenever it is
+ * available.  Returns nonzero if hardware acceleration is in use after
+ * the call.
+ */
+
+int
+aes_use_hw_accel(int enable);
+
 #if 0
 /*
  * internal functions 